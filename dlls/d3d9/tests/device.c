@@ -15027,12 +15027,164 @@ static void test_window_position(void)
     IDirect3D9_Release(d3d);
 }
 
+static void shader_cache_draw(void)
+{
+    static const struct
+    {
+        struct vec3 position;
+        DWORD diffuse;
+    }
+    quad[] =
+    {
+        {{-1.0f, -1.0f, 0.0f}, 0xffff0000},
+        {{-1.0f,  1.0f, 0.0f}, 0xff00ff00},
+        {{ 1.0f, -1.0f, 0.0f}, 0xff0000ff},
+        {{ 1.0f,  1.0f, 0.0f}, 0xffffffff},
+    };
+    IDirect3DVertexShader9 *vs;
+    IDirect3DDevice9 *device;
+    IDirect3D9 *d3d;
+    ULONG refcount;
+    HWND window;
+    HRESULT hr;
+
+    window = create_window();
+    d3d = Direct3DCreate9(D3D_SDK_VERSION);
+    ok(!!d3d, "Failed to create a D3D object.\n");
+    if (!(device = create_device(d3d, window, NULL)))
+    {
+        IDirect3D9_Release(d3d);
+        DestroyWindow(window);
+        return;
+    }
+
+    hr = IDirect3DDevice9_SetRenderState(device, D3DRS_LIGHTING, FALSE);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZ | D3DFVF_DIFFUSE);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    hr = IDirect3DDevice9_BeginScene(device);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    hr = IDirect3DDevice9_DrawPrimitiveUP(device, D3DPT_TRIANGLESTRIP, 2, quad, sizeof(*quad));
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    if (SUCCEEDED(IDirect3DDevice9_CreateVertexShader(device, simple_vs, &vs)))
+    {
+        hr = IDirect3DDevice9_SetVertexShader(device, vs);
+        ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+        hr = IDirect3DDevice9_DrawPrimitiveUP(device, D3DPT_TRIANGLESTRIP, 2, quad, sizeof(*quad));
+        ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+        IDirect3DVertexShader9_Release(vs);
+    }
+    hr = IDirect3DDevice9_EndScene(device);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    hr = IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+
+    refcount = IDirect3DDevice9_Release(device);
+    ok(!refcount, "Device has %lu references left.\n", refcount);
+    IDirect3D9_Release(d3d);
+    DestroyWindow(window);
+}
+
+/* Each program stored in the shader cache is one the child had to compile. */
+static unsigned int shader_cache_count_entries(const char *dir, BOOL delete)
+{
+    char path[MAX_PATH];
+    WIN32_FIND_DATAA data;
+    unsigned int count = 0;
+    HANDLE find;
+
+    sprintf(path, "%s\\wined3d\\shader_cache\\*", dir);
+    if ((find = FindFirstFileA(path, &data)) == INVALID_HANDLE_VALUE)
+        return 0;
+    do
+    {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+        if (strcmp(data.cFileName, "last_trim"))
+            ++count;
+        if (delete)
+        {
+            sprintf(path, "%s\\wined3d\\shader_cache\\%s", dir, data.cFileName);
+            DeleteFileA(path);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+
+    return count;
+}
+
+static void run_shader_cache_child(const char *dir)
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = {0};
+    char cmdline[MAX_PATH];
+    char **argv;
+    BOOL ret;
+
+    winetest_get_mainargs(&argv);
+    sprintf(cmdline, "\"%s\" device shader_cache", argv[0]);
+    si.cb = sizeof(si);
+    ret = CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    ok(ret, "Failed to create process, error %lu.\n", GetLastError());
+    if (!ret)
+        return;
+    wait_child_process(pi.hProcess);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+}
+
+static void test_shader_cache(void)
+{
+    char dir[MAX_PATH], path[MAX_PATH], old_dir[MAX_PATH];
+    unsigned int first_count, second_count;
+    DWORD len;
+
+    if (strcmp(winetest_platform, "wine"))
+    {
+        skip("The shader cache is specific to Wine.\n");
+        return;
+    }
+
+    len = GetEnvironmentVariableA("LOCALAPPDATA", old_dir, ARRAY_SIZE(old_dir));
+    GetTempPathA(ARRAY_SIZE(path), path);
+    GetTempFileNameA(path, "d3d", 0, dir);
+    DeleteFileA(dir);
+    CreateDirectoryA(dir, NULL);
+    SetEnvironmentVariableA("LOCALAPPDATA", dir);
+
+    /* The first run populates the cache, the second one should not need to
+     * compile, and therefore store, anything. */
+    run_shader_cache_child(dir);
+    first_count = shader_cache_count_entries(dir, FALSE);
+    if (!first_count)
+    {
+        skip("The shader cache was not used.\n");
+    }
+    else
+    {
+        run_shader_cache_child(dir);
+        second_count = shader_cache_count_entries(dir, FALSE);
+        ok(second_count == first_count, "Got %u cache entries after the second run, expected %u.\n",
+                second_count, first_count);
+    }
+
+    SetEnvironmentVariableA("LOCALAPPDATA", len && len < ARRAY_SIZE(old_dir) ? old_dir : NULL);
+    shader_cache_count_entries(dir, TRUE);
+    sprintf(path, "%s\\wined3d\\shader_cache", dir);
+    RemoveDirectoryA(path);
+    sprintf(path, "%s\\wined3d", dir);
+    RemoveDirectoryA(path);
+    RemoveDirectoryA(dir);
+}
+
 START_TEST(device)
 {
     HMODULE d3d9_handle = GetModuleHandleA("d3d9.dll");
     WNDCLASSA wc = {0};
     IDirect3D9 *d3d9;
     DEVMODEW current_mode;
+    char **argv;
+    int argc;
 
     memset(&current_mode, 0, sizeof(current_mode));
     current_mode.dmSize = sizeof(current_mode);
@@ -15057,6 +15209,14 @@ START_TEST(device)
     wc.lpszClassName = "d3d9_test_wc";
     RegisterClassA(&wc);
 
+    argc = winetest_get_mainargs(&argv);
+    if (argc >= 3 && !strcmp(argv[2], "shader_cache"))
+    {
+        shader_cache_draw();
+        UnregisterClassA("d3d9_test_wc", GetModuleHandleA(NULL));
+        return;
+    }
+
     Direct3DShaderValidatorCreate9 = (void *)GetProcAddress(d3d9_handle, "Direct3DShaderValidatorCreate9");
 
     test_get_set_vertex_declaration();
@@ -15163,6 +15323,7 @@ START_TEST(device)
     test_creation_parameters();
     test_cursor_clipping();
     test_window_position();
+    test_shader_cache();
 
     UnregisterClassA("d3d9_test_wc", GetModuleHandleA(NULL));
 }
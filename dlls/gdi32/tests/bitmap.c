@@ -3856,6 +3856,73 @@ static void test_GdiAlphaBlend(void)
     free(bmi);
 }
 
+static void test_GdiAlphaBlend_widths(void)
+{
+    /* opaque, transparent, intermediate alpha and non-premultiplied pixels */
+    static const DWORD src_pixels[9] = { 0xff102030, 0x00000000, 0x80402010, 0x40302010, 0x40a08070,
+                                         0xc0804020, 0x01010101, 0xfe7f3f1f, 0x20100804 };
+    static const struct
+    {
+        BLENDFUNCTION blend;
+        DWORD expect[9];
+    }
+    tests[] =
+    {
+        { { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA },
+          { 0xff102030, 0x80112233, 0xc0483129, 0xa03d3936, 0xa0ad9996,
+            0xe084482d, 0x80122334, 0xff7f3f1f, 0x901f2631 } },
+        { { AC_SRC_OVER, 0, 128, AC_SRC_ALPHA },
+          { 0xc0102131, 0x80112233, 0xa02d292e, 0x90272e35, 0x905f5e65,
+            0xb04b3530, 0x80122334, 0xbf49312a, 0x88182432 } },
+        { { AC_SRC_OVER, 0, 128, 0 },
+          { 0xc0102131, 0x40081119, 0x80292121, 0x60212121, 0x60595152,
+            0xa0493129, 0x4009111a, 0xbf483129, 0x5010151b } },
+    };
+    BITMAPINFO bmi = {{ sizeof(bmi.bmiHeader), 10, -1, 1, 32, BI_RGB }};
+    HBITMAP bmp_dst, bmp_src;
+    DWORD *dst_bits, *src_bits, expect;
+    HDC hdc_dst, hdc_src;
+    int i, width, x;
+    BOOL ret;
+
+    if (!pGdiAlphaBlend)
+    {
+        win_skip("GdiAlphaBlend() is not implemented\n");
+        return;
+    }
+
+    hdc_dst = CreateCompatibleDC( 0 );
+    hdc_src = CreateCompatibleDC( 0 );
+    bmp_dst = CreateDIBSection( hdc_dst, &bmi, DIB_RGB_COLORS, (void **)&dst_bits, NULL, 0 );
+    bmp_src = CreateDIBSection( hdc_src, &bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    SelectObject( hdc_dst, bmp_dst );
+    SelectObject( hdc_src, bmp_src );
+    memcpy( src_bits, src_pixels, sizeof(src_pixels) );
+
+    /* widths that are not a multiple of the number of pixels blended at once */
+    for (i = 0; i < ARRAY_SIZE(tests); i++)
+    {
+        for (width = 1; width <= 9; width++)
+        {
+            for (x = 0; x < 10; x++) dst_bits[x] = 0x80112233;
+            ret = pGdiAlphaBlend( hdc_dst, 0, 0, width, 1, hdc_src, 0, 0, width, 1, tests[i].blend );
+            ok( ret, "%d/%d: GdiAlphaBlend failed err %lu\n", i, width, GetLastError() );
+            GdiFlush();
+            for (x = 0; x < 10; x++)
+            {
+                expect = x < width ? tests[i].expect[x] : 0x80112233;
+                ok( dst_bits[x] == expect, "%d/%d: got %08lx at %d, expected %08lx\n",
+                    i, width, dst_bits[x], x, expect );
+            }
+        }
+    }
+
+    DeleteDC( hdc_dst );
+    DeleteDC( hdc_src );
+    DeleteObject( bmp_dst );
+    DeleteObject( bmp_src );
+}
+
 static void test_GdiGradientFill(void)
 {
     HDC hdc;
@@ -6011,6 +6078,7 @@ START_TEST(bitmap)
     test_StretchBlt();
     test_StretchDIBits();
     test_GdiAlphaBlend();
+    test_GdiAlphaBlend_widths();
     test_GdiGradientFill();
     test_32bit_ddb();
     test_bitmapinfoheadersize();
@@ -3529,11 +3529,76 @@ static void test_simple_graphics(void)
     DeleteDC(mem_dc);
 }
 
+static void draw_large_blits( HDC hdc, HDC src_dc, int width, int height, int step )
+{
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 0x80, AC_SRC_ALPHA };
+    HBRUSH brush, old_brush;
+    int y;
+
+    brush = CreateSolidBrush( RGB(0x12, 0x34, 0x56) );
+    old_brush = SelectObject( hdc, brush );
+    for (y = 0; y < height; y += step)
+        PatBlt( hdc, 0, y, width, min( step, height - y ), PATINVERT );
+    for (y = 0; y < height; y += step)
+        GdiAlphaBlend( hdc, 0, y, width, min( step, height - y ), src_dc, 0, y, width, min( step, height - y ), blend );
+    SelectObject( hdc, old_brush );
+    DeleteObject( brush );
+}
+
+/* large operations may be split in bands internally, the result must be
+ * the same as when doing them in strips of a few rows */
+static void test_large_blits(void)
+{
+    static const int width = 1024, height = 768;
+    HBITMAP dib, src_dib, old_bm, old_src_bm;
+    DWORD *bits, *ref_bits, *src_bits;
+    HDC hdc, src_dc;
+    BITMAPINFO bmi;
+    int i;
+
+    memset( &bmi, 0, sizeof(bmi) );
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    hdc = CreateCompatibleDC( NULL );
+    src_dc = CreateCompatibleDC( NULL );
+    src_dib = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    ok( !!src_dib, "CreateDIBSection failed\n" );
+    for (i = 0; i < width * height; i++) src_bits[i] = (i * 0x01010101 + (i / width) * 0x3917) | ((i % 251) << 24);
+    old_src_bm = SelectObject( src_dc, src_dib );
+
+    ref_bits = malloc( width * height * sizeof(*ref_bits) );
+    dib = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&bits, NULL, 0 );
+    ok( !!dib, "CreateDIBSection failed\n" );
+    old_bm = SelectObject( hdc, dib );
+
+    for (i = 0; i < width * height; i++) bits[i] = i * 0x10203;
+    draw_large_blits( hdc, src_dc, width, height, 16 );
+    memcpy( ref_bits, bits, width * height * sizeof(*bits) );
+
+    for (i = 0; i < width * height; i++) bits[i] = i * 0x10203;
+    draw_large_blits( hdc, src_dc, width, height, height );
+    ok( !memcmp( bits, ref_bits, width * height * sizeof(*bits) ), "bits differ\n" );
+
+    SelectObject( hdc, old_bm );
+    DeleteObject( dib );
+    SelectObject( src_dc, old_src_bm );
+    DeleteObject( src_dib );
+    DeleteDC( src_dc );
+    DeleteDC( hdc );
+    free( ref_bits );
+}
+
 START_TEST(dib)
 {
     CryptAcquireContextW(&crypt_prov, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
 
     test_simple_graphics();
+    test_large_blits();
 
     CryptReleaseContext(crypt_prov, 0);
 }
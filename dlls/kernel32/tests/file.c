@@ -5738,6 +5738,91 @@ static void test_overlapped_read(void)
     ok(ret, "Unexpected error %lu.\n", GetLastError());
 }
 
+/* overlapped I/O on regular files may complete asynchronously, and may or may not be canceled */
+static void test_overlapped_cancel(void)
+{
+    static const DWORD size = 0x10000;
+    char temp_path[MAX_PATH], file_name[MAX_PATH];
+    OVERLAPPED ov[16];
+    DWORD count, err;
+    unsigned int i, j;
+    BYTE *buffers;
+    HANDLE hfile;
+    BOOL ret;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    GetTempFileNameA(temp_path, "ovl", 0, file_name);
+    hfile = CreateFileA(file_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_FLAG_OVERLAPPED | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ok(hfile != INVALID_HANDLE_VALUE, "CreateFile failed, error %lu\n", GetLastError());
+    buffers = malloc(ARRAY_SIZE(ov) * size);
+
+    for (i = 0; i < ARRAY_SIZE(ov); i++)
+    {
+        memset(buffers + i * size, i + 1, size);
+        memset(&ov[i], 0, sizeof(ov[i]));
+        ov[i].Offset = i * size;
+        ov[i].hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        ret = WriteFile(hfile, buffers + i * size, size, NULL, &ov[i]);
+        ok(ret || GetLastError() == ERROR_IO_PENDING, "%u: WriteFile failed, error %lu\n", i, GetLastError());
+    }
+    for (i = 0; i < ARRAY_SIZE(ov); i++)
+    {
+        ret = GetOverlappedResult(hfile, &ov[i], &count, TRUE);
+        ok(ret, "%u: GetOverlappedResult failed, error %lu\n", i, GetLastError());
+        ok(count == size, "%u: got size %lu\n", i, count);
+    }
+
+    /* cancel all the reads of the thread */
+    memset(buffers, 0, ARRAY_SIZE(ov) * size);
+    for (i = 0; i < ARRAY_SIZE(ov); i++)
+    {
+        ResetEvent(ov[i].hEvent);
+        ret = ReadFile(hfile, buffers + i * size, size, NULL, &ov[i]);
+        ok(ret || GetLastError() == ERROR_IO_PENDING, "%u: ReadFile failed, error %lu\n", i, GetLastError());
+    }
+    CancelIo(hfile);
+    for (i = 0; i < ARRAY_SIZE(ov); i++)
+    {
+        ret = GetOverlappedResult(hfile, &ov[i], &count, TRUE);
+        err = GetLastError();
+        ok(ret || err == ERROR_OPERATION_ABORTED, "%u: GetOverlappedResult failed, error %lu\n", i, err);
+        if (!ret) continue;
+        ok(count == size, "%u: got size %lu\n", i, count);
+        for (j = 0; j < size; j++) if (buffers[i * size + j] != i + 1) break;
+        ok(j == size, "%u: got %#x at %#x\n", i, buffers[i * size + j], j);
+    }
+
+    /* cancel a single read, the other ones are not affected */
+    for (i = 0; i < ARRAY_SIZE(ov); i++)
+    {
+        ResetEvent(ov[i].hEvent);
+        ret = ReadFile(hfile, buffers + i * size, size, NULL, &ov[i]);
+        ok(ret || GetLastError() == ERROR_IO_PENDING, "%u: ReadFile failed, error %lu\n", i, GetLastError());
+    }
+    ret = CancelIoEx(hfile, &ov[ARRAY_SIZE(ov) - 1]);
+    ok(ret || GetLastError() == ERROR_NOT_FOUND, "CancelIoEx failed, error %lu\n", GetLastError());
+    for (i = 0; i < ARRAY_SIZE(ov); i++)
+    {
+        ret = GetOverlappedResult(hfile, &ov[i], &count, TRUE);
+        err = GetLastError();
+        if (i == ARRAY_SIZE(ov) - 1)
+            ok(ret || err == ERROR_OPERATION_ABORTED, "%u: GetOverlappedResult failed, error %lu\n", i, err);
+        else
+            ok(ret, "%u: GetOverlappedResult failed, error %lu\n", i, err);
+        if (ret) ok(count == size, "%u: got size %lu\n", i, count);
+    }
+
+    /* nothing is left to cancel */
+    SetLastError(0xdeadbeef);
+    ret = CancelIoEx(hfile, &ov[0]);
+    ok(!ret && GetLastError() == ERROR_NOT_FOUND, "got ret %d, error %lu\n", ret, GetLastError());
+
+    for (i = 0; i < ARRAY_SIZE(ov); i++) CloseHandle(ov[i].hEvent);
+    free(buffers);
+    CloseHandle(hfile);
+}
+
 static void test_file_readonly_access(void)
 {
     static const DWORD default_sharing = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
@@ -6316,6 +6401,7 @@ START_TEST(file)
     test_GetFileAttributesExW();
     test_post_completion();
     test_overlapped_read();
+    test_overlapped_cancel();
     test_file_readonly_access();
     test_find_file_stream();
     test_SetFileTime();
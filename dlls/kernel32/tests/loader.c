@@ -2183,7 +2183,7 @@ static void test_import_resolution(void)
     static const UCHAR entry_point_code[] = { 0x00 };
 #endif
 
-    for (test = 0; test < 7; test++)
+    for (test = 0; test < 8; test++)
     {
 #define DATA_RVA(ptr) (page_size + ((char *)(ptr) - (char *)&data))
 #ifdef _WIN64
@@ -2202,7 +2202,7 @@ static void test_import_resolution(void)
         nt.OptionalHeader.SizeOfImage = 2 * page_size;
         nt.OptionalHeader.SizeOfHeaders = nt.OptionalHeader.FileAlignment;
         nt.OptionalHeader.DllCharacteristics = IMAGE_DLLCHARACTERISTICS_NX_COMPAT;
-        if (test < 6) nt.OptionalHeader.DllCharacteristics |= IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE;
+        if (test != 6) nt.OptionalHeader.DllCharacteristics |= IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE;
         nt.OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
         memset( nt.OptionalHeader.DataDirectory, 0, sizeof(nt.OptionalHeader.DataDirectory) );
         nt.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size = sizeof(data.descr);
@@ -2216,6 +2216,7 @@ static void test_import_resolution(void)
         data.descr[0].Name = DATA_RVA( data.module );
         strcpy( data.module, "kernel32.dll" );
         strcpy( data.function.name, "CreateEventA" );
+        if (test == 7) data.function.hint = 1;  /* hint for a different name */
         data.original_thunks[0].u1.AddressOfData = DATA_RVA( &data.function );
         data.thunks[0].u1.AddressOfData = 0xdeadbeef;
         nb_rel = 0;
@@ -2279,6 +2280,7 @@ static void test_import_resolution(void)
         switch (test)
         {
         case 0:  /* normal load */
+        case 7:  /* normal load with a wrong hint */
             mod = LoadLibraryA( dll_name );
             ok( mod != NULL, "failed to load err %lu\n", GetLastError() );
             if (!mod) break;
@@ -2409,6 +2411,58 @@ static void test_import_resolution(void)
     }
 }
 
+/* look up all the exported names of kernel32, often enough for the loader to index them */
+static void test_export_names(void)
+{
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *functions, *names;
+    const WORD *ordinals;
+    char module[MAX_PATH];
+    const char *name, *forward, *dot;
+    HMODULE kernel32 = GetModuleHandleA( "kernel32.dll" ), target;
+    void *proc, *expect;
+    ULONG size;
+    DWORD i;
+
+    exports = pRtlImageDirectoryEntryToData( kernel32, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size );
+    ok( exports != NULL, "no exports\n" );
+    if (!exports) return;
+    functions = (const DWORD *)((char *)kernel32 + exports->AddressOfFunctions);
+    names = (const DWORD *)((char *)kernel32 + exports->AddressOfNames);
+    ordinals = (const WORD *)((char *)kernel32 + exports->AddressOfNameOrdinals);
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        name = (const char *)kernel32 + names[i];
+        proc = GetProcAddress( kernel32, name );
+        ok( proc != NULL, "%s not found, error %lu\n", name, GetLastError() );
+
+        if (functions[ordinals[i]] < (char *)exports - (char *)kernel32 ||
+            functions[ordinals[i]] >= (char *)exports - (char *)kernel32 + size)
+        {
+            expect = (char *)kernel32 + functions[ordinals[i]];
+            ok( proc == expect, "%s: got %p, expected %p\n", name, proc, expect );
+            continue;
+        }
+
+        /* forwarded names resolve to the export of the target module */
+        forward = (const char *)kernel32 + functions[ordinals[i]];
+        if (!(dot = strrchr( forward, '.' )) || dot[1] == '#' || dot - forward >= sizeof(module) - 4) continue;
+        memcpy( module, forward, dot - forward );
+        strcpy( module + (dot - forward), ".dll" );
+        if (!(target = GetModuleHandleA( module ))) continue;  /* api sets */
+        expect = GetProcAddress( target, dot + 1 );
+        ok( proc == expect, "%s forwarded to %s: got %p, expected %p\n", name, forward, proc, expect );
+    }
+
+    SetLastError( 0xdeadbeef );
+    proc = GetProcAddress( kernel32, "NoSuchExportedFunction" );
+    ok( !proc, "got %p\n", proc );
+    ok( GetLastError() == ERROR_PROC_NOT_FOUND, "wrong error %lu\n", GetLastError() );
+    proc = GetProcAddress( kernel32, "createeventa" );
+    ok( !proc, "got %p\n", proc );
+}
+
 static HANDLE gen_forward_chain_testdll( char testdll_path[MAX_PATH],
                                          const char source_dll[MAX_PATH],
                                          BOOL is_export, BOOL is_import,
@@ -4718,6 +4772,7 @@ START_TEST(loader)
     test_ImportDescriptors();
     test_section_access();
     test_import_resolution();
+    test_export_names();
     test_export_forwarder_dep_chain();
     test_ExitProcess();
     test_InMemoryOrderModuleList();
@@ -339,6 +339,154 @@ static void test_mutex(void)
     CloseHandle(hCreated);
 }
 
+struct unnamed_mutex_info
+{
+    HANDLE mutex;
+    HANDLE ready;
+    HANDLE release;
+    DWORD result;
+};
+
+static DWORD WINAPI unnamed_mutex_owner_thread(void *arg)
+{
+    struct unnamed_mutex_info *info = arg;
+    DWORD ret;
+
+    ret = WaitForSingleObject(info->mutex, 0);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    SetEvent(info->ready);
+    if (!info->release) Sleep(100);  /* exit without releasing the mutex */
+    else
+    {
+        ret = WaitForSingleObject(info->release, 5000);
+        ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+        ret = ReleaseMutex(info->mutex);
+        ok(ret, "ReleaseMutex failed, error %lu\n", GetLastError());
+    }
+    return 0;
+}
+
+static DWORD WINAPI unnamed_mutex_waiter_thread(void *arg)
+{
+    struct unnamed_mutex_info *info = arg;
+
+    info->result = WaitForSingleObject(info->mutex, 5000);
+    if (info->result == WAIT_OBJECT_0) ReleaseMutex(info->mutex);
+    return 0;
+}
+
+static void test_unnamed_mutex_child(HANDLE mutex, HANDLE event)
+{
+    HANDLE handles[2] = {mutex, event};
+    DWORD ret;
+
+    ret = WaitForMultipleObjects(2, handles, TRUE, 5000);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    if (ret == WAIT_OBJECT_0)
+    {
+        ret = ReleaseMutex(mutex);
+        ok(ret, "ReleaseMutex failed, error %lu\n", GetLastError());
+    }
+}
+
+/* unnamed mutexes may be owned without going through the server, which has to take them back
+ * when their owner dies, when other waits need them, or when other processes use them */
+static void test_unnamed_mutex(void)
+{
+    struct unnamed_mutex_info info = {0}, waiter = {0};
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    HANDLE handles[2], thread, thread2, child_mutex, child_event;
+    char cmdline[MAX_PATH];
+    DWORD ret, code;
+    char **argv;
+
+    info.mutex = CreateMutexA(NULL, FALSE, NULL);
+    ok(info.mutex != NULL, "CreateMutex failed, error %lu\n", GetLastError());
+    info.ready = CreateEventA(NULL, FALSE, FALSE, NULL);
+    ok(info.ready != NULL, "CreateEvent failed, error %lu\n", GetLastError());
+
+    /* abandoned while nobody is waiting */
+    thread = CreateThread(NULL, 0, unnamed_mutex_owner_thread, &info, 0, NULL);
+    ret = WaitForSingleObject(thread, 5000);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    CloseHandle(thread);
+    ret = WaitForSingleObject(info.mutex, 0);
+    ok(ret == WAIT_ABANDONED, "got %lu\n", ret);
+    ret = ReleaseMutex(info.mutex);
+    ok(ret, "ReleaseMutex failed, error %lu\n", GetLastError());
+
+    /* abandoned while another thread is waiting for it */
+    thread = CreateThread(NULL, 0, unnamed_mutex_owner_thread, &info, 0, NULL);
+    ret = WaitForSingleObject(info.ready, 5000);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    ret = WaitForSingleObject(info.mutex, 5000);
+    ok(ret == WAIT_ABANDONED, "got %lu\n", ret);
+    ret = ReleaseMutex(info.mutex);
+    ok(ret, "ReleaseMutex failed, error %lu\n", GetLastError());
+    WaitForSingleObject(thread, 5000);
+    CloseHandle(thread);
+    CloseHandle(info.mutex);
+
+    /* taken back by the server while another thread is waiting for it */
+    info.mutex = CreateMutexA(NULL, FALSE, NULL);
+    ok(info.mutex != NULL, "CreateMutex failed, error %lu\n", GetLastError());
+    info.release = CreateEventA(NULL, FALSE, FALSE, NULL);
+    ok(info.release != NULL, "CreateEvent failed, error %lu\n", GetLastError());
+    thread = CreateThread(NULL, 0, unnamed_mutex_owner_thread, &info, 0, NULL);
+    ret = WaitForSingleObject(info.ready, 5000);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    waiter.mutex = info.mutex;
+    waiter.result = 0xdeadbeef;
+    thread2 = CreateThread(NULL, 0, unnamed_mutex_waiter_thread, &waiter, 0, NULL);
+    Sleep(50);
+    handles[0] = info.mutex;
+    handles[1] = info.ready;
+    ret = WaitForMultipleObjects(2, handles, FALSE, 0);
+    ok(ret == WAIT_TIMEOUT, "got %lu\n", ret);
+    SetEvent(info.release);
+    ret = WaitForSingleObject(thread2, 5000);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    ok(waiter.result == WAIT_OBJECT_0, "got %lu\n", waiter.result);
+    WaitForSingleObject(thread, 5000);
+    CloseHandle(thread2);
+    CloseHandle(thread);
+
+    /* owned in-process, then waited for by another process along with an event */
+    ret = WaitForSingleObject(info.mutex, 0);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    ret = DuplicateHandle(GetCurrentProcess(), info.mutex, GetCurrentProcess(), &child_mutex, 0, TRUE,
+                          DUPLICATE_SAME_ACCESS);
+    ok(ret, "DuplicateHandle failed, error %lu\n", GetLastError());
+    ret = DuplicateHandle(GetCurrentProcess(), info.release, GetCurrentProcess(), &child_event, 0, TRUE,
+                          DUPLICATE_SAME_ACCESS);
+    ok(ret, "DuplicateHandle failed, error %lu\n", GetLastError());
+    winetest_get_mainargs(&argv);
+    sprintf(cmdline, "\"%s\" sync unnamed_mutex %p %p", argv[0], child_mutex, child_event);
+    ret = CreateProcessA(argv[0], cmdline, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
+    ok(ret, "CreateProcess failed, error %lu\n", GetLastError());
+    Sleep(50);
+    SetEvent(info.release);
+    ret = ReleaseMutex(info.mutex);
+    ok(ret, "ReleaseMutex failed, error %lu\n", GetLastError());
+    wait_child_process(pi.hProcess);
+    ret = GetExitCodeProcess(pi.hProcess, &code);
+    ok(ret, "GetExitCodeProcess failed, error %lu\n", GetLastError());
+    ok(!code, "got exit code %#lx\n", code);
+    ret = WaitForSingleObject(info.mutex, 0);
+    ok(ret == WAIT_OBJECT_0, "got %lu\n", ret);
+    ret = ReleaseMutex(info.mutex);
+    ok(ret, "ReleaseMutex failed, error %lu\n", GetLastError());
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+
+    CloseHandle(child_mutex);
+    CloseHandle(child_event);
+    CloseHandle(info.release);
+    CloseHandle(info.ready);
+    CloseHandle(info.mutex);
+}
+
 static void test_slist(void)
 {
     struct item
@@ -2911,6 +3059,14 @@ START_TEST(sync)
         {
             for (;;) SleepEx(INFINITE, TRUE);
         }
+        if (!strcmp(argv[2], "unnamed_mutex") && argc >= 5)
+        {
+            HANDLE mutex, event;
+
+            sscanf(argv[3], "%p", &mutex);
+            sscanf(argv[4], "%p", &event);
+            test_unnamed_mutex_child(mutex, event);
+        }
         return;
     }
 
@@ -2920,6 +3076,7 @@ START_TEST(sync)
     test_signalandwait();
     test_temporary_objects();
     test_mutex();
+    test_unnamed_mutex();
     test_slist();
     test_event();
     test_semaphore();
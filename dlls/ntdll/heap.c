@@ -34,9 +34,11 @@
 #include "winternl.h"
 #include "ntdll_misc.h"
 #include "wine/list.h"
+#include "wine/heapinfo.h"
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(heap);
+WINE_DECLARE_DEBUG_CHANNEL(heapstats);
 
 /* HeapCompatibilityInformation values */
 
@@ -276,6 +278,24 @@ static inline struct group **bin_get_affinity_group( struct bin *bin, BYTE affin
     return bin->affinity_group_base + affinity * BLOCK_SIZE_BIN_COUNT;
 }
 
+#define THREAD_CACHE_BIN_COUNT  0x20  /* number of bins with a thread cache, for blocks up to 0x200 bytes */
+#define THREAD_CACHE_BIN_DEPTH  16    /* maximum number of free blocks kept in a bin cache */
+#define THREAD_CACHE_BIN_BATCH  8     /* number of blocks moved at once between a bin cache and its groups */
+
+/* free blocks of a bin, cached by the thread owning the cache */
+struct thread_cache_bin
+{
+    UINT          count;
+    struct block *blocks[THREAD_CACHE_BIN_DEPTH];
+};
+
+/* a thread cache of free LFH blocks, one for each affinity, owned by a single thread at a time */
+struct thread_cache
+{
+    LONG                    owner;  /* id of the owner thread, 0 if the cache is unowned */
+    struct thread_cache_bin bins[THREAD_CACHE_BIN_COUNT];
+};
+
 struct heap
 {                                  /* win32/win64 */
     DWORD_PTR        unknown1[2];   /* 0000/0000 */
@@ -300,6 +320,14 @@ struct heap
     RTL_CRITICAL_SECTION cs;
     struct entry     free_lists[FREE_LIST_COUNT];
     struct bin      *bins;
+    struct thread_cache *thread_caches; /* per-affinity thread caches, allocated on first LFH use */
+    SIZE_T           committed;     /* committed size of the subheaps and large blocks */
+    SIZE_T           peak_committed; /* highest committed size */
+    LONG             sample_rate;   /* allocation sampling rate, 0 if disabled */
+    LONG             sample_countdown; /* allocations left until the next sample */
+    DWORD            sample_pos;    /* position of the next sample in the samples ring */
+    DWORD            sample_count;  /* number of valid samples in the samples ring */
+    HEAP_WINE_ALLOCATION_SAMPLE *samples; /* ring buffer of allocation samples */
     SUBHEAP          subheap;
 };
 
@@ -318,6 +346,8 @@ C_ASSERT( HEAP_MIN_LARGE_BLOCK_SIZE <= HEAP_INITIAL_GROW_SIZE );
 
 #define MAX_FREE_PENDING     1024    /* max number of free requests to delay */
 
+#define MAX_HEAP_SAMPLES     256     /* max number of allocation samples to keep */
+
 /* some undocumented flags (names are made up) */
 #define HEAP_PRIVATE          0x00001000
 #define HEAP_ADD_USER_INFO    0x00000100
@@ -598,6 +628,13 @@ static void heap_set_status( const struct heap *heap, ULONG flags, NTSTATUS stat
     if (status) RtlSetLastWin32ErrorAndNtStatusFromNtStatus( status );
 }
 
+/* update the heap committed size, heap must be locked */
+static inline void heap_add_committed( struct heap *heap, SSIZE_T size )
+{
+    heap->committed += size;
+    if (heap->committed > heap->peak_committed) heap->peak_committed = heap->committed;
+}
+
 static SIZE_T get_free_list_block_size( unsigned int index )
 {
     DWORD log = index >> FREE_LIST_LINEAR_BITS;
@@ -798,7 +835,7 @@ static SUBHEAP *find_subheap( const struct heap *heap, const struct block *block
 }
 
 
-static inline BOOL subheap_commit( const struct heap *heap, SUBHEAP *subheap, const struct block *block, SIZE_T block_size )
+static inline BOOL subheap_commit( struct heap *heap, SUBHEAP *subheap, const struct block *block, SIZE_T block_size )
 {
     const char *end = (char *)subheap_base( subheap ) + subheap_size( subheap ), *commit_end;
     SIZE_T size;
@@ -821,10 +858,11 @@ static inline BOOL subheap_commit( const struct heap *heap, SUBHEAP *subheap, co
     }
 
     subheap->data_size = (char *)commit_end - (char *)(subheap + 1);
+    heap_add_committed( heap, size );
     return TRUE;
 }
 
-static inline BOOL subheap_decommit( const struct heap *heap, SUBHEAP *subheap, const void *commit_end )
+static inline BOOL subheap_decommit( struct heap *heap, SUBHEAP *subheap, const void *commit_end )
 {
     char *base = subheap_base( subheap );
     SIZE_T size;
@@ -844,6 +882,7 @@ static inline BOOL subheap_decommit( const struct heap *heap, SUBHEAP *subheap,
     }
 
     subheap->data_size = (char *)commit_end - (char *)(subheap + 1);
+    heap_add_committed( heap, -(SSIZE_T)size );
     return TRUE;
 }
 
@@ -935,6 +974,7 @@ static NTSTATUS heap_free_block( struct heap *heap, ULONG flags, struct block *b
         void *addr = subheap_base( subheap );
         SIZE_T size = 0;
 
+        heap_add_committed( heap, -((char *)subheap_commit_end( subheap ) - (char *)addr) );
         list_remove( &subheap->entry );
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
         return STATUS_SUCCESS;
@@ -1016,6 +1056,7 @@ static NTSTATUS heap_allocate_large( struct heap *heap, ULONG flags, SIZE_T bloc
 
     heap_lock( heap, flags );
     list_add_tail( &heap->large_list, &arena->entry );
+    heap_add_committed( heap, total_size );
     heap_unlock( heap, flags );
 
     valgrind_make_noaccess( (char *)block + sizeof(*block) + arena->data_size,
@@ -1034,6 +1075,7 @@ static NTSTATUS heap_free_large( struct heap *heap, ULONG flags, struct block *b
 
     heap_lock( heap, flags );
     list_remove( &arena->entry );
+    heap_add_committed( heap, -((char *)block + arena->block_size - (char *)arena) );
     heap_unlock( heap, flags );
 
     return NtFreeVirtualMemory( NtCurrentProcess(), &address, &size, MEM_RELEASE );
@@ -1095,6 +1137,7 @@ static SUBHEAP *create_subheap( struct heap *heap, DWORD flags, SIZE_T total_siz
     block_init_free( first_block( subheap ), flags, subheap, block_size );
 
     list_add_head( &heap->subheap_list, &subheap->entry );
+    heap_add_committed( heap, commit_size );
 
     return subheap;
 }
@@ -1523,6 +1566,8 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, void *addr, SIZE_T total_size, SIZE_T
     heap->magic         = HEAP_MAGIC;
     heap->grow_size     = HEAP_INITIAL_GROW_SIZE;
     heap->min_size      = commit_size;
+    heap->committed     = commit_size;
+    heap->peak_committed = commit_size;
     list_init( &heap->subheap_list );
     list_init( &heap->large_list );
 
@@ -1670,6 +1715,16 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE handle )
         size = 0;
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
     }
+    if ((addr = heap->thread_caches))
+    {
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
+    if ((addr = heap->samples))
+    {
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
     size = 0;
     addr = heap;
     NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
@@ -1768,14 +1823,22 @@ static inline struct block *group_get_block( struct group *group, SIZE_T block_s
     return (struct block *)(first_block + index * block_size);
 }
 
-/* lookup a free block using the group free_bits, the current thread must own the group */
-static inline struct block *group_find_free_block( struct group *group, SIZE_T block_size )
+/* lookup up to count free blocks using the group free_bits, the current thread must own the group */
+static inline UINT group_find_free_blocks( struct group *group, SIZE_T block_size, struct block **blocks, UINT count )
 {
-    ULONG i, free_bits = ReadNoFence( &group->free_bits );
+    ULONG i, free_bits = ReadNoFence( &group->free_bits ), bits = 0;
+    UINT n;
+
     /* free_bits will never be 0 as the group is unlinked when it's fully used */
-    BitScanForward( &i, free_bits );
-    InterlockedAnd( &group->free_bits, ~(1 << i) );
-    return group_get_block( group, block_size, i );
+    for (n = 0; n < count && free_bits; n++)
+    {
+        BitScanForward( &i, free_bits );
+        free_bits &= ~(1 << i);
+        bits |= 1 << i;
+        blocks[n] = group_get_block( group, block_size, i );
+    }
+    InterlockedAnd( &group->free_bits, ~bits );
+    return n;
 }
 
 /* allocate a new group block using non-LFH allocation, returns a group owned by current thread */
@@ -1887,19 +1950,19 @@ static NTSTATUS heap_release_bin_group( struct heap *heap, ULONG flags, struct b
     return group_release( heap, flags, bin, group );
 }
 
-static struct block *find_free_bin_block( struct heap *heap, ULONG flags, SIZE_T block_size, struct bin *bin )
+static UINT find_free_bin_blocks( struct heap *heap, ULONG flags, SIZE_T block_size, struct bin *bin,
+                                  struct block **blocks, UINT count )
 {
     ULONG affinity = heap_current_thread_affinity();
-    struct block *block;
     struct group *group;
 
     /* acquire a group, the thread will own it and no other thread can clear free bits.
      * some other thread might still set the free bits if they are freeing blocks.
      */
-    if (!(group = heap_acquire_bin_group( heap, flags, block_size, bin ))) return NULL;
+    if (!(group = heap_acquire_bin_group( heap, flags, block_size, bin ))) return 0;
     group->affinity = affinity;
 
-    block = group_find_free_block( group, block_size );
+    count = group_find_free_blocks( group, block_size, blocks, count );
 
     /* serialize with heap_free_block_lfh: atomically set GROUP_FLAG_FREE when the free bits are all 0. */
     if (ReadNoFence( &group->free_bits ) || InterlockedCompareExchange( &group->free_bits, GROUP_FLAG_FREE, 0 ))
@@ -1909,13 +1972,82 @@ static struct block *find_free_bin_block( struct heap *heap, ULONG flags, SIZE_T
             RtlInterlockedPushEntrySList( &bin->groups, &group->entry );
     }
 
-    return block;
+    return count;
+}
+
+/* give free blocks back to their groups, releasing the groups that become fully free */
+static NTSTATUS group_free_blocks( struct heap *heap, ULONG flags, struct bin *bin, struct block **blocks, UINT count )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    struct group *group;
+    LONG bits;
+    UINT i = 0;
+
+    while (i < count)
+    {
+        /* merge the free bits of consecutive blocks from the same group */
+        group = block_get_group( blocks[i] );
+        for (bits = 0; i < count && block_get_group( blocks[i] ) == group; i++)
+            bits |= 1 << block_get_group_index( blocks[i] );
+
+        /* if these were the last used blocks in a group and GROUP_FLAG_FREE was set */
+        if (InterlockedOr( &group->free_bits, bits ) == ~bits)
+        {
+            /* thread now owns the group, and can release it to its bin */
+            group->free_bits = ~GROUP_FLAG_FREE;
+            status = heap_release_bin_group( heap, flags, bin, group );
+        }
+    }
+
+    return status;
+}
+
+/* allocate the thread caches of a heap, the first time a thread uses them */
+static struct thread_cache *heap_alloc_thread_caches( struct heap *heap )
+{
+    SIZE_T size = sizeof(struct thread_cache) * ARRAY_SIZE(affinity_mapping);
+    void *caches = NULL, *prev;
+
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), &caches, 0, &size, MEM_COMMIT, PAGE_READWRITE )) return NULL;
+    if (!(prev = InterlockedCompareExchangePointer( (void **)&heap->thread_caches, caches, NULL ))) return caches;
+
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), &caches, &size, MEM_RELEASE );
+    return prev;
+}
+
+/* get the current thread cache of a bin, taking ownership of the affinity cache if it is unowned */
+static struct thread_cache_bin *heap_get_thread_cache_bin( struct heap *heap, ULONG flags, struct bin *bin, BOOL create )
+{
+    LONG owner, tid = GetCurrentThreadId();
+    struct thread_cache *cache;
+    ULONG affinity;
+
+    if (bin - heap->bins >= THREAD_CACHE_BIN_COUNT) return NULL;
+    /* the affinity of a new thread may still be reassigned if it was mapped to 0 */
+    if (!(affinity = create ? heap_current_thread_affinity() : NtCurrentTeb()->HeapVirtualAffinity)) return NULL;
+
+    /* the caches are allocated zeroed, so there's nothing to order against when reading the pointer */
+    if (!(cache = heap->thread_caches))
+    {
+        if (!create || !(cache = heap_alloc_thread_caches( heap ))) return NULL;
+    }
+    cache += affinity;
+    if ((owner = ReadNoFence( &cache->owner )) != tid)
+    {
+        /* the cache is released when its owner thread detaches */
+        if (!create || owner) return NULL;
+        if (InterlockedCompareExchange( &cache->owner, tid, 0 )) return NULL;
+    }
+
+    return cache->bins + (bin - heap->bins);
 }
 
 static NTSTATUS heap_allocate_block_lfh( struct heap *heap, ULONG flags, SIZE_T block_size,
                                          SIZE_T size, void **ret )
 {
     struct bin *bin, *last = heap->bins + BLOCK_SIZE_BIN_COUNT - 1;
+    struct thread_cache_bin *cache;
     struct block *block;
 
     bin = heap->bins + BLOCK_SIZE_BIN( block_size );
@@ -1926,7 +2058,15 @@ static NTSTATUS heap_allocate_block_lfh( struct heap *heap, ULONG flags, SIZE_T
 
     block_size = BLOCK_BIN_SIZE( BLOCK_SIZE_BIN( block_size ) );
 
-    if ((block = find_free_bin_block( heap, flags, block_size, bin )))
+    if ((cache = heap_get_thread_cache_bin( heap, flags, bin, TRUE )))
+    {
+        /* refill the thread cache from the bin groups in batches */
+        if (!cache->count) cache->count = find_free_bin_blocks( heap, flags, block_size, bin, cache->blocks, THREAD_CACHE_BIN_BATCH );
+        block = cache->count ? cache->blocks[--cache->count] : NULL;
+    }
+    else if (!find_free_bin_blocks( heap, flags, block_size, bin, &block, 1 )) block = NULL;
+
+    if (block)
     {
         block_set_type( block, BLOCK_TYPE_USED );
         block_set_flags( block, (BYTE)~BLOCK_FLAG_LFH, BLOCK_USER_FLAGS( flags ) );
@@ -1942,28 +2082,33 @@ static NTSTATUS heap_allocate_block_lfh( struct heap *heap, ULONG flags, SIZE_T
 static NTSTATUS heap_free_block_lfh( struct heap *heap, ULONG flags, struct block *block )
 {
     struct bin *bin, *last = heap->bins + BLOCK_SIZE_BIN_COUNT - 1;
-    SIZE_T i, block_size = block_get_size( block );
-    struct group *group = block_get_group( block );
+    SIZE_T block_size = block_get_size( block );
     NTSTATUS status = STATUS_SUCCESS;
+    struct thread_cache_bin *cache;
 
     if (!(block_get_flags( block ) & BLOCK_FLAG_LFH)) return STATUS_UNSUCCESSFUL;
 
     bin = heap->bins + BLOCK_SIZE_BIN( block_size );
     if (bin == last) return STATUS_UNSUCCESSFUL;
 
-    i = block_get_group_index( block );
     valgrind_make_writable( block, sizeof(*block) );
     block_set_type( block, BLOCK_TYPE_FREE );
     block_set_flags( block, (BYTE)~BLOCK_FLAG_LFH, BLOCK_FLAG_FREE );
+    /* reset the free block size high bits, block_get_group needs the size of cached blocks */
+    block_set_size( block, block_size );
     mark_block_free( block + 1, (char *)block + block_size - (char *)(block + 1), flags );
 
-    /* if this was the last used block in a group and GROUP_FLAG_FREE was set */
-    if (InterlockedOr( &group->free_bits, 1 << i ) == ~(1 << i))
+    if (!(cache = heap_get_thread_cache_bin( heap, flags, bin, FALSE )))
+        return group_free_blocks( heap, flags, bin, &block, 1 );
+
+    /* drain the least recently freed blocks to their groups when the thread cache is full */
+    if (cache->count == THREAD_CACHE_BIN_DEPTH)
     {
-        /* thread now owns the group, and can release it to its bin */
-        group->free_bits = ~GROUP_FLAG_FREE;
-        status = heap_release_bin_group( heap, flags, bin, group );
+        status = group_free_blocks( heap, flags, bin, cache->blocks, THREAD_CACHE_BIN_BATCH );
+        cache->count -= THREAD_CACHE_BIN_BATCH;
+        memmove( cache->blocks, cache->blocks + THREAD_CACHE_BIN_BATCH, cache->count * sizeof(*cache->blocks) );
     }
+    cache->blocks[cache->count++] = block;
 
     return status;
 }
@@ -2000,9 +2145,21 @@ static void bin_try_enable( struct heap *heap, struct bin *bin )
 static void heap_thread_detach_bin_groups( struct heap *heap )
 {
     ULONG i, affinity = NtCurrentTeb()->HeapVirtualAffinity;
+    struct thread_cache *cache;
 
     if (!heap->bins) return;
 
+    if ((cache = heap->thread_caches)) cache += affinity;
+    if (cache && ReadNoFence( &cache->owner ) == GetCurrentThreadId())
+    {
+        for (i = 0; i < THREAD_CACHE_BIN_COUNT; ++i)
+        {
+            group_free_blocks( heap, heap->flags, heap->bins + i, cache->bins[i].blocks, cache->bins[i].count );
+            cache->bins[i].count = 0;
+        }
+        WriteRelease( &cache->owner, 0 );
+    }
+
     for (i = 0; i < BLOCK_SIZE_BIN_COUNT; ++i)
     {
         struct bin *bin = heap->bins + i;
@@ -2026,6 +2183,34 @@ void heap_thread_detach(void)
     RtlLeaveCriticalSection( &process_heap->cs );
 }
 
+/* record one allocation out of sample_rate, along with its backtrace */
+static void DECLSPEC_NOINLINE heap_sample_allocation( struct heap *heap, ULONG flags, void *ptr, SIZE_T size )
+{
+    HEAP_WINE_ALLOCATION_SAMPLE *sample;
+    void *frames[HEAP_WINE_SAMPLE_FRAMES];
+    LONG rate = ReadNoFence( &heap->sample_rate );
+    ULONG count;
+
+    if (!rate || InterlockedDecrement( &heap->sample_countdown ) > 0) return;
+    WriteNoFence( &heap->sample_countdown, rate );
+
+    /* skip our frame and RtlAllocateHeap */
+    count = RtlCaptureStackBackTrace( 2, ARRAY_SIZE(frames), frames, NULL );
+
+    heap_lock( heap, flags );
+    if (heap->samples)
+    {
+        sample = heap->samples + heap->sample_pos;
+        sample->Address = ptr;
+        sample->Size = size;
+        sample->FrameCount = count;
+        memcpy( sample->Frames, frames, count * sizeof(*frames) );
+        heap->sample_pos = (heap->sample_pos + 1) % MAX_HEAP_SAMPLES;
+        if (heap->sample_count < MAX_HEAP_SAMPLES) heap->sample_count++;
+    }
+    heap_unlock( heap, flags );
+}
+
 /***********************************************************************
  *           RtlAllocateHeap   (NTDLL.@)
  */
@@ -2059,6 +2244,7 @@ void *WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE handle, ULONG flags, SIZE
     }
 
     if (!status) valgrind_notify_alloc( ptr, size, flags & HEAP_ZERO_MEMORY );
+    if (!status && ReadNoFence( &heap->sample_rate )) heap_sample_allocation( heap, heap_flags, ptr, size );
 
     TRACE( "handle %p, flags %#lx, size %#Ix, return %p, status %#lx.\n", handle, flags, size, ptr, status );
     heap_set_status( heap, flags, status );
@@ -2546,6 +2732,124 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
     return total;
 }
 
+/* accumulate the statistics of an LFH group, group may be concurrently used */
+static void heap_get_group_statistics( struct group *group, SIZE_T group_size, HEAP_WINE_STATISTICS *stats )
+{
+    SIZE_T block_size = (group_size - offsetof( struct group, first_block )) / GROUP_BLOCK_COUNT;
+    HEAP_WINE_BIN_STATISTICS *bin = stats->Bins + BLOCK_SIZE_BIN( block_size );
+    UINT i;
+
+    if (!stats->BinCount) return;
+
+    bin->LfhGroups++;
+    for (i = 0; i < GROUP_BLOCK_COUNT; ++i)
+    {
+        const struct block *block = group_get_block( group, block_size, i );
+        if (block_get_type( block ) != BLOCK_TYPE_USED) bin->LfhFreeCount++;
+        else
+        {
+            stats->UsedSize += block_size - sizeof(*block) - block->tail_size;
+            stats->UsedCount++;
+            bin->LfhUsedCount++;
+        }
+    }
+}
+
+/* collect the heap statistics, heap must be locked */
+static void heap_get_statistics( struct heap *heap, HEAP_WINE_STATISTICS *stats )
+{
+    const ARENA_LARGE *large;
+    const SUBHEAP *subheap;
+    struct block *block;
+    unsigned int i;
+
+    memset( stats, 0, offsetof( HEAP_WINE_STATISTICS, Bins[0] ) );
+    stats->CompatibilityInfo = ReadNoFence( &heap->compat_info );
+    stats->BinCount = heap->bins ? BLOCK_SIZE_BIN_COUNT : 0;
+    stats->CommittedSize = heap->committed;
+    stats->PeakCommittedSize = heap->peak_committed;
+
+    for (i = 0; i < stats->BinCount; i++)
+    {
+        const struct bin *bin = heap->bins + i;
+        memset( stats->Bins + i, 0, sizeof(*stats->Bins) );
+        stats->Bins[i].BlockSize = BLOCK_BIN_SIZE( i );
+        stats->Bins[i].AllocCount = ReadNoFence( &bin->count_alloc );
+        stats->Bins[i].FreeCount = ReadNoFence( &bin->count_freed );
+        stats->Bins[i].LfhEnabled = ReadNoFence( &bin->enabled );
+    }
+
+    LIST_FOR_EACH_ENTRY( subheap, &heap->subheap_list, SUBHEAP, entry )
+    {
+        stats->ReservedSize += subheap_size( subheap );
+
+        for (block = first_block( subheap ); block; block = next_block( subheap, block ))
+        {
+            SIZE_T size = block_get_size( block ) - block_get_overhead( block );
+
+            if (block_get_flags( block ) & BLOCK_FLAG_FREE)
+            {
+                stats->FreeSize += size;
+                stats->FreeCount++;
+                stats->LargestFreeSize = max( stats->LargestFreeSize, size );
+            }
+            else if (block_get_flags( block ) & BLOCK_FLAG_LFH)
+                heap_get_group_statistics( (struct group *)(block + 1), size, stats );
+            else if (block_get_type( block ) == BLOCK_TYPE_USED)
+            {
+                stats->UsedSize += size;
+                stats->UsedCount++;
+            }
+        }
+    }
+
+    LIST_FOR_EACH_ENTRY( large, &heap->large_list, ARENA_LARGE, entry )
+    {
+        stats->ReservedSize += (char *)&large->block + large->block_size - (char *)large;
+
+        if (block_get_flags( &large->block ) & BLOCK_FLAG_LFH)
+            heap_get_group_statistics( (struct group *)(&large->block + 1), large->data_size, stats );
+        else
+        {
+            stats->UsedSize += large->data_size;
+            stats->UsedCount++;
+            stats->LargeSize += large->data_size;
+            stats->LargeCount++;
+        }
+    }
+}
+
+static void heap_dump_statistics( struct heap *heap, const HEAP_WINE_STATISTICS *stats )
+{
+    unsigned int i;
+
+    TRACE_(heapstats)( "heap %p: compat_info %lu, reserved %#Ix, committed %#Ix, peak %#Ix\n", heap,
+                       stats->CompatibilityInfo, stats->ReservedSize, stats->CommittedSize,
+                       stats->PeakCommittedSize );
+    TRACE_(heapstats)( "  used %#Ix in %Iu blocks, large %#Ix in %Iu blocks\n", stats->UsedSize,
+                       stats->UsedCount, stats->LargeSize, stats->LargeCount );
+    TRACE_(heapstats)( "  free %#Ix in %Iu blocks, largest %#Ix, fragmentation %Iu%%\n", stats->FreeSize,
+                       stats->FreeCount, stats->LargestFreeSize, stats->FreeSize ?
+                       100 - stats->LargestFreeSize * 100 / stats->FreeSize : 0 );
+
+    for (i = 0; i < stats->BinCount; i++)
+    {
+        const HEAP_WINE_BIN_STATISTICS *bin = stats->Bins + i;
+        if (!bin->AllocCount && !bin->FreeCount && !bin->LfhGroups) continue;
+        TRACE_(heapstats)( "  bin %3u: size %#6Ix, alloc %lu, freed %lu, enabled %lu, groups %lu, used %lu, free %lu\n",
+                           i, bin->BlockSize, bin->AllocCount, bin->FreeCount, bin->LfhEnabled, bin->LfhGroups,
+                           bin->LfhUsedCount, bin->LfhFreeCount );
+    }
+
+    for (i = 0; i < heap->sample_count; i++)
+    {
+        const HEAP_WINE_ALLOCATION_SAMPLE *sample;
+        sample = heap->samples + (heap->sample_pos + MAX_HEAP_SAMPLES - heap->sample_count + i) % MAX_HEAP_SAMPLES;
+        TRACE_(heapstats)( "  sample %p: size %#Ix, frames %p %p %p %p\n", sample->Address, sample->Size,
+                           sample->Frames[0], sample->Frames[1], sample->Frames[2], sample->Frames[3] );
+    }
+}
+
 /***********************************************************************
  *           RtlQueryHeapInformation    (NTDLL.@)
  */
@@ -2557,7 +2861,7 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS i
 
     TRACE( "handle %p, info_class %u, info %p, size_in %Iu, size_out %p.\n", handle, info_class, info, size_in, size_out );
 
-    switch (info_class)
+    switch ((ULONG)info_class)
     {
     case HeapCompatibilityInformation:
         if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_ACCESS_VIOLATION;
@@ -2566,6 +2870,46 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS i
         *(ULONG *)info = ReadNoFence( &heap->compat_info );
         return STATUS_SUCCESS;
 
+    case HeapWineStatistics:
+    {
+        HEAP_WINE_STATISTICS *stats = info;
+        SIZE_T size;
+
+        if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_ACCESS_VIOLATION;
+        size = offsetof( HEAP_WINE_STATISTICS, Bins[heap->bins ? BLOCK_SIZE_BIN_COUNT : 0] );
+        if (size_out) *size_out = size;
+        if (size_in < size) return STATUS_BUFFER_TOO_SMALL;
+
+        heap_lock( heap, flags );
+        heap_get_statistics( heap, stats );
+        heap_unlock( heap, flags );
+        return STATUS_SUCCESS;
+    }
+
+    case HeapWineAllocationSampling:
+    {
+        HEAP_WINE_ALLOCATION_SAMPLES *samples = info;
+        SIZE_T size;
+        ULONG i;
+
+        if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_ACCESS_VIOLATION;
+
+        heap_lock( heap, flags );
+        size = offsetof( HEAP_WINE_ALLOCATION_SAMPLES, Samples[heap->sample_count] );
+        if (size_out) *size_out = size;
+        if (size_in < size)
+        {
+            heap_unlock( heap, flags );
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        samples->Rate = ReadNoFence( &heap->sample_rate );
+        samples->Count = heap->sample_count;
+        for (i = 0; i < heap->sample_count; i++)
+            samples->Samples[i] = heap->samples[(heap->sample_pos + MAX_HEAP_SAMPLES - heap->sample_count + i) % MAX_HEAP_SAMPLES];
+        heap_unlock( heap, flags );
+        return STATUS_SUCCESS;
+    }
+
     default:
         FIXME( "HEAP_INFORMATION_CLASS %u not implemented!\n", info_class );
         return STATUS_INVALID_INFO_CLASS;
@@ -2582,7 +2926,7 @@ NTSTATUS WINAPI RtlSetHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS inf
 
     TRACE( "handle %p, info_class %u, info %p, size %Iu.\n", handle, info_class, info, size );
 
-    switch (info_class)
+    switch ((ULONG)info_class)
     {
     case HeapCompatibilityInformation:
     {
@@ -2603,6 +2947,54 @@ NTSTATUS WINAPI RtlSetHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS inf
         return STATUS_SUCCESS;
     }
 
+    case HeapWineStatistics:
+    {
+        HEAP_WINE_STATISTICS *stats;
+        SIZE_T stats_size = offsetof( HEAP_WINE_STATISTICS, Bins[BLOCK_SIZE_BIN_COUNT] );
+
+        /* dump the heap statistics on the heapstats channel */
+        if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_INVALID_HANDLE;
+        if (!TRACE_ON(heapstats)) return STATUS_SUCCESS;
+        if (!(stats = RtlAllocateHeap( GetProcessHeap(), 0, stats_size ))) return STATUS_NO_MEMORY;
+
+        heap_lock( heap, flags );
+        heap_get_statistics( heap, stats );
+        heap_dump_statistics( heap, stats );
+        heap_unlock( heap, flags );
+
+        RtlFreeHeap( GetProcessHeap(), 0, stats );
+        return STATUS_SUCCESS;
+    }
+
+    case HeapWineAllocationSampling:
+    {
+        SIZE_T samples_size = MAX_HEAP_SAMPLES * sizeof(*heap->samples);
+        void *samples = NULL;
+        ULONG rate;
+
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_INVALID_HANDLE;
+        if ((rate = *(ULONG *)info) > MAXLONG) return STATUS_INVALID_PARAMETER;
+
+        if (rate && !heap->samples && NtAllocateVirtualMemory( NtCurrentProcess(), &samples, 0, &samples_size,
+                                                               MEM_COMMIT, PAGE_READWRITE ))
+            return STATUS_NO_MEMORY;
+
+        heap_lock( heap, flags );
+        if (!heap->samples) heap->samples = samples;
+        else if (samples)
+        {
+            samples_size = 0;
+            NtFreeVirtualMemory( NtCurrentProcess(), &samples, &samples_size, MEM_RELEASE );
+        }
+        /* keep the previous samples around when sampling is disabled */
+        if (rate) heap->sample_pos = heap->sample_count = 0;
+        WriteNoFence( &heap->sample_countdown, rate );
+        WriteNoFence( &heap->sample_rate, rate );
+        heap_unlock( heap, flags );
+        return STATUS_SUCCESS;
+    }
+
     default:
         FIXME( "HEAP_INFORMATION_CLASS %u not implemented!\n", info_class );
         return STATUS_SUCCESS;
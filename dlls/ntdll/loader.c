@@ -43,6 +43,7 @@ WINE_DECLARE_DEBUG_CHANNEL(relay);
 WINE_DECLARE_DEBUG_CHANNEL(snoop);
 WINE_DECLARE_DEBUG_CHANNEL(loaddll);
 WINE_DECLARE_DEBUG_CHANNEL(imports);
+WINE_DECLARE_DEBUG_CHANNEL(loadtime);
 
 #ifdef _WIN64
 #define DEFAULT_SECURITY_COOKIE_64  (((ULONGLONG)0x00002b99 << 32) | 0x2ddfa232)
@@ -128,6 +129,13 @@ struct file_id
     BYTE ObjectId[16];
 };
 
+/* hash table of the exported names of a module */
+struct export_names
+{
+    UINT                  mask;      /* number of buckets - 1 */
+    DWORD                 index[1];  /* index in the names array + 1, or 0 for empty buckets */
+};
+
 /* internal representation of loaded modules */
 typedef struct _wine_modref
 {
@@ -135,6 +143,8 @@ typedef struct _wine_modref
     struct file_id        id;
     ULONG                 CheckSum;
     BOOL                  system;
+    UINT                  name_lookups;   /* number of exported name lookups without a hash table */
+    struct export_names  *export_names;   /* hash table of exported names, built on demand */
 } WINE_MODREF;
 
 static UINT tls_module_count;      /* number of modules with TLS directory */
@@ -1039,6 +1049,63 @@ static int find_name_in_exports( HMODULE module, const IMAGE_EXPORT_DIRECTORY *e
 }
 
 
+static inline UINT hash_export_name( const char *name )
+{
+    UINT hash = 2166136261u;  /* FNV-1a */
+    while (*name) hash = (hash ^ (BYTE)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		build_export_names
+ *
+ * Build the hash table of the exported names of a module.
+ * The loader_section must be locked while calling this function.
+ */
+static struct export_names *build_export_names( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    struct export_names *table;
+    UINT i, pos, size = 64;
+
+    while (size < 2 * exports->NumberOfNames) size *= 2;
+    if (!(table = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   offsetof( struct export_names, index[size] ))))
+        return NULL;
+    table->mask = size - 1;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        pos = hash_export_name( get_rva( module, names[i] )) & table->mask;
+        while (table->index[pos]) pos = (pos + 1) & table->mask;
+        table->index[pos] = i + 1;
+    }
+    return table;
+}
+
+
+/*************************************************************************
+ *		find_name_in_export_names
+ *
+ * Find a name in the hash table of the exported names of a module.
+ */
+static int find_name_in_export_names( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+                                      const struct export_names *table, const char *name )
+{
+    const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    UINT pos = hash_export_name( name ) & table->mask;
+
+    for ( ; table->index[pos]; pos = (pos + 1) & table->mask)
+    {
+        DWORD idx = table->index[pos] - 1;
+        if (!strcmp( get_rva( module, names[idx] ), name )) return ordinals[idx];
+    }
+    return -1;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -1050,6 +1117,7 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    WINE_MODREF *wm;
     int ordinal;
 
     /* first check the hint */
@@ -1060,8 +1128,17 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
-    if ((ordinal = find_name_in_exports( module, exports, name )) == -1) return NULL;
+    /* then use the hash table, building it once the module has been searched often enough */
+    if ((wm = get_modref( module )) && !wm->export_names && exports->NumberOfNames >= 64 &&
+        ++wm->name_lookups >= 32)
+        wm->export_names = build_export_names( module, exports );
+
+    if (wm && wm->export_names)
+        ordinal = find_name_in_export_names( module, exports, wm->export_names, name );
+    else  /* or do a binary search */
+        ordinal = find_name_in_exports( module, exports, name );
+
+    if (ordinal == -1) return NULL;
     return find_ordinal_export( module, exports, exp_size, ordinal, load_path );
 
 }
@@ -1427,6 +1504,20 @@ static NTSTATUS fixup_imports_ilonly( WINE_MODREF *wm, LPCWSTR load_path, void *
 }
 
 
+/*************************************************************************
+ *		get_elapsed_us
+ *
+ * Return the time elapsed since a performance counter value, in microseconds.
+ */
+static ULONG get_elapsed_us( LARGE_INTEGER start )
+{
+    LARGE_INTEGER now, freq;
+
+    NtQueryPerformanceCounter( &now, &freq );
+    return (now.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart;
+}
+
+
 /****************************************************************
  *       fixup_imports
  *
@@ -1442,6 +1533,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     DWORD size;
     NTSTATUS status;
     ULONG_PTR cookie;
+    LARGE_INTEGER start = { .QuadPart = 0 };
 
     if (!(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS)) return STATUS_SUCCESS;  /* already done */
     wm->ldr.Flags &= ~LDR_DONT_RESOLVE_REFS;
@@ -1463,6 +1555,8 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     /* load the imported modules. They are automatically
      * added to the modref list of the process.
      */
+    if (TRACE_ON(loadtime)) NtQueryPerformanceCounter( &start, NULL );
+
     prev = current_modref;
     current_modref = wm;
     status = STATUS_SUCCESS;
@@ -1475,6 +1569,11 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
             add_module_dependency_after( wm->ldr.DdagNode, imp->ldr.DdagNode, dep_after );
     }
     current_modref = prev;
+
+    /* the time includes loading the dependencies that were not loaded yet */
+    TRACE_(loadtime)( "%s: imports from %d dlls resolved in %lu us\n",
+                      debugstr_w(wm->ldr.BaseDllName.Buffer), nb_imports,
+                      get_elapsed_us( start ) );
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
 }
@@ -3950,6 +4049,7 @@ static void free_modref( WINE_MODREF *wm )
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.DllBase );
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_names );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
@@ -4291,8 +4391,10 @@ static void release_address_space(void)
 void loader_init( CONTEXT *context, void **entry )
 {
     static int attach_done;
+    static LARGE_INTEGER init_start;
     NTSTATUS status;
     ULONG_PTR cookie, port = 0;
+    LARGE_INTEGER attach_start = { .QuadPart = 0 };
     WINE_MODREF *wm;
 
     if (process_detaching) NtTerminateThread( GetCurrentThread(), 0 );
@@ -4312,6 +4414,8 @@ void loader_init( CONTEXT *context, void **entry )
         peb->LoaderLock         = &loader_section;
         peb->ProcessHeap        = RtlCreateHeap( HEAP_GROWABLE, NULL, 0, 0, NULL, NULL );
 
+        if (TRACE_ON(loadtime)) NtQueryPerformanceCounter( &init_start, NULL );
+
         RtlInitializeBitMap( &tls_bitmap, peb->TlsBitmapBits, sizeof(peb->TlsBitmapBits) * 8 );
         RtlInitializeBitMap( &tls_expansion_bitmap, peb->TlsExpansionBitmapBits,
                              sizeof(peb->TlsExpansionBitmapBits) * 8 );
@@ -4354,6 +4458,8 @@ void loader_init( CONTEXT *context, void **entry )
             NtTerminateProcess( GetCurrentProcess(), status );
         }
         imports_fixup_done = TRUE;
+        TRACE_(loadtime)( "process imports resolved in %lu us\n",
+                          get_elapsed_us( init_start ) );
     }
     else wm = get_modref( NtCurrentTeb()->Peb->ImageBaseAddress );
 
@@ -4377,6 +4483,7 @@ void loader_init( CONTEXT *context, void **entry )
             NtTerminateProcess( GetCurrentProcess(), status );
         }
         wm->ldr.Flags |= LDR_PROCESS_ATTACHED;  /* don't try to attach again */
+        if (TRACE_ON(loadtime)) NtQueryPerformanceCounter( &attach_start, NULL );
         if (wm->ldr.ActivationContext)
             RtlActivateActivationContext( 0, wm->ldr.ActivationContext, &cookie );
 
@@ -4400,6 +4507,9 @@ void loader_init( CONTEXT *context, void **entry )
         release_address_space();
         if (wm->ldr.TlsIndex == -1) call_tls_callbacks( wm->ldr.DllBase, DLL_PROCESS_ATTACH );
         if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
+        TRACE_(loadtime)( "dlls initialized in %lu us, process startup took %lu us\n",
+                          get_elapsed_us( attach_start ),
+                          get_elapsed_us( init_start ) );
 
         NtQueryInformationProcess( GetCurrentProcess(), ProcessDebugPort, &port, sizeof(port), NULL );
         if (port) process_breakpoint();
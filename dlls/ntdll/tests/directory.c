@@ -1042,6 +1042,146 @@ static void test_redirection(void)
     pRtlWow64EnableFsRedirectionEx( old, &cur );
 }
 
+/* read all the entries of a directory, returns the count of entries found
+ * "seen" counts how many times each of the test files has been returned */
+static unsigned int read_large_directory( HANDLE handle, BOOLEAN restart, BYTE *seen, unsigned int count )
+{
+    FILE_BOTH_DIRECTORY_INFORMATION *info;
+    WCHAR name[MAX_PATH];
+    unsigned int total = 0, index;
+    BYTE data[8192];
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    ULONG pos;
+
+    for (;;)
+    {
+        status = pNtQueryDirectoryFile( handle, NULL, NULL, NULL, &io, data, sizeof(data),
+                                        FileBothDirectoryInformation, FALSE, NULL, restart );
+        restart = FALSE;
+        if (status == STATUS_NO_MORE_FILES) break;
+        ok( status == STATUS_SUCCESS, "failed to query directory, status %#lx\n", status );
+        if (status) break;
+
+        for (pos = 0;; pos += info->NextEntryOffset)
+        {
+            info = (FILE_BOTH_DIRECTORY_INFORMATION *)(data + pos);
+            memcpy( name, info->FileName, info->FileNameLength );
+            name[info->FileNameLength / sizeof(WCHAR)] = 0;
+            total++;
+            if (swscanf( name, L"long file name %u.txt", &index ) == 1 && index < count)
+            {
+                seen[index]++;
+                ok( info->ShortNameLength && info->ShortNameLength <= 12 * sizeof(WCHAR),
+                    "%s: wrong short name length %u\n", debugstr_w(name), info->ShortNameLength );
+            }
+            if (!info->NextEntryOffset) break;
+        }
+    }
+    return total;
+}
+
+/* directories that are too large to be sorted are read as a stream */
+static void test_NtQueryDirectoryFile_large(void)
+{
+    static const unsigned int count = 16500;
+    WCHAR testdir[MAX_PATH], path[MAX_PATH], short_name[13], long_name[MAX_PATH];
+    FILE_BOTH_DIRECTORY_INFORMATION *info;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING ntdirname, mask;
+    unsigned int i, total;
+    IO_STATUS_BLOCK io;
+    BYTE data[1024];
+    NTSTATUS status;
+    HANDLE handle, file;
+    BYTE *seen;
+
+    GetTempPathW( MAX_PATH, testdir );
+    lstrcatW( testdir, L"largedir" );
+    if (!CreateDirectoryW( testdir, NULL ))
+    {
+        skip( "failed to create %s, error %lu\n", debugstr_w(testdir), GetLastError() );
+        return;
+    }
+    for (i = 0; i < count; i++)
+    {
+        swprintf( path, MAX_PATH, L"%s\\long file name %u.txt", testdir, i );
+        file = CreateFileW( path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL );
+        if (file == INVALID_HANDLE_VALUE) break;
+        CloseHandle( file );
+    }
+    ok( i == count, "failed to create file %u, error %lu\n", i, GetLastError() );
+    if (i < count) goto done;
+
+    seen = calloc( count, 1 );
+    pRtlDosPathNameToNtPathName_U( testdir, &ntdirname, NULL, NULL );
+    InitializeObjectAttributes( &attr, &ntdirname, OBJ_CASE_INSENSITIVE, 0, NULL );
+    status = pNtOpenFile( &handle, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( status == STATUS_SUCCESS, "failed to open dir, status %#lx\n", status );
+
+    total = read_large_directory( handle, TRUE, seen, count );
+    ok( total == count + 2, "got %u entries\n", total );
+
+    /* restart after the end of the directory */
+    total = read_large_directory( handle, TRUE, seen, count );
+    ok( total == count + 2, "got %u entries\n", total );
+    for (i = 0; i < count; i++) if (seen[i] != 2) break;
+    ok( i == count, "file %u seen %u times\n", i, i < count ? seen[i] : 0 );
+
+    /* restart in the middle of the directory */
+    status = pNtQueryDirectoryFile( handle, NULL, NULL, NULL, &io, data, sizeof(data),
+                                    FileBothDirectoryInformation, TRUE, NULL, TRUE );
+    ok( status == STATUS_SUCCESS, "failed to query directory, status %#lx\n", status );
+    status = pNtQueryDirectoryFile( handle, NULL, NULL, NULL, &io, data, sizeof(data),
+                                    FileBothDirectoryInformation, TRUE, NULL, FALSE );
+    ok( status == STATUS_SUCCESS, "failed to query directory, status %#lx\n", status );
+    total = read_large_directory( handle, TRUE, seen, count );
+    ok( total == count + 2, "got %u entries\n", total );
+    pNtClose( handle );
+
+    /* the short name of an entry that was generated on demand finds the same file */
+    swprintf( long_name, MAX_PATH, L"long file name %u.txt", count - 1 );
+    pRtlInitUnicodeString( &mask, long_name );
+    status = pNtOpenFile( &handle, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( status == STATUS_SUCCESS, "failed to open dir, status %#lx\n", status );
+    info = (FILE_BOTH_DIRECTORY_INFORMATION *)data;
+    status = pNtQueryDirectoryFile( handle, NULL, NULL, NULL, &io, data, sizeof(data),
+                                    FileBothDirectoryInformation, TRUE, &mask, TRUE );
+    ok( status == STATUS_SUCCESS, "failed to query directory, status %#lx\n", status );
+    pNtClose( handle );
+    if (!status && info->ShortNameLength)
+    {
+        memcpy( short_name, info->ShortName, info->ShortNameLength );
+        short_name[info->ShortNameLength / sizeof(WCHAR)] = 0;
+        pRtlInitUnicodeString( &mask, short_name );
+        status = pNtOpenFile( &handle, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                              FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+        ok( status == STATUS_SUCCESS, "failed to open dir, status %#lx\n", status );
+        status = pNtQueryDirectoryFile( handle, NULL, NULL, NULL, &io, data, sizeof(data),
+                                        FileBothDirectoryInformation, TRUE, &mask, TRUE );
+        ok( status == STATUS_SUCCESS, "failed to query %s, status %#lx\n", debugstr_w(short_name), status );
+        if (!status)
+            ok( info->FileNameLength == wcslen( long_name ) * sizeof(WCHAR) &&
+                !memcmp( info->FileName, long_name, info->FileNameLength ),
+                "%s: got %s\n", debugstr_w(short_name),
+                debugstr_wn( info->FileName, info->FileNameLength / sizeof(WCHAR) ));
+        pNtClose( handle );
+    }
+    else ok( 0, "no short name for %s\n", debugstr_w(long_name) );
+
+    pRtlFreeUnicodeString( &ntdirname );
+    free( seen );
+done:
+    for (i = 0; i < count; i++)
+    {
+        swprintf( path, MAX_PATH, L"%s\\long file name %u.txt", testdir, i );
+        if (!DeleteFileW( path )) break;
+    }
+    RemoveDirectoryW( testdir );
+}
+
 START_TEST(directory)
 {
     WCHAR sysdir[MAX_PATH];
@@ -1065,5 +1205,6 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_NtQueryDirectoryFile_large();
     test_redirection();
 }
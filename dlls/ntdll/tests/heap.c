@@ -0,0 +1,202 @@
+/*
+ * Unit test suite for ntdll heap functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winbase.h"
+#include "winternl.h"
+#include "wine/heapinfo.h"
+#include "wine/test.h"
+
+static HEAP_WINE_STATISTICS *get_heap_statistics( HANDLE heap )
+{
+    HEAP_WINE_STATISTICS *stats;
+    SIZE_T size = 0;
+    NTSTATUS status;
+
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, NULL, 0, &size );
+    ok( status == STATUS_BUFFER_TOO_SMALL, "got status %#lx\n", status );
+    ok( size >= offsetof( HEAP_WINE_STATISTICS, Bins[0] ), "got size %Iu\n", size );
+
+    stats = malloc( size );
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, stats, size, NULL );
+    ok( !status, "got status %#lx\n", status );
+    ok( offsetof( HEAP_WINE_STATISTICS, Bins[stats->BinCount] ) == size, "got %lu bins, size %Iu\n",
+        stats->BinCount, size );
+    return stats;
+}
+
+static HEAP_WINE_ALLOCATION_SAMPLES *get_heap_samples( HANDLE heap )
+{
+    HEAP_WINE_ALLOCATION_SAMPLES *samples;
+    SIZE_T size = 0;
+    NTSTATUS status;
+
+    status = RtlQueryHeapInformation( heap, HeapWineAllocationSampling, NULL, 0, &size );
+    ok( status == STATUS_BUFFER_TOO_SMALL || (!status && size == offsetof( HEAP_WINE_ALLOCATION_SAMPLES, Samples[0] )),
+        "got status %#lx\n", status );
+
+    samples = malloc( size );
+    status = RtlQueryHeapInformation( heap, HeapWineAllocationSampling, samples, size, NULL );
+    ok( !status, "got status %#lx\n", status );
+    ok( offsetof( HEAP_WINE_ALLOCATION_SAMPLES, Samples[samples->Count] ) == size, "got %lu samples, size %Iu\n",
+        samples->Count, size );
+    return samples;
+}
+
+static void test_heap_statistics(void)
+{
+    HEAP_WINE_STATISTICS *stats, *new_stats;
+    void *ptrs[16], *large;
+    NTSTATUS status;
+    SIZE_T size;
+    HANDLE heap;
+    ULONG i;
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( !!heap, "HeapCreate failed, error %lu\n", GetLastError() );
+
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, NULL, 0, &size );
+    if (status != STATUS_BUFFER_TOO_SMALL)
+    {
+        win_skip( "HeapWineStatistics is not supported, status %#lx\n", status );
+        HeapDestroy( heap );
+        return;
+    }
+
+    stats = get_heap_statistics( heap );
+    ok( stats->BinCount > 0, "got %lu bins\n", stats->BinCount );
+    ok( stats->CommittedSize > 0, "got committed %#Ix\n", stats->CommittedSize );
+    ok( stats->CommittedSize <= stats->ReservedSize, "got committed %#Ix, reserved %#Ix\n",
+        stats->CommittedSize, stats->ReservedSize );
+    ok( stats->PeakCommittedSize >= stats->CommittedSize, "got peak %#Ix, committed %#Ix\n",
+        stats->PeakCommittedSize, stats->CommittedSize );
+    ok( stats->LargestFreeSize <= stats->FreeSize, "got largest free %#Ix, free %#Ix\n",
+        stats->LargestFreeSize, stats->FreeSize );
+    ok( !stats->LargeCount, "got %Iu large blocks\n", stats->LargeCount );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++) ptrs[i] = HeapAlloc( heap, 0, 0x100 );
+    large = HeapAlloc( heap, 0, 0x400000 );
+    ok( !!large, "HeapAlloc failed, error %lu\n", GetLastError() );
+
+    new_stats = get_heap_statistics( heap );
+    ok( new_stats->UsedCount == stats->UsedCount + ARRAY_SIZE(ptrs) + 1, "got %Iu used blocks, expected %Iu\n",
+        new_stats->UsedCount, stats->UsedCount + ARRAY_SIZE(ptrs) + 1 );
+    ok( new_stats->UsedSize == stats->UsedSize + ARRAY_SIZE(ptrs) * 0x100 + 0x400000, "got used %#Ix, expected %#Ix\n",
+        new_stats->UsedSize, stats->UsedSize + ARRAY_SIZE(ptrs) * 0x100 + 0x400000 );
+    ok( new_stats->LargeCount == 1, "got %Iu large blocks\n", new_stats->LargeCount );
+    ok( new_stats->LargeSize == 0x400000, "got large %#Ix\n", new_stats->LargeSize );
+    ok( new_stats->CommittedSize > stats->CommittedSize, "got committed %#Ix, previously %#Ix\n",
+        new_stats->CommittedSize, stats->CommittedSize );
+    free( new_stats );
+
+    HeapFree( heap, 0, large );
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++) HeapFree( heap, 0, ptrs[i] );
+
+    new_stats = get_heap_statistics( heap );
+    ok( new_stats->UsedCount == stats->UsedCount, "got %Iu used blocks, expected %Iu\n",
+        new_stats->UsedCount, stats->UsedCount );
+    ok( !new_stats->LargeCount, "got %Iu large blocks\n", new_stats->LargeCount );
+    ok( new_stats->PeakCommittedSize >= stats->CommittedSize + 0x400000, "got peak %#Ix\n",
+        new_stats->PeakCommittedSize );
+    free( new_stats );
+    free( stats );
+
+    /* setting the statistics dumps them to the heapstats channel */
+    status = RtlSetHeapInformation( heap, HeapWineStatistics, NULL, 0 );
+    ok( !status, "got status %#lx\n", status );
+
+    HeapDestroy( heap );
+}
+
+static void test_heap_allocation_sampling(void)
+{
+    HEAP_WINE_ALLOCATION_SAMPLES *samples;
+    NTSTATUS status;
+    void *ptrs[4];
+    ULONG i, rate;
+    SIZE_T size;
+    HANDLE heap;
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( !!heap, "HeapCreate failed, error %lu\n", GetLastError() );
+
+    status = RtlQueryHeapInformation( heap, HeapWineAllocationSampling, NULL, 0, &size );
+    if (status && status != STATUS_BUFFER_TOO_SMALL)
+    {
+        win_skip( "HeapWineAllocationSampling is not supported, status %#lx\n", status );
+        HeapDestroy( heap );
+        return;
+    }
+
+    samples = get_heap_samples( heap );
+    ok( !samples->Rate, "got rate %lu\n", samples->Rate );
+    ok( !samples->Count, "got %lu samples\n", samples->Count );
+    free( samples );
+
+    rate = 1;
+    status = RtlSetHeapInformation( heap, HeapWineAllocationSampling, &rate, sizeof(rate) - 1 );
+    ok( status == STATUS_BUFFER_TOO_SMALL, "got status %#lx\n", status );
+    rate = 0x80000000;
+    status = RtlSetHeapInformation( heap, HeapWineAllocationSampling, &rate, sizeof(rate) );
+    ok( status == STATUS_INVALID_PARAMETER, "got status %#lx\n", status );
+
+    rate = 1;
+    status = RtlSetHeapInformation( heap, HeapWineAllocationSampling, &rate, sizeof(rate) );
+    ok( !status, "got status %#lx\n", status );
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++) ptrs[i] = HeapAlloc( heap, 0, 0x30 + i );
+
+    samples = get_heap_samples( heap );
+    ok( samples->Rate == 1, "got rate %lu\n", samples->Rate );
+    ok( samples->Count == ARRAY_SIZE(ptrs), "got %lu samples\n", samples->Count );
+    for (i = 0; i < samples->Count && i < ARRAY_SIZE(ptrs); i++)
+    {
+        winetest_push_context( "%lu", i );
+        ok( samples->Samples[i].Address == ptrs[i], "got address %p, expected %p\n",
+            samples->Samples[i].Address, ptrs[i] );
+        ok( samples->Samples[i].Size == 0x30 + i, "got size %#Ix\n", samples->Samples[i].Size );
+        ok( samples->Samples[i].FrameCount <= HEAP_WINE_SAMPLE_FRAMES, "got %lu frames\n",
+            samples->Samples[i].FrameCount );
+        winetest_pop_context();
+    }
+    free( samples );
+
+    /* the samples are kept when sampling is disabled */
+    rate = 0;
+    status = RtlSetHeapInformation( heap, HeapWineAllocationSampling, &rate, sizeof(rate) );
+    ok( !status, "got status %#lx\n", status );
+    HeapFree( heap, 0, HeapAlloc( heap, 0, 0x30 ) );
+
+    samples = get_heap_samples( heap );
+    ok( !samples->Rate, "got rate %lu\n", samples->Rate );
+    ok( samples->Count == ARRAY_SIZE(ptrs), "got %lu samples\n", samples->Count );
+    free( samples );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++) HeapFree( heap, 0, ptrs[i] );
+    HeapDestroy( heap );
+}
+
+START_TEST(heap)
+{
+    test_heap_statistics();
+    test_heap_allocation_sampling();
+}
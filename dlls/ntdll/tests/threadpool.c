@@ -838,6 +838,96 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+static void CALLBACK work_count_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    InterlockedIncrement((LONG *)userdata);
+}
+
+struct post_work_info
+{
+    TP_WORK *work[3];
+    HANDLE start;
+};
+
+static DWORD CALLBACK post_work_thread(void *param)
+{
+    struct post_work_info *info = param;
+    int i, j;
+
+    WaitForSingleObject(info->start, INFINITE);
+    for (i = 0; i < 200; i++)
+        for (j = 0; j < ARRAY_SIZE(info->work); j++)
+            pTpPostWork(info->work[j]);
+    return 0;
+}
+
+static void test_tp_work_many(void)
+{
+    TP_CALLBACK_ENVIRON_V3 environment;
+    struct post_work_info info[4];
+    LONG userdata[4][3];
+    HANDLE threads[4];
+    TP_POOL *pool;
+    NTSTATUS status;
+    HANDLE start;
+    int i, j;
+
+    /* allocate new threadpool */
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %lx\n", status);
+    ok(pool != NULL, "expected pool != NULL\n");
+    pTpSetPoolMaxThreads(pool, 4);
+
+    start = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(start != NULL, "CreateEventW failed (%lu)\n", GetLastError());
+
+    /* post work items with all priorities from several threads at once */
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 3;
+    environment.Pool = pool;
+    environment.Size = sizeof(environment);
+    for (i = 0; i < ARRAY_SIZE(info); i++)
+    {
+        info[i].start = start;
+        for (j = 0; j < ARRAY_SIZE(info[i].work); j++)
+        {
+            userdata[i][j] = 0;
+            environment.CallbackPriority = TP_CALLBACK_PRIORITY_HIGH + j;
+            info[i].work[j] = NULL;
+            status = pTpAllocWork(&info[i].work[j], work_count_cb, &userdata[i][j],
+                                  (TP_CALLBACK_ENVIRON *)&environment);
+            ok(!status, "TpAllocWork failed with status %lx\n", status);
+            ok(info[i].work[j] != NULL, "expected work != NULL\n");
+        }
+        threads[i] = CreateThread(NULL, 0, post_work_thread, &info[i], 0, NULL);
+        ok(threads[i] != NULL, "CreateThread failed (%lu)\n", GetLastError());
+    }
+    SetEvent(start);
+
+    for (i = 0; i < ARRAY_SIZE(info); i++)
+    {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+
+    /* all callbacks run, none of them is lost or executed twice */
+    for (i = 0; i < ARRAY_SIZE(info); i++)
+    {
+        for (j = 0; j < ARRAY_SIZE(info[i].work); j++)
+        {
+            pTpWaitForWork(info[i].work[j], FALSE);
+            ok(userdata[i][j] == 200, "thread %d priority %d: expected userdata = 200, got %lu\n",
+               i, j, userdata[i][j]);
+            pTpReleaseWork(info[i].work[j]);
+        }
+    }
+
+    /* cleanup */
+    CloseHandle(start);
+    pTpReleasePool(pool);
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -1628,6 +1718,80 @@ static void test_tp_window_length(void)
     CloseHandle(semaphore);
 }
 
+struct many_timers_info
+{
+    HANDLE semaphore;
+    LONG remaining;
+    TP_TIMER *timers[200];
+    LONG fired[200];
+};
+
+static void CALLBACK many_timers_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_TIMER *timer)
+{
+    struct many_timers_info *info = userdata;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(info->timers); i++)
+        if (info->timers[i] == timer) InterlockedIncrement(&info->fired[i]);
+    if (!InterlockedDecrement(&info->remaining))
+        ReleaseSemaphore(info->semaphore, 1, NULL);
+}
+
+static void test_tp_many_timers(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    struct many_timers_info info;
+    LARGE_INTEGER when;
+    NTSTATUS status;
+    TP_POOL *pool;
+    DWORD result;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    info.semaphore = CreateSemaphoreA(NULL, 0, 1, NULL);
+    ok(info.semaphore != NULL, "CreateSemaphoreA failed %lu\n", GetLastError());
+    info.remaining = ARRAY_SIZE(info.timers) / 2;
+
+    /* allocate new threadpool */
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %lx\n", status);
+    ok(pool != NULL, "expected pool != NULL\n");
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+
+    for (i = 0; i < ARRAY_SIZE(info.timers); i++)
+    {
+        status = pTpAllocTimer(&info.timers[i], many_timers_cb, &info, &environment);
+        ok(!status, "TpAllocTimer failed with status %lx\n", status);
+        ok(info.timers[i] != NULL, "expected timer != NULL\n");
+    }
+
+    /* arm timers with interleaved timeouts, then cancel every second one */
+    for (i = ARRAY_SIZE(info.timers) - 1; i >= 0; i--)
+    {
+        when.QuadPart = (ULONGLONG)(200 + (i % 10) * 20) * -10000;
+        pTpSetTimer(info.timers[i], &when, 0, 0);
+    }
+    for (i = 0; i < ARRAY_SIZE(info.timers); i += 2)
+        pTpSetTimer(info.timers[i], NULL, 0, 0);
+
+    result = WaitForSingleObject(info.semaphore, 2000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %lu\n", result);
+    for (i = 0; i < ARRAY_SIZE(info.timers); i++)
+    {
+        pTpWaitForTimer(info.timers[i], FALSE);
+        ok(info.fired[i] == (i & 1), "timer %d: expected %d callbacks, got %ld\n", i, i & 1, info.fired[i]);
+        pTpReleaseTimer(info.timers[i]);
+    }
+
+    /* cleanup */
+    pTpReleasePool(pool);
+    CloseHandle(info.semaphore);
+}
+
 struct wait_info
 {
     HANDLE semaphore;
@@ -2398,12 +2562,14 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_many();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
     test_tp_disassociate();
     test_tp_timer();
     test_tp_window_length();
+    test_tp_many_timers();
     test_tp_wait();
     test_tp_multi_wait();
     test_tp_io();
@@ -2492,6 +2492,154 @@ static void test_query_region_information(void)
     NtClose(mapping);
 }
 
+static void test_write_watch_large(void)
+{
+    static const SIZE_T page_count = 16384;
+    ULONG_PTR count, i, expected;
+    SIZE_T size, decommit_size;
+    void **addresses;
+    NTSTATUS status;
+    ULONG granularity;
+    char *base, *addr;
+
+    base = NULL;
+    size = page_count * page_size;
+    status = NtAllocateVirtualMemory(NtCurrentProcess(), (void **)&base, 0, &size,
+                                     MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE);
+    ok(status == STATUS_SUCCESS, "Unexpected status %08lx.\n", status);
+    addresses = malloc(page_count * sizeof(*addresses));
+
+    count = page_count;
+    status = NtGetWriteWatch(NtCurrentProcess(), 0, base, size, addresses, &count, &granularity);
+    ok(!status, "Unexpected status %08lx.\n", status);
+    ok(!count, "Unexpected count %Iu.\n", count);
+
+    for (i = 0; i < page_count; i += 16) base[i * page_size + 1] = 1;
+
+    /* only the scanned part is reset */
+    count = page_count / 32;
+    status = NtGetWriteWatch(NtCurrentProcess(), WRITE_WATCH_FLAG_RESET, base, size, addresses, &count, &granularity);
+    ok(!status, "Unexpected status %08lx.\n", status);
+    ok(count == page_count / 32, "Unexpected count %Iu.\n", count);
+    ok(granularity == page_size, "Unexpected granularity %lu.\n", granularity);
+    for (i = 0; i < count; i++)
+        if (addresses[i] != base + i * 16 * page_size) break;
+    ok(i == count, "Unexpected address %p at %Iu.\n", addresses[i], i);
+
+    count = page_count;
+    status = NtGetWriteWatch(NtCurrentProcess(), 0, base, size, addresses, &count, &granularity);
+    ok(!status, "Unexpected status %08lx.\n", status);
+    ok(count == page_count / 32, "Unexpected count %Iu.\n", count);
+    ok(addresses[0] == base + page_count / 2 * page_size, "Unexpected address %p.\n", addresses[0]);
+
+    /* decommitted pages are still watched once committed again */
+    addr = base + page_count / 4 * page_size;
+    decommit_size = 16 * page_size;
+    status = NtFreeVirtualMemory(NtCurrentProcess(), (void **)&addr, &decommit_size, MEM_DECOMMIT);
+    ok(status == STATUS_SUCCESS, "Unexpected status %08lx.\n", status);
+    status = NtAllocateVirtualMemory(NtCurrentProcess(), (void **)&addr, 0, &decommit_size, MEM_COMMIT, PAGE_READWRITE);
+    ok(status == STATUS_SUCCESS, "Unexpected status %08lx.\n", status);
+    addr[5 * page_size] = 1;
+
+    count = page_count;
+    status = NtGetWriteWatch(NtCurrentProcess(), WRITE_WATCH_FLAG_RESET, base, page_count / 2 * page_size,
+                             addresses, &count, &granularity);
+    ok(!status, "Unexpected status %08lx.\n", status);
+    ok(count == 1, "Unexpected count %Iu.\n", count);
+    ok(addresses[0] == addr + 5 * page_size, "Unexpected address %p.\n", addresses[0]);
+
+    status = NtResetWriteWatch(NtCurrentProcess(), base, size);
+    ok(!status, "Unexpected status %08lx.\n", status);
+    for (i = 0, expected = 0; i < page_count; i += 7, expected++) base[i * page_size] = 1;
+    count = page_count;
+    status = NtGetWriteWatch(NtCurrentProcess(), 0, base, size, addresses, &count, &granularity);
+    ok(!status, "Unexpected status %08lx.\n", status);
+    ok(count == expected, "Unexpected count %Iu, expected %Iu.\n", count, expected);
+
+    free(addresses);
+    size = 0;
+    status = NtFreeVirtualMemory(NtCurrentProcess(), (void **)&base, &size, MEM_RELEASE);
+    ok(status == STATUS_SUCCESS, "Unexpected status %08lx.\n", status);
+}
+
+struct concurrent_query_info
+{
+    char *ptr;
+    SIZE_T size;
+    LONG done;
+};
+
+static DWORD WINAPI concurrent_query_thread(void *arg)
+{
+    struct concurrent_query_info *info = arg;
+    SIZE_T size;
+    DWORD old_prot;
+    NTSTATUS status;
+    void *ptr;
+    int i;
+
+    for (i = 0; !ReadAcquire(&info->done); i++)
+    {
+        VirtualProtect(info->ptr + (i % 16) * page_size, page_size,
+                       (i / 16) & 1 ? PAGE_READWRITE : PAGE_READONLY, &old_prot);
+
+        /* also modify the views tree */
+        ptr = NULL;
+        size = page_size;
+        status = NtAllocateVirtualMemory(NtCurrentProcess(), &ptr, 0, &size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (status) break;
+        size = 0;
+        NtFreeVirtualMemory(NtCurrentProcess(), &ptr, &size, MEM_RELEASE);
+    }
+    return 0;
+}
+
+static void test_query_concurrent(void)
+{
+    struct concurrent_query_info info;
+    MEMORY_BASIC_INFORMATION mbi;
+    unsigned int i, failures = 0;
+    NTSTATUS status;
+    HANDLE thread;
+    SIZE_T len;
+
+    info.ptr = NULL;
+    info.size = 16 * page_size;
+    info.done = 0;
+    status = NtAllocateVirtualMemory(NtCurrentProcess(), (void **)&info.ptr, 0, &info.size,
+                                     MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(status == STATUS_SUCCESS, "Unexpected status %08lx.\n", status);
+
+    thread = CreateThread(NULL, 0, concurrent_query_thread, &info, 0, NULL);
+    ok(thread != NULL, "CreateThread failed %lu.\n", GetLastError());
+
+    for (i = 0; i < 20000; i++)
+    {
+        char *addr = info.ptr + (i % 16) * page_size;
+
+        status = NtQueryVirtualMemory(NtCurrentProcess(), addr, MemoryBasicInformation, &mbi, sizeof(mbi), &len);
+        if (status || mbi.BaseAddress != addr || mbi.AllocationBase != info.ptr ||
+            mbi.AllocationProtect != PAGE_READWRITE || mbi.State != MEM_COMMIT || mbi.Type != MEM_PRIVATE ||
+            (mbi.Protect != PAGE_READWRITE && mbi.Protect != PAGE_READONLY) ||
+            !mbi.RegionSize || mbi.RegionSize % page_size || addr + mbi.RegionSize > info.ptr + info.size)
+        {
+            if (!failures++)
+                ok(0, "%u: status %08lx, base %p, alloc base %p/%p, alloc prot %#lx, state %#lx, "
+                   "type %#lx, prot %#lx, size %#Ix.\n", i, status, mbi.BaseAddress, mbi.AllocationBase,
+                   info.ptr, mbi.AllocationProtect, mbi.State, mbi.Type, mbi.Protect, mbi.RegionSize);
+        }
+    }
+    ok(!failures, "got %u inconsistent results.\n", failures);
+
+    WriteRelease(&info.done, 1);
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+
+    len = 0;
+    status = NtFreeVirtualMemory(NtCurrentProcess(), (void **)&info.ptr, &len, MEM_RELEASE);
+    ok(status == STATUS_SUCCESS, "Unexpected status %08lx.\n", status);
+}
+
 static void test_query_image_information(void)
 {
     MEMORY_IMAGE_INFORMATION info;
@@ -2755,4 +2903,6 @@ START_TEST(virtual)
     test_syscalls();
     test_query_region_information();
     test_query_image_information();
+    test_query_concurrent();
+    test_write_watch_large();
 }
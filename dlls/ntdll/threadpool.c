@@ -29,6 +29,7 @@
 
 #include "wine/debug.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 
 #include "ntdll_misc.h"
 
@@ -71,7 +72,7 @@ struct timer_queue;
 struct queue_timer
 {
     struct timer_queue *q;
-    struct list entry;
+    struct rb_entry entry;
     ULONG runcount;             /* number of callbacks pending execution */
     RTL_WAITORTIMERCALLBACKFUNC callback;
     PVOID param;
@@ -86,7 +87,7 @@ struct timer_queue
 {
     DWORD magic;
     RTL_CRITICAL_SECTION cs;
-    struct list timers;         /* sorted by expiration time */
+    struct rb_tree timers;      /* sorted by expiration time */
     BOOL quit;                  /* queue should be deleted; once set, never unset */
     HANDLE event;
     HANDLE thread;
@@ -97,8 +98,21 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_MAX_QUEUES     64
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+/* queue of objects with pending callbacks. Threads submit work to the queue
+ * selected by their thread id, and workers look in their own queue first and
+ * steal work from the other queues when it is empty. */
+struct threadpool_queue
+{
+    RTL_SRWLOCK             lock;
+    /* Pools of work items, locked via .lock, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+    struct list             pools[3];
+    /* number of objects in each pool, updated with interlocked operations */
+    LONG                    counts[3];
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -106,16 +120,18 @@ struct threadpool
     LONG                    objcount;
     BOOL                    shutdown;
     CRITICAL_SECTION        cs;
-    /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
-    struct list             pools[3];
     RTL_CONDITION_VARIABLE  update_event;
-    /* information about worker threads, locked via .cs */
-    int                     max_workers;
-    int                     min_workers;
-    int                     num_workers;
-    int                     num_busy_workers;
+    /* information about worker threads, modified under .cs but read without it */
+    LONG                    max_workers;
+    LONG                    min_workers;
+    LONG                    num_workers;
+    LONG                    num_idle_workers;
+    /* number of queued objects and running callbacks, updated with interlocked operations */
+    LONG                    num_busy_workers;
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
+    unsigned int            queue_count;
+    struct threadpool_queue queues[1];
 };
 
 enum threadpool_objtype
@@ -152,11 +168,16 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
-    /* information about the pool, locked via .pool->cs */
+    /* entry in a pool queue, locked via .queue->lock */
     struct list             pool_entry;
+    struct threadpool_queue *queue;
+    LONG                    queued;
+    /* information about the pool, locked via .pool->cs */
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
     HANDLE                  completed_event;
+    LONG                    num_waiters;
+    /* callback counters, updated with interlocked operations */
     LONG                    num_pending_callbacks;
     LONG                    num_running_callbacks;
     LONG                    num_associated_callbacks;
@@ -177,7 +198,7 @@ struct threadpool_object
             /* information about the timer, locked via timerqueue.cs */
             BOOL            timer_initialized;
             BOOL            timer_pending;
-            struct list     timer_entry;
+            struct rb_entry timer_entry;
             BOOL            timer_set;
             ULONGLONG       timeout;
             LONG            period;
@@ -235,6 +256,16 @@ struct threadpool_group
     struct list             members;
 };
 
+static int compare_timer_timeout( const void *key, const struct rb_entry *entry )
+{
+    const struct threadpool_object *a = key;
+    const struct threadpool_object *b = RB_ENTRY_VALUE( entry, const struct threadpool_object, u.timer.timer_entry );
+
+    if (a->u.timer.timeout != b->u.timer.timeout) return a->u.timer.timeout < b->u.timer.timeout ? -1 : 1;
+    if (a != b) return a < b ? -1 : 1;
+    return 0;
+}
+
 /* global timerqueue object */
 static RTL_CRITICAL_SECTION_DEBUG timerqueue_debug;
 
@@ -243,7 +274,7 @@ static struct
     CRITICAL_SECTION        cs;
     LONG                    objcount;
     BOOL                    thread_running;
-    struct list             pending_timers;
+    struct rb_tree          pending_timers;
     RTL_CONDITION_VARIABLE  update_event;
 }
 timerqueue =
@@ -251,7 +282,7 @@ timerqueue =
     { &timerqueue_debug, -1, 0, 0, 0, 0 },      /* cs */
     0,                                          /* objcount */
     FALSE,                                      /* thread_running */
-    LIST_INIT( timerqueue.pending_timers ),     /* pending_timers */
+    { compare_timer_timeout },                  /* pending_timers */
     RTL_CONDITION_VARIABLE_INIT                 /* update_event */
 };
 
@@ -363,7 +394,7 @@ static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CAL
 
 static void CALLBACK threadpool_worker_proc( void *param );
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled );
-static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread );
+static BOOL tp_object_execute( struct threadpool_object *object, BOOL wait_thread );
 static void tp_object_prepare_shutdown( struct threadpool_object *object );
 static BOOL tp_object_release( struct threadpool_object *object );
 static struct threadpool *default_threadpool = NULL;
@@ -556,6 +587,24 @@ static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout
 
 /************************** Timer Queue Impl **************************/
 
+static int compare_queue_timer(const void *key, const struct rb_entry *entry)
+{
+    const struct queue_timer *a = key;
+    const struct queue_timer *b = RB_ENTRY_VALUE(entry, const struct queue_timer, entry);
+
+    /* Destroyed timers are sorted after all other timers that never expire.  */
+    if (a->expire != b->expire) return a->expire < b->expire ? -1 : 1;
+    if (a->destroy != b->destroy) return a->destroy ? 1 : -1;
+    if (a != b) return a < b ? -1 : 1;
+    return 0;
+}
+
+static inline struct queue_timer *queue_first_timer(struct timer_queue *q)
+{
+    struct rb_entry *ptr = rb_head(q->timers.root);
+    return ptr ? RB_ENTRY_VALUE(ptr, struct queue_timer, entry) : NULL;
+}
+
 static void queue_remove_timer(struct queue_timer *t)
 {
     /* We MUST hold the queue cs while calling this function.  This ensures
@@ -566,12 +615,12 @@ static void queue_remove_timer(struct queue_timer *t)
     assert(t->runcount == 0);
     assert(t->destroy);
 
-    list_remove(&t->entry);
+    rb_remove(&q->timers, &t->entry);
     if (t->event)
         NtSetEvent(t->event, NULL);
     RtlFreeHeap(GetProcessHeap(), 0, t);
 
-    if (q->quit && list_empty(&q->timers))
+    if (q->quit && !q->timers.root)
         NtSetEvent(q->event, NULL);
 }
 
@@ -609,24 +658,15 @@ static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
 {
     /* We MUST hold the queue cs while calling this function.  */
     struct timer_queue *q = t->q;
-    struct list *ptr = &q->timers;
 
     assert(!q->quit || (t->destroy && time == EXPIRE_NEVER));
 
-    if (time != EXPIRE_NEVER)
-        LIST_FOR_EACH(ptr, &q->timers)
-        {
-            struct queue_timer *cur = LIST_ENTRY(ptr, struct queue_timer, entry);
-            if (time < cur->expire)
-                break;
-        }
-    list_add_before(ptr, &t->entry);
-
     t->expire = time;
+    rb_put(&q->timers, t, &t->entry);
 
-    /* If we insert at the head of the list, we need to expire sooner
+    /* If we insert at the head of the tree, we need to expire sooner
        than expected.  */
-    if (set_event && &t->entry == list_head(&q->timers))
+    if (set_event && t == queue_first_timer(q))
         NtSetEvent(q->event, NULL);
 }
 
@@ -634,19 +674,18 @@ static inline void queue_move_timer(struct queue_timer *t, ULONGLONG time,
                                     BOOL set_event)
 {
     /* We MUST hold the queue cs while calling this function.  */
-    list_remove(&t->entry);
+    rb_remove(&t->q->timers, &t->entry);
     queue_add_timer(t, time, set_event);
 }
 
-static void queue_timer_expire(struct timer_queue *q)
+static BOOL queue_timer_expire(struct timer_queue *q)
 {
-    struct queue_timer *t = NULL;
+    struct queue_timer *t;
 
     RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    if ((t = queue_first_timer(q)))
     {
         ULONGLONG now, next;
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
         if (!t->destroy && t->expire <= ((now = queue_current_time())))
         {
             ++t->runcount;
@@ -681,6 +720,7 @@ static void queue_timer_expire(struct timer_queue *q)
                 timer_cleanup_callback(t);
         }
     }
+    return t != NULL;
 }
 
 static ULONG queue_get_timeout(struct timer_queue *q)
@@ -689,9 +729,8 @@ static ULONG queue_get_timeout(struct timer_queue *q)
     ULONG timeout = INFINITE;
 
     RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    if ((t = queue_first_timer(q)))
     {
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
         assert(!t->destroy || t->expire == EXPIRE_NEVER);
 
         if (t->expire != EXPIRE_NEVER)
@@ -728,12 +767,13 @@ static void WINAPI timer_queue_thread_proc(LPVOID p)
                timer got put at the head of the list so we need to adjust
                our timeout.  */
             RtlEnterCriticalSection(&q->cs);
-            if (q->quit && list_empty(&q->timers))
+            if (q->quit && !q->timers.root)
                 done = TRUE;
             RtlLeaveCriticalSection(&q->cs);
         }
         else if (status == STATUS_TIMEOUT)
-            queue_timer_expire(q);
+            /* Fire all expired timers without waiting again in between.  */
+            while (queue_timer_expire(q));
 
         if (done)
             break;
@@ -759,7 +799,7 @@ static void queue_destroy_timer(struct queue_timer *t)
         queue_remove_timer(t);
     else
         /* Make sure no destroyed timer masks an active timer at the head
-           of the sorted list.  */
+           of the sorted tree.  */
         queue_move_timer(t, EXPIRE_NEVER, FALSE);
 }
 
@@ -783,7 +823,7 @@ NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
         return STATUS_NO_MEMORY;
 
     RtlInitializeCriticalSection(&q->cs);
-    list_init(&q->timers);
+    rb_init(&q->timers, compare_queue_timer);
     q->quit = FALSE;
     q->magic = TIMER_QUEUE_MAGIC;
     status = NtCreateEvent(&q->event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
@@ -824,7 +864,7 @@ NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
 NTSTATUS WINAPI RtlDeleteTimerQueueEx(HANDLE TimerQueue, HANDLE CompletionEvent)
 {
     struct timer_queue *q = TimerQueue;
-    struct queue_timer *t, *temp;
+    struct queue_timer *t;
     HANDLE thread;
     NTSTATUS status;
 
@@ -835,10 +875,11 @@ NTSTATUS WINAPI RtlDeleteTimerQueueEx(HANDLE TimerQueue, HANDLE CompletionEvent)
 
     RtlEnterCriticalSection(&q->cs);
     q->quit = TRUE;
-    if (list_head(&q->timers))
+    if (q->timers.root)
         /* When the last timer is removed, it will signal the timer thread to
-           exit...  */
-        LIST_FOR_EACH_ENTRY_SAFE(t, temp, &q->timers, struct queue_timer, entry)
+           exit...  Destroyed timers are moved to the end of the tree, so we
+           are done when we reach the first one.  */
+        while ((t = queue_first_timer(q)) && !t->destroy)
             queue_destroy_timer(t);
     else
         /* However if we have none, we must do it ourselves.  */
@@ -1057,7 +1098,7 @@ static void CALLBACK timerqueue_thread_proc( void *param )
     ULONGLONG timeout_lower, timeout_upper, new_timeout;
     struct threadpool_object *other_timer;
     LARGE_INTEGER now, timeout;
-    struct list *ptr;
+    struct rb_entry *ptr;
 
     TRACE( "starting timer queue thread\n" );
     set_thread_name(L"wine_threadpool_timerqueue");
@@ -1068,16 +1109,16 @@ static void CALLBACK timerqueue_thread_proc( void *param )
         NtQuerySystemTime( &now );
 
         /* Check for expired timers. */
-        while ((ptr = list_head( &timerqueue.pending_timers )))
+        while ((ptr = rb_head( timerqueue.pending_timers.root )))
         {
-            struct threadpool_object *timer = LIST_ENTRY( ptr, struct threadpool_object, u.timer.timer_entry );
+            struct threadpool_object *timer = RB_ENTRY_VALUE( ptr, struct threadpool_object, u.timer.timer_entry );
             assert( timer->type == TP_OBJECT_TYPE_TIMER );
             assert( timer->u.timer.timer_pending );
             if (timer->u.timer.timeout > now.QuadPart)
                 break;
 
             /* Queue a new callback in one of the worker threads. */
-            list_remove( &timer->u.timer.timer_entry );
+            rb_remove( &timerqueue.pending_timers, &timer->u.timer.timer_entry );
             timer->u.timer.timer_pending = FALSE;
             tp_object_submit( timer, FALSE );
 
@@ -1088,14 +1129,7 @@ static void CALLBACK timerqueue_thread_proc( void *param )
                 if (timer->u.timer.timeout <= now.QuadPart)
                     timer->u.timer.timeout = now.QuadPart + 1;
 
-                LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                                     struct threadpool_object, u.timer.timer_entry )
-                {
-                    assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
-                    if (timer->u.timer.timeout < other_timer->u.timer.timeout)
-                        break;
-                }
-                list_add_before( &other_timer->u.timer.timer_entry, &timer->u.timer.timer_entry );
+                rb_put( &timerqueue.pending_timers, timer, &timer->u.timer.timer_entry );
                 timer->u.timer.timer_pending = TRUE;
             }
         }
@@ -1103,8 +1137,8 @@ static void CALLBACK timerqueue_thread_proc( void *param )
         timeout_lower = timeout_upper = MAXLONGLONG;
 
         /* Determine next timeout and use the window length to optimize wakeup times. */
-        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                             struct threadpool_object, u.timer.timer_entry )
+        RB_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
+                           struct threadpool_object, u.timer.timer_entry )
         {
             assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
             if (other_timer->u.timer.timeout >= timeout_upper)
@@ -1157,7 +1191,7 @@ static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
     if (status == STATUS_SUCCESS)
     {
         InterlockedIncrement( &pool->refcount );
-        pool->num_workers++;
+        InterlockedIncrement( &pool->num_workers );
         NtClose( thread );
     }
     return status;
@@ -1221,14 +1255,14 @@ static void tp_timerqueue_unlock( struct threadpool_object *timer )
         /* If timer was pending, remove it. */
         if (timer->u.timer.timer_pending)
         {
-            list_remove( &timer->u.timer.timer_entry );
+            rb_remove( &timerqueue.pending_timers, &timer->u.timer.timer_entry );
             timer->u.timer.timer_pending = FALSE;
         }
 
         /* If the last timer object was destroyed, then wake up the thread. */
         if (!--timerqueue.objcount)
         {
-            assert( list_empty( &timerqueue.pending_timers ) );
+            assert( !timerqueue.pending_timers.root );
             RtlWakeAllConditionVariable( &timerqueue.update_event );
         }
 
@@ -1276,10 +1310,8 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                 if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                 {
                     InterlockedIncrement( &wait->refcount );
-                    wait->num_pending_callbacks++;
-                    RtlEnterCriticalSection( &wait->pool->cs );
+                    InterlockedIncrement( &wait->num_pending_callbacks );
                     tp_object_execute( wait, TRUE );
-                    RtlLeaveCriticalSection( &wait->pool->cs );
                     tp_object_release( wait );
                 }
                 else tp_object_submit( wait, FALSE );
@@ -1332,11 +1364,11 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                     }
                     if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                     {
-                        wait->u.wait.signaled++;
-                        wait->num_pending_callbacks++;
                         RtlEnterCriticalSection( &wait->pool->cs );
-                        tp_object_execute( wait, TRUE );
+                        wait->u.wait.signaled++;
+                        InterlockedIncrement( &wait->num_pending_callbacks );
                         RtlLeaveCriticalSection( &wait->pool->cs );
+                        tp_object_execute( wait, TRUE );
                     }
                     else tp_object_submit( wait, TRUE );
                 }
@@ -1664,10 +1696,11 @@ static NTSTATUS tp_ioqueue_lock( struct threadpool_object *io, HANDLE file )
 static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 {
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->Peb->ImageBaseAddress );
+    unsigned int i, j, queue_count = NtCurrentTeb()->Peb->NumberOfProcessors;
     struct threadpool *pool;
-    unsigned int i;
 
-    pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) );
+    queue_count = max( 1, min( queue_count, THREADPOOL_MAX_QUEUES ) );
+    pool = RtlAllocateHeap( GetProcessHeap(), 0, offsetof( struct threadpool, queues[queue_count] ) );
     if (!pool)
         return STATUS_NO_MEMORY;
 
@@ -1678,13 +1711,23 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     RtlInitializeCriticalSectionEx( &pool->cs, 0, RTL_CRITICAL_SECTION_FLAG_FORCE_DEBUG_INFO );
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        list_init( &pool->pools[i] );
+    pool->queue_count = queue_count;
+    for (i = 0; i < queue_count; ++i)
+    {
+        struct threadpool_queue *queue = pool->queues + i;
+        RtlInitializeSRWLock( &queue->lock );
+        for (j = 0; j < ARRAY_SIZE(queue->pools); ++j)
+        {
+            list_init( &queue->pools[j] );
+            queue->counts[j] = 0;
+        }
+    }
     RtlInitializeConditionVariable( &pool->update_event );
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
     pool->num_workers             = 0;
+    pool->num_idle_workers        = 0;
     pool->num_busy_workers        = 0;
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
@@ -1717,7 +1760,7 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
  */
 static BOOL tp_threadpool_release( struct threadpool *pool )
 {
-    unsigned int i;
+    unsigned int i, j;
 
     if (InterlockedDecrement( &pool->refcount ))
         return FALSE;
@@ -1726,8 +1769,9 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
 
     assert( pool->shutdown );
     assert( !pool->objcount );
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        assert( list_empty( &pool->pools[i] ) );
+    for (i = 0; i < pool->queue_count; ++i)
+        for (j = 0; j < ARRAY_SIZE(pool->queues[i].pools); ++j)
+            assert( list_empty( &pool->queues[i].pools[j] ) );
 
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -1908,9 +1952,12 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     object->is_group_member         = FALSE;
 
     memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
+    object->queue                   = NULL;
+    object->queued                  = FALSE;
     RtlInitializeConditionVariable( &object->finished_event );
     RtlInitializeConditionVariable( &object->group_finished_event );
     object->completed_event         = NULL;
+    object->num_waiters             = 0;
     object->num_pending_callbacks   = 0;
     object->num_running_callbacks   = 0;
     object->num_associated_callbacks = 0;
@@ -1930,7 +1977,7 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
             TP_CALLBACK_ENVIRON_V3 *environment_v3 = (TP_CALLBACK_ENVIRON_V3 *)environment;
 
             object->priority = environment_v3->CallbackPriority;
-            assert( object->priority < ARRAY_SIZE(pool->pools) );
+            assert( object->priority < ARRAY_SIZE(pool->queues[0].pools) );
         }
 
         if (environment->ActivationContext)
@@ -1967,42 +2014,110 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
         tp_object_release( object );
 }
 
-static void tp_object_prio_queue( struct threadpool_object *object )
+static inline struct threadpool_queue *threadpool_current_queue( struct threadpool *pool )
 {
-    ++object->pool->num_busy_workers;
-    list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
+    return &pool->queues[(GetCurrentThreadId() >> 2) % pool->queue_count];
 }
 
 /***********************************************************************
- *           tp_object_submit    (internal)
+ *           tp_object_prio_queue    (internal)
  *
- * Submits a threadpool object to the associated threadpool. This
- * function has to be VOID because TpPostWork can never fail on Windows.
+ * Adds an object with pending callbacks to the queue of the current thread,
+ * unless it is already queued. Objects queued again after executing a
+ * callback go back to the end of their previous queue, so that callbacks
+ * of other objects are not starved. Returns TRUE if the object was added.
  */
-static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+static BOOL tp_object_prio_queue( struct threadpool_object *object, BOOL requeue )
 {
     struct threadpool *pool = object->pool;
+    struct threadpool_queue *queue;
+
+    if (InterlockedCompareExchange( &object->queued, TRUE, FALSE ))
+        return FALSE;
+
+    if (!requeue || !(queue = object->queue))
+        queue = threadpool_current_queue( pool );
+    object->queue = queue;
+
+    /* The queue entry keeps a reference until a worker removes it. */
+    InterlockedIncrement( &object->refcount );
+    InterlockedIncrement( &pool->num_busy_workers );
+
+    RtlAcquireSRWLockExclusive( &queue->lock );
+    list_add_tail( &queue->pools[object->priority], &object->pool_entry );
+    InterlockedIncrement( &queue->counts[object->priority] );
+    RtlReleaseSRWLockExclusive( &queue->lock );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           threadpool_get_next_item    (internal)
+ *
+ * Removes the next object from the queues, looking at the queue of the
+ * current thread first and stealing work from the other queues otherwise.
+ */
+static struct threadpool_object *threadpool_get_next_item( struct threadpool *pool )
+{
+    unsigned int i, j, start = threadpool_current_queue( pool ) - pool->queues;
+    struct list *ptr;
+
+    for (i = 0; i < ARRAY_SIZE(pool->queues[0].pools); ++i)
+    {
+        for (j = 0; j < pool->queue_count; ++j)
+        {
+            struct threadpool_queue *queue = &pool->queues[(start + j) % pool->queue_count];
+
+            if (!ReadNoFence( &queue->counts[i] )) continue;
+
+            RtlAcquireSRWLockExclusive( &queue->lock );
+            if ((ptr = list_head( &queue->pools[i] )))
+            {
+                list_remove( ptr );
+                InterlockedDecrement( &queue->counts[i] );
+            }
+            RtlReleaseSRWLockExclusive( &queue->lock );
+
+            if (ptr) return LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+        }
+    }
+
+    return NULL;
+}
+
+static BOOL threadpool_has_items( struct threadpool *pool )
+{
+    unsigned int i, j;
+
+    for (i = 0; i < pool->queue_count; ++i)
+        for (j = 0; j < ARRAY_SIZE(pool->queues[i].counts); ++j)
+            if (ReadAcquire( &pool->queues[i].counts[j] )) return TRUE;
+
+    return FALSE;
+}
+
+/***********************************************************************
+ *           tp_threadpool_wake_worker    (internal)
+ *
+ * Makes sure that a worker thread picks up a newly queued object,
+ * starting a new worker thread if all existing ones are busy.
+ */
+static void tp_threadpool_wake_worker( struct threadpool *pool )
+{
     NTSTATUS status = STATUS_UNSUCCESSFUL;
 
-    assert( !object->shutdown );
-    assert( !pool->shutdown );
+    /* The queue counters were updated with a full barrier, idle workers either
+     * see the new item before going to sleep or are seen here. */
+    if (!ReadNoFence( &pool->num_idle_workers ) &&
+        ReadNoFence( &pool->num_busy_workers ) <= ReadNoFence( &pool->num_workers ))
+        return;
 
     RtlEnterCriticalSection( &pool->cs );
 
     /* Start new worker threads if required. */
-    if (pool->num_busy_workers >= pool->num_workers &&
+    if (pool->num_busy_workers > pool->num_workers &&
         pool->num_workers < pool->max_workers)
         status = tp_new_worker_thread( pool );
 
-    /* Queue work item and increment refcount. */
-    InterlockedIncrement( &object->refcount );
-    if (!object->num_pending_callbacks++)
-        tp_object_prio_queue( object );
-
-    /* Count how often the object was signaled. */
-    if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
-        object->u.wait.signaled++;
-
     /* No new thread started - wake up one existing thread. */
     if (status != STATUS_SUCCESS)
     {
@@ -2013,6 +2128,38 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     RtlLeaveCriticalSection( &pool->cs );
 }
 
+/***********************************************************************
+ *           tp_object_submit    (internal)
+ *
+ * Submits a threadpool object to the associated threadpool. This
+ * function has to be VOID because TpPostWork can never fail on Windows.
+ */
+static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+{
+    struct threadpool *pool = object->pool;
+
+    assert( !object->shutdown );
+    assert( !pool->shutdown );
+
+    /* Increment refcount and the number of pending callbacks. */
+    InterlockedIncrement( &object->refcount );
+
+    /* Count how often the object was signaled. */
+    if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
+    {
+        RtlEnterCriticalSection( &pool->cs );
+        object->u.wait.signaled++;
+        InterlockedIncrement( &object->num_pending_callbacks );
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+    else
+        InterlockedIncrement( &object->num_pending_callbacks );
+
+    /* Queue work item, unless it is already queued. */
+    if (tp_object_prio_queue( object, FALSE ))
+        tp_threadpool_wake_worker( pool );
+}
+
 /***********************************************************************
  *           tp_object_cancel    (internal)
  *
@@ -2021,18 +2168,14 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 static void tp_object_cancel( struct threadpool_object *object )
 {
     struct threadpool *pool = object->pool;
-    LONG pending_callbacks = 0;
+    LONG pending_callbacks;
 
+    /* The object stays queued, workers drop the entry when they find no
+     * pending callbacks left. */
     RtlEnterCriticalSection( &pool->cs );
-    if (object->num_pending_callbacks)
-    {
-        pending_callbacks = object->num_pending_callbacks;
-        object->num_pending_callbacks = 0;
-        list_remove( &object->pool_entry );
-
-        if (object->type == TP_OBJECT_TYPE_WAIT)
-            object->u.wait.signaled = 0;
-    }
+    pending_callbacks = InterlockedExchange( &object->num_pending_callbacks, 0 );
+    if (pending_callbacks && object->type == TP_OBJECT_TYPE_WAIT)
+        object->u.wait.signaled = 0;
     if (object->type == TP_OBJECT_TYPE_IO)
     {
         object->u.io.skipped_count += object->u.io.pending_count;
@@ -2044,17 +2187,56 @@ static void tp_object_cancel( struct threadpool_object *object )
         tp_object_release( object );
 }
 
+/***********************************************************************
+ *           tp_object_claim_callback    (internal)
+ *
+ * Takes one of the pending callbacks, fails if they were cancelled.
+ */
+static BOOL tp_object_claim_callback( struct threadpool_object *object )
+{
+    LONG count = ReadNoFence( &object->num_pending_callbacks ), prev;
+
+    while (count > 0)
+    {
+        if ((prev = InterlockedCompareExchange( &object->num_pending_callbacks, count - 1, count )) == count)
+            return TRUE;
+        count = prev;
+    }
+    return FALSE;
+}
+
 static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
 {
-    if (object->num_pending_callbacks)
+    if (ReadAcquire( &object->num_pending_callbacks ))
         return FALSE;
     if (object->type == TP_OBJECT_TYPE_IO && object->u.io.pending_count)
         return FALSE;
 
     if (group)
-        return !object->num_running_callbacks;
+        return !ReadAcquire( &object->num_running_callbacks );
     else
-        return !object->num_associated_callbacks;
+        return !ReadAcquire( &object->num_associated_callbacks );
+}
+
+/***********************************************************************
+ *           tp_object_wake_waiters    (internal)
+ *
+ * Wakes up threads waiting for the object after its callback counters
+ * were decremented.
+ */
+static void tp_object_wake_waiters( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+
+    if (!ReadAcquire( &object->num_waiters ))
+        return;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (object_is_finished( object, TRUE ))
+        RtlWakeAllConditionVariable( &object->group_finished_event );
+    if (object_is_finished( object, FALSE ))
+        RtlWakeAllConditionVariable( &object->finished_event );
+    RtlLeaveCriticalSection( &pool->cs );
 }
 
 /***********************************************************************
@@ -2068,6 +2250,7 @@ static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
     struct threadpool *pool = object->pool;
 
     RtlEnterCriticalSection( &pool->cs );
+    InterlockedIncrement( &object->num_waiters );
     while (!object_is_finished( object, group_wait ))
     {
         if (group_wait)
@@ -2075,6 +2258,7 @@ static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
         else
             RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
     }
+    InterlockedDecrement( &object->num_waiters );
     RtlLeaveCriticalSection( &pool->cs );
 }
 
@@ -2152,53 +2336,62 @@ static BOOL tp_object_release( struct threadpool_object *object )
     return TRUE;
 }
 
-static struct list *threadpool_get_next_item( const struct threadpool *pool )
-{
-    struct list *ptr;
-    unsigned int i;
-
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-    {
-        if ((ptr = list_head( &pool->pools[i] )))
-            break;
-    }
-
-    return ptr;
-}
-
 /***********************************************************************
  *           tp_object_execute    (internal)
  *
- * Executes a threadpool object callback, object->pool->cs has to be
- * held.
+ * Executes one of the pending callbacks of a threadpool object. Returns
+ * FALSE if there was no pending callback left. If wait_thread is set,
+ * waitqueue.cs has to be held.
  */
-static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread )
+static BOOL tp_object_execute( struct threadpool_object *object, BOOL wait_thread )
 {
     TP_CALLBACK_INSTANCE *callback_instance;
     struct threadpool_instance instance;
     struct io_completion completion;
     struct threadpool *pool = object->pool;
     TP_WAIT_RESULT wait_result = 0;
+    BOOL locked, claimed;
     NTSTATUS status;
 
-    object->num_pending_callbacks--;
+    /* Count the callback as running before taking it from the pending ones,
+     * so that waiters never see the object as finished in between. */
+    InterlockedIncrement( &object->num_associated_callbacks );
+    InterlockedIncrement( &object->num_running_callbacks );
+
+    locked = object->type == TP_OBJECT_TYPE_WAIT || object->type == TP_OBJECT_TYPE_IO;
+    if (locked) RtlEnterCriticalSection( &pool->cs );
 
-    /* For wait objects check if they were signaled or have timed out. */
-    if (object->type == TP_OBJECT_TYPE_WAIT)
+    if ((claimed = tp_object_claim_callback( object )))
     {
-        wait_result = object->u.wait.signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
-        if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
+        /* For wait objects check if they were signaled or have timed out. */
+        if (object->type == TP_OBJECT_TYPE_WAIT)
+        {
+            wait_result = object->u.wait.signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+            if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
+        }
+        else if (object->type == TP_OBJECT_TYPE_IO)
+        {
+            assert( object->u.io.completion_count );
+            completion = object->u.io.completions[--object->u.io.completion_count];
+        }
     }
-    else if (object->type == TP_OBJECT_TYPE_IO)
+
+    if (locked) RtlLeaveCriticalSection( &pool->cs );
+
+    if (!claimed)
     {
-        assert( object->u.io.completion_count );
-        completion = object->u.io.completions[--object->u.io.completion_count];
+        InterlockedDecrement( &object->num_running_callbacks );
+        InterlockedDecrement( &object->num_associated_callbacks );
+        tp_object_wake_waiters( object );
+        return FALSE;
     }
 
-    /* Leave critical section and do the actual callback. */
-    object->num_associated_callbacks++;
-    object->num_running_callbacks++;
-    RtlLeaveCriticalSection( &pool->cs );
+    /* If further callbacks are pending, queue the object again so that
+     * other workers can run them in parallel. */
+    if (ReadNoFence( &object->num_pending_callbacks ) && tp_object_prio_queue( object, TRUE ))
+        tp_threadpool_wake_worker( pool );
+
+    /* Do the actual callback. */
     if (wait_thread) RtlLeaveCriticalSection( &waitqueue.cs );
 
     /* Initialize threadpool instance struct. */
@@ -2304,7 +2497,6 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
 
 skip_cleanup:
     if (wait_thread) RtlEnterCriticalSection( &waitqueue.cs );
-    RtlEnterCriticalSection( &pool->cs );
 
     /* Simple callbacks are automatically shutdown after execution. */
     if (object->type == TP_OBJECT_TYPE_SIMPLE)
@@ -2313,16 +2505,11 @@ skip_cleanup:
         object->shutdown = TRUE;
     }
 
-    object->num_running_callbacks--;
-    if (object_is_finished( object, TRUE ))
-        RtlWakeAllConditionVariable( &object->group_finished_event );
-
+    InterlockedDecrement( &object->num_running_callbacks );
     if (instance.associated)
-    {
-        object->num_associated_callbacks--;
-        if (object_is_finished( object, FALSE ))
-            RtlWakeAllConditionVariable( &object->finished_event );
-    }
+        InterlockedDecrement( &object->num_associated_callbacks );
+    tp_object_wake_waiters( object );
+    return TRUE;
 }
 
 /***********************************************************************
@@ -2331,52 +2518,62 @@ skip_cleanup:
 static void CALLBACK threadpool_worker_proc( void *param )
 {
     struct threadpool *pool = param;
+    struct threadpool_object *object;
     LARGE_INTEGER timeout;
-    struct list *ptr;
+    NTSTATUS status;
 
     TRACE( "starting worker thread for pool %p\n", pool );
     set_thread_name(L"wine_threadpool_worker");
 
-    RtlEnterCriticalSection( &pool->cs );
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
+        while ((object = threadpool_get_next_item( pool )))
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
-            assert( object->num_pending_callbacks > 0 );
+            /* Further callbacks submitted from now on queue the object again. */
+            InterlockedExchange( &object->queued, FALSE );
 
-            /* If further pending callbacks are queued, move the work item to
-             * the end of the pool list. Otherwise remove it from the pool. */
-            list_remove( &object->pool_entry );
-            if (object->num_pending_callbacks > 1)
-                tp_object_prio_queue( object );
-
-            tp_object_execute( object, FALSE );
+            /* Entries of cancelled objects have no pending callbacks left. */
+            if (tp_object_execute( object, FALSE ))
+                tp_object_release( object );
 
-            assert(pool->num_busy_workers);
-            pool->num_busy_workers--;
+            assert( ReadNoFence( &pool->num_busy_workers ) > 0 );
+            InterlockedDecrement( &pool->num_busy_workers );
 
             tp_object_release( object );
         }
 
+        RtlEnterCriticalSection( &pool->cs );
+
         /* Shutdown worker thread if requested. */
-        if (pool->shutdown)
+        if (pool->shutdown && !threadpool_has_items( pool ))
+        {
+            InterlockedDecrement( &pool->num_workers );
             break;
+        }
 
         /* Wait for new tasks or until the timeout expires. A thread only terminates
          * when no new tasks are available, and the number of threads can be
          * decreased without violating the min_workers limit. An exception is when
          * min_workers == 0, then objcount is used to detect if the last thread
          * can be terminated. */
+        InterlockedIncrement( &pool->num_idle_workers );
         timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
-            (!pool->min_workers && !pool->objcount)))
+        if (threadpool_has_items( pool ) || pool->shutdown) status = STATUS_SUCCESS;
+        else status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        InterlockedDecrement( &pool->num_idle_workers );
+
+        if (status == STATUS_TIMEOUT && !threadpool_has_items( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) || (!pool->min_workers && !pool->objcount)))
         {
-            break;
+            /* Objects queued before the thread count was decremented are still
+             * visible here, later ones start or wake another thread. */
+            InterlockedDecrement( &pool->num_workers );
+            if (!threadpool_has_items( pool )) break;
+            InterlockedIncrement( &pool->num_workers );
         }
+
+        RtlLeaveCriticalSection( &pool->cs );
     }
-    pool->num_workers--;
     RtlLeaveCriticalSection( &pool->cs );
 
     TRACE( "terminating worker thread for pool %p\n", pool );
@@ -2707,7 +2904,6 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
 {
     struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
     struct threadpool_object *object = this->object;
-    struct threadpool *pool;
 
     TRACE( "%p\n", instance );
 
@@ -2720,14 +2916,8 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
     if (!this->associated)
         return;
 
-    pool = object->pool;
-    RtlEnterCriticalSection( &pool->cs );
-
-    object->num_associated_callbacks--;
-    if (object_is_finished( object, FALSE ))
-        RtlWakeAllConditionVariable( &object->finished_event );
-
-    RtlLeaveCriticalSection( &pool->cs );
+    InterlockedDecrement( &object->num_associated_callbacks );
+    tp_object_wake_waiters( object );
     this->associated = FALSE;
 }
 
@@ -2946,7 +3136,7 @@ BOOL WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
 
     RtlEnterCriticalSection( &this->cs );
 
-    while (this->num_workers < minimum)
+    while (this->num_workers < (LONG)minimum)
     {
         status = tp_new_worker_thread( this );
         if (status != STATUS_SUCCESS)
@@ -2969,7 +3159,6 @@ BOOL WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
 VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LONG window_length )
 {
     struct threadpool_object *this = impl_from_TP_TIMER( timer );
-    struct threadpool_object *other_timer;
     BOOL submit_timer = FALSE;
     ULONGLONG timestamp;
 
@@ -3008,7 +3197,7 @@ VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LO
     /* First remove existing timeout. */
     if (this->u.timer.timer_pending)
     {
-        list_remove( &this->u.timer.timer_entry );
+        rb_remove( &timerqueue.pending_timers, &this->u.timer.timer_entry );
         this->u.timer.timer_pending = FALSE;
     }
 
@@ -3019,17 +3208,10 @@ VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LO
         this->u.timer.period        = period;
         this->u.timer.window_length = window_length;
 
-        LIST_FOR_EACH_ENTRY( other_timer, &timerqueue.pending_timers,
-                             struct threadpool_object, u.timer.timer_entry )
-        {
-            assert( other_timer->type == TP_OBJECT_TYPE_TIMER );
-            if (this->u.timer.timeout < other_timer->u.timer.timeout)
-                break;
-        }
-        list_add_before( &other_timer->u.timer.timer_entry, &this->u.timer.timer_entry );
+        rb_put( &timerqueue.pending_timers, this, &this->u.timer.timer_entry );
 
         /* Wake up the timer thread when the timeout has to be updated. */
-        if (list_head( &timerqueue.pending_timers ) == &this->u.timer.timer_entry )
+        if (rb_head( timerqueue.pending_timers.root ) == &this->u.timer.timer_entry)
             RtlWakeAllConditionVariable( &timerqueue.update_event );
 
         this->u.timer.timer_pending = TRUE;
@@ -49,6 +49,11 @@
 #ifdef HAVE_SYS_SYSCALL_H
 # include <sys/syscall.h>
 #endif
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+# include <sys/mman.h>
+# include <linux/io_uring.h>
+# define USE_IO_URING
+#endif
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/ioctl.h>
@@ -216,7 +221,7 @@ struct dir_data_buffer
 struct dir_data_names
 {
     const WCHAR *long_name;          /* long file name in Unicode */
-    const WCHAR *short_name;         /* short file name in Unicode */
+    const WCHAR *short_name;         /* short file name in Unicode, NULL if not generated yet */
     const char  *unix_name;          /* Unix file name in host encoding */
 };
 
@@ -228,11 +233,16 @@ struct dir_data
     struct file_identity    id;      /* directory file identity */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
+    BOOL                    streamed; /* directory too large to be read at once, read as a stream */
+    DIR                    *dir;     /* directory stream, closed once the end has been reached */
+    BOOL                    eof;     /* end of the directory stream has been reached */
+    UNICODE_STRING          mask;    /* search mask for reading the rest of the stream */
 };
 
 static const unsigned int dir_data_buffer_initial_size = 4096;
 static const unsigned int dir_data_cache_initial_size  = 256;
 static const unsigned int dir_data_names_initial_size  = 64;
+static const unsigned int dir_data_sort_limit          = 16384;  /* larger directories are returned unsorted */
 
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
@@ -498,7 +508,8 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
         data->names = names;
     }
 
-    if (short_name[0])
+    if (!short_name) names[data->count].short_name = NULL;
+    else if (short_name[0])
     {
         if (!(names[data->count].short_name = add_dir_data_nameW( data, short_name ))) return FALSE;
     }
@@ -510,6 +521,24 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
     return TRUE;
 }
 
+/* remove all the entries from the directory data, keeping the largest buffer for reuse */
+static void reset_dir_data( struct dir_data *data )
+{
+    struct dir_data_buffer *buffer, *next;
+
+    if (data->buffer)
+    {
+        for (buffer = data->buffer->next; buffer; buffer = next)
+        {
+            next = buffer->next;
+            free( buffer );
+        }
+        data->buffer->next = NULL;
+        data->buffer->pos = 0;
+    }
+    data->count = data->pos = 0;
+}
+
 /* free the complete directory data structure */
 static void free_dir_data( struct dir_data *data )
 {
@@ -522,6 +551,8 @@ static void free_dir_data( struct dir_data *data )
         next = buffer->next;
         free( buffer );
     }
+    if (data->dir) closedir( data->dir );
+    free( data->mask.Buffer );
     free( data->names );
     free( data );
 }
@@ -1486,6 +1517,24 @@ static BOOLEAN is_legal_8dot3_name( const WCHAR *name, int len )
 }
 
 
+/***********************************************************************
+ *           generate_short_name
+ *
+ * Generate the short name of a file if its long name is not a valid one.
+ * 'buffer' must be at least 13 characters long.
+ */
+static int generate_short_name( const WCHAR *long_name, int long_len, WCHAR *buffer )
+{
+    int len = 0;
+
+    if (!is_legal_8dot3_name( long_name, long_len ))
+        len = hash_short_file_name( long_name, long_len, buffer );
+    buffer[len] = 0;
+    wcsupr( buffer );
+    return len;
+}
+
+
 /***********************************************************************
  *           append_entry
  *
@@ -1506,26 +1555,22 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
     {
         short_len = ntdll_umbstowcs( short_name, strlen(short_name),
                                      short_nameW, ARRAY_SIZE( short_nameW ) - 1 );
+        short_nameW[short_len] = 0;
+        wcsupr( short_nameW );
     }
-    else  /* generate a short name if necessary */
-    {
-        short_len = 0;
-        if (!is_legal_8dot3_name( long_nameW, long_len ))
-            short_len = hash_short_file_name( long_nameW, long_len, short_nameW );
-    }
-    short_nameW[short_len] = 0;
-    wcsupr( short_nameW );
+    else short_len = -1;  /* generated when needed */
 
-    TRACE( "long %s short %s mask %s\n",
-           debugstr_w( long_nameW ), debugstr_w( short_nameW ), debugstr_us( mask ));
+    TRACE( "long %s short %s mask %s\n", debugstr_w( long_nameW ),
+           short_len == -1 ? "(lazy)" : debugstr_w( short_nameW ), debugstr_us( mask ));
 
     if (mask && !match_filename( long_nameW, long_len, mask ))
     {
+        if (short_len == -1) short_len = generate_short_name( long_nameW, long_len, short_nameW );
         if (!short_len) return TRUE;  /* no short name to match */
         if (!match_filename( short_nameW, short_len, mask )) return TRUE;
     }
 
-    return add_dir_data_names( data, long_nameW, short_nameW, long_name );
+    return add_dir_data_names( data, long_nameW, short_len == -1 ? NULL : short_nameW, long_name );
 }
 
 
@@ -2224,6 +2269,26 @@ static NTSTATUS get_mountmgr_fs_info( HANDLE handle, int fd, struct mountmgr_uni
 }
 
 
+/* retrieve the short name of a directory entry, generating it if necessary */
+static ULONG get_dir_data_short_name( const struct dir_data_names *names, WCHAR *buffer )
+{
+    WCHAR short_name[13];
+    ULONG len;
+
+    if (names->short_name)
+    {
+        len = wcslen( names->short_name );
+        memcpy( buffer, names->short_name, len * sizeof(WCHAR) );
+    }
+    else
+    {
+        len = generate_short_name( names->long_name, wcslen( names->long_name ), short_name );
+        memcpy( buffer, short_name, len * sizeof(WCHAR) );
+    }
+    return len * sizeof(WCHAR);
+}
+
+
 /***********************************************************************
  *           get_dir_data_entry
  *
@@ -2286,15 +2351,13 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
 
     case FileBothDirectoryInformation:
         info->both.EaSize = 0; /* FIXME */
-        info->both.ShortNameLength = wcslen( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->both.ShortName, names->short_name, info->both.ShortNameLength );
+        info->both.ShortNameLength = get_dir_data_short_name( names, info->both.ShortName );
         info->both.FileNameLength = name_len;
         break;
 
     case FileIdBothDirectoryInformation:
         info->id_both.EaSize = 0; /* FIXME */
-        info->id_both.ShortNameLength = wcslen( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->id_both.ShortName, names->short_name, info->id_both.ShortNameLength );
+        info->id_both.ShortNameLength = get_dir_data_short_name( names, info->id_both.ShortName );
         info->id_both.FileNameLength = name_len;
         break;
 
@@ -2440,30 +2503,67 @@ static NTSTATUS read_directory_data_stat( struct dir_data *data, const char *uni
 }
 
 
+/***********************************************************************
+ *           read_directory_stream
+ *
+ * Read the next part of the directory stream, replacing the current entries.
+ */
+static NTSTATUS read_directory_stream( struct dir_data *data, const UNICODE_STRING *mask, BOOL restart )
+{
+    struct dirent *de;
+
+    reset_dir_data( data );
+    if (restart)
+    {
+        if (data->dir) rewinddir( data->dir );
+        else if (!(data->dir = opendir( "." ))) return STATUS_NO_SUCH_FILE;
+        data->eof = FALSE;
+        if (!append_entry( data, ".", NULL, mask )) return STATUS_NO_MEMORY;
+        if (!append_entry( data, "..", NULL, mask )) return STATUS_NO_MEMORY;
+    }
+    while (!data->eof && data->count < dir_data_sort_limit)
+    {
+        if (!(de = readdir( data->dir ))) data->eof = TRUE;
+        else if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
+        else if (!append_entry( data, de->d_name, NULL, mask )) return STATUS_NO_MEMORY;
+    }
+    if (data->eof)
+    {
+        /* reopened if the scan is restarted */
+        closedir( data->dir );
+        data->dir = NULL;
+    }
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           read_directory_readdir
  *
  * Read a directory using the POSIX readdir interface; helper for NtQueryDirectoryFile.
+ * Directories that are too large are not read completely, the remaining
+ * entries are returned as they are read.
  */
 static NTSTATUS read_directory_data_readdir( struct dir_data *data, const UNICODE_STRING *mask )
 {
-    struct dirent *de;
-    NTSTATUS status = STATUS_NO_MEMORY;
-    DIR *dir = opendir( "." );
-
-    if (!dir) return STATUS_NO_SUCH_FILE;
+    NTSTATUS status;
 
-    if (!append_entry( data, ".", NULL, mask )) goto done;
-    if (!append_entry( data, "..", NULL, mask )) goto done;
-    while ((de = readdir( dir )))
+    if (!(status = read_directory_stream( data, mask, TRUE )) && !data->eof)
     {
-        if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
-        if (!append_entry( data, de->d_name, NULL, mask )) goto done;
+        TRACE( "more than %u files, not sorting\n", dir_data_sort_limit );
+        data->streamed = TRUE;
+        if (!mask) return STATUS_SUCCESS;
+        if ((data->mask.Buffer = malloc( mask->Length )))
+        {
+            memcpy( data->mask.Buffer, mask->Buffer, mask->Length );
+            data->mask.Length = data->mask.MaximumLength = mask->Length;
+            return STATUS_SUCCESS;
+        }
+        status = STATUS_NO_MEMORY;
     }
-    status = STATUS_SUCCESS;
-
-done:
-    closedir( dir );
+    if (data->dir) closedir( data->dir );
+    data->dir = NULL;
+    data->streamed = FALSE;
     return status;
 }
 
@@ -2532,11 +2632,11 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         return status;
     }
 
-    /* sort filenames, but not "." and ".." */
+    /* sort filenames, but not "." and "..", unless the directory is streamed */
     i = 0;
     if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
     if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
-    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    if (i < data->count && !data->streamed) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
 
     if (data->count)
     {
@@ -2674,18 +2774,29 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event, PIO_APC_ROUTI
     {
         if (!(status = get_cached_dir_data( handle, &data, fd, mask )))
         {
+            const UNICODE_STRING *stream_mask = data->mask.Buffer ? &data->mask : NULL;
             union file_directory_info *last_info = NULL;
 
-            if (restart_scan) data->pos = 0;
+            if (restart_scan)
+            {
+                if (data->streamed) status = read_directory_stream( data, stream_mask, TRUE );
+                else data->pos = 0;
+            }
 
-            while (!status && data->pos < data->count)
+            while (!status)
             {
+                if (data->pos >= data->count)
+                {
+                    if (!data->streamed || data->eof) break;
+                    status = read_directory_stream( data, stream_mask, FALSE );
+                    continue;
+                }
                 status = get_dir_data_entry( data, buffer, io, length, info_class, &last_info );
                 if (!status || status == STATUS_BUFFER_OVERFLOW) data->pos++;
                 if (single_entry && last_info) break;
             }
 
-            if (!last_info) status = STATUS_NO_MORE_FILES;
+            if (!last_info && status != STATUS_NO_MEMORY) status = STATUS_NO_MORE_FILES;
             else if (status == STATUS_MORE_ENTRIES) status = STATUS_SUCCESS;
 
             io->Status = status;
@@ -2703,47 +2814,169 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event, PIO_APC_ROUTI
 }
 
 
-/***********************************************************************
- *           find_file_in_dir
- *
- * Find a file in a directory the hard way, by doing a case-insensitive search.
- * The file found is appended to unix_name at pos.
- * There must be at least MAX_DIR_ENTRY_LEN+2 chars available at pos.
- */
-static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, int length,
-                                  BOOLEAN check_case )
+/* directory contents cached for case-insensitive lookups */
+struct dir_case_cache
 {
-    WCHAR buffer[MAX_DIR_ENTRY_LEN];
-    BOOLEAN is_name_8_dot_3;
-    DIR *dir;
+    struct list           entry;        /* entry in the LRU list */
+    struct file_identity  id;           /* directory file identity */
+    LARGE_INTEGER         mtime;        /* directory modification time when it was read */
+    struct dir_data      *data;         /* directory file names */
+    unsigned int          hash_size;    /* size of the hash tables, a power of 2 */
+    unsigned int         *long_hash;    /* long names hash table, index in data->names + 1 */
+    unsigned int         *short_hash;   /* short names hash table, built on the first short name lookup */
+};
+
+static struct list dir_case_cache_list = LIST_INIT( dir_case_cache_list );
+static unsigned int dir_case_cache_count;
+static const unsigned int dir_case_cache_max = 256;
+static pthread_mutex_t dir_case_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int hash_dir_case_name( const WCHAR *name, int length )
+{
+    unsigned int hash = 0;
+    while (length--) hash = hash * 31 + towupper( *name++ );
+    return hash;
+}
+
+static void add_dir_case_hash( unsigned int *table, unsigned int size, const WCHAR *name, unsigned int index )
+{
+    unsigned int i = hash_dir_case_name( name, wcslen( name ) ) & (size - 1);
+
+    while (table[i]) i = (i + 1) & (size - 1);
+    table[i] = index + 1;
+}
+
+static void free_dir_case_cache( struct dir_case_cache *cache )
+{
+    free_dir_data( cache->data );
+    free( cache->long_hash );
+    free( cache->short_hash );
+    free( cache );
+}
+
+/* read a directory and hash its long names */
+static NTSTATUS create_dir_case_cache( const char *unix_name, struct dir_case_cache **ret )
+{
+    struct dir_case_cache *cache;
     struct dirent *de;
     struct stat st;
-    int ret;
+    LARGE_INTEGER dummy;
+    NTSTATUS status = STATUS_NO_MEMORY;
+    unsigned int i;
+    DIR *dir;
 
-    /* try a shortcut for this directory */
+    if (!(dir = opendir( unix_name ))) return errno_to_status( errno );
+    if (!(cache = calloc( 1, sizeof(*cache) ))) goto done;
+    if (!(cache->data = calloc( 1, sizeof(*cache->data) ))) goto done;
 
-    unix_name[pos++] = '/';
-    ret = ntdll_wcstoumbs( name, length, unix_name + pos, MAX_DIR_ENTRY_LEN + 1, TRUE );
-    if (ret >= 0 && ret <= MAX_DIR_ENTRY_LEN)
+    /* the modification time must be retrieved before reading the directory
+     * so that changes made while we are reading it are noticed */
+    fstat( dirfd( dir ), &st );
+    cache->id.dev = st.st_dev;
+    cache->id.ino = st.st_ino;
+    get_file_times( &st, &cache->mtime, &dummy, &dummy, &dummy );
+
+#ifdef VFAT_IOCTL_READDIR_BOTH
+    status = read_directory_data_vfat( cache->data, dirfd( dir ), NULL );
+    if (status == STATUS_NO_MEMORY) goto done;
+    if (status)
+#endif
     {
-        unix_name[pos + ret] = 0;
-        if (!stat( unix_name, &st )) return STATUS_SUCCESS;
+        status = STATUS_NO_MEMORY;
+        while ((de = readdir( dir )))
+            if (!append_entry( cache->data, de->d_name, NULL, NULL )) goto done;
     }
-    if (check_case) goto not_found;  /* we want an exact match */
 
-    if (pos > 1) unix_name[pos - 1] = 0;
-    else unix_name[1] = 0;  /* keep the initial slash */
+    for (cache->hash_size = 16; cache->hash_size < 2 * cache->data->count; cache->hash_size *= 2) ;
+    if (!(cache->long_hash = calloc( cache->hash_size, sizeof(*cache->long_hash) ))) goto done;
 
-    /* check if it fits in 8.3 so that we don't look for short names if we won't need them */
+    for (i = 0; i < cache->data->count; i++)
+        add_dir_case_hash( cache->long_hash, cache->hash_size, cache->data->names[i].long_name, i );
+    TRACE( "%s: %u files\n", debugstr_a(unix_name), cache->data->count );
+    *ret = cache;
+    cache = NULL;
+    status = STATUS_SUCCESS;
 
-    is_name_8_dot_3 = is_legal_8dot3_name( name, length );
-#ifndef VFAT_IOCTL_READDIR_BOTH
-    is_name_8_dot_3 = is_name_8_dot_3 && length >= 8 && name[4] == '~';
-#endif
+done:
+    closedir( dir );
+    if (cache) free_dir_case_cache( cache );
+    return status;
+}
 
-    if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
+static const char *find_dir_case_name( unsigned int *table, unsigned int size, const struct dir_data *data,
+                                       const WCHAR *name, int length, BOOL short_name )
+{
+    unsigned int i = hash_dir_case_name( name, length ) & (size - 1);
 
-    /* now look for it through the directory */
+    for ( ; table[i]; i = (i + 1) & (size - 1))
+    {
+        const struct dir_data_names *names = &data->names[table[i] - 1];
+        const WCHAR *str = short_name ? names->short_name : names->long_name;
+
+        if (!wcsnicmp( str, name, length ) && !str[length]) return names->unix_name;
+    }
+    return NULL;
+}
+
+/* generate the missing short names of a cached directory and hash them */
+static BOOL create_dir_case_short_hash( struct dir_case_cache *cache )
+{
+    static const WCHAR empty[1];
+    struct dir_data *data = cache->data;
+    WCHAR buffer[13];
+    unsigned int i;
+
+    if (!(cache->short_hash = calloc( cache->hash_size, sizeof(*cache->short_hash) ))) return FALSE;
+
+    for (i = 0; i < data->count; i++)
+    {
+        struct dir_data_names *names = &data->names[i];
+
+        if (!names->short_name)
+        {
+            if (!generate_short_name( names->long_name, wcslen( names->long_name ), buffer ))
+                names->short_name = empty;
+            else if (!(names->short_name = add_dir_data_nameW( data, buffer )))
+                return FALSE;
+        }
+        if (names->short_name[0]) add_dir_case_hash( cache->short_hash, cache->hash_size, names->short_name, i );
+    }
+    return TRUE;
+}
+
+static const char *find_dir_case_cache_name( struct dir_case_cache *cache, const WCHAR *name,
+                                             int length, BOOLEAN is_name_8_dot_3 )
+{
+    const char *ret;
+
+    if ((ret = find_dir_case_name( cache->long_hash, cache->hash_size, cache->data, name, length, FALSE )))
+        return ret;
+    if (!is_name_8_dot_3) return NULL;
+    if (!cache->short_hash && !create_dir_case_short_hash( cache ))
+    {
+        /* try again on the next lookup */
+        free( cache->short_hash );
+        cache->short_hash = NULL;
+        return NULL;
+    }
+    return find_dir_case_name( cache->short_hash, cache->hash_size, cache->data, name, length, TRUE );
+}
+
+
+/***********************************************************************
+ *           scan_dir_for_file
+ *
+ * Case-insensitive search of a file by reading through the directory, for
+ * directories that are not worth caching. unix_name contains the directory
+ * name, the file found is appended at pos.
+ */
+static NTSTATUS scan_dir_for_file( char *unix_name, int pos, const WCHAR *name, int length,
+                                   BOOLEAN is_name_8_dot_3 )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    DIR *dir;
+    struct dirent *de;
+    int ret;
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
     if (is_name_8_dot_3)
@@ -2781,7 +3014,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
                     if (ioctl( fd, VFAT_IOCTL_READDIR_BOTH, (long)kde ) == -1)
                     {
                         close( fd );
-                        goto not_found;
+                        return STATUS_OBJECT_NAME_NOT_FOUND;
                     }
                 }
                 /* if that did not work, restore previous state of unix_name */
@@ -2821,6 +3054,140 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
         }
     }
     closedir( dir );
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+
+/***********************************************************************
+ *           lookup_dir_case_cache
+ *
+ * Case-insensitive search of a file in a directory, through a cache of the
+ * directory contents that is validated with the directory modification time.
+ * unix_name contains the directory name, the file found is appended at pos.
+ */
+static NTSTATUS lookup_dir_case_cache( char *unix_name, int pos, const WCHAR *name, int length,
+                                       BOOLEAN is_name_8_dot_3 )
+{
+    struct dir_case_cache *cache, *new_cache = NULL;
+    LARGE_INTEGER mtime, now, dummy;
+    const char *found;
+    struct stat st;
+    NTSTATUS status;
+
+    if (stat( unix_name, &st ) == -1) return errno_to_status( errno );
+    get_file_times( &st, &mtime, &dummy, &dummy, &dummy );
+
+    mutex_lock( &dir_case_mutex );
+    LIST_FOR_EACH_ENTRY( cache, &dir_case_cache_list, struct dir_case_cache, entry )
+    {
+        if (cache->id.dev != st.st_dev || cache->id.ino != st.st_ino) continue;
+        if (cache->mtime.QuadPart == mtime.QuadPart)
+        {
+            list_remove( &cache->entry );
+            list_add_head( &dir_case_cache_list, &cache->entry );
+            if ((found = find_dir_case_cache_name( cache, name, length, is_name_8_dot_3 )))
+            {
+                unix_name[pos - 1] = '/';
+                strcpy( unix_name + pos, found );
+            }
+            mutex_unlock( &dir_case_mutex );
+            return found ? STATUS_SUCCESS : STATUS_OBJECT_NAME_NOT_FOUND;
+        }
+        /* the directory has been modified */
+        list_remove( &cache->entry );
+        dir_case_cache_count--;
+        free_dir_case_cache( cache );
+        break;
+    }
+    mutex_unlock( &dir_case_mutex );
+
+    /* a directory modified very recently may be modified again without its
+     * time stamp changing, depending on the file system granularity */
+    NtQuerySystemTime( &now );
+    if (now.QuadPart - mtime.QuadPart < 2 * TICKSPERSEC)
+        return scan_dir_for_file( unix_name, pos, name, length, is_name_8_dot_3 );
+
+    if ((status = create_dir_case_cache( unix_name, &new_cache ))) return status;
+
+    if ((found = find_dir_case_cache_name( new_cache, name, length, is_name_8_dot_3 )))
+    {
+        unix_name[pos - 1] = '/';
+        strcpy( unix_name + pos, found );
+    }
+    status = found ? STATUS_SUCCESS : STATUS_OBJECT_NAME_NOT_FOUND;
+
+    /* the directory was modified while we were reading it */
+    if (now.QuadPart - new_cache->mtime.QuadPart < 2 * TICKSPERSEC)
+    {
+        free_dir_case_cache( new_cache );
+        return status;
+    }
+
+    mutex_lock( &dir_case_mutex );
+    LIST_FOR_EACH_ENTRY( cache, &dir_case_cache_list, struct dir_case_cache, entry )
+    {
+        if (cache->id.dev != new_cache->id.dev || cache->id.ino != new_cache->id.ino) continue;
+        list_remove( &cache->entry );
+        dir_case_cache_count--;
+        free_dir_case_cache( cache );
+        break;
+    }
+    if (dir_case_cache_count == dir_case_cache_max)
+    {
+        cache = LIST_ENTRY( list_tail( &dir_case_cache_list ), struct dir_case_cache, entry );
+        list_remove( &cache->entry );
+        dir_case_cache_count--;
+        free_dir_case_cache( cache );
+    }
+    list_add_head( &dir_case_cache_list, &new_cache->entry );
+    dir_case_cache_count++;
+    mutex_unlock( &dir_case_mutex );
+    return status;
+}
+
+
+/***********************************************************************
+ *           find_file_in_dir
+ *
+ * Find a file in a directory the hard way, by doing a case-insensitive search
+ * through the cached directory contents. The file found is appended to unix_name at pos.
+ * There must be at least MAX_DIR_ENTRY_LEN+2 chars available at pos.
+ */
+static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, int length,
+                                  BOOLEAN check_case )
+{
+    BOOLEAN is_name_8_dot_3;
+    NTSTATUS status;
+    struct stat st;
+    int ret;
+
+    /* try a shortcut for this directory */
+
+    unix_name[pos++] = '/';
+    ret = ntdll_wcstoumbs( name, length, unix_name + pos, MAX_DIR_ENTRY_LEN + 1, TRUE );
+    if (ret >= 0 && ret <= MAX_DIR_ENTRY_LEN)
+    {
+        unix_name[pos + ret] = 0;
+        if (!stat( unix_name, &st )) return STATUS_SUCCESS;
+    }
+    if (check_case) goto not_found;  /* we want an exact match */
+
+    if (pos > 1) unix_name[pos - 1] = 0;
+    else unix_name[1] = 0;  /* keep the initial slash */
+
+    /* check if it fits in 8.3 so that we don't look for short names if we won't need them */
+
+    is_name_8_dot_3 = is_legal_8dot3_name( name, length );
+#ifndef VFAT_IOCTL_READDIR_BOTH
+    is_name_8_dot_3 = is_name_8_dot_3 && length >= 8 && name[4] == '~';
+#endif
+
+    if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
+
+    /* now look for it through the directory */
+
+    status = lookup_dir_case_cache( unix_name, pos, name, length, is_name_8_dot_3 );
+    if (status != STATUS_OBJECT_NAME_NOT_FOUND) return status;
 
 not_found:
     unix_name[pos - 1] = 0;
@@ -4947,6 +5314,19 @@ struct async_fileio_write
     unsigned int        count;
 };
 
+struct async_fileio_ring
+{
+    struct async_fileio io;
+    struct list         entry;      /* entry in the list of requests in flight */
+    void               *buffer;
+    unsigned int        count;
+    off_t               offset;
+    BOOL                write;
+    BOOL                done;       /* the completion has been reaped */
+    int                 result;     /* result of the completion */
+    client_ptr_t        token;      /* user pointer written to the server pipe */
+};
+
 struct async_fileio_read_changes
 {
     struct async_fileio io;
@@ -5109,6 +5489,327 @@ static BOOL async_write_proc( void *user, ULONG_PTR *info, unsigned int *status
     return TRUE;
 }
 
+#ifdef USE_IO_URING
+
+/* Overlapped I/O on regular files is submitted to an io_uring. Each request is linked to a write
+ * of its async user pointer to a pipe polled by the server, which then wakes up the async. The
+ * async callback runs in the thread that started the I/O, and reaps the result from the
+ * completion ring before reporting it through the usual APC mechanism. */
+
+#define IO_RING_ENTRIES 128
+
+static pthread_mutex_t io_ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BOOL io_ring_init_done;
+static int io_ring_fd = -1;
+static int io_ring_pipe = -1;               /* write end of the server pipe */
+static unsigned int *io_ring_sq_tail;       /* submission ring tail */
+static unsigned int *io_ring_sq_array;      /* submission ring index array */
+static unsigned int io_ring_sq_mask;        /* submission ring mask */
+static struct io_uring_sqe *io_ring_sqes;   /* submission queue entries */
+static unsigned int *io_ring_cq_head;       /* completion ring head */
+static unsigned int *io_ring_cq_tail;       /* completion ring tail (updated by the kernel) */
+static unsigned int io_ring_cq_mask;        /* completion ring mask */
+static struct io_uring_cqe *io_ring_cqes;   /* completion queue entries */
+static unsigned int io_ring_pending;        /* count of requests in flight */
+static unsigned int io_ring_max_pending;    /* max count of requests in flight */
+static struct list io_ring_requests = LIST_INIT( io_ring_requests );  /* requests not reaped yet */
+
+/* create the io_uring and the server pipe; io_ring_mutex must be held */
+static void init_io_ring(void)
+{
+    /* IORING_OP_READ and IORING_OP_WRITE were added together with IORING_FEAT_RW_CUR_POS */
+    static const unsigned int features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+    struct io_uring_params params;
+    size_t ring_size, sqes_size;
+    unsigned int status;
+    void *ring, *sqes;
+    int fd, fds[2];
+
+    io_ring_init_done = TRUE;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, IO_RING_ENTRIES, &params )) == -1) return;
+    if ((params.features & features) != features) goto failed;
+
+    ring_size = max( params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+                     params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) );
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring = mmap( NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if (ring == MAP_FAILED) goto failed;
+    sqes = mmap( NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (sqes == MAP_FAILED) goto failed_unmap;
+    if (server_pipe( fds ) == -1) goto failed_unmap_sqes;
+
+    wine_server_send_fd( fds[0] );
+    SERVER_START_REQ( set_io_ring )
+    {
+        req->fd = fds[0];
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    close( fds[0] );
+
+    if (status)
+    {
+        WARN( "server doesn't support io_uring completions, status %#x\n", status );
+        close( fds[1] );
+        goto failed_unmap_sqes;
+    }
+
+    io_ring_sq_tail     = (unsigned int *)((char *)ring + params.sq_off.tail);
+    io_ring_sq_array    = (unsigned int *)((char *)ring + params.sq_off.array);
+    io_ring_sq_mask     = *(unsigned int *)((char *)ring + params.sq_off.ring_mask);
+    io_ring_sqes        = sqes;
+    io_ring_cq_head     = (unsigned int *)((char *)ring + params.cq_off.head);
+    io_ring_cq_tail     = (unsigned int *)((char *)ring + params.cq_off.tail);
+    io_ring_cq_mask     = *(unsigned int *)((char *)ring + params.cq_off.ring_mask);
+    io_ring_cqes        = (struct io_uring_cqe *)((char *)ring + params.cq_off.cqes);
+    io_ring_max_pending = min( params.sq_entries, params.cq_entries ) / 2;  /* two entries per request */
+    io_ring_pipe = fds[1];
+    io_ring_fd = fd;
+    TRACE( "using io_uring with %u entries\n", params.sq_entries );
+    return;
+
+failed_unmap_sqes:
+    munmap( sqes, sqes_size );
+failed_unmap:
+    munmap( ring, ring_size );
+failed:
+    close( fd );
+}
+
+/* store the results of the completed requests; io_ring_mutex must be held */
+static void reap_io_ring(void)
+{
+    unsigned int head = *io_ring_cq_head, tail = __atomic_load_n( io_ring_cq_tail, __ATOMIC_ACQUIRE );
+
+    for ( ; head != tail; head++)
+    {
+        const struct io_uring_cqe *cqe = &io_ring_cqes[head & io_ring_cq_mask];
+        struct async_fileio_ring *fileio = wine_server_get_ptr( cqe->user_data );
+
+        if (!fileio) continue;  /* write to the server pipe, or cancel request */
+        fileio->result = cqe->res;
+        fileio->done = TRUE;
+        list_remove( &fileio->entry );
+        io_ring_pending--;
+    }
+    __atomic_store_n( io_ring_cq_head, head, __ATOMIC_RELEASE );
+}
+
+/* wait until the completion of a request has been reaped; io_ring_mutex must not be held
+ * another thread may reap it first, so we can't block in io_uring_enter for it */
+static void wait_io_ring_request( struct async_fileio_ring *fileio )
+{
+    BOOL done;
+
+    for (;;)
+    {
+        mutex_lock( &io_ring_mutex );
+        reap_io_ring();
+        done = fileio->done;
+        mutex_unlock( &io_ring_mutex );
+        if (done) break;
+        NtYieldExecution();
+    }
+}
+
+static BOOL async_ring_proc( void *user, ULONG_PTR *info, unsigned int *status )
+{
+    struct async_fileio_ring *fileio = user;
+    int fd, needs_close, result;
+
+    /* the completion is posted before the linked pipe write starts, so we should never have to wait */
+    wait_io_ring_request( fileio );
+    result = fileio->result;
+
+    if (*status == STATUS_ALERTED)
+    {
+        /* the kernel can't write to a write-watched buffer, do it the slow way */
+        if (result == -EFAULT && !fileio->write &&
+            !server_get_unix_fd( fileio->io.handle, FILE_READ_DATA, &fd, &needs_close, NULL, NULL ))
+        {
+            if ((result = virtual_locked_pread( fd, fileio->buffer, fileio->count, fileio->offset )) == -1)
+                result = -errno;
+            if (needs_close) close( fd );
+        }
+
+        if (result >= 0)
+        {
+            if (fileio->write || result || !fileio->count) *status = STATUS_SUCCESS;
+            else *status = STATUS_END_OF_FILE;
+        }
+        else if (result == -EFAULT) *status = fileio->write ? STATUS_INVALID_USER_BUFFER : STATUS_ACCESS_VIOLATION;
+        else if (result == -ECANCELED) *status = STATUS_CANCELLED;
+        else *status = errno_to_status( -result );
+    }
+    *info = (*status == STATUS_SUCCESS || *status == STATUS_END_OF_FILE) ? result : 0;
+    release_fileio( &fileio->io );
+    return TRUE;
+}
+
+/* queue a submission entry; io_ring_mutex must be held */
+static void queue_io_ring_request( unsigned int tail, __u8 opcode, __u8 flags, int fd, const void *addr,
+                                   unsigned int len, __u64 offset, __u64 user_data )
+{
+    unsigned int index = tail & io_ring_sq_mask;
+    struct io_uring_sqe *sqe = &io_ring_sqes[index];
+
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode    = opcode;
+    sqe->flags     = flags;
+    sqe->fd        = fd;
+    sqe->addr      = (ULONG_PTR)addr;
+    sqe->len       = len;
+    sqe->off       = offset;
+    sqe->user_data = user_data;
+    io_ring_sq_array[index] = index;
+}
+
+/* submit an overlapped read or write on a regular file to the io_uring; helper for NtReadFile/NtWriteFile
+ * returns STATUS_NOT_SUPPORTED if the I/O needs to be done synchronously instead */
+static unsigned int submit_io_ring( HANDLE handle, int unix_fd, HANDLE event, PIO_APC_ROUTINE apc,
+                                    void *apc_user, client_ptr_t iosb, void *buffer, ULONG length,
+                                    off_t offset, BOOL is_write )
+{
+    struct async_fileio_ring *fileio;
+    unsigned int status, tail;
+    int ret;
+
+    mutex_lock( &io_ring_mutex );
+    if (!io_ring_init_done) init_io_ring();
+    if (io_ring_fd != -1 && io_ring_pending < io_ring_max_pending)
+    {
+        io_ring_pending++;
+        status = STATUS_SUCCESS;
+    }
+    else status = STATUS_NOT_SUPPORTED;
+    mutex_unlock( &io_ring_mutex );
+    if (status) return status;
+
+    if (!(fileio = (struct async_fileio_ring *)alloc_fileio( sizeof(*fileio), async_ring_proc, handle )))
+    {
+        status = STATUS_NO_MEMORY;
+        goto failed;
+    }
+    fileio->buffer = buffer;
+    fileio->count  = length;
+    fileio->offset = offset;
+    fileio->write  = is_write;
+    fileio->done   = FALSE;
+    fileio->token  = wine_server_client_ptr( fileio );
+
+    /* the async must exist before the server gets notified */
+    SERVER_START_REQ( register_async )
+    {
+        req->type  = is_write ? ASYNC_TYPE_WRITE : ASYNC_TYPE_READ;
+        req->count = length;
+        req->ring  = 1;
+        req->async = server_async( handle, &fileio->io, event, apc, apc_user, iosb );
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+
+    if (status != STATUS_PENDING)
+    {
+        free( fileio );
+        goto failed;
+    }
+
+    mutex_lock( &io_ring_mutex );
+    tail = *io_ring_sq_tail;
+    queue_io_ring_request( tail, is_write ? IORING_OP_WRITE : IORING_OP_READ, IOSQE_IO_HARDLINK,
+                           unix_fd, buffer, length, offset, fileio->token );
+    queue_io_ring_request( tail + 1, IORING_OP_WRITE, 0, io_ring_pipe, &fileio->token,
+                           sizeof(fileio->token), -1, 0 );
+    __atomic_store_n( io_ring_sq_tail, tail + 2, __ATOMIC_RELEASE );
+    list_add_tail( &io_ring_requests, &fileio->entry );
+
+    /* the kernel grabs the file during the submission, so the fd can be closed once we return */
+    while ((ret = syscall( __NR_io_uring_enter, io_ring_fd, 2, 0, 0, NULL, 0 )) == -1)
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+
+    if (ret == 1)
+    {
+        /* the I/O got submitted without the pipe write, notify the server ourselves once it's done */
+        WARN( "io_uring submission incomplete\n" );
+        __atomic_store_n( io_ring_sq_tail, tail + 1, __ATOMIC_RELEASE );
+        mutex_unlock( &io_ring_mutex );
+        wait_io_ring_request( fileio );
+        write( io_ring_pipe, &fileio->token, sizeof(fileio->token) );
+        return STATUS_PENDING;
+    }
+    if (ret != 2)
+    {
+        /* nothing was consumed, do the I/O now and notify the server ourselves */
+        WARN( "io_uring submission failed, ret %d errno %d\n", ret, errno );
+        __atomic_store_n( io_ring_sq_tail, tail, __ATOMIC_RELEASE );
+        list_remove( &fileio->entry );
+        if (is_write) ret = pwrite( unix_fd, buffer, length, offset );
+        else ret = pread( unix_fd, buffer, length, offset );
+        fileio->result = ret == -1 ? -errno : ret;
+        fileio->done = TRUE;
+        io_ring_pending--;
+        write( io_ring_pipe, &fileio->token, sizeof(fileio->token) );
+    }
+    mutex_unlock( &io_ring_mutex );
+    return STATUS_PENDING;
+
+failed:
+    mutex_lock( &io_ring_mutex );
+    io_ring_pending--;
+    mutex_unlock( &io_ring_mutex );
+    return status;
+}
+
+/* cancel requests that the server canceled; helper for NtCancelIoFile/NtCancelIoFileEx
+ * the request completes with -ECANCELED, unless it's already done */
+static void cancel_io_ring( const client_ptr_t *tokens, unsigned int count )
+{
+    struct async_fileio_ring *fileio;
+    unsigned int i, tail, submit = 0;
+
+    mutex_lock( &io_ring_mutex );
+    tail = *io_ring_sq_tail;
+    for (i = 0; i < count; i++)
+    {
+        /* the token may be reused once the request has been reaped */
+        LIST_FOR_EACH_ENTRY( fileio, &io_ring_requests, struct async_fileio_ring, entry )
+        {
+            if (fileio->token != tokens[i]) continue;
+            queue_io_ring_request( tail + submit++, IORING_OP_ASYNC_CANCEL, 0, -1,
+                                   wine_server_get_ptr( tokens[i] ), 0, 0, 0 );
+            break;
+        }
+    }
+    if (submit)
+    {
+        __atomic_store_n( io_ring_sq_tail, tail + submit, __ATOMIC_RELEASE );
+        if (syscall( __NR_io_uring_enter, io_ring_fd, submit, 0, 0, NULL, 0 ) != submit)
+        {
+            /* the I/O will still complete normally */
+            WARN( "io_uring cancel submission failed, errno %d\n", errno );
+        }
+    }
+    mutex_unlock( &io_ring_mutex );
+}
+
+#else  /* USE_IO_URING */
+
+static unsigned int submit_io_ring( HANDLE handle, int unix_fd, HANDLE event, PIO_APC_ROUTINE apc,
+                                    void *apc_user, client_ptr_t iosb, void *buffer, ULONG length,
+                                    off_t offset, BOOL is_write )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+static void cancel_io_ring( const client_ptr_t *tokens, unsigned int count )
+{
+}
+
+#endif  /* USE_IO_URING */
+
 /* do a read call through the server */
 static unsigned int server_read_file( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_context,
                                       IO_STATUS_BLOCK *io, void *buffer, ULONG size,
@@ -5462,7 +6163,10 @@ NTSTATUS WINAPI NtReadFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
-            /* async I/O doesn't make sense on regular files */
+            if (async_read && (status = submit_io_ring( handle, unix_handle, event, apc, apc_user, iosb_ptr, buffer,
+                                                        length, offset->QuadPart, FALSE )) != STATUS_NOT_SUPPORTED)
+                goto err;
+
             while ((result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
                 if (errno != EINTR)
@@ -5778,8 +6482,10 @@ NTSTATUS WINAPI NtWriteFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, v
                 status = STATUS_INVALID_PARAMETER;
                 goto done;
             }
+            else if (async_write && (status = submit_io_ring( handle, unix_handle, event, apc, apc_user, iosb_ptr,
+                                                              (void *)buffer, length, off, TRUE )) != STATUS_NOT_SUPPORTED)
+                goto err;
 
-            /* async I/O doesn't make sense on regular files */
             while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
             {
                 if (errno != EINTR)
@@ -6265,7 +6971,8 @@ NTSTATUS WINAPI NtFlushBuffersFile( HANDLE handle, IO_STATUS_BLOCK *io )
  */
 NTSTATUS WINAPI NtCancelIoFile( HANDLE handle, IO_STATUS_BLOCK *io_status )
 {
-    unsigned int status;
+    client_ptr_t rings[64];
+    unsigned int status, count;
 
     TRACE( "%p %p\n", handle, io_status );
 
@@ -6273,14 +6980,17 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE handle, IO_STATUS_BLOCK *io_status )
     {
         req->handle      = wine_server_obj_handle( handle );
         req->only_thread = TRUE;
+        wine_server_set_reply( req, rings, sizeof(rings) );
         if (!(status = wine_server_call( req )))
         {
             io_status->Status = status;
             io_status->Information = 0;
         }
+        count = wine_server_reply_size( reply ) / sizeof(rings[0]);
     }
     SERVER_END_REQ;
 
+    if (count) cancel_io_ring( rings, count );
     return status;
 }
 
@@ -6290,7 +7000,8 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE handle, IO_STATUS_BLOCK *io_status )
  */
 NTSTATUS WINAPI NtCancelIoFileEx( HANDLE handle, IO_STATUS_BLOCK *io, IO_STATUS_BLOCK *io_status )
 {
-    unsigned int status;
+    client_ptr_t rings[64];
+    unsigned int status, count;
 
     TRACE( "%p %p %p\n", handle, io, io_status );
 
@@ -6298,14 +7009,17 @@ NTSTATUS WINAPI NtCancelIoFileEx( HANDLE handle, IO_STATUS_BLOCK *io, IO_STATUS_
     {
         req->handle = wine_server_obj_handle( handle );
         req->iosb   = wine_server_client_ptr( io );
+        wine_server_set_reply( req, rings, sizeof(rings) );
         if (!(status = wine_server_call( req )))
         {
             io_status->Status = status;
             io_status->Information = 0;
         }
+        count = wine_server_reply_size( reply ) / sizeof(rings[0]);
     }
     SERVER_END_REQ;
 
+    if (count) cancel_io_ring( rings, count );
     return status;
 }
 
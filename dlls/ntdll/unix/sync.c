@@ -129,6 +129,28 @@ static inline int futex_wake( const LONG *addr, int val )
     return syscall( __NR_futex, addr, FUTEX_WAKE_PRIVATE, val, NULL, 0, 0 );
 }
 
+/* futexes in memory shared with the server, that can't use the private operations */
+static inline int futex_wait_shared( const volatile int *addr, int val, struct timespec *timeout )
+{
+#if (defined(__i386__) || defined(__arm__)) && _TIME_BITS==64
+    if (timeout && sizeof(*timeout) != 8)
+    {
+        struct {
+            long tv_sec;
+            long tv_nsec;
+        } timeout32 = { timeout->tv_sec, timeout->tv_nsec };
+
+        return syscall( __NR_futex, addr, FUTEX_WAIT, val, &timeout32, 0, 0 );
+    }
+#endif
+    return syscall( __NR_futex, addr, FUTEX_WAIT, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake_shared( const volatile int *addr, int val )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAKE, val, NULL, 0, 0 );
+}
+
 #endif
 
 
@@ -241,6 +263,407 @@ static unsigned int validate_open_object_attributes( const OBJECT_ATTRIBUTES *at
 }
 
 
+/***********************************************************************
+ * In-process synchronization objects
+ *
+ * The server gives unnamed events, mutexes and semaphores a state in memory
+ * shared with the creating process, so that the process can signal them and
+ * wait on them with atomic operations and futexes. The server takes the state
+ * back the first time it needs it, for instance when another process uses the
+ * object or when a thread waits on it along with other objects; we then go
+ * through the server like for any other object.
+ */
+
+#ifdef __linux__
+
+struct fast_sync_cache_entry
+{
+    LONG index;  /* index + 1 of the object in the shared memory, 0 if none */
+    LONG id;     /* id of the object, to check that the entry wasn't reused since */
+};
+
+#define FAST_SYNC_CACHE_BLOCK_SIZE  (65536 / sizeof(struct fast_sync_cache_entry))
+#define FAST_SYNC_CACHE_ENTRIES     128
+
+static fast_sync_t *fast_sync_objects;
+static struct fast_sync_cache_entry *fast_sync_cache[FAST_SYNC_CACHE_ENTRIES];
+static struct fast_sync_cache_entry fast_sync_cache_initial_block[FAST_SYNC_CACHE_BLOCK_SIZE];
+
+static inline unsigned int fast_sync_handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / FAST_SYNC_CACHE_BLOCK_SIZE;
+    return idx % FAST_SYNC_CACHE_BLOCK_SIZE;
+}
+
+static BOOL map_fast_sync_objects(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','f','a','s','t','_','s','y','n','c',0};
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING name;
+    SIZE_T size = 0;
+    void *ptr = NULL;
+    HANDLE section;
+    NTSTATUS status;
+
+    init_unicode_string( &name, nameW );
+    InitializeObjectAttributes( &attr, &name, 0, 0, NULL );
+    if ((status = NtOpenSection( &section, SECTION_MAP_READ | SECTION_MAP_WRITE, &attr )))
+    {
+        WARN( "cannot open the fast sync section, status %#x\n", status );
+        return FALSE;
+    }
+    status = NtMapViewOfSection( section, NtCurrentProcess(), &ptr, 0, 0, NULL, &size,
+                                 ViewShare, 0, PAGE_READWRITE );
+    NtClose( section );
+    if (status)
+    {
+        WARN( "cannot map the fast sync section, status %#x\n", status );
+        return FALSE;
+    }
+    if (InterlockedCompareExchangePointer( (void **)&fast_sync_objects, ptr, NULL ))
+        NtUnmapViewOfSection( NtCurrentProcess(), ptr );
+    return TRUE;
+}
+
+/* remember the in-process state of a newly created object, or forget the previous one */
+static void cache_fast_sync( HANDLE handle, unsigned int index, unsigned int id )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+    struct fast_sync_cache_entry *cache;
+
+    if (entry >= FAST_SYNC_CACHE_ENTRIES) return;
+    if (!index)
+    {
+        close_fast_sync( handle );
+        return;
+    }
+    if (!fast_sync_objects && !map_fast_sync_objects()) return;
+
+    if (!fast_sync_cache[entry])  /* do we need to allocate a new block of entries? */
+    {
+        if (!entry) fast_sync_cache[0] = fast_sync_cache_initial_block;
+        else
+        {
+            void *ptr = anon_mmap_alloc( FAST_SYNC_CACHE_BLOCK_SIZE * sizeof(*cache), PROT_READ | PROT_WRITE );
+            if (ptr == MAP_FAILED) return;
+            if (InterlockedCompareExchangePointer( (void **)&fast_sync_cache[entry], ptr, NULL ))
+                munmap( ptr, FAST_SYNC_CACHE_BLOCK_SIZE * sizeof(*cache) );
+        }
+    }
+    cache = &fast_sync_cache[entry][idx];
+    InterlockedExchange( &cache->index, 0 );
+    InterlockedExchange( &cache->id, id );
+    InterlockedExchange( &cache->index, index );
+}
+
+/* get the in-process state of an object, if it has one */
+static fast_sync_t *get_fast_sync( HANDLE handle )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+    struct fast_sync_cache_entry *cache;
+    fast_sync_t *sync;
+    LONG index;
+
+    if (entry >= FAST_SYNC_CACHE_ENTRIES || !fast_sync_cache[entry]) return NULL;
+    cache = &fast_sync_cache[entry][idx];
+    if (!(index = ReadAcquire( &cache->index ))) return NULL;
+    sync = &fast_sync_objects[index - 1];
+    /* the entry may have been given to another object if the handle was closed behind our back */
+    if (sync->id != ReadAcquire( &cache->id )) return NULL;
+    return sync;
+}
+
+/***********************************************************************
+ *           close_fast_sync
+ *
+ * Forget the in-process state of an object when its handle is closed.
+ */
+void close_fast_sync( HANDLE handle )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+
+    if (entry < FAST_SYNC_CACHE_ENTRIES && fast_sync_cache[entry])
+        InterlockedExchange( &fast_sync_cache[entry][idx].index, 0 );
+}
+
+static inline LONG64 read_fast_sync( fast_sync_t *sync )
+{
+    return InterlockedCompareExchange64( (LONG64 *)sync, 0, 0 );
+}
+
+static inline LONG64 make_fast_sync( int state, unsigned int count )
+{
+    return ((LONG64)count << 32) | (unsigned int)state;
+}
+
+static inline BOOL is_fast_event( fast_sync_t *sync )
+{
+    return sync->type == FAST_SYNC_EVENT || sync->type == FAST_SYNC_MANUAL_EVENT;
+}
+
+static NTSTATUS fast_set_event( HANDLE handle, LONG *prev_state )
+{
+    fast_sync_t *sync;
+    LONG state;
+
+    if (!(sync = get_fast_sync( handle )) || !is_fast_event( sync )) return STATUS_NOT_IMPLEMENTED;
+    if ((state = InterlockedCompareExchange( (LONG *)&sync->state, 1, 0 )) == FAST_SYNC_SERVER)
+        return STATUS_NOT_IMPLEMENTED;
+    if (!state) futex_wake_shared( &sync->state, sync->type == FAST_SYNC_MANUAL_EVENT ? INT_MAX : 1 );
+    if (prev_state) *prev_state = state;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_reset_event( HANDLE handle, LONG *prev_state )
+{
+    fast_sync_t *sync;
+    LONG state;
+
+    if (!(sync = get_fast_sync( handle )) || !is_fast_event( sync )) return STATUS_NOT_IMPLEMENTED;
+    if ((state = InterlockedCompareExchange( (LONG *)&sync->state, 0, 1 )) == FAST_SYNC_SERVER)
+        return STATUS_NOT_IMPLEMENTED;
+    if (prev_state) *prev_state = state;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_query_event( HANDLE handle, EVENT_BASIC_INFORMATION *info )
+{
+    fast_sync_t *sync;
+    LONG state;
+
+    if (!(sync = get_fast_sync( handle )) || !is_fast_event( sync )) return STATUS_NOT_IMPLEMENTED;
+    if ((state = ReadAcquire( (LONG *)&sync->state )) == FAST_SYNC_SERVER) return STATUS_NOT_IMPLEMENTED;
+    info->EventType  = sync->type == FAST_SYNC_MANUAL_EVENT ? NotificationEvent : SynchronizationEvent;
+    info->EventState = state;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_release_semaphore( HANDLE handle, ULONG count, ULONG *previous )
+{
+    fast_sync_t *sync;
+    LONG state;
+
+    if (!(sync = get_fast_sync( handle )) || sync->type != FAST_SYNC_SEMAPHORE) return STATUS_NOT_IMPLEMENTED;
+    do
+    {
+        if ((state = ReadAcquire( (LONG *)&sync->state )) == FAST_SYNC_SERVER) return STATUS_NOT_IMPLEMENTED;
+        if (count > sync->max - state) return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+    } while (InterlockedCompareExchange( (LONG *)&sync->state, state + count, state ) != state);
+
+    /* there cannot be any thread to wake up if the count was != 0 */
+    if (!state) futex_wake_shared( &sync->state, min( count, INT_MAX ));
+    if (previous) *previous = state;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_query_semaphore( HANDLE handle, SEMAPHORE_BASIC_INFORMATION *info )
+{
+    fast_sync_t *sync;
+    LONG state;
+
+    if (!(sync = get_fast_sync( handle )) || sync->type != FAST_SYNC_SEMAPHORE) return STATUS_NOT_IMPLEMENTED;
+    if ((state = ReadAcquire( (LONG *)&sync->state )) == FAST_SYNC_SERVER) return STATUS_NOT_IMPLEMENTED;
+    info->CurrentCount = state;
+    info->MaximumCount = sync->max;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_release_mutant( HANDLE handle, LONG *prev_count )
+{
+    int tid = GetCurrentThreadId(), state;
+    fast_sync_t *sync;
+    unsigned int count;
+    LONG64 value;
+
+    if (!(sync = get_fast_sync( handle )) || sync->type != FAST_SYNC_MUTEX) return STATUS_NOT_IMPLEMENTED;
+    do
+    {
+        value = read_fast_sync( sync );
+        state = (int)value;
+        count = value >> 32;
+        if (state == FAST_SYNC_SERVER) return STATUS_NOT_IMPLEMENTED;
+        if (state != tid)
+        {
+            if (prev_count) *prev_count = 1;
+            return STATUS_MUTANT_NOT_OWNED;
+        }
+    } while (InterlockedCompareExchange64( (LONG64 *)sync, count > 1 ? make_fast_sync( tid, count - 1 ) : 0,
+                                           value ) != value);
+
+    if (count == 1) futex_wake_shared( &sync->state, 1 );
+    if (prev_count) *prev_count = 1 - count;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_query_mutant( HANDLE handle, MUTANT_BASIC_INFORMATION *info )
+{
+    fast_sync_t *sync;
+    LONG64 value;
+
+    if (!(sync = get_fast_sync( handle )) || sync->type != FAST_SYNC_MUTEX) return STATUS_NOT_IMPLEMENTED;
+    value = read_fast_sync( sync );
+    if ((int)value == FAST_SYNC_SERVER) return STATUS_NOT_IMPLEMENTED;
+    info->CurrentCount   = 1 - (unsigned int)(value >> 32);
+    info->OwnedByCaller  = (int)value == GetCurrentThreadId();
+    info->AbandonedState = FALSE;
+    return STATUS_SUCCESS;
+}
+
+/* try to acquire an object; return the state to wait on if it is not available */
+static BOOL fast_sync_acquire( fast_sync_t *sync, int *ret_state )
+{
+    int tid, state;
+    unsigned int count;
+    LONG64 value;
+
+    switch (sync->type)
+    {
+    case FAST_SYNC_EVENT:
+        if ((state = InterlockedCompareExchange( (LONG *)&sync->state, 0, 1 )) == 1) return TRUE;
+        break;
+    case FAST_SYNC_MANUAL_EVENT:
+        if ((state = ReadAcquire( (LONG *)&sync->state )) == 1) return TRUE;
+        break;
+    case FAST_SYNC_SEMAPHORE:
+        if ((state = ReadAcquire( (LONG *)&sync->state )) > 0)
+        {
+            if (InterlockedCompareExchange( (LONG *)&sync->state, state - 1, state ) == state) return TRUE;
+            state = -2;  /* retry without waiting */
+        }
+        break;
+    case FAST_SYNC_MUTEX:
+        tid = GetCurrentThreadId();
+        value = read_fast_sync( sync );
+        state = (int)value;
+        count = value >> 32;
+        if (!state || (state == tid && count < ~0u))
+        {
+            if (InterlockedCompareExchange64( (LONG64 *)sync, make_fast_sync( tid, count + 1 ), value ) == value)
+                return TRUE;
+            state = -2;  /* retry without waiting */
+        }
+        break;
+    default:
+        state = FAST_SYNC_SERVER;
+        break;
+    }
+    *ret_state = state;
+    return FALSE;
+}
+
+/* when falling back to the server, a relative timeout is updated with the time already waited */
+static NTSTATUS fast_wait( HANDLE handle, BOOLEAN alertable, const LARGE_INTEGER **server_timeout,
+                           LARGE_INTEGER *remaining )
+{
+    const LARGE_INTEGER *timeout = *server_timeout;
+    ULONGLONG end = 0, now;
+    struct timespec ts;
+    fast_sync_t *sync;
+    int state;
+
+    /* user APCs are only delivered by the server */
+    if (alertable || !(sync = get_fast_sync( handle ))) return STATUS_NOT_IMPLEMENTED;
+
+    if (timeout && timeout->QuadPart == TIMEOUT_INFINITE) timeout = NULL;
+    if (timeout)
+    {
+        if (timeout->QuadPart < 0) end = monotonic_counter() - timeout->QuadPart;
+        else
+        {
+            LARGE_INTEGER system_now;
+
+            NtQuerySystemTime( &system_now );
+            end = monotonic_counter() + max( timeout->QuadPart - system_now.QuadPart, 0 );
+        }
+    }
+
+    for (;;)
+    {
+        if (fast_sync_acquire( sync, &state )) return STATUS_WAIT_0;
+        if (state == FAST_SYNC_SERVER)
+        {
+            if (timeout && timeout->QuadPart < 0)
+            {
+                now = monotonic_counter();
+                remaining->QuadPart = now < end ? now - end : 0;
+                *server_timeout = remaining;
+            }
+            return STATUS_NOT_IMPLEMENTED;
+        }
+        if (state == -2) continue;
+
+        if (!timeout)
+        {
+            futex_wait_shared( &sync->state, state, NULL );
+            continue;
+        }
+        if ((now = monotonic_counter()) >= end)
+        {
+            NtYieldExecution();
+            return STATUS_TIMEOUT;
+        }
+        ts.tv_sec = (end - now) / TICKSPERSEC;
+        ts.tv_nsec = (end - now) % TICKSPERSEC * 100;
+        futex_wait_shared( &sync->state, state, &ts );
+    }
+}
+
+#else
+
+static void cache_fast_sync( HANDLE handle, unsigned int index, unsigned int id )
+{
+}
+
+void close_fast_sync( HANDLE handle )
+{
+}
+
+static NTSTATUS fast_set_event( HANDLE handle, LONG *prev_state )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_reset_event( HANDLE handle, LONG *prev_state )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_query_event( HANDLE handle, EVENT_BASIC_INFORMATION *info )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_semaphore( HANDLE handle, ULONG count, ULONG *previous )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_query_semaphore( HANDLE handle, SEMAPHORE_BASIC_INFORMATION *info )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_mutant( HANDLE handle, LONG *prev_count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_query_mutant( HANDLE handle, MUTANT_BASIC_INFORMATION *info )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wait( HANDLE handle, BOOLEAN alertable, const LARGE_INTEGER **server_timeout,
+                           LARGE_INTEGER *remaining )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif
+
+
 /******************************************************************************
  *              NtCreateSemaphore (NTDLL.@)
  */
@@ -263,6 +686,7 @@ NTSTATUS WINAPI NtCreateSemaphore( HANDLE *handle, ACCESS_MASK access, const OBJ
         wine_server_add_data( req, objattr, len );
         ret = wine_server_call( req );
         *handle = wine_server_ptr_handle( reply->handle );
+        if (!ret) cache_fast_sync( *handle, reply->fast_sync, reply->fast_sync_id );
     }
     SERVER_END_REQ;
 
@@ -315,6 +739,12 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
 
     if (len != sizeof(SEMAPHORE_BASIC_INFORMATION)) return STATUS_INFO_LENGTH_MISMATCH;
 
+    if ((ret = fast_query_semaphore( handle, out )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (!ret && ret_len) *ret_len = sizeof(SEMAPHORE_BASIC_INFORMATION);
+        return ret;
+    }
+
     SERVER_START_REQ( query_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -337,6 +767,8 @@ NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, ULONG *previous
 {
     unsigned int ret;
 
+    if ((ret = fast_release_semaphore( handle, count, previous )) != STATUS_NOT_IMPLEMENTED) return ret;
+
     SERVER_START_REQ( release_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -373,6 +805,7 @@ NTSTATUS WINAPI NtCreateEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_
         wine_server_add_data( req, objattr, len );
         ret = wine_server_call( req );
         *handle = wine_server_ptr_handle( reply->handle );
+        if (!ret) cache_fast_sync( *handle, reply->fast_sync, reply->fast_sync_id );
     }
     SERVER_END_REQ;
 
@@ -413,6 +846,8 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, LONG *prev_state )
 {
     unsigned int ret;
 
+    if ((ret = fast_set_event( handle, prev_state )) != STATUS_NOT_IMPLEMENTED) return ret;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -432,6 +867,8 @@ NTSTATUS WINAPI NtResetEvent( HANDLE handle, LONG *prev_state )
 {
     unsigned int ret;
 
+    if ((ret = fast_reset_event( handle, prev_state )) != STATUS_NOT_IMPLEMENTED) return ret;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -492,6 +929,12 @@ NTSTATUS WINAPI NtQueryEvent( HANDLE handle, EVENT_INFORMATION_CLASS class,
 
     if (len != sizeof(EVENT_BASIC_INFORMATION)) return STATUS_INFO_LENGTH_MISMATCH;
 
+    if ((ret = fast_query_event( handle, out )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (!ret && ret_len) *ret_len = sizeof(EVENT_BASIC_INFORMATION);
+        return ret;
+    }
+
     SERVER_START_REQ( query_event )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -527,6 +970,7 @@ NTSTATUS WINAPI NtCreateMutant( HANDLE *handle, ACCESS_MASK access, const OBJECT
         wine_server_add_data( req, objattr, len );
         ret = wine_server_call( req );
         *handle = wine_server_ptr_handle( reply->handle );
+        if (!ret) cache_fast_sync( *handle, reply->fast_sync, reply->fast_sync_id );
     }
     SERVER_END_REQ;
 
@@ -567,6 +1011,8 @@ NTSTATUS WINAPI NtReleaseMutant( HANDLE handle, LONG *prev_count )
 {
     unsigned int ret;
 
+    if ((ret = fast_release_mutant( handle, prev_count )) != STATUS_NOT_IMPLEMENTED) return ret;
+
     SERVER_START_REQ( release_mutex )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -597,6 +1043,12 @@ NTSTATUS WINAPI NtQueryMutant( HANDLE handle, MUTANT_INFORMATION_CLASS class,
 
     if (len != sizeof(MUTANT_BASIC_INFORMATION)) return STATUS_INFO_LENGTH_MISMATCH;
 
+    if ((ret = fast_query_mutant( handle, out )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (!ret && ret_len) *ret_len = sizeof(MUTANT_BASIC_INFORMATION);
+        return ret;
+    }
+
     SERVER_START_REQ( query_mutex )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -1473,9 +1925,14 @@ NTSTATUS WINAPI NtWaitForMultipleObjects( DWORD count, const HANDLE *handles, BO
 {
     select_op_t select_op;
     UINT i, flags = SELECT_INTERRUPTIBLE;
+    LARGE_INTEGER remaining;
+    NTSTATUS ret;
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    if (count == 1 && (ret = fast_wait( handles[0], alertable, &timeout, &remaining )) != STATUS_NOT_IMPLEMENTED)
+        return ret;
+
     if (alertable) flags |= SELECT_ALERTABLE;
     select_op.wait.op = wait_any ? SELECT_WAIT : SELECT_WAIT_ALL;
     for (i = 0; i < count; i++) select_op.wait.handles[i] = wine_server_obj_handle( handles[i] );
@@ -249,6 +249,7 @@ extern NTSTATUS set_thread_context( HANDLE handle, const void *context, BOOL *se
 extern NTSTATUS get_thread_context( HANDLE handle, void *context, BOOL *self, USHORT machine );
 extern unsigned int alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                              data_size_t *ret_len );
+extern void close_fast_sync( HANDLE handle );
 extern NTSTATUS system_time_precise( void *args );
 
 extern void *anon_mmap_fixed( void *start, size_t size, int prot, int flags );
@@ -54,6 +54,13 @@
 #ifdef HAVE_LIBPROCSTAT_H
 # include <libprocstat.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#ifdef HAVE_LINUX_USERFAULTFD_H
+# include <sys/ioctl.h>
+# include <linux/userfaultfd.h>
+#endif
 #include <unistd.h>
 #include <dlfcn.h>
 #ifdef HAVE_VALGRIND_VALGRIND_H
@@ -127,6 +134,7 @@ struct file_view
 #define VPROT_SYSTEM           0x0200  /* system view (underlying mmap not under our control) */
 #define VPROT_PLACEHOLDER      0x0400
 #define VPROT_FREE_PLACEHOLDER 0x0800
+#define VPROT_KERNEL_WRITEWATCH 0x1000  /* write watches are tracked by the kernel */
 
 /* Conversion from VPROT_* to Win32 flags */
 static const BYTE VIRTUAL_Win32Flags[16] =
@@ -151,6 +159,9 @@ static const BYTE VIRTUAL_Win32Flags[16] =
 
 static struct wine_rb_tree views_tree;
 static pthread_mutex_t virtual_mutex;
+static unsigned int views_seq;          /* sequence count for lockless lookups, odd while modifying views */
+static unsigned int views_write_depth;  /* nesting level of views modifications */
+static const unsigned int views_max_depth = 2 * 8 * sizeof(void *);  /* max depth of a valid views tree */
 
 static const UINT page_shift = 12;
 static const UINT_PTR page_mask = 0xfff;
@@ -868,6 +879,58 @@ static inline int is_view_valloc( const struct file_view *view )
     return !(view->protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT));
 }
 
+
+/***********************************************************************
+ *           views_write_begin
+ *
+ * Start modifying the views tree or the page protection bytes. Modifications may be nested.
+ * virtual_mutex must be held by caller.
+ */
+static inline void views_write_begin(void)
+{
+    if (views_write_depth++) return;
+    __atomic_store_n( &views_seq, views_seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+
+/***********************************************************************
+ *           views_write_end
+ *
+ * Finish modifying the views tree or the page protection bytes.
+ * virtual_mutex must be held by caller.
+ */
+static inline void views_write_end(void)
+{
+    if (--views_write_depth) return;
+    __atomic_store_n( &views_seq, views_seq + 1, __ATOMIC_RELEASE );
+}
+
+
+/***********************************************************************
+ *           views_read_begin
+ *
+ * Start a lockless lookup in the views tree or the page protection bytes. View structures
+ * and protection bytes are never unmapped, so they can be read at any time, but the data
+ * must not be trusted until views_read_valid() has succeeded.
+ */
+static inline unsigned int views_read_begin(void)
+{
+    return __atomic_load_n( &views_seq, __ATOMIC_ACQUIRE );
+}
+
+
+/***********************************************************************
+ *           views_read_valid
+ *
+ * Check that no modification happened since the corresponding views_read_begin().
+ */
+static inline BOOL views_read_valid( unsigned int seq )
+{
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    return !(seq & 1) && __atomic_load_n( &views_seq, __ATOMIC_RELAXED ) == seq;
+}
+
 /***********************************************************************
  *           get_page_vprot
  *
@@ -951,6 +1014,7 @@ static void set_page_vprot( const void *addr, size_t size, BYTE vprot )
     size_t idx = (size_t)addr >> page_shift;
     size_t end = ((size_t)addr + size + page_mask) >> page_shift;
 
+    views_write_begin();
 #ifdef _WIN64
     while (idx >> pages_vprot_shift != end >> pages_vprot_shift)
     {
@@ -962,6 +1026,26 @@ static void set_page_vprot( const void *addr, size_t size, BYTE vprot )
 #else
     memset( pages_vprot + idx, vprot, end - idx );
 #endif
+    views_write_end();
+}
+
+
+/***********************************************************************
+ *           update_vprot_bytes
+ *
+ * Set or clear bits in an array of page protection bytes, a word at a time where possible.
+ */
+static void update_vprot_bytes( BYTE *ptr, size_t count, BYTE set, BYTE clear )
+{
+    static const UINT_PTR word_from_byte = (UINT_PTR)0x101010101010101;
+    UINT_PTR set_word = word_from_byte * set, clear_word = word_from_byte * clear;
+
+    for ( ; count && ((UINT_PTR)ptr & (sizeof(UINT_PTR) - 1)); count--, ptr++)
+        *ptr = (*ptr & ~clear) | set;
+    for ( ; count >= sizeof(UINT_PTR); count -= sizeof(UINT_PTR), ptr += sizeof(UINT_PTR))
+        *(UINT_PTR *)ptr = (*(UINT_PTR *)ptr & ~clear_word) | set_word;
+    for ( ; count; count--, ptr++)
+        *ptr = (*ptr & ~clear) | set;
 }
 
 
@@ -975,15 +1059,19 @@ static void set_page_vprot_bits( const void *addr, size_t size, BYTE set, BYTE c
     size_t idx = (size_t)addr >> page_shift;
     size_t end = ((size_t)addr + size + page_mask) >> page_shift;
 
+    views_write_begin();
 #ifdef _WIN64
-    for ( ; idx < end; idx++)
+    while (idx >> pages_vprot_shift != end >> pages_vprot_shift)
     {
-        BYTE *ptr = pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask);
-        *ptr = (*ptr & ~clear) | set;
+        size_t dir_size = pages_vprot_mask + 1 - (idx & pages_vprot_mask);
+        update_vprot_bytes( pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask), dir_size, set, clear );
+        idx += dir_size;
     }
+    update_vprot_bytes( pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask), end - idx, set, clear );
 #else
-    for ( ; idx < end; idx++) pages_vprot[idx] = (pages_vprot[idx] & ~clear) | set;
+    update_vprot_bytes( pages_vprot + idx, end - idx, set, clear );
 #endif
+    views_write_end();
 }
 
 
@@ -1177,7 +1265,8 @@ static void VIRTUAL_Dump(void)
 /***********************************************************************
  *           find_view
  *
- * Find the view containing a given address. virtual_mutex must be held by caller.
+ * Find the view containing a given address. virtual_mutex must be held by caller,
+ * unless the result is checked with views_read_valid().
  *
  * PARAMS
  *      addr  [I] Address
@@ -1189,10 +1278,12 @@ static void VIRTUAL_Dump(void)
 static struct file_view *find_view( const void *addr, size_t size )
 {
     struct wine_rb_entry *ptr = views_tree.root;
+    unsigned int depth = 0;
 
     if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
 
-    while (ptr)
+    /* a lockless lookup may run into a loop while the tree is being rebalanced */
+    while (ptr && depth++ < views_max_depth)
     {
         struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
 
@@ -1205,6 +1296,45 @@ static struct file_view *find_view( const void *addr, size_t size )
 }
 
 
+/***********************************************************************
+ *           find_view_alloc_range
+ *
+ * Find the view containing a given address, and the allocation range around it;
+ * if there is no view, the range is the free area containing the address.
+ * virtual_mutex must be held by caller, unless the result is checked with views_read_valid().
+ */
+static struct file_view *find_view_alloc_range( char *base, char **alloc_base, char **alloc_end )
+{
+    struct wine_rb_entry *ptr = views_tree.root;
+    unsigned int depth = 0;
+
+    *alloc_base = 0;
+    *alloc_end = working_set_limit;
+    while (ptr && depth++ < views_max_depth)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+
+        if ((char *)view->base > base)
+        {
+            *alloc_end = view->base;
+            ptr = ptr->left;
+        }
+        else if ((char *)view->base + view->size <= base)
+        {
+            *alloc_base = (char *)view->base + view->size;
+            ptr = ptr->right;
+        }
+        else
+        {
+            *alloc_base = view->base;
+            *alloc_end = (char *)view->base + view->size;
+            return view;
+        }
+    }
+    return NULL;
+}
+
+
 /***********************************************************************
  *           is_write_watch_range
  */
@@ -1524,7 +1654,9 @@ static void unregister_view( struct file_view *view )
 {
     if (mmap_is_in_reserved_area( view->base, view->size ))
         free_ranges_remove_view( view );
+    views_write_begin();
     wine_rb_remove( &views_tree, &view->entry );
+    views_write_end();
 }
 
 
@@ -1536,9 +1668,11 @@ static void unregister_view( struct file_view *view )
 static void delete_view( struct file_view *view ) /* [in] View */
 {
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
+    views_write_begin();
     set_page_vprot( view->base, view->size, 0 );
     if (view->protect & VPROT_ARM64EC) clear_arm64ec_range( view->base, view->size );
     unregister_view( view );
+    views_write_end();
     free_view( view );
 }
 
@@ -1550,7 +1684,9 @@ static void delete_view( struct file_view *view ) /* [in] View */
  */
 static void register_view( struct file_view *view )
 {
+    views_write_begin();
     wine_rb_put( &views_tree, view->base, &view->entry );
+    views_write_end();
     if (mmap_is_in_reserved_area( view->base, view->size ))
         free_ranges_insert_view( view );
 }
@@ -1776,11 +1912,213 @@ static void commit_arm64ec_map( struct file_view *view )
     size_t size = ROUND_SIZE( start, end + 1 - start );
     void *base = ROUND_ADDR( (char *)arm64ec_view->base + start, page_mask );
 
+    views_write_begin();
     view->protect |= VPROT_ARM64EC;
+    views_write_end();
     set_vprot( arm64ec_view, base, size, VPROT_READ | VPROT_WRITE | VPROT_COMMITTED );
 }
 
 
+#if defined(HAVE_LINUX_USERFAULTFD_H) && defined(__NR_userfaultfd) && defined(UFFDIO_WRITEPROTECT)
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+
+#ifndef PAGEMAP_SCAN  /* Linux 6.7 */
+#define PAGE_IS_WRITTEN       (1 << 3)
+#define PM_SCAN_WP_MATCHING   (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC (1 << 1)
+
+struct page_region
+{
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+struct pm_scan_arg
+{
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+/* With an asynchronous write-protect userfaultfd, the kernel resolves write faults on watched
+ * pages by itself, and PAGEMAP_SCAN reports the pages written since they were protected. */
+static int write_watch_uffd = -2;  /* userfaultfd, -1 if write watches are not tracked by the kernel */
+static int write_watch_pagemap = -1;  /* /proc/self/pagemap fd for PAGEMAP_SCAN */
+
+/***********************************************************************
+ *           kernel_reset_write_watches
+ */
+static BOOL kernel_reset_write_watches( void *base, SIZE_T size )
+{
+    struct uffdio_writeprotect wp;
+
+    wp.range.start = (UINT_PTR)base;
+    wp.range.len = size;
+    wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+    return !ioctl( write_watch_uffd, UFFDIO_WRITEPROTECT, &wp );
+}
+
+
+/***********************************************************************
+ *           kernel_register_write_watches
+ *
+ * Start tracking writes to a range with the kernel; all the pages start unwritten.
+ */
+static BOOL kernel_register_write_watches( void *base, SIZE_T size )
+{
+    struct uffdio_register reg;
+
+    reg.range.start = (UINT_PTR)base;
+    reg.range.len = size;
+    reg.mode = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl( write_watch_uffd, UFFDIO_REGISTER, &reg )) return FALSE;
+    return kernel_reset_write_watches( base, size );
+}
+
+
+/***********************************************************************
+ *           kernel_unregister_write_watches
+ *
+ * Stop tracking writes to a range with the kernel.
+ */
+static void kernel_unregister_write_watches( void *base, SIZE_T size )
+{
+    struct uffdio_range range;
+
+    range.start = (UINT_PTR)base;
+    range.len = size;
+    ioctl( write_watch_uffd, UFFDIO_UNREGISTER, &range );
+}
+
+
+/***********************************************************************
+ *           kernel_get_write_watches
+ *
+ * Retrieve at most count written pages in a range, optionally resetting the scanned part.
+ * Returns the number of pages, or -1 on failure.
+ */
+static SSIZE_T kernel_get_write_watches( char *base, SIZE_T size, void **addresses, ULONG_PTR count,
+                                         BOOL reset )
+{
+    struct page_region regions[64];
+    struct pm_scan_arg arg;
+    ULONG_PTR pos = 0;
+    char *addr;
+    int i, ret;
+
+    memset( &arg, 0, sizeof(arg) );
+    arg.size = sizeof(arg);
+    arg.flags = PM_SCAN_CHECK_WPASYNC | (reset ? PM_SCAN_WP_MATCHING : 0);
+    arg.start = (UINT_PTR)base;
+    arg.end = (UINT_PTR)base + size;
+    arg.vec = (UINT_PTR)regions;
+    arg.vec_len = ARRAY_SIZE(regions);
+    arg.category_mask = PAGE_IS_WRITTEN;
+    arg.return_mask = PAGE_IS_WRITTEN;
+
+    while (pos < count && arg.start < arg.end)
+    {
+        arg.max_pages = count - pos;
+        if ((ret = ioctl( write_watch_pagemap, PAGEMAP_SCAN, &arg )) == -1) return -1;
+        for (i = 0; i < ret; i++)
+            for (addr = (char *)(UINT_PTR)regions[i].start; addr < (char *)(UINT_PTR)regions[i].end; addr += page_size)
+                addresses[pos++] = addr;
+        if (arg.walk_end <= arg.start) break;
+        arg.start = arg.walk_end;
+    }
+    return pos;
+}
+
+
+/***********************************************************************
+ *           use_kernel_write_watches
+ *
+ * Check whether write watches can be tracked by the kernel (Linux 6.7+).
+ * virtual_mutex must be held by caller.
+ */
+static BOOL use_kernel_write_watches(void)
+{
+    struct uffdio_api api;
+    void *addresses[2];
+    char *ptr;
+    BOOL ret;
+
+    if (write_watch_uffd != -2) return write_watch_uffd != -1;
+
+    write_watch_uffd = syscall( __NR_userfaultfd, UFFD_USER_MODE_ONLY | O_CLOEXEC | O_NONBLOCK );
+    if (write_watch_uffd == -1)
+    {
+        TRACE( "userfaultfd not available, errno %d\n", errno );
+        return FALSE;
+    }
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    if (ioctl( write_watch_uffd, UFFDIO_API, &api ) ||
+        (write_watch_pagemap = open( "/proc/self/pagemap", O_RDONLY | O_CLOEXEC )) == -1)
+    {
+        TRACE( "asynchronous write protection not supported\n" );
+        goto failed;
+    }
+
+    /* make sure that writes are tracked as expected, some virtualized environments get it wrong */
+    if ((ptr = anon_mmap_alloc( page_size, PROT_READ | PROT_WRITE )) == MAP_FAILED) goto failed;
+    ret = kernel_register_write_watches( ptr, page_size ) &&
+          !kernel_get_write_watches( ptr, page_size, addresses, 2, FALSE );
+    if (ret)
+    {
+        ptr[0] = 1;
+        ret = kernel_get_write_watches( ptr, page_size, addresses, 2, TRUE ) == 1 &&
+              !kernel_get_write_watches( ptr, page_size, addresses, 2, FALSE );
+    }
+    munmap( ptr, page_size );
+    if (ret)
+    {
+        TRACE( "using kernel write watches\n" );
+        return TRUE;
+    }
+    WARN( "kernel write watches not working as expected\n" );
+
+failed:
+    if (write_watch_pagemap != -1) close( write_watch_pagemap );
+    close( write_watch_uffd );
+    write_watch_pagemap = write_watch_uffd = -1;
+    return FALSE;
+}
+
+#else
+
+static BOOL kernel_reset_write_watches( void *base, SIZE_T size ) { return FALSE; }
+static BOOL kernel_register_write_watches( void *base, SIZE_T size ) { return FALSE; }
+static void kernel_unregister_write_watches( void *base, SIZE_T size ) { }
+static SSIZE_T kernel_get_write_watches( char *base, SIZE_T size, void **addresses, ULONG_PTR count,
+                                         BOOL reset ) { return -1; }
+static BOOL use_kernel_write_watches(void) { return FALSE; }
+
+#endif
+
+
 /***********************************************************************
  *           update_write_watches
  */
@@ -1799,13 +2137,90 @@ static void update_write_watches( void *base, size_t size, size_t accessed_size
  *
  * Reset write watches in a memory range.
  */
-static void reset_write_watches( void *base, SIZE_T size )
+static void reset_write_watches( struct file_view *view, void *base, SIZE_T size )
 {
+    if (view->protect & VPROT_KERNEL_WRITEWATCH)
+    {
+        if (!kernel_reset_write_watches( base, size ))
+            ERR( "failed to reset write watches %p-%p, errno %d\n", base, (char *)base + size, errno );
+        return;
+    }
     set_page_vprot_bits( base, size, VPROT_WRITEWATCH, 0 );
     mprotect_range( base, size, 0, 0 );
 }
 
 
+/***********************************************************************
+ *           enable_write_watches
+ *
+ * Enable write watches on a newly allocated view that was not mapped with VPROT_WRITEWATCH
+ * because the kernel can track them. virtual_mutex must be held by caller.
+ */
+static void enable_write_watches( struct file_view *view )
+{
+    views_write_begin();
+    view->protect |= VPROT_WRITEWATCH;
+    if (kernel_register_write_watches( view->base, view->size ))
+        view->protect |= VPROT_KERNEL_WRITEWATCH;
+    else
+    {
+        WARN( "failed to register %p-%p, errno %d, falling back to write faults\n",
+              view->base, (char *)view->base + view->size, errno );
+        reset_write_watches( view, view->base, view->size );
+    }
+    views_write_end();
+}
+
+
+/***********************************************************************
+ *           clear_kernel_written_pages
+ *
+ * Clear the write watch flag of the pages written in a range tracked by the kernel.
+ * virtual_mutex must be held by caller.
+ */
+static void clear_kernel_written_pages( char *addr, char *end )
+{
+    void *addresses[64];
+    SSIZE_T i, count;
+
+    while (addr < end && (count = kernel_get_write_watches( addr, end - addr, addresses,
+                                                              ARRAY_SIZE(addresses), FALSE )))
+    {
+        if (count == -1)
+        {
+            /* report the remaining pages as written rather than missing a write */
+            ERR( "failed to get write watches %p-%p, errno %d\n", addr, end, errno );
+            set_page_vprot_bits( addr, end - addr, 0, VPROT_WRITEWATCH );
+            break;
+        }
+        for (i = 0; i < count; i++) set_page_vprot_bits( addresses[i], page_size, 0, VPROT_WRITEWATCH );
+        addr = (char *)addresses[count - 1] + page_size;
+    }
+}
+
+
+/***********************************************************************
+ *           disable_kernel_write_watches
+ *
+ * Switch a view from kernel write watches to write faults, keeping the pages written so far.
+ * The range at start is not tracked by the kernel anymore, and is left unwritten.
+ * virtual_mutex must be held by caller.
+ */
+static void disable_kernel_write_watches( struct file_view *view, size_t start, size_t size )
+{
+    char *base = view->base;
+
+    views_write_begin();
+    set_page_vprot_bits( base, view->size, VPROT_WRITEWATCH, 0 );
+    clear_kernel_written_pages( base, base + start );
+    clear_kernel_written_pages( base + start + size, base + view->size );
+    kernel_unregister_write_watches( base, view->size );
+    view->protect &= ~VPROT_KERNEL_WRITEWATCH;
+    mprotect_range( base, view->size, 0, 0 );
+    views_write_end();
+}
+
+
 /***********************************************************************
  *           unmap_extra_space
  *
@@ -1990,9 +2405,11 @@ static NTSTATUS map_view( struct file_view **view_ret, void *base, size_t size,
 
         TRACE( "found view %p, size %p, protect %#x.\n", view->base, (void *)view->size, view->protect );
 
+        views_write_begin();
         view->protect = vprot | VPROT_PLACEHOLDER;
         set_vprot( view, base, size, vprot );
-        if (vprot & VPROT_WRITEWATCH) reset_write_watches( base, size );
+        views_write_end();
+        if (vprot & VPROT_WRITEWATCH) reset_write_watches( view, base, size );
         *view_ret = view;
         return STATUS_SUCCESS;
     }
@@ -2189,6 +2606,14 @@ static NTSTATUS decommit_pages( struct file_view *view, size_t start, size_t siz
     if (anon_mmap_fixed( (char *)view->base + start, size, PROT_NONE, 0 ) != MAP_FAILED)
     {
         set_page_vprot_bits( (char *)view->base + start, size, 0, VPROT_COMMITTED );
+        /* the new mapping needs to be registered again */
+        if ((view->protect & VPROT_KERNEL_WRITEWATCH) &&
+            !kernel_register_write_watches( (char *)view->base + start, size ))
+        {
+            WARN( "failed to register %p-%p, errno %d, falling back to write faults\n",
+                  (char *)view->base + start, (char *)view->base + start + size, errno );
+            disable_kernel_write_watches( view, start, size );
+        }
         return STATUS_SUCCESS;
     }
     return STATUS_NO_MEMORY;
@@ -2218,16 +2643,19 @@ static NTSTATUS remove_pages_from_view( struct file_view *view, char *base, size
         new_view->size    = (char *)view->base + view->size - (char *)new_view->base;
         new_view->protect = view->protect;
 
+        views_write_begin();
         unregister_view( view );
         view->size = base - (char *)view->base;
         register_view( view );
         register_view( new_view );
+        views_write_end();
 
         VIRTUAL_DEBUG_DUMP_VIEW( view );
         VIRTUAL_DEBUG_DUMP_VIEW( new_view );
     }
     else
     {
+        views_write_begin();
         unregister_view( view );
         if (view->base == base)
         {
@@ -2237,6 +2665,7 @@ static NTSTATUS remove_pages_from_view( struct file_view *view, char *base, size
         else view->size = base - (char *)view->base;
 
         register_view( view );
+        views_write_end();
         VIRTUAL_DEBUG_DUMP_VIEW( view );
     }
     return STATUS_SUCCESS;
@@ -2266,8 +2695,10 @@ static NTSTATUS free_pages_preserve_placeholder( struct file_view *view, char *b
         if (status) return status;
     }
 
+    views_write_begin();
     view->protect = VPROT_PLACEHOLDER | VPROT_FREE_PLACEHOLDER;
     set_page_vprot( view->base, view->size, 0 );
+    views_write_end();
     anon_mmap_fixed( view->base, view->size, PROT_NONE, 0 );
     return STATUS_SUCCESS;
 }
@@ -2331,6 +2762,7 @@ static NTSTATUS coalesce_placeholders( struct file_view *view, char *base, size_
 
     if (view_count < 2 || size != views_size) return STATUS_CONFLICTING_ADDRESSES;
 
+    views_write_begin();
     for (i = 1; i < view_count; ++i)
     {
         curr_view = RB_ENTRY_VALUE( rb_next( &view->entry ), struct file_view, entry );
@@ -2341,6 +2773,7 @@ static NTSTATUS coalesce_placeholders( struct file_view *view, char *base, size_
     unregister_view( view );
     view->size = views_size;
     register_view( view );
+    views_write_end();
 
     VIRTUAL_DEBUG_DUMP_VIEW( view );
 
@@ -3986,8 +4419,24 @@ NTSTATUS virtual_handle_fault( void *addr, DWORD err, void *stack )
 {
     NTSTATUS ret = STATUS_ACCESS_VIOLATION;
     char *page = ROUND_ADDR( addr, page_mask );
+    unsigned int seq;
     BYTE vprot;
 
+    /* faults that don't require updating the page protections can be resolved without locking */
+    seq = views_read_begin();
+    vprot = get_page_vprot( page );
+    if (!(vprot & (VPROT_GUARD | VPROT_WRITEWATCH)))
+    {
+#ifdef __APPLE__
+        if (err == EXCEPTION_READ_FAULT && (get_unix_prot( vprot ) & PROT_READ)) err = EXCEPTION_WRITE_FAULT;
+#endif
+        if ((err & EXCEPTION_WRITE_FAULT) && (get_unix_prot( vprot ) & PROT_WRITE) &&
+            is_write_watch_range( page, page_size ))
+            ret = STATUS_SUCCESS;
+        if (views_read_valid( seq )) return ret;
+        ret = STATUS_ACCESS_VIOLATION;
+    }
+
     mutex_lock( &virtual_mutex );  /* no need for signal masking inside signal handler */
     vprot = get_page_vprot( page );
 
@@ -4218,12 +4667,19 @@ ssize_t virtual_locked_recvmsg( int fd, struct msghdr *hdr, int flags )
 BOOL virtual_is_valid_code_address( const void *addr, SIZE_T size )
 {
     struct file_view *view;
+    unsigned int seq;
     BOOL ret = FALSE;
     sigset_t sigset;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    seq = views_read_begin();
     if ((view = find_view( addr, size )))
         ret = !(view->protect & VPROT_SYSTEM);  /* system views are not visible to the app */
+    if (views_read_valid( seq )) return ret;
+
+    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    if ((view = find_view( addr, size )))
+        ret = !(view->protect & VPROT_SYSTEM);
+    else ret = FALSE;
     server_leave_uninterrupted_section( &virtual_mutex, &sigset );
     return ret;
 }
@@ -4520,7 +4976,7 @@ static NTSTATUS allocate_virtual_memory( void **ret, SIZE_T *size_ptr, ULONG typ
         if (!(status = get_vprot_flags( protect, &vprot, FALSE )))
         {
             if (type & MEM_COMMIT) vprot |= VPROT_COMMITTED;
-            if (type & MEM_WRITE_WATCH) vprot |= VPROT_WRITEWATCH;
+            if ((type & MEM_WRITE_WATCH) && !use_kernel_write_watches()) vprot |= VPROT_WRITEWATCH;
             if (type & MEM_RESERVE_PLACEHOLDER) vprot |= VPROT_PLACEHOLDER | VPROT_FREE_PLACEHOLDER;
             if (protect & PAGE_NOCACHE) vprot |= SEC_NOCACHE;
 
@@ -4529,7 +4985,11 @@ static NTSTATUS allocate_virtual_memory( void **ret, SIZE_T *size_ptr, ULONG typ
             else status = map_view( &view, base, size, type, vprot, limit_low, limit_high,
                                     align ? align - 1 : granularity_mask );
 
-            if (status == STATUS_SUCCESS) base = view->base;
+            if (status == STATUS_SUCCESS)
+            {
+                base = view->base;
+                if ((type & MEM_WRITE_WATCH) && !(vprot & VPROT_WRITEWATCH)) enable_write_watches( view );
+            }
         }
     }
     else if (type & MEM_RESET)
@@ -4944,10 +5404,64 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
 }
 
 
+static void fill_view_memory_info( MEMORY_BASIC_INFORMATION *info, char *alloc_base, unsigned int protect,
+                                   BYTE vprot, SIZE_T size )
+{
+    info->AllocationBase = alloc_base;
+    info->RegionSize = size;
+    info->State = (vprot & VPROT_COMMITTED) ? MEM_COMMIT : MEM_RESERVE;
+    info->Protect = (vprot & VPROT_COMMITTED) ? get_win32_prot( vprot, protect ) : 0;
+    info->AllocationProtect = get_win32_prot( protect, protect );
+    if (protect & SEC_IMAGE) info->Type = MEM_IMAGE;
+    else if (protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT)) info->Type = MEM_MAPPED;
+    else info->Type = MEM_PRIVATE;
+}
+
+/* try to fill the basic information without taking the virtual mutex */
+static BOOL fill_basic_memory_info_lockless( char *base, MEMORY_BASIC_INFORMATION *info )
+{
+    char *alloc_base, *alloc_end, *view_base;
+    struct file_view *view;
+    unsigned int seq, protect;
+    SIZE_T view_size, size;
+    BYTE vprot;
+
+    seq = views_read_begin();
+    if (!(view = find_view_alloc_range( base, &alloc_base, &alloc_end )))
+    {
+#ifdef __i386__
+        return FALSE;  /* free ranges may need to check the reserved areas */
+#else
+        if (!views_read_valid( seq )) return FALSE;
+        info->BaseAddress       = base;
+        info->RegionSize        = alloc_end - base;
+        info->State             = MEM_FREE;
+        info->Protect           = PAGE_NOACCESS;
+        info->AllocationBase    = 0;
+        info->AllocationProtect = 0;
+        info->Type              = 0;
+        return TRUE;
+#endif
+    }
+
+    view_base = view->base;
+    view_size = view->size;
+    protect = view->protect;
+    if (protect & SEC_RESERVE) return FALSE;  /* committed state is kept by the server */
+    /* make sure the protection bytes of the range are allocated before reading them */
+    if (!views_read_valid( seq )) return FALSE;
+
+    size = get_vprot_range_size( base, view_base + view_size - base, ~VPROT_WRITEWATCH, &vprot );
+    if (!views_read_valid( seq )) return FALSE;
+
+    info->BaseAddress = base;
+    fill_view_memory_info( info, alloc_base, protect, vprot, size );
+    return TRUE;
+}
+
 static unsigned int fill_basic_memory_info( const void *addr, MEMORY_BASIC_INFORMATION *info )
 {
-    char *base, *alloc_base = 0, *alloc_end = working_set_limit;
-    struct wine_rb_entry *ptr;
+    char *base, *alloc_base, *alloc_end;
     struct file_view *view;
     sigset_t sigset;
 
@@ -4955,37 +5469,19 @@ static unsigned int fill_basic_memory_info( const void *addr, MEMORY_BASIC_INFOR
 
     if (is_beyond_limit( base, 1, working_set_limit )) return STATUS_INVALID_PARAMETER;
 
+    if (fill_basic_memory_info_lockless( base, info )) return STATUS_SUCCESS;
+
     /* Find the view containing the address */
 
     server_enter_uninterrupted_section( &virtual_mutex, &sigset );
-    ptr = views_tree.root;
-    while (ptr)
-    {
-        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
-        if ((char *)view->base > base)
-        {
-            alloc_end = view->base;
-            ptr = ptr->left;
-        }
-        else if ((char *)view->base + view->size <= base)
-        {
-            alloc_base = (char *)view->base + view->size;
-            ptr = ptr->right;
-        }
-        else
-        {
-            alloc_base = view->base;
-            alloc_end = (char *)view->base + view->size;
-            break;
-        }
-    }
+    view = find_view_alloc_range( base, &alloc_base, &alloc_end );
 
     /* Fill the info structure */
 
     info->BaseAddress = base;
     info->RegionSize  = alloc_end - base;
 
-    if (!ptr)
+    if (!view)
     {
         info->State             = MEM_FREE;
         info->Protect           = PAGE_NOACCESS;
@@ -5041,15 +5537,9 @@ static unsigned int fill_basic_memory_info( const void *addr, MEMORY_BASIC_INFOR
     else
     {
         BYTE vprot;
+        SIZE_T size = get_committed_size( view, base, &vprot, ~VPROT_WRITEWATCH );
 
-        info->AllocationBase = alloc_base;
-        info->RegionSize = get_committed_size( view, base, &vprot, ~VPROT_WRITEWATCH );
-        info->State = (vprot & VPROT_COMMITTED) ? MEM_COMMIT : MEM_RESERVE;
-        info->Protect = (vprot & VPROT_COMMITTED) ? get_win32_prot( vprot, view->protect ) : 0;
-        info->AllocationProtect = get_win32_prot( view->protect, view->protect );
-        if (view->protect & SEC_IMAGE) info->Type = MEM_IMAGE;
-        else if (view->protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT)) info->Type = MEM_MAPPED;
-        else info->Type = MEM_PRIVATE;
+        fill_view_memory_info( info, alloc_base, view->protect, vprot, size );
     }
     server_leave_uninterrupted_section( &virtual_mutex, &sigset );
 
@@ -5829,6 +6319,7 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
                                  ULONG_PTR *count, ULONG *granularity )
 {
     NTSTATUS status = STATUS_SUCCESS;
+    struct file_view *view;
     sigset_t sigset;
 
     size = ROUND_SIZE( base, size );
@@ -5845,18 +6336,33 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
 
     server_enter_uninterrupted_section( &virtual_mutex, &sigset );
 
-    if (is_write_watch_range( base, size ))
+    if ((view = find_view( base, size )) && (view->protect & VPROT_WRITEWATCH))
     {
         ULONG_PTR pos = 0;
         char *addr = base;
         char *end = addr + size;
+        SSIZE_T ret;
 
-        while (pos < *count && addr < end)
+        if (view->protect & VPROT_KERNEL_WRITEWATCH)
         {
-            if (!(get_page_vprot( addr ) & VPROT_WRITEWATCH)) addresses[pos++] = addr;
-            addr += page_size;
+            if ((ret = kernel_get_write_watches( base, size, addresses, *count,
+                                                 flags & WRITE_WATCH_FLAG_RESET )) != -1)
+                pos = ret;
+            else
+            {
+                ERR( "failed to get write watches %p-%p, errno %d\n", base, end, errno );
+                status = STATUS_UNSUCCESSFUL;
+            }
+        }
+        else
+        {
+            while (pos < *count && addr < end)
+            {
+                if (!(get_page_vprot( addr ) & VPROT_WRITEWATCH)) addresses[pos++] = addr;
+                addr += page_size;
+            }
+            if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( view, base, addr - (char *)base );
         }
-        if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( base, addr - (char *)base );
         *count = pos;
         *granularity = page_size;
     }
@@ -5874,6 +6380,7 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
 NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 {
     NTSTATUS status = STATUS_SUCCESS;
+    struct file_view *view;
     sigset_t sigset;
 
     size = ROUND_SIZE( base, size );
@@ -5885,8 +6392,8 @@ NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 
     server_enter_uninterrupted_section( &virtual_mutex, &sigset );
 
-    if (is_write_watch_range( base, size ))
-        reset_write_watches( base, size );
+    if ((view = find_view( base, size )) && (view->protect & VPROT_WRITEWATCH))
+        reset_write_watches( view, base, size );
     else
         status = STATUS_INVALID_PARAMETER;
 
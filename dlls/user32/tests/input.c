@@ -5852,6 +5852,47 @@ static void test_LoadKeyboardLayoutEx( HKL orig_hkl )
 
 /* run the tests in a separate desktop to avoid interaction with other
  * tests, current desktop state, or user actions. */
+static DWORD WINAPI shared_state_thread( void *arg )
+{
+    DWORD tid = (DWORD)(UINT_PTR)arg;
+
+    ok_ret( 1, PostThreadMessageW( tid, WM_USER, 0, 0 ) );
+    ok_ret( 1, SetCursorPos( 70, 70 ) );
+    keybd_event( 'F', 0, 0, 0 );
+    return 0;
+}
+
+/* state changed by other threads is visible through the session shared memory */
+static void test_shared_state(void)
+{
+    POINT pos, expect_pos = {70, 70};
+    HANDLE thread;
+    MSG msg;
+
+    while (PeekMessageW( &msg, 0, 0, 0, PM_REMOVE )) /* nothing */;
+    GetQueueStatus( QS_ALLINPUT );
+    ok_ret( 0, GetQueueStatus( QS_POSTMESSAGE ) );
+    ok_ret( 0, (WORD)GetAsyncKeyState( 'F' ) & 0x8000 );
+
+    thread = CreateThread( NULL, 0, shared_state_thread, ULongToPtr( GetCurrentThreadId() ), 0, NULL );
+    ok( !!thread, "CreateThread failed, error %lu\n", GetLastError() );
+    ok_ret( 0, WaitForSingleObject( thread, 5000 ) );
+    CloseHandle( thread );
+
+    ok_ret( MAKELONG( QS_POSTMESSAGE, QS_POSTMESSAGE ), GetQueueStatus( QS_POSTMESSAGE ) );
+    ok_ret( 1, GetCursorPos( &pos ) );
+    ok_point( expect_pos, pos );
+    ok_ret( 0x8000, (WORD)GetAsyncKeyState( 'F' ) & 0x8000 );
+
+    keybd_event( 'F', 0, KEYEVENTF_KEYUP, 0 );
+    ok_ret( 0, (WORD)GetAsyncKeyState( 'F' ) & 0x8000 );
+
+    ok_ret( 1, PeekMessageW( &msg, 0, WM_USER, WM_USER, PM_REMOVE ) );
+    ok_ret( WM_USER, msg.message );
+    ok_ret( 0, GetQueueStatus( QS_POSTMESSAGE ) );
+    while (PeekMessageW( &msg, 0, 0, 0, PM_REMOVE )) /* nothing */;
+}
+
 static void test_input_desktop( char **argv )
 {
     HKL hkl = GetKeyboardLayout( 0 );
@@ -5862,6 +5903,7 @@ static void test_input_desktop( char **argv )
     trace( "hkl %p\n", hkl );
     ok_ret( 1, GetCursorPos( &pos ) );
     test_SetCursorPos();
+    test_shared_state();
 
     get_test_scan( 'F', &scan, &wch, &wch_shift );
     test_SendInput( 'F', wch, hkl );
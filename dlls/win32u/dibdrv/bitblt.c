@@ -23,6 +23,9 @@
 #endif
 
 #include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "ntgdi_private.h"
 #include "dibdrv.h"
@@ -585,17 +588,259 @@ static void mask_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     }
 }
 
+/* large operations are split in row bands that are processed in parallel by worker threads */
+
+#define MAX_BANDS 8
+
+static const unsigned int band_min_pixels = 512 * 512;  /* smaller operations are done directly */
+static const int band_min_rows = 32;
+
+typedef void (*band_func)( const dib_info *dib, int num, const RECT *rects, void *ctx );
+
+struct band_job
+{
+    band_func       func;
+    const dib_info *dib;
+    void           *ctx;
+    int             count;      /* number of bands */
+    int             next;       /* next band to process */
+    int             done;       /* number of bands processed */
+    int             num[MAX_BANDS];
+    const RECT     *rects[MAX_BANDS];
+};
+
+static pthread_mutex_t band_job_mutex = PTHREAD_MUTEX_INITIALIZER;  /* held while a job is running */
+static pthread_mutex_t band_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t band_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t band_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t band_once = PTHREAD_ONCE_INIT;
+static struct band_job *band_job;
+static int band_workers;
+
+/* take the next band of the current job, the band_mutex must be held */
+static int get_next_band( struct band_job *job )
+{
+    if (!job || job->next >= job->count) return -1;
+    return job->next++;
+}
+
+static void finish_band( struct band_job *job )
+{
+    pthread_mutex_lock( &band_mutex );
+    if (++job->done == job->count) pthread_cond_signal( &band_done_cond );
+    pthread_mutex_unlock( &band_mutex );
+}
+
+static void *band_worker( void *arg )
+{
+    struct band_job *job;
+    int band;
+
+    for (;;)
+    {
+        pthread_mutex_lock( &band_mutex );
+        while ((band = get_next_band( band_job )) == -1) pthread_cond_wait( &band_cond, &band_mutex );
+        job = band_job;
+        pthread_mutex_unlock( &band_mutex );
+
+        job->func( job->dib, job->num[band], job->rects[band], job->ctx );
+        finish_band( job );
+    }
+    return NULL;
+}
+
+static void init_band_workers(void)
+{
+    long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    sigset_t sigset, old_sigset;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int i;
+
+    if (cpus <= 1) return;
+
+    /* the workers only touch pixels, they must not receive any of the Wine signals */
+    sigfillset( &sigset );
+    pthread_sigmask( SIG_SETMASK, &sigset, &old_sigset );
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    for (i = 0; i < min( cpus, MAX_BANDS ) - 1; i++)
+    {
+        if (pthread_create( &thread, &attr, band_worker, NULL )) break;
+        band_workers++;
+    }
+    pthread_attr_destroy( &attr );
+    pthread_sigmask( SIG_SETMASK, &old_sigset, NULL );
+    TRACE( "started %u band workers\n", band_workers );
+}
+
+/* check that the rows of a bitmap can be accessed from a worker thread, that is without
+ * causing any fault that needs to be handled by Wine, write watches or guard pages in particular */
+static BOOL is_band_memory_safe( const dib_info *dib, int top, int bottom, BOOL write )
+{
+    const BYTE *first = (const BYTE *)dib->bits.ptr + (dib->rect.top + top) * dib->stride;
+    const BYTE *last = (const BYTE *)dib->bits.ptr + (dib->rect.top + bottom - 1) * dib->stride;
+    const BYTE *addr = min( first, last ), *end = max( first, last ) + abs( dib->stride );
+    MEMORY_BASIC_INFORMATION info;
+    ULONG_PTR count;
+    ULONG granularity;
+    void *watch;
+
+    while (addr < end)
+    {
+        if (NtQueryVirtualMemory( GetCurrentProcess(), addr, MemoryBasicInformation,
+                                  &info, sizeof(info), NULL ))
+            return FALSE;
+        if (info.State == MEM_COMMIT)
+        {
+            if (info.Protect & (PAGE_GUARD | PAGE_NOACCESS)) return FALSE;
+            if (write)
+            {
+                if (!(info.Protect & (PAGE_READWRITE | PAGE_EXECUTE_READWRITE))) return FALSE;
+                count = 1;
+                if (!NtGetWriteWatch( GetCurrentProcess(), 0, info.BaseAddress, 1, &watch, &count, &granularity ))
+                    return FALSE;
+            }
+        }
+        else if (info.State != MEM_FREE) return FALSE;  /* memory outside of any view is not managed by Wine */
+        addr = (const BYTE *)info.BaseAddress + info.RegionSize;
+    }
+    return TRUE;
+}
+
+/***********************************************************************
+ *           run_in_bands
+ *
+ * Run an operation on a list of rectangles, splitting it in bands of rows
+ * that are processed in parallel when the operation is large enough.
+ */
+static void run_in_bands( const dib_info *dib, int num, const RECT *rects, const dib_info *src,
+                          const POINT *offset, band_func func, void *ctx )
+{
+    struct band_job job;
+    unsigned int pixels = 0;
+    int i, band, top = INT_MAX, bottom = INT_MIN, height;
+    RECT *band_rects;
+
+    for (i = 0; i < num; i++)
+    {
+        pixels += (rects[i].right - rects[i].left) * (rects[i].bottom - rects[i].top);
+        top = min( top, rects[i].top );
+        bottom = max( bottom, rects[i].bottom );
+    }
+
+    if (pixels < band_min_pixels || bottom - top < 2 * band_min_rows) goto direct;
+    pthread_once( &band_once, init_band_workers );
+    if (!band_workers) goto direct;
+    if (!is_band_memory_safe( dib, top, bottom, TRUE )) goto direct;
+    if (src && !is_band_memory_safe( src, top + offset->y, bottom + offset->y, FALSE )) goto direct;
+    /* only one job at a time, other threads do their own work */
+    if (pthread_mutex_trylock( &band_job_mutex )) goto direct;
+
+    if (!(band_rects = malloc( num * MAX_BANDS * sizeof(*band_rects) )))
+    {
+        pthread_mutex_unlock( &band_job_mutex );
+        goto direct;
+    }
+
+    job.func  = func;
+    job.dib   = dib;
+    job.ctx   = ctx;
+    job.count = min( band_workers + 1, (bottom - top) / band_min_rows );
+    job.next  = 0;
+    job.done  = 0;
+    height = (bottom - top + job.count - 1) / job.count;
+    for (band = 0; band < job.count; band++)
+    {
+        RECT *rc = band_rects + band * num;
+        int band_top = top + band * height, band_bottom = min( bottom, band_top + height );
+
+        job.rects[band] = rc;
+        job.num[band] = 0;
+        for (i = 0; i < num; i++)
+        {
+            rc->left   = rects[i].left;
+            rc->right  = rects[i].right;
+            rc->top    = max( rects[i].top, band_top );
+            rc->bottom = min( rects[i].bottom, band_bottom );
+            if (rc->top >= rc->bottom) continue;
+            rc++;
+            job.num[band]++;
+        }
+    }
+
+    pthread_mutex_lock( &band_mutex );
+    band_job = &job;
+    pthread_cond_broadcast( &band_cond );
+    while ((band = get_next_band( &job )) != -1)
+    {
+        pthread_mutex_unlock( &band_mutex );
+        func( dib, job.num[band], job.rects[band], ctx );
+        finish_band( &job );
+        pthread_mutex_lock( &band_mutex );
+    }
+    while (job.done < job.count) pthread_cond_wait( &band_done_cond, &band_mutex );
+    band_job = NULL;
+    pthread_mutex_unlock( &band_mutex );
+
+    pthread_mutex_unlock( &band_job_mutex );
+    free( band_rects );
+    return;
+
+direct:
+    func( dib, num, rects, ctx );
+}
+
+struct solid_band_ctx
+{
+    DWORD and;
+    DWORD xor;
+};
+
+static void solid_band( const dib_info *dib, int num, const RECT *rects, void *ctx )
+{
+    struct solid_band_ctx *solid = ctx;
+
+    dib->funcs->solid_rects( dib, num, rects, solid->and, solid->xor );
+}
+
+/***********************************************************************
+ *           solid_rects_in_bands
+ */
+void solid_rects_in_bands( const dib_info *dib, int num, const RECT *rects, DWORD and, DWORD xor )
+{
+    struct solid_band_ctx ctx = { and, xor };
+
+    run_in_bands( dib, num, rects, NULL, NULL, solid_band, &ctx );
+}
+
+struct blend_band_ctx
+{
+    const dib_info *src;
+    POINT           offset;
+    BLENDFUNCTION   blend;
+};
+
+static void blend_band( const dib_info *dib, int num, const RECT *rects, void *ctx )
+{
+    struct blend_band_ctx *blend = ctx;
+
+    dib->funcs->blend_rects( dib, num, rects, blend->src, &blend->offset, blend->blend );
+}
+
 static DWORD blend_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src, const RECT *src_rect,
                          HRGN clip, BLENDFUNCTION blend )
 {
-    POINT offset;
+    struct blend_band_ctx ctx;
     struct clipped_rects clipped_rects;
 
     if (!get_clipped_rects( dst, dst_rect, clip, &clipped_rects )) return ERROR_SUCCESS;
 
-    offset.x = src_rect->left - dst_rect->left;
-    offset.y = src_rect->top  - dst_rect->top;
-    dst->funcs->blend_rects( dst, clipped_rects.count, clipped_rects.rects, src, &offset, blend );
+    ctx.src = src;
+    ctx.offset.x = src_rect->left - dst_rect->left;
+    ctx.offset.y = src_rect->top  - dst_rect->top;
+    ctx.blend = blend;
+    run_in_bands( dst, clipped_rects.count, clipped_rects.rects, src, &ctx.offset, blend_band, &ctx );
 
     free_clipped_rects( &clipped_rects );
     return ERROR_SUCCESS;
@@ -257,6 +257,7 @@ extern void copy_dib_color_info(dib_info *dst, const dib_info *src);
 extern BOOL convert_dib(dib_info *dst, const dib_info *src);
 extern DWORD get_pixel_color( DC *dc, const dib_info *dib, COLORREF color, BOOL mono_fixup );
 extern int get_dib_rect( const dib_info *dib, RECT *rc );
+extern void solid_rects_in_bands( const dib_info *dib, int num, const RECT *rects, DWORD and, DWORD xor );
 extern int clip_rect_to_dib( const dib_info *dib, RECT *rc );
 extern int get_clipped_rects( const dib_info *dib, const RECT *rc, HRGN clip, struct clipped_rects *clip_rects );
 extern void add_clipped_bounds( dibdrv_physdev *dev, const RECT *rect, HRGN clip );
@@ -47,18 +47,34 @@ enum glyph_type
 #define GLYPH_CACHE_PAGE_SIZE  0x100
 #define GLYPH_CACHE_PAGES      (0x10000 / GLYPH_CACHE_PAGE_SIZE)
 
+struct glyph_page_info
+{
+    LONG size;   /* total size of the glyphs of the page */
+    LONG used;   /* font clock value when the page was last used */
+};
+
 struct cached_font
 {
     struct list           entry;
     LONG                  ref;
+    pthread_mutex_t       lock;     /* protects the glyphs while a string is rendered */
     DWORD                 hash;
     LOGFONTW              lf;
     XFORM                 xform;
     UINT                  aa_flags;
+    LONG                  size;     /* total size of the cached glyphs */
+    LONG                  hits;     /* glyph cache statistics */
+    LONG                  misses;
+    LONG                  clock;    /* incremented for every string rendered */
     struct cached_glyph **glyphs[GLYPH_NBTYPES][GLYPH_CACHE_PAGES];
+    struct glyph_page_info pages[GLYPH_NBTYPES][GLYPH_CACHE_PAGES];
 };
 
 static struct list font_cache = LIST_INIT( font_cache );
+static LONG font_cache_size;  /* total size of the glyphs of all the cached fonts */
+
+static const LONG font_cache_max_size = 32 * 1024 * 1024;  /* unused fonts are freed above this size */
+static const LONG font_glyphs_max_size = 8 * 1024 * 1024;  /* glyphs are no longer cached above this size */
 
 static pthread_mutex_t font_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -551,10 +567,80 @@ static int font_cache_cmp( const struct cached_font *p1, const struct cached_fon
     return ret;
 }
 
+/* free a page of glyphs, the font lock must be held, or the font must not be in use */
+static void free_glyph_page( struct cached_font *font, UINT type, UINT page )
+{
+    UINT i;
+
+    for (i = 0; i < GLYPH_CACHE_PAGE_SIZE; i++) free( font->glyphs[type][page][i] );
+    free( font->glyphs[type][page] );
+    font->glyphs[type][page] = NULL;
+    font->size -= font->pages[type][page].size;
+    InterlockedExchangeAdd( &font_cache_size, -font->pages[type][page].size );
+    font->pages[type][page].size = 0;
+}
+
+/* free the glyphs of a cached font, the font_cache_lock must be held */
+static void free_cached_font_glyphs( struct cached_font *font )
+{
+    UINT i, j;
+
+    TRACE( "%p %d %s: %d bytes, %d hits, %d misses\n", font, (int)font->lf.lfHeight,
+           debugstr_w(font->lf.lfFaceName), (int)font->size, (int)font->hits, (int)font->misses );
+
+    for (i = 0; i < GLYPH_NBTYPES; i++)
+        for (j = 0; j < GLYPH_CACHE_PAGES; j++)
+            if (font->glyphs[i][j]) free_glyph_page( font, i, j );
+}
+
+/* free the least recently used glyph pages of a font, so that it can cache new glyphs
+ * again, the font lock must be held */
+static void trim_font_glyphs( struct cached_font *font )
+{
+    UINT i, j, type, page;
+
+    TRACE( "%p %d %s: %d bytes\n", font, (int)font->lf.lfHeight, debugstr_w(font->lf.lfFaceName),
+           (int)font->size );
+
+    while (font->size > font_glyphs_max_size / 2)
+    {
+        type = page = GLYPH_CACHE_PAGES;
+        for (i = 0; i < GLYPH_NBTYPES; i++)
+        {
+            for (j = 0; j < GLYPH_CACHE_PAGES; j++)
+            {
+                if (!font->glyphs[i][j]) continue;
+                if (page != GLYPH_CACHE_PAGES &&
+                    font->pages[i][j].used - font->pages[type][page].used >= 0) continue;
+                type = i;
+                page = j;
+            }
+        }
+        if (page == GLYPH_CACHE_PAGES) break;
+        free_glyph_page( font, type, page );
+    }
+}
+
+/* free the least recently used fonts until the cache is small enough, the font_cache_lock must be held */
+static void trim_font_cache(void)
+{
+    struct cached_font *font, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE_REV( font, next, &font_cache, struct cached_font, entry )
+    {
+        if (font_cache_size <= font_cache_max_size) break;
+        if (font->ref) continue;
+        free_cached_font_glyphs( font );
+        list_remove( &font->entry );
+        pthread_mutex_destroy( &font->lock );
+        free( font );
+    }
+}
+
 static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
 {
     struct cached_font font, *ptr, *last_unused = NULL;
-    UINT i = 0, j, k;
+    UINT i = 0;
 
     NtGdiExtGetObjectW( hfont, sizeof(font.lf), &font.lf );
     font.xform = dc->xformWorld2Vport;
@@ -588,17 +674,9 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
     if (i > 5)  /* keep at least 5 of the most-recently used fonts around */
     {
         ptr = last_unused;
-        for (i = 0; i < GLYPH_NBTYPES; i++)
-        {
-            for (j = 0; j < GLYPH_CACHE_PAGES; j++)
-            {
-                if (!ptr->glyphs[i][j]) continue;
-                for (k = 0; k < GLYPH_CACHE_PAGE_SIZE; k++)
-                    free( ptr->glyphs[i][j][k] );
-                free( ptr->glyphs[i][j] );
-            }
-        }
+        free_cached_font_glyphs( ptr );
         list_remove( &ptr->entry );
+        pthread_mutex_destroy( &ptr->lock );
     }
     else if (!(ptr = malloc( sizeof(*ptr) )))
     {
@@ -608,9 +686,13 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
 
     *ptr = font;
     ptr->ref = 1;
+    ptr->size = ptr->hits = ptr->misses = ptr->clock = 0;
+    pthread_mutex_init( &ptr->lock, NULL );
     memset( ptr->glyphs, 0, sizeof(ptr->glyphs) );
+    memset( ptr->pages, 0, sizeof(ptr->pages) );
 done:
     list_add_head( &font_cache, &ptr->entry );
+    trim_font_cache();
     pthread_mutex_unlock( &font_cache_lock );
     TRACE( "%d %s -> %p\n", (int)ptr->lf.lfHeight, debugstr_w(ptr->lf.lfFaceName), ptr );
     return ptr;
@@ -621,39 +703,46 @@ void release_cached_font( struct cached_font *font )
     if (font) InterlockedDecrement( &font->ref );
 }
 
+/* add a glyph to the cache, the font lock must be held */
 static struct cached_glyph *add_cached_glyph( struct cached_font *font, UINT index, UINT flags,
-                                              struct cached_glyph *glyph )
+                                              struct cached_glyph *glyph, LONG size,
+                                              struct cached_glyph **uncached )
 {
-    struct cached_glyph *ret;
     enum glyph_type type = (flags & ETO_GLYPH_INDEX) ? GLYPH_INDEX : GLYPH_WCHAR;
     UINT page = index / GLYPH_CACHE_PAGE_SIZE;
     UINT entry = index % GLYPH_CACHE_PAGE_SIZE;
 
-    if (!font->glyphs[type][page])
+    if (font->size + size > font_glyphs_max_size) trim_font_glyphs( font );
+
+    /* the glyph is too large to be cached, return it to the caller instead */
+    if (font->size + size > font_glyphs_max_size)
     {
-        struct cached_glyph **ptr;
+        *uncached = glyph;
+        return glyph;
+    }
 
-        ptr = calloc( 1, GLYPH_CACHE_PAGE_SIZE * sizeof(*ptr) );
-        if (!ptr)
-        {
-            free( glyph );
-            return NULL;
-        }
-        if (InterlockedCompareExchangePointer( (void **)&font->glyphs[type][page], ptr, NULL ))
-            free( ptr );
+    if (!font->glyphs[type][page] &&
+        !(font->glyphs[type][page] = calloc( 1, GLYPH_CACHE_PAGE_SIZE * sizeof(struct cached_glyph *) )))
+    {
+        free( glyph );
+        return NULL;
     }
-    ret = InterlockedCompareExchangePointer( (void **)&font->glyphs[type][page][entry], glyph, NULL );
-    if (!ret) ret = glyph;
-    else free( glyph );
-    return ret;
+    font->glyphs[type][page][entry] = glyph;
+    font->pages[type][page].size += size;
+    font->pages[type][page].used = font->clock;
+    font->size += size;
+    InterlockedExchangeAdd( &font_cache_size, size );
+    return glyph;
 }
 
-static struct cached_glyph *get_cached_glyph( struct cached_font *font, UINT index, UINT flags )
+/* look up a cached glyph, the font lock must be held */
+static struct cached_glyph *get_cached_glyph( struct cached_font *font, UINT index, UINT flags, LONG clock )
 {
     enum glyph_type type = (flags & ETO_GLYPH_INDEX) ? GLYPH_INDEX : GLYPH_WCHAR;
     UINT page = index / GLYPH_CACHE_PAGE_SIZE;
 
     if (!font->glyphs[type][page]) return NULL;
+    font->pages[type][page].used = clock;
     return font->glyphs[type][page][index % GLYPH_CACHE_PAGE_SIZE];
 }
 
@@ -741,8 +830,10 @@ static const int padding[4] = {0, 3, 2, 1};
  *
  * For non-antialiased bitmaps convert them to the 17-level format
  * using only values 0 or 16.
+ * If the glyph can't be cached, it's returned in 'uncached' and must be freed by the caller.
  */
-static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font, UINT index, UINT flags )
+static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font, UINT index, UINT flags,
+                                                struct cached_glyph **uncached )
 {
     UINT ggo_flags = font->aa_flags;
     static const MAT2 identity = { {0,1}, {0,0}, {0,0}, {0,1} };
@@ -754,6 +845,7 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
     GLYPHMETRICS metrics;
     struct cached_glyph *glyph;
 
+    InterlockedIncrement( &font->misses );
     if (flags & ETO_GLYPH_INDEX) ggo_flags |= GGO_GLYPH_INDEX;
     indices[0] = index;
     for (i = 0; i < ARRAY_SIZE( indices ); i++)
@@ -804,7 +896,7 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
 
 done:
     glyph->metrics = metrics;
-    return add_cached_glyph( font, index, flags, glyph );
+    return add_cached_glyph( font, index, flags, glyph, FIELD_OFFSET( struct cached_glyph, bits[size] ), uncached );
 }
 
 static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT x, INT y,
@@ -812,10 +904,11 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
                            const struct clipped_rects *clipped_rects, RECT *bounds )
 {
     UINT i;
-    struct cached_glyph *glyph;
+    struct cached_glyph *glyph, *uncached;
     dib_info glyph_dib;
     DWORD text_color;
     struct font_intensities intensity;
+    LONG clock;
 
     glyph_dib.bit_count    = get_glyph_depth( font->aa_flags );
     glyph_dib.rect.left    = 0;
@@ -830,10 +923,14 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
     else
         get_aa_ranges( dib->funcs->pixel_to_colorref( dib, text_color ), intensity.ranges );
 
+    /* the glyphs may be freed by another thread rendering with the same font */
+    pthread_mutex_lock( &font->lock );
+    clock = ++font->clock;
     for (i = 0; i < count; i++)
     {
-        if (!(glyph = get_cached_glyph( font, str[i], flags )) &&
-            !(glyph = cache_glyph_bitmap( dc, font, str[i], flags ))) continue;
+        uncached = NULL;
+        if ((glyph = get_cached_glyph( font, str[i], flags, clock ))) InterlockedIncrement( &font->hits );
+        else if (!(glyph = cache_glyph_bitmap( dc, font, str[i], flags, &uncached ))) continue;
 
         glyph_dib.width       = glyph->metrics.gmBlackBoxX;
         glyph_dib.height      = glyph->metrics.gmBlackBoxY;
@@ -859,7 +956,9 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
             x += glyph->metrics.gmCellIncX;
             y += glyph->metrics.gmCellIncY;
         }
+        free( uncached );
     }
+    pthread_mutex_unlock( &font->lock );
 }
 
 BOOL render_aa_text_bitmapinfo( DC *dc, BITMAPINFO *info, struct gdi_image_bits *bits,
@@ -1795,7 +1795,7 @@ BOOL fill_with_pixel( DC *dc, dib_info *dib, DWORD pixel, int num, const RECT *r
     rop_mask mask;
 
     calc_rop_masks( rop, pixel, &mask );
-    dib->funcs->solid_rects( dib, num, rects, mask.and, mask.xor );
+    solid_rects_in_bands( dib, num, rects, mask.and, mask.xor );
     return TRUE;
 }
 
@@ -4682,35 +4682,121 @@ static inline DWORD blend_rgb( BYTE dst_r, BYTE dst_g, BYTE dst_b, DWORD src, BL
             blend_color( dst_r, src >> 16, blend.SourceConstantAlpha ) << 16);
 }
 
+/* the vector versions of the 32-bpp blending functions process several pixels at once
+ * when the compiler can use SIMD instructions for them, and one pixel otherwise */
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON))
+typedef DWORD pixel_vector __attribute__((vector_size(16)));
+#else
+typedef DWORD pixel_vector;
+#endif
+
+#define PIXELS_PER_VECTOR ((int)(sizeof(pixel_vector) / sizeof(DWORD)))
+
+static inline pixel_vector load_pixels( const DWORD *ptr )
+{
+    pixel_vector ret;
+    memcpy( &ret, ptr, sizeof(ret) );
+    return ret;
+}
+
+static inline void store_pixels( DWORD *ptr, pixel_vector val )
+{
+    memcpy( ptr, &val, sizeof(val) );
+}
+
+/* same as (val + 127) / 255, for val <= 255 * 255 */
+static inline pixel_vector div255_pixels( pixel_vector val )
+{
+    val += 127;
+    return (val + 1 + (val >> 8)) >> 8;
+}
+
+static inline pixel_vector blend_color_pixels( pixel_vector dst, pixel_vector src, DWORD alpha )
+{
+    return div255_pixels( src * alpha + dst * (255 - alpha) );
+}
+
+static inline pixel_vector blend_argb_constant_alpha_pixels( pixel_vector dst, pixel_vector src, DWORD alpha )
+{
+    return (blend_color_pixels( dst & 0xff, src & 0xff, alpha ) |
+            blend_color_pixels( (dst >> 8) & 0xff, (src >> 8) & 0xff, alpha ) << 8 |
+            blend_color_pixels( (dst >> 16) & 0xff, (src >> 16) & 0xff, alpha ) << 16 |
+            blend_color_pixels( dst >> 24, src >> 24, alpha ) << 24);
+}
+
+static inline pixel_vector blend_argb_no_src_alpha_pixels( pixel_vector dst, pixel_vector src, DWORD alpha )
+{
+    return blend_argb_constant_alpha_pixels( dst, src | 0xff000000, alpha );
+}
+
+static inline pixel_vector blend_premultiplied_pixels( pixel_vector dst, pixel_vector b, pixel_vector g,
+                                                       pixel_vector r, pixel_vector alpha )
+{
+    return ((b     + div255_pixels( (dst & 0xff) * (255 - alpha) )) |
+            (g     + div255_pixels( ((dst >> 8) & 0xff) * (255 - alpha) )) << 8 |
+            (r     + div255_pixels( ((dst >> 16) & 0xff) * (255 - alpha) )) << 16 |
+            (alpha + div255_pixels( (dst >> 24) * (255 - alpha) )) << 24);
+}
+
+static inline pixel_vector blend_argb_pixels( pixel_vector dst, pixel_vector src )
+{
+    return blend_premultiplied_pixels( dst, src & 0xff, (src >> 8) & 0xff, (src >> 16) & 0xff, src >> 24 );
+}
+
+static inline pixel_vector blend_argb_alpha_pixels( pixel_vector dst, pixel_vector src, DWORD alpha )
+{
+    return blend_premultiplied_pixels( dst, div255_pixels( (src & 0xff) * alpha ),
+                                       div255_pixels( ((src >> 8) & 0xff) * alpha ),
+                                       div255_pixels( ((src >> 16) & 0xff) * alpha ),
+                                       div255_pixels( (src >> 24) * alpha ));
+}
+
 static void blend_rects_8888(const dib_info *dst, int num, const RECT *rc,
                              const dib_info *src, const POINT *offset, BLENDFUNCTION blend)
 {
-    int i, x, y;
+    int i, x, y, width;
+    DWORD alpha = blend.SourceConstantAlpha;
 
     for (i = 0; i < num; i++, rc++)
     {
         DWORD *src_ptr = get_pixel_ptr_32( src, rc->left + offset->x, rc->top + offset->y );
         DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
 
-        if (blend.AlphaFormat & AC_SRC_ALPHA)
+        width = rc->right - rc->left;
+        for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
         {
-            if (blend.SourceConstantAlpha == 255)
-                for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                    for (x = 0; x < rc->right - rc->left; x++)
-                        dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
+            if (blend.AlphaFormat & AC_SRC_ALPHA)
+            {
+                if (alpha == 255)
+                {
+                    for (x = 0; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR)
+                        store_pixels( dst_ptr + x, blend_argb_pixels( load_pixels( dst_ptr + x ),
+                                                                      load_pixels( src_ptr + x )));
+                    for (; x < width; x++) dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
+                }
+                else
+                {
+                    for (x = 0; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR)
+                        store_pixels( dst_ptr + x, blend_argb_alpha_pixels( load_pixels( dst_ptr + x ),
+                                                                            load_pixels( src_ptr + x ), alpha ));
+                    for (; x < width; x++) dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], alpha );
+                }
+            }
+            else if (src->compression == BI_RGB)
+            {
+                for (x = 0; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR)
+                    store_pixels( dst_ptr + x, blend_argb_constant_alpha_pixels( load_pixels( dst_ptr + x ),
+                                                                                 load_pixels( src_ptr + x ), alpha ));
+                for (; x < width; x++) dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], alpha );
+            }
             else
-                for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                    for (x = 0; x < rc->right - rc->left; x++)
-                        dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+            {
+                for (x = 0; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR)
+                    store_pixels( dst_ptr + x, blend_argb_no_src_alpha_pixels( load_pixels( dst_ptr + x ),
+                                                                                load_pixels( src_ptr + x ), alpha ));
+                for (; x < width; x++) dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], alpha );
+            }
         }
-        else if (src->compression == BI_RGB)
-            for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                for (x = 0; x < rc->right - rc->left; x++)
-                    dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
-        else
-            for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                for (x = 0; x < rc->right - rc->left; x++)
-                    dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
     }
 }
 
@@ -125,6 +125,7 @@
 #include "ntgdi_private.h"
 #include "wine/debug.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 
 #ifdef HAVE_FREETYPE
 
@@ -1168,11 +1169,378 @@ struct unix_face
     struct bitmap_font_size size;
 };
 
+/* font catalogue
+ *
+ * The parsed properties of the font files are kept in a file in the prefix, so that
+ * processes don't have to open every system font again on startup. Entries are
+ * validated against the size and modification time of the font file. The file is
+ * rewritten at the end of the initial font loading if some fonts had to be parsed
+ * again. It is shared by 32-bit and 64-bit processes, so the 64-bit fields come
+ * first to keep the same layout in both.
+ */
+
+#define FONT_CATALOG_MAGIC   0x676f7466  /* "ftog" */
+#define FONT_CATALOG_VERSION 2
+
+struct font_catalog_header
+{
+    UINT magic;
+    UINT version;
+    UINT lcid;      /* locale used for the localized names */
+    UINT count;     /* number of entries */
+};
+
+struct font_catalog_entry
+{
+    ULONGLONG               file_size;     /* size of the font file */
+    ULONGLONG               file_mtime;    /* modification time of the font file */
+    UINT                    size;          /* total size of the entry */
+    UINT                    face_index;
+    UINT                    allow_bitmap;
+    UINT                    num_faces;
+    UINT                    scalable;
+    DWORD                   ntm_flags;
+    DWORD                   font_version;
+    FONTSIGNATURE           fs;
+    struct bitmap_font_size bitmap_size;
+    UINT                    name_len[4];   /* family, second, style and full name lengths, 0 if missing */
+    UINT                    path_len;      /* length of the unix file name */
+    WCHAR                   names[1];      /* names followed by the unix file name */
+};
+
+struct catalog_face
+{
+    struct wine_rb_entry             entry;
+    const struct font_catalog_entry *data;
+    BOOL                             allocated;  /* data is not part of the mapped file */
+    BOOL                             valid;      /* file size and mtime have been checked */
+};
+
+struct catalog_key
+{
+    const char *path;
+    UINT        face_index;
+    UINT        allow_bitmap;
+};
+
+enum catalog_state
+{
+    CATALOG_UNLOADED,
+    CATALOG_LOADED,
+    CATALOG_CLOSED
+};
+
+static enum catalog_state catalog_state;
+static BOOL catalog_dirty;
+static void *catalog_data;
+static size_t catalog_size;
+
+static const char *catalog_entry_path( const struct font_catalog_entry *entry )
+{
+    return (const char *)(entry->names + entry->name_len[0] + entry->name_len[1] +
+                          entry->name_len[2] + entry->name_len[3]);
+}
+
+static int catalog_face_compare( const void *key, const struct wine_rb_entry *entry )
+{
+    const struct catalog_face *face = WINE_RB_ENTRY_VALUE( entry, const struct catalog_face, entry );
+    const struct catalog_key *k = key;
+    int ret;
+
+    if ((ret = strcmp( k->path, catalog_entry_path( face->data ) ))) return ret;
+    if (k->face_index != face->data->face_index) return k->face_index > face->data->face_index ? 1 : -1;
+    return k->allow_bitmap - face->data->allow_bitmap;
+}
+
+static struct wine_rb_tree catalog_tree = { catalog_face_compare };
+
+static char *get_font_catalog_path(void)
+{
+    const char *prefix = getenv( "WINEPREFIX" );
+    char *path = NULL;
+
+    if (prefix) asprintf( &path, "%s/fontcatalog", prefix );
+    else if (getenv( "HOME" )) asprintf( &path, "%s/.wine/fontcatalog", getenv( "HOME" ) );
+    return path;
+}
+
+/* get the size and modification time of a font file */
+static BOOL get_font_file_info( const char *unix_name, ULONGLONG *size, ULONGLONG *mtime )
+{
+    struct stat st;
+
+    if (stat( unix_name, &st ) == -1) return FALSE;
+    *size = st.st_size;
+    *mtime = (ULONGLONG)st.st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    *mtime += st.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    *mtime += st.st_mtimespec.tv_nsec;
+#endif
+    return TRUE;
+}
+
+/* check that a catalogue entry matches the font file */
+static BOOL is_catalog_entry_up_to_date( const struct font_catalog_entry *entry )
+{
+    ULONGLONG size, mtime;
+
+    if (!get_font_file_info( catalog_entry_path( entry ), &size, &mtime )) return FALSE;
+    return size == entry->file_size && mtime == entry->file_mtime;
+}
+
+static BOOL add_catalog_face( const struct font_catalog_entry *data, BOOL allocated )
+{
+    struct catalog_key key = { catalog_entry_path( data ), data->face_index, data->allow_bitmap };
+    struct wine_rb_entry *entry;
+    struct catalog_face *face;
+
+    if ((entry = wine_rb_get( &catalog_tree, &key )))
+    {
+        face = WINE_RB_ENTRY_VALUE( entry, struct catalog_face, entry );
+        if (face->allocated) free( (void *)face->data );
+    }
+    else
+    {
+        if (!(face = malloc( sizeof(*face) ))) return FALSE;
+        face->data = data;
+        wine_rb_put( &catalog_tree, &key, &face->entry );
+    }
+    face->data = data;
+    face->allocated = allocated;
+    face->valid = allocated;
+    return TRUE;
+}
+
+static BOOL is_valid_catalog_entry( const struct font_catalog_entry *entry, size_t size )
+{
+    size_t len;
+    UINT i;
+
+    if (size < sizeof(*entry) || entry->size < sizeof(*entry) || entry->size > size) return FALSE;
+    for (i = 0, len = 0; i < ARRAY_SIZE(entry->name_len); i++)
+    {
+        len += entry->name_len[i];
+        if (FIELD_OFFSET( struct font_catalog_entry, names[len] ) > entry->size) return FALSE;
+        if (entry->name_len[i] && entry->names[len - 1]) return FALSE;
+    }
+    len = FIELD_OFFSET( struct font_catalog_entry, names[len] ) + entry->path_len;
+    if (!entry->path_len || len > entry->size) return FALSE;
+    return !catalog_entry_path( entry )[entry->path_len - 1];
+}
+
+static void load_font_catalog(void)
+{
+    const struct font_catalog_header *header;
+    const char *ptr, *end;
+    struct stat st;
+    char *path;
+    void *data;
+    UINT i;
+    int fd;
+
+    catalog_state = CATALOG_LOADED;
+    if (!(path = get_font_catalog_path())) return;
+    fd = open( path, O_RDONLY );
+    free( path );
+    if (fd == -1) return;
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header)) goto done;
+    if ((data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED) goto done;
+
+    catalog_data = data;
+    catalog_size = st.st_size;
+
+    header = data;
+    if (header->magic != FONT_CATALOG_MAGIC || header->version != FONT_CATALOG_VERSION ||
+        header->lcid != system_lcid)
+    {
+        TRACE( "ignoring outdated font catalogue\n" );
+        goto done;
+    }
+
+    ptr = (const char *)(header + 1);
+    end = (const char *)data + catalog_size;
+    for (i = 0; i < header->count; i++)
+    {
+        const struct font_catalog_entry *entry = (const struct font_catalog_entry *)ptr;
+        if (!is_valid_catalog_entry( entry, end - ptr ))
+        {
+            WARN( "invalid entry %u in font catalogue\n", i );
+            break;
+        }
+        if (!add_catalog_face( entry, FALSE )) break;
+        ptr += entry->size;
+    }
+    TRACE( "loaded %u faces from font catalogue\n", i );
+
+done:
+    close( fd );
+}
+
+/* look up a face in the catalogue, and check that it's still up to date */
+static const struct font_catalog_entry *find_catalog_face( const char *unix_name, UINT face_index,
+                                                           UINT flags )
+{
+    struct catalog_key key = { unix_name, face_index, !!(flags & ADDFONT_ALLOW_BITMAP) };
+    struct wine_rb_entry *entry;
+    struct catalog_face *face;
+
+    if (catalog_state == CATALOG_UNLOADED) load_font_catalog();
+    if (catalog_state != CATALOG_LOADED) return NULL;
+
+    if (!(entry = wine_rb_get( &catalog_tree, &key ))) return NULL;
+    face = WINE_RB_ENTRY_VALUE( entry, struct catalog_face, entry );
+    if (!face->valid)
+    {
+        if (!is_catalog_entry_up_to_date( face->data ))
+        {
+            TRACE( "%s has been modified\n", debugstr_a(unix_name) );
+            return NULL;
+        }
+        face->valid = TRUE;
+    }
+    return face->data;
+}
+
+static void add_face_to_catalog( const char *unix_name, UINT face_index, UINT flags,
+                                 const struct unix_face *unix_face )
+{
+    const WCHAR *names[4] = { unix_face->family_name, unix_face->second_name,
+                              unix_face->style_name, unix_face->full_name };
+    struct font_catalog_entry *entry;
+    ULONGLONG file_size, file_mtime;
+    size_t len = 0, size;
+    UINT i, name_len[4];
+
+    if (catalog_state != CATALOG_LOADED) return;
+    if (!get_font_file_info( unix_name, &file_size, &file_mtime )) return;
+
+    for (i = 0; i < ARRAY_SIZE(names); i++)
+    {
+        name_len[i] = names[i] ? lstrlenW( names[i] ) + 1 : 0;
+        len += name_len[i];
+    }
+    size = FIELD_OFFSET( struct font_catalog_entry, names[len] ) + strlen( unix_name ) + 1;
+    size = (size + 7) & ~7;
+    if (!(entry = calloc( 1, size ))) return;
+
+    entry->size = size;
+    entry->face_index = face_index;
+    entry->allow_bitmap = !!(flags & ADDFONT_ALLOW_BITMAP);
+    entry->num_faces = unix_face->num_faces;
+    entry->scalable = unix_face->scalable;
+    entry->ntm_flags = unix_face->ntm_flags;
+    entry->font_version = unix_face->font_version;
+    entry->fs = unix_face->fs;
+    entry->bitmap_size = unix_face->size;
+    entry->file_size = file_size;
+    entry->file_mtime = file_mtime;
+    entry->path_len = strlen( unix_name ) + 1;
+    for (i = 0, len = 0; i < ARRAY_SIZE(names); i++)
+    {
+        entry->name_len[i] = name_len[i];
+        if (names[i]) memcpy( entry->names + len, names[i], name_len[i] * sizeof(WCHAR) );
+        len += name_len[i];
+    }
+    memcpy( (char *)catalog_entry_path( entry ), unix_name, entry->path_len );
+
+    if (!add_catalog_face( entry, TRUE )) free( entry );
+    else catalog_dirty = TRUE;
+}
+
+static BOOL write_font_catalog( const char *path )
+{
+    struct font_catalog_header header = { FONT_CATALOG_MAGIC, FONT_CATALOG_VERSION, system_lcid, 0 };
+    struct catalog_face *face;
+    char *tmp = NULL;
+    BOOL ret = FALSE;
+    FILE *file;
+    int fd;
+
+    if (asprintf( &tmp, "%s.%u", path, (int)getpid() ) == -1) return FALSE;
+    if ((fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666 )) == -1) goto done;
+    if (!(file = fdopen( fd, "wb" )))
+    {
+        close( fd );
+        goto done;
+    }
+
+    fwrite( &header, sizeof(header), 1, file );
+    WINE_RB_FOR_EACH_ENTRY( face, &catalog_tree, struct catalog_face, entry )
+    {
+        /* drop the faces of the files that have changed since */
+        if (!face->valid && !is_catalog_entry_up_to_date( face->data )) continue;
+        fwrite( face->data, face->data->size, 1, file );
+        header.count++;
+    }
+    fseek( file, 0, SEEK_SET );
+    fwrite( &header, sizeof(header), 1, file );
+    ret = !ferror( file );
+    if (fclose( file )) ret = FALSE;
+    if (ret) ret = !rename( tmp, path );
+    if (!ret) unlink( tmp );
+    TRACE( "wrote %u faces to %s\n", header.count, debugstr_a(path) );
+
+done:
+    free( tmp );
+    return ret;
+}
+
+static void free_catalog_face( struct wine_rb_entry *entry, void *context )
+{
+    struct catalog_face *face = WINE_RB_ENTRY_VALUE( entry, struct catalog_face, entry );
+    if (face->allocated) free( (void *)face->data );
+    free( face );
+}
+
+/* update the catalogue file if needed, and release it */
+static void close_font_catalog(void)
+{
+    char *path;
+
+    if (catalog_dirty && (path = get_font_catalog_path()))
+    {
+        if (!write_font_catalog( path )) WARN( "failed to write %s\n", debugstr_a(path) );
+        free( path );
+    }
+    wine_rb_destroy( &catalog_tree, free_catalog_face, NULL );
+    if (catalog_data) munmap( catalog_data, catalog_size );
+    catalog_data = NULL;
+    catalog_state = CATALOG_CLOSED;
+}
+
+static struct unix_face *unix_face_from_catalog( const struct font_catalog_entry *entry )
+{
+    WCHAR **names[4];
+    struct unix_face *This;
+    const WCHAR *name = entry->names;
+    UINT i;
+
+    if (!(This = calloc( 1, sizeof(*This) ))) return NULL;
+    names[0] = &This->family_name;
+    names[1] = &This->second_name;
+    names[2] = &This->style_name;
+    names[3] = &This->full_name;
+    for (i = 0; i < ARRAY_SIZE(names); i++)
+    {
+        if (entry->name_len[i]) *names[i] = wcsdup( name );
+        name += entry->name_len[i];
+    }
+    This->scalable = entry->scalable;
+    This->num_faces = entry->num_faces;
+    This->ntm_flags = entry->ntm_flags;
+    This->font_version = entry->font_version;
+    This->fs = entry->fs;
+    This->size = entry->bitmap_size;
+    return This;
+}
+
 static struct unix_face *unix_face_create( const char *unix_name, void *data_ptr, UINT data_size,
                                            UINT face_index, UINT flags )
 {
     static const WCHAR space_w[] = {' ',0};
 
+    const struct font_catalog_entry *entry;
     const struct ttc_sfnt_v1 *ttc_sfnt_v1;
     const struct tt_name_v0 *tt_name_v0;
     struct unix_face *This;
@@ -1185,6 +1553,9 @@ static struct unix_face *unix_face_create( const char *unix_name, void *data_ptr
 
     if (unix_name)
     {
+        if ((entry = find_catalog_face( unix_name, face_index, flags )))
+            return unix_face_from_catalog( entry );
+
         if ((fd = open( unix_name, O_RDONLY )) == -1) return NULL;
         if (fstat( fd, &st ) == -1)
         {
@@ -1280,7 +1651,11 @@ static struct unix_face *unix_face_create( const char *unix_name, void *data_ptr
     }
 
 done:
-    if (unix_name) munmap( data_ptr, data_size );
+    if (unix_name)
+    {
+        munmap( data_ptr, data_size );
+        if (This) add_face_to_catalog( unix_name, face_index, flags, This );
+    }
     return This;
 }
 
@@ -1892,6 +2267,7 @@ static void freetype_load_fonts(void)
 #elif defined(__ANDROID__)
     ReadFontDir("/system/fonts", TRUE);
 #endif
+    close_font_catalog();
 }
 
 /* Some fonts have large usWinDescent values, as a result of storing signed short
@@ -740,22 +740,32 @@ BOOL WINAPI NtUserSetCursorPos( INT x, INT y )
  */
 BOOL get_cursor_pos( POINT *pt )
 {
+    desktop_shm_t desktop;
     BOOL ret;
     DWORD last_change;
     UINT dpi;
 
     if (!pt) return FALSE;
 
-    SERVER_START_REQ( set_cursor )
+    if ((ret = get_shared_desktop( &desktop )))
     {
-        if ((ret = !wine_server_call( req )))
+        pt->x = desktop.cursor_x;
+        pt->y = desktop.cursor_y;
+        last_change = desktop.cursor_last_change;
+    }
+    else
+    {
+        SERVER_START_REQ( set_cursor )
         {
-            pt->x = reply->new_x;
-            pt->y = reply->new_y;
-            last_change = reply->last_change;
+            if ((ret = !wine_server_call( req )))
+            {
+                pt->x = reply->new_x;
+                pt->y = reply->new_y;
+                last_change = reply->last_change;
+            }
         }
+        SERVER_END_REQ;
     }
-    SERVER_END_REQ;
 
     /* query new position from graphics driver if we haven't updated recently */
     if (ret && NtGetTickCount() - last_change > 100) ret = user_driver->pGetCursorPos( pt );
@@ -812,6 +822,7 @@ SHORT WINAPI NtUserGetAsyncKeyState( INT key )
 {
     struct user_key_state_info *key_state_info = get_user_thread_info()->key_state;
     INT counter = global_key_state_counter;
+    desktop_shm_t desktop;
     BYTE prev_key_state;
     SHORT ret;
 
@@ -819,6 +830,9 @@ SHORT WINAPI NtUserGetAsyncKeyState( INT key )
 
     check_for_events( QS_INPUT );
 
+    /* nothing to report or to reset on the server side */
+    if (get_shared_desktop( &desktop ) && !(desktop.keystate[key] & 0xc0)) return 0;
+
     if (key_state_info && !(key_state_info->state[key] & 0xc0) &&
         key_state_info->counter == counter && NtGetTickCount() - key_state_info->time < 50)
     {
@@ -868,6 +882,7 @@ SHORT WINAPI NtUserGetAsyncKeyState( INT key )
  */
 DWORD WINAPI NtUserGetQueueStatus( UINT flags )
 {
+    queue_shm_t queue;
     DWORD ret;
 
     if (flags & ~(QS_ALLINPUT | QS_ALLPOSTMESSAGE | QS_SMRESULT))
@@ -878,6 +893,10 @@ DWORD WINAPI NtUserGetQueueStatus( UINT flags )
 
     check_for_events( flags );
 
+    /* the changed bits only need to be cleared on the server if some are set */
+    if (get_shared_queue( &queue ) && !(queue.changed_bits & flags))
+        return MAKELONG( 0, queue.wake_bits & flags );
+
     SERVER_START_REQ( get_queue_status )
     {
         req->clear_bits = flags;
@@ -893,10 +912,13 @@ DWORD WINAPI NtUserGetQueueStatus( UINT flags )
  */
 DWORD get_input_state(void)
 {
+    queue_shm_t queue;
     DWORD ret;
 
     check_for_events( QS_INPUT );
 
+    if (get_shared_queue( &queue )) return queue.wake_bits & (QS_KEY | QS_MOUSEBUTTON);
+
     SERVER_START_REQ( get_queue_status )
     {
         req->clear_bits = 0;
@@ -2700,6 +2700,62 @@ static BOOL process_hardware_message( MSG *msg, UINT hw_id, const struct hardwar
     return ret;
 }
 
+/***********************************************************************
+ *           get_server_queue_handle
+ *
+ * Get a handle to the server message queue for the current thread.
+ */
+static HANDLE get_server_queue_handle(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+    HANDLE ret;
+
+    if (!(ret = thread_info->server_queue))
+    {
+        SERVER_START_REQ( get_msg_queue )
+        {
+            wine_server_call( req );
+            ret = wine_server_ptr_handle( reply->handle );
+            thread_info->queue_locator = reply->locator;
+        }
+        SERVER_END_REQ;
+        thread_info->server_queue = ret;
+        if (!ret) ERR( "Cannot get server thread queue\n" );
+    }
+    return ret;
+}
+
+/* check from the shared queue state whether a get_message request would find nothing */
+static BOOL is_queue_empty( HWND hwnd, UINT first, UINT last, const struct peek_message_filter *filter )
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+    UINT signal_bits = filter->flags >> 16, clear_bits = 0;
+    queue_shm_t queue;
+
+    if (hwnd) return FALSE;  /* the server validates the window handle */
+    if (!get_shared_queue( &queue )) return FALSE;
+    if (filter->internal) return !(queue.wake_bits & QS_INPUT);
+
+    /* the server uses get_message requests to detect hung queues */
+    if (NtGetTickCount() - thread_info->last_getmsg_time > 3000) return FALSE;
+
+    /* the request would also have updated the masks and cleared the changed bits */
+    if (queue.wake_mask != (filter->mask & (QS_SENDMESSAGE | QS_SMRESULT))) return FALSE;
+    if (queue.changed_mask != filter->mask) return FALSE;
+
+    if (!signal_bits) signal_bits = QS_ALLINPUT;
+    if (signal_bits & QS_POSTMESSAGE)
+    {
+        clear_bits |= QS_POSTMESSAGE | QS_HOTKEY | QS_TIMER;
+        if (first == 0 && last == ~0U) clear_bits |= QS_ALLPOSTMESSAGE;
+    }
+    if (signal_bits & QS_INPUT) clear_bits |= QS_INPUT;
+    if (signal_bits & QS_PAINT) clear_bits |= QS_PAINT;
+    if (queue.changed_bits & clear_bits) return FALSE;
+
+    return !(queue.wake_bits & (signal_bits | QS_SENDMESSAGE | QS_INPUT));
+}
+
 /***********************************************************************
  *           peek_message
  *
@@ -2732,6 +2788,14 @@ int peek_message( MSG *msg, const struct peek_message_filter *filter )
 
         thread_info->client_info.msg_source = prev_source;
 
+        if (!hw_id && is_queue_empty( hwnd, first, last, filter ))
+        {
+            free( buffer );
+            thread_info->wake_mask = filter->mask & (QS_SENDMESSAGE | QS_SMRESULT);
+            thread_info->changed_mask = filter->mask;
+            return 0;
+        }
+
         SERVER_START_REQ( get_message )
         {
             req->internal  = filter->internal;
@@ -2761,11 +2825,14 @@ int peek_message( MSG *msg, const struct peek_message_filter *filter )
         }
         SERVER_END_REQ;
 
+        if (!filter->internal) thread_info->last_getmsg_time = NtGetTickCount();
+
         if (res)
         {
             free( buffer );
             if (res == STATUS_PENDING)
             {
+                if (!filter->internal) get_server_queue_handle();
                 thread_info->wake_mask = filter->mask & (QS_SENDMESSAGE | QS_SMRESULT);
                 thread_info->changed_mask = filter->mask;
                 return 0;
@@ -2990,30 +3057,6 @@ static void process_sent_messages(void)
     peek_message( &msg, &filter );
 }
 
-/***********************************************************************
- *           get_server_queue_handle
- *
- * Get a handle to the server message queue for the current thread.
- */
-static HANDLE get_server_queue_handle(void)
-{
-    struct user_thread_info *thread_info = get_user_thread_info();
-    HANDLE ret;
-
-    if (!(ret = thread_info->server_queue))
-    {
-        SERVER_START_REQ( get_msg_queue )
-        {
-            wine_server_call( req );
-            ret = wine_server_ptr_handle( reply->handle );
-        }
-        SERVER_END_REQ;
-        thread_info->server_queue = ret;
-        if (!ret) ERR( "Cannot get server thread queue\n" );
-    }
-    return ret;
-}
-
 /* check for driver events if we detect that the app is not properly consuming messages */
 static inline void check_for_driver_events( UINT msg )
 {
@@ -128,6 +128,10 @@ struct user_thread_info
     UINT                          spy_indent;             /* Current spy indent */
     BOOL                          clipping_cursor;        /* thread is currently clipping */
     DWORD                         clipping_reset;         /* time when clipping was last reset */
+    struct obj_locator            queue_locator;          /* Locator for the shared queue state */
+    struct obj_locator            desktop_locator;        /* Locator for the shared desktop state */
+    BOOL                          desktop_locator_valid;  /* Is desktop_locator up to date? */
+    DWORD                         last_getmsg_time;       /* Time of last get_message server call */
 };
 
 C_ASSERT( sizeof(struct user_thread_info) <= sizeof(((TEB *)0)->Win32ClientInfo) );
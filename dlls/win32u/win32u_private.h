@@ -207,6 +207,8 @@ extern BOOL get_vulkan_uuid_from_luid( const LUID *luid, GUID *uuid );
 
 /* winstation.c */
 extern BOOL is_virtual_desktop(void);
+extern BOOL get_shared_queue( queue_shm_t *queue );
+extern BOOL get_shared_desktop( desktop_shm_t *desktop );
 
 /* window.c */
 struct tagWND;
@@ -263,6 +263,7 @@ BOOL WINAPI NtUserSetThreadDesktop( HDESK handle )
         struct user_key_state_info *key_state_info = thread_info->key_state;
         thread_info->client_info.top_window = 0;
         thread_info->client_info.msg_window = 0;
+        thread_info->desktop_locator_valid = FALSE;
         if (key_state_info) key_state_info->time = 0;
         if (was_virtual_desktop != is_virtual_desktop()) update_display_cache( FALSE );
     }
@@ -426,6 +427,112 @@ BOOL WINAPI NtUserSetObjectInformation( HANDLE handle, INT index, void *info, DW
     return ret;
 }
 
+static const shared_object_t *session_objects;
+static SIZE_T session_size;
+
+/* map the session shared memory, read-only */
+static const shared_object_t *get_session_objects(void)
+{
+    static const WCHAR nameW[] =
+        {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+         '_','_','w','i','n','e','_','s','e','s','s','i','o','n',0};
+    UNICODE_STRING name = RTL_CONSTANT_STRING( nameW );
+    OBJECT_ATTRIBUTES attr;
+    void *ptr = NULL;
+    SIZE_T size = 0;
+    HANDLE handle;
+    NTSTATUS status;
+
+    if (session_objects) return session_objects;
+
+    InitializeObjectAttributes( &attr, &name, 0, 0, NULL );
+    if ((status = NtOpenSection( &handle, SECTION_MAP_READ, &attr )))
+    {
+        WARN( "failed to open the session section, status %#x\n", (int)status );
+        return NULL;
+    }
+    status = NtMapViewOfSection( handle, GetCurrentProcess(), &ptr, 0, 0, NULL, &size,
+                                 ViewUnmap, 0, PAGE_READONLY );
+    NtClose( handle );
+    if (status)
+    {
+        WARN( "failed to map the session section, status %#x\n", (int)status );
+        return NULL;
+    }
+
+    session_size = size;
+    if (InterlockedCompareExchangePointer( (void **)&session_objects, ptr, NULL ))
+        NtUnmapViewOfSection( GetCurrentProcess(), ptr );
+    return session_objects;
+}
+
+/* copy an object state from the session shared memory, fails if the locator is stale */
+static BOOL read_shared_object( const struct obj_locator *locator, void *data, size_t size )
+{
+    const shared_object_t *objects, *object;
+    object_id_t id;
+    LONG seq;
+
+    if (!locator->id || !(objects = get_session_objects())) return FALSE;
+    if (locator->offset > session_size - sizeof(*object)) return FALSE;
+    object = (const shared_object_t *)((const char *)objects + locator->offset);
+
+    do
+    {
+        while ((seq = ReadAcquire( (LONG *)&object->seq )) & 1) YieldProcessor();
+        id = object->id;
+        memcpy( data, (const void *)&object->shm, size );
+        MemoryBarrier();
+    } while (ReadNoFence( (LONG *)&object->seq ) != seq);
+
+    return id == locator->id;
+}
+
+/***********************************************************************
+ *           get_shared_queue
+ *
+ * Get the current thread queue state without a server round trip.
+ */
+BOOL get_shared_queue( queue_shm_t *queue )
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+
+    if (!thread_info->server_queue) return FALSE;
+    return read_shared_object( &thread_info->queue_locator, queue, sizeof(*queue) );
+}
+
+static void update_desktop_locator( struct user_thread_info *thread_info )
+{
+    SERVER_START_REQ( get_thread_desktop )
+    {
+        req->tid = GetCurrentThreadId();
+        if (!wine_server_call( req )) thread_info->desktop_locator = reply->locator;
+        else memset( &thread_info->desktop_locator, 0, sizeof(thread_info->desktop_locator) );
+    }
+    SERVER_END_REQ;
+    thread_info->desktop_locator_valid = TRUE;
+}
+
+/***********************************************************************
+ *           get_shared_desktop
+ *
+ * Get the current thread desktop state without a server round trip.
+ */
+BOOL get_shared_desktop( desktop_shm_t *desktop )
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+
+    if (!thread_info->desktop_locator_valid) update_desktop_locator( thread_info );
+    else if (!thread_info->desktop_locator.id) return FALSE;
+
+    if (read_shared_object( &thread_info->desktop_locator, desktop, sizeof(*desktop) )) return TRUE;
+    if (!thread_info->desktop_locator.id) return FALSE;
+
+    /* the desktop was destroyed or replaced, try once more with a new locator */
+    update_desktop_locator( thread_info );
+    return read_shared_object( &thread_info->desktop_locator, desktop, sizeof(*desktop) );
+}
+
 #ifdef _WIN64
 static inline TEB64 *NtCurrentTeb64(void) { return NULL; }
 #else
@@ -533,12 +533,14 @@ void print_glsl_info_log(const struct wined3d_gl_info *gl_info, GLuint id, BOOL
     }
 }
 
-/* Context activation is done by the caller. */
+/* Context activation is done by the caller. The shader is only compiled when
+ * the program it is attached to is linked, and not found in the shader cache,
+ * see shader_glsl_link_program(). */
 static void shader_glsl_compile(const struct wined3d_gl_info *gl_info, GLuint shader, const char *src)
 {
     const char *ptr, *end, *line;
 
-    TRACE("Compiling shader object %u.\n", shader);
+    TRACE("Setting source of shader object %u.\n", shader);
 
     if (TRACE_ON(d3d_shader))
     {
@@ -552,9 +554,6 @@ static void shader_glsl_compile(const struct wined3d_gl_info *gl_info, GLuint sh
 
     GL_EXTCALL(glShaderSource(shader, 1, &src, NULL));
     checkGLcall("glShaderSource");
-    GL_EXTCALL(glCompileShader(shader));
-    checkGLcall("glCompileShader");
-    print_glsl_info_log(gl_info, shader, FALSE);
 }
 
 /* Context activation is done by the caller. */
@@ -631,6 +630,210 @@ void shader_glsl_validate_link(const struct wined3d_gl_info *gl_info, GLuint pro
     print_glsl_info_log(gl_info, program, TRUE);
 }
 
+struct glsl_link_shader
+{
+    GLint type;
+    GLint length;
+    char *source;
+};
+
+static int __cdecl glsl_link_shader_compare(const void *a, const void *b)
+{
+    const struct glsl_link_shader *s1 = a, *s2 = b;
+
+    if (s1->type != s2->type)
+        return s1->type < s2->type ? -1 : 1;
+    return strcmp(s1->source, s2->source);
+}
+
+static void glsl_link_key_add(uint8_t **key, SIZE_T *key_size, SIZE_T *key_count, const void *data, SIZE_T size)
+{
+    if (!*key || !wined3d_array_reserve((void **)key, key_size, *key_count + size, 1))
+    {
+        free(*key);
+        *key = NULL;
+        return;
+    }
+    memcpy(*key + *key_count, data, size);
+    *key_count += size;
+}
+
+static void glsl_link_key_add_string(uint8_t **key, SIZE_T *key_size, SIZE_T *key_count, const char *str)
+{
+    if (!str)
+        str = "";
+    glsl_link_key_add(key, key_size, key_count, str, strlen(str) + 1);
+}
+
+/* Build the shader cache key of a program, from the GL implementation, the
+ * sources of the attached shaders, and the other state that affects linking. */
+static uint8_t *glsl_link_get_cache_key(const struct wined3d_gl_info *gl_info, GLuint program,
+        const void *link_args, SIZE_T link_args_size, SIZE_T *key_count)
+{
+    struct glsl_link_shader *shaders;
+    GLint i, shader_count = 0;
+    SIZE_T key_size = 256;
+    GLuint *ids = NULL;
+    uint8_t *key;
+
+    *key_count = 0;
+    if (!(key = malloc(key_size)))
+        return NULL;
+    glsl_link_key_add_string(&key, &key_size, key_count, (const char *)gl_info->gl_ops.gl.p_glGetString(GL_VENDOR));
+    glsl_link_key_add_string(&key, &key_size, key_count, (const char *)gl_info->gl_ops.gl.p_glGetString(GL_RENDERER));
+    glsl_link_key_add_string(&key, &key_size, key_count, (const char *)gl_info->gl_ops.gl.p_glGetString(GL_VERSION));
+    if (link_args_size)
+        glsl_link_key_add(&key, &key_size, key_count, link_args, link_args_size);
+
+    GL_EXTCALL(glGetProgramiv(program, GL_ATTACHED_SHADERS, &shader_count));
+    if (!(shaders = calloc(shader_count, sizeof(*shaders))) || !(ids = calloc(shader_count, sizeof(*ids))))
+    {
+        free(shaders);
+        free(key);
+        return NULL;
+    }
+    GL_EXTCALL(glGetAttachedShaders(program, shader_count, NULL, ids));
+    for (i = 0; i < shader_count; ++i)
+    {
+        GL_EXTCALL(glGetShaderiv(ids[i], GL_SHADER_TYPE, &shaders[i].type));
+        GL_EXTCALL(glGetShaderiv(ids[i], GL_SHADER_SOURCE_LENGTH, &shaders[i].length));
+        if (!(shaders[i].source = calloc(1, shaders[i].length + 1)))
+        {
+            free(key);
+            key = NULL;
+            break;
+        }
+        GL_EXTCALL(glGetShaderSource(ids[i], shaders[i].length + 1, NULL, shaders[i].source));
+    }
+    checkGLcall("get shader sources");
+
+    /* The order of the attached shaders isn't defined. */
+    if (key)
+        qsort(shaders, shader_count, sizeof(*shaders), glsl_link_shader_compare);
+    for (i = 0; i < shader_count; ++i)
+    {
+        glsl_link_key_add(&key, &key_size, key_count, &shaders[i].type, sizeof(shaders[i].type));
+        glsl_link_key_add_string(&key, &key_size, key_count, shaders[i].source);
+        free(shaders[i].source);
+    }
+    free(shaders);
+    free(ids);
+    return key;
+}
+
+/* Context activation is done by the caller. */
+static BOOL shader_glsl_load_program_binary(const struct wined3d_gl_info *gl_info, GLuint program,
+        const uint8_t *key, SIZE_T key_size)
+{
+    struct vkd3d_shader_code data;
+    GLint status = GL_FALSE;
+    GLenum format;
+
+    if (!wined3d_shader_cache_load_data(key, key_size, &data))
+        return FALSE;
+
+    if (data.size > sizeof(format))
+    {
+        memcpy(&format, data.code, sizeof(format));
+        GL_EXTCALL(glProgramBinary(program, format, (const uint8_t *)data.code + sizeof(format),
+                data.size - sizeof(format)));
+        GL_EXTCALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+        checkGLcall("glProgramBinary");
+    }
+    free((void *)data.code);
+
+    /* The binary may be rejected, e.g. after a driver update. */
+    if (!status)
+        TRACE("Failed to load binary for program %u.\n", program);
+    return status;
+}
+
+/* Context activation is done by the caller. */
+static void shader_glsl_store_program_binary(const struct wined3d_gl_info *gl_info, GLuint program,
+        const uint8_t *key, SIZE_T key_size)
+{
+    struct vkd3d_shader_code data;
+    GLint status, length = 0;
+    GLenum format;
+    uint8_t *ptr;
+
+    GL_EXTCALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    if (!status)
+        return;
+    GL_EXTCALL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0 || !(ptr = malloc(sizeof(format) + length)))
+        return;
+
+    GL_EXTCALL(glGetProgramBinary(program, length, &length, &format, ptr + sizeof(format)));
+    checkGLcall("glGetProgramBinary");
+    if (length > 0)
+    {
+        memcpy(ptr, &format, sizeof(format));
+        data.code = ptr;
+        data.size = sizeof(format) + length;
+        wined3d_shader_cache_store_data(key, key_size, &data);
+    }
+    free(ptr);
+}
+
+/* Link a program, or load its binary from the shader cache. The attached
+ * shaders are compiled here if the program needs to be linked.
+ * "link_args" is the state set on the program before linking that is not
+ * part of the shader sources.
+ * Context activation is done by the caller. */
+static void shader_glsl_link_program(const struct wined3d_gl_info *gl_info, GLuint program,
+        const void *link_args, SIZE_T link_args_size, BOOL cacheable)
+{
+    GLint i, tmp, shader_count = 0;
+    uint8_t *key = NULL;
+    SIZE_T key_size = 0;
+    GLuint *shaders;
+
+    if (cacheable && wined3d_settings.shader_cache && gl_info->supported[ARB_GET_PROGRAM_BINARY])
+    {
+        gl_info->gl_ops.gl.p_glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &tmp);
+        if (tmp > 0)
+            key = glsl_link_get_cache_key(gl_info, program, link_args, link_args_size, &key_size);
+    }
+
+    if (key && shader_glsl_load_program_binary(gl_info, program, key, key_size))
+    {
+        TRACE("Loaded GLSL shader program %u from the shader cache.\n", program);
+        free(key);
+        return;
+    }
+
+    GL_EXTCALL(glGetProgramiv(program, GL_ATTACHED_SHADERS, &shader_count));
+    if ((shaders = calloc(shader_count, sizeof(*shaders))))
+    {
+        GL_EXTCALL(glGetAttachedShaders(program, shader_count, NULL, shaders));
+        for (i = 0; i < shader_count; ++i)
+        {
+            /* Shader objects are shared between programs, they may be compiled already. */
+            GL_EXTCALL(glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &tmp));
+            if (tmp)
+                continue;
+            TRACE("Compiling shader object %u.\n", shaders[i]);
+            GL_EXTCALL(glCompileShader(shaders[i]));
+            checkGLcall("glCompileShader");
+            print_glsl_info_log(gl_info, shaders[i], FALSE);
+        }
+        free(shaders);
+    }
+
+    if (key)
+        GL_EXTCALL(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    TRACE("Linking GLSL shader program %u.\n", program);
+    GL_EXTCALL(glLinkProgram(program));
+    shader_glsl_validate_link(gl_info, program);
+
+    if (key)
+    {
+        shader_glsl_store_program_binary(gl_info, program, key, key_size);
+        free(key);
+    }
+}
+
 static struct vkd3d_shader_resource_binding *create_resource_bindings(const struct wined3d_gl_info *gl_info,
         enum wined3d_shader_type shader_type, unsigned int *count)
 {
@@ -784,7 +987,7 @@ static GLuint shader_glsl_generate_vkd3d_shader(const struct wined3d_context_gl
     info.log_level = VKD3D_SHADER_LOG_WARNING;
     info.source_name = NULL;
 
-    ret = vkd3d_shader_compile(&info, &glsl, &messages);
+    ret = wined3d_shader_compile_vkd3d(&info, &glsl, &messages);
     if (messages && *messages && FIXME_ON(d3d_shader))
     {
         const char *ptr, *end, *line;
@@ -811,7 +1014,7 @@ static GLuint shader_glsl_generate_vkd3d_shader(const struct wined3d_context_gl
     if (!(shader_id = GL_EXTCALL(glCreateShader(gl_shader_type))))
     {
         ERR("Failed to create shader.\n");
-        vkd3d_shader_free_shader_code(&glsl);
+        free((void *)glsl.code);
         return 0;
     }
 
@@ -822,7 +1025,7 @@ static GLuint shader_glsl_generate_vkd3d_shader(const struct wined3d_context_gl
     checkGLcall("glCompileShader");
     print_glsl_info_log(gl_info, shader_id, FALSE);
 
-    vkd3d_shader_free_shader_code(&glsl);
+    free((void *)glsl.code);
 
     return shader_id;
 }
@@ -10238,9 +10441,7 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
 
     list_add_head(&shader->linked_programs, &entry->cs.shader_entry);
 
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
+    shader_glsl_link_program(gl_info, program_id, NULL, 0, TRUE);
 
     GL_EXTCALL(glUseProgram(program_id));
     checkGLcall("glUseProgram");
@@ -10310,6 +10511,11 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
     struct glsl_shader_prog_link *entry = NULL;
     struct wined3d_shader *vshader = NULL;
     struct wined3d_shader *pshader = NULL;
+    struct
+    {
+        uint32_t attribs_map;
+        uint32_t dual_source;
+    } link_args;
     GLuint reorder_shader_id = 0;
     struct glsl_program_key key;
     uint32_t attribs_map;
@@ -10565,10 +10771,12 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
         list_add_head(ps_list, &entry->ps.shader_entry);
     }
 
-    /* Link the program */
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
+    /* Link the program. Stream output is not part of the cache key, so those
+     * programs are always linked. */
+    link_args.attribs_map = vshader ? vshader->reg_maps.input_registers : (1u << WINED3D_FFP_ATTRIBS_COUNT) - 1;
+    link_args.dual_source = state->blend_state && state->blend_state->dual_source;
+    shader_glsl_link_program(gl_info, program_id, &link_args, sizeof(link_args),
+            !gshader || !gshader->u.gs.so_desc);
 
     shader_glsl_init_vs_uniform_locations(gl_info, priv, program_id, &entry->vs,
             vshader ? vshader->limits->constant_float : 0);
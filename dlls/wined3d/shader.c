@@ -2414,6 +2414,512 @@ static void shader_trace(const void *code, size_t size, enum vkd3d_shader_source
     vkd3d_shader_free_shader_code(&d3d_asm);
 }
 
+/* The output of vkd3d-shader is cached on disk, keyed on everything that is
+ * passed to vkd3d_shader_compile(), and so are the GL program binaries of the
+ * GLSL backend, keyed on the GLSL sources and the GL implementation. The whole
+ * key is stored along with the output so that hash collisions are detected.
+ * Entries are touched when they are used, and the least recently used ones are
+ * deleted when the cache grows over the "shader_cache_size" setting. */
+
+#define SHADER_CACHE_MAGIC   0x63336477 /* "wd3c" */
+#define SHADER_CACHE_VERSION 3
+#define SHADER_CACHE_TRIM_INTERVAL 256 /* number of stored entries between checks of the trim stamp */
+#define SHADER_CACHE_TRIM_PERIOD   (24 * 60 * 60 * (ULONGLONG)10000000) /* minimum time between scans, in 100ns */
+
+enum shader_cache_entry_type
+{
+    SHADER_CACHE_ENTRY_VKD3D,
+    SHADER_CACHE_ENTRY_DATA,
+};
+
+struct shader_cache_key
+{
+    uint8_t *data;
+    SIZE_T size, count;
+    bool failed;
+};
+
+struct shader_cache_header
+{
+    uint32_t magic;
+    uint32_t key_size;
+    uint32_t code_size;
+};
+
+struct shader_cache_chain_header
+{
+    enum vkd3d_shader_structure_type type;
+    const void *next;
+};
+
+struct shader_cache_file
+{
+    FILETIME time;
+    uint64_t size;
+    WCHAR name[MAX_PATH];
+};
+
+static LONG shader_cache_hits, shader_cache_misses, shader_cache_stores;
+
+static void shader_cache_key_add(struct shader_cache_key *key, const void *data, SIZE_T size)
+{
+    if (key->failed)
+        return;
+
+    if (!wined3d_array_reserve((void **)&key->data, &key->size, key->count + size, 1))
+    {
+        key->failed = true;
+        return;
+    }
+    memcpy(&key->data[key->count], data, size);
+    key->count += size;
+}
+
+static void shader_cache_key_add_uint(struct shader_cache_key *key, unsigned int value)
+{
+    shader_cache_key_add(key, &value, sizeof(value));
+}
+
+static void shader_cache_key_add_string(struct shader_cache_key *key, const char *str)
+{
+    shader_cache_key_add_uint(key, !!str);
+    if (str)
+        shader_cache_key_add(key, str, strlen(str) + 1);
+}
+
+static void shader_cache_key_add_array(struct shader_cache_key *key,
+        const void *elements, unsigned int count, SIZE_T size)
+{
+    shader_cache_key_add_uint(key, count);
+    if (count)
+        shader_cache_key_add(key, elements, count * size);
+}
+
+/* Returns false if the compile info contains structures the cache doesn't know about. */
+static void shader_cache_key_init_common(struct shader_cache_key *key, enum shader_cache_entry_type type)
+{
+    static const char * (CDECL *wine_get_build_id)(void);
+
+    if (!wine_get_build_id)
+        wine_get_build_id = (void *)GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "wine_get_build_id");
+
+    memset(key, 0, sizeof(*key));
+    shader_cache_key_add_uint(key, SHADER_CACHE_VERSION);
+    /* Invalidate the cache when wined3d itself changes, it builds the cached data. */
+    shader_cache_key_add_string(key, wine_get_build_id ? wine_get_build_id() : NULL);
+    shader_cache_key_add_uint(key, type);
+}
+
+static bool shader_cache_key_init(struct shader_cache_key *key, const struct vkd3d_shader_compile_info *info)
+{
+    const struct shader_cache_chain_header *header;
+    unsigned int i;
+
+    shader_cache_key_init_common(key, SHADER_CACHE_ENTRY_VKD3D);
+    shader_cache_key_add_string(key, vkd3d_shader_get_version(NULL, NULL));
+    shader_cache_key_add_uint(key, info->source_type);
+    shader_cache_key_add_uint(key, info->target_type);
+    shader_cache_key_add_array(key, info->options, info->option_count, sizeof(*info->options));
+
+    for (header = info->next; header; header = header->next)
+    {
+        shader_cache_key_add_uint(key, header->type);
+
+        switch (header->type)
+        {
+            case VKD3D_SHADER_STRUCTURE_TYPE_INTERFACE_INFO:
+            {
+                const struct vkd3d_shader_interface_info *iface = (const void *)header;
+
+                shader_cache_key_add_array(key, iface->bindings,
+                        iface->binding_count, sizeof(*iface->bindings));
+                shader_cache_key_add_array(key, iface->push_constant_buffers,
+                        iface->push_constant_buffer_count, sizeof(*iface->push_constant_buffers));
+                shader_cache_key_add_array(key, iface->combined_samplers,
+                        iface->combined_sampler_count, sizeof(*iface->combined_samplers));
+                shader_cache_key_add_array(key, iface->uav_counters,
+                        iface->uav_counter_count, sizeof(*iface->uav_counters));
+                break;
+            }
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_TRANSFORM_FEEDBACK_INFO:
+            {
+                const struct vkd3d_shader_transform_feedback_info *xfb = (const void *)header;
+
+                shader_cache_key_add_uint(key, xfb->element_count);
+                for (i = 0; i < xfb->element_count; ++i)
+                {
+                    const struct vkd3d_shader_transform_feedback_element *e = &xfb->elements[i];
+
+                    shader_cache_key_add_uint(key, e->stream_index);
+                    shader_cache_key_add_string(key, e->semantic_name);
+                    shader_cache_key_add_uint(key, e->semantic_index);
+                    shader_cache_key_add_uint(key, e->component_index);
+                    shader_cache_key_add_uint(key, e->component_count);
+                    shader_cache_key_add_uint(key, e->output_slot);
+                }
+                shader_cache_key_add_array(key, xfb->buffer_strides,
+                        xfb->buffer_stride_count, sizeof(*xfb->buffer_strides));
+                break;
+            }
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_SPIRV_TARGET_INFO:
+            {
+                const struct vkd3d_shader_spirv_target_info *spirv = (const void *)header;
+
+                shader_cache_key_add_string(key, spirv->entry_point);
+                shader_cache_key_add_uint(key, spirv->environment);
+                shader_cache_key_add_array(key, spirv->extensions,
+                        spirv->extension_count, sizeof(*spirv->extensions));
+                shader_cache_key_add_uint(key, spirv->parameter_count);
+                for (i = 0; i < spirv->parameter_count; ++i)
+                {
+                    const struct vkd3d_shader_parameter *p = &spirv->parameters[i];
+
+                    shader_cache_key_add_uint(key, p->name);
+                    shader_cache_key_add_uint(key, p->type);
+                    shader_cache_key_add_uint(key, p->data_type);
+                    if (p->type == VKD3D_SHADER_PARAMETER_TYPE_IMMEDIATE_CONSTANT)
+                        shader_cache_key_add_uint(key, p->u.immediate_constant.u.u32);
+                    else
+                        shader_cache_key_add_uint(key, p->u.specialization_constant.id);
+                }
+                shader_cache_key_add_uint(key, spirv->dual_source_blending);
+                shader_cache_key_add_array(key, spirv->output_swizzles,
+                        spirv->output_swizzle_count, sizeof(*spirv->output_swizzles));
+                break;
+            }
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_VARYING_MAP_INFO:
+            {
+                const struct vkd3d_shader_varying_map_info *map = (const void *)header;
+
+                shader_cache_key_add_array(key, map->varying_map,
+                        map->varying_count, sizeof(*map->varying_map));
+                break;
+            }
+
+            default:
+                TRACE("Not caching shader with structure type %#x.\n", header->type);
+                free(key->data);
+                return false;
+        }
+    }
+
+    shader_cache_key_add(key, info->source.code, info->source.size);
+
+    if (key->failed)
+    {
+        free(key->data);
+        return false;
+    }
+    return true;
+}
+
+static uint64_t shader_cache_key_hash(const struct shader_cache_key *key)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    SIZE_T i;
+
+    for (i = 0; i < key->count; ++i)
+    {
+        hash ^= key->data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static bool shader_cache_get_path(WCHAR *path, unsigned int size, uint64_t hash)
+{
+    DWORD len;
+
+    if (!(len = GetEnvironmentVariableW(L"LOCALAPPDATA", path, size)) || len >= size)
+        return false;
+    return swprintf(path + len, size - len, L"\\wined3d\\shader_cache\\%08x%08x",
+            (uint32_t)(hash >> 32), (uint32_t)hash) > 0;
+}
+
+static void shader_cache_create_directories(WCHAR *path)
+{
+    WCHAR *file, *dir;
+
+    file = wcsrchr(path, '\\');
+    *file = 0;
+    dir = wcsrchr(path, '\\');
+    *dir = 0;
+    CreateDirectoryW(path, NULL);
+    *dir = '\\';
+    CreateDirectoryW(path, NULL);
+    *file = '\\';
+}
+
+static bool shader_cache_load(const struct shader_cache_key *key, uint64_t hash, struct vkd3d_shader_code *code)
+{
+    struct shader_cache_header header;
+    WCHAR path[MAX_PATH];
+    bool ret = false;
+    uint8_t *data;
+    FILETIME now;
+    DWORD size;
+    HANDLE file;
+
+    if (!shader_cache_get_path(path, ARRAY_SIZE(path), hash))
+        return false;
+    if ((file = CreateFileW(path, GENERIC_READ | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, 0, NULL)) == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (!ReadFile(file, &header, sizeof(header), &size, NULL) || size != sizeof(header)
+            || header.magic != SHADER_CACHE_MAGIC || header.key_size != key->count)
+        goto done;
+
+    if (!(data = malloc(header.key_size + header.code_size)))
+        goto done;
+    if (!ReadFile(file, data, header.key_size + header.code_size, &size, NULL)
+            || size != header.key_size + header.code_size || memcmp(data, key->data, key->count))
+    {
+        WARN("Ignoring invalid shader cache entry %s.\n", debugstr_w(path));
+        free(data);
+        goto done;
+    }
+
+    memmove(data, data + header.key_size, header.code_size);
+    code->code = data;
+    code->size = header.code_size;
+    ret = true;
+
+    /* The modification time is used to find the least recently used entries. */
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(file, NULL, NULL, &now);
+
+done:
+    CloseHandle(file);
+    return ret;
+}
+
+static int __cdecl shader_cache_file_compare(const void *a, const void *b)
+{
+    const struct shader_cache_file *f1 = a, *f2 = b;
+
+    return CompareFileTime(&f1->time, &f2->time);
+}
+
+/* Check the time of the last scan of the cache, and update it if another scan
+ * is due. Scanning the whole cache is expensive, so that it is only done once in
+ * a while, by whichever process gets there first. */
+static bool shader_cache_trim_due(const WCHAR *stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    ULARGE_INTEGER now, last;
+    FILETIME time;
+    HANDLE file;
+
+    GetSystemTimeAsFileTime(&time);
+    now.LowPart = time.dwLowDateTime;
+    now.HighPart = time.dwHighDateTime;
+    if (GetFileAttributesExW(stamp, GetFileExInfoStandard, &attr))
+    {
+        last.LowPart = attr.ftLastWriteTime.dwLowDateTime;
+        last.HighPart = attr.ftLastWriteTime.dwHighDateTime;
+        if (now.QuadPart - last.QuadPart < SHADER_CACHE_TRIM_PERIOD)
+            return false;
+    }
+
+    if ((file = CreateFileW(stamp, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_ALWAYS, 0, NULL)) == INVALID_HANDLE_VALUE)
+        return false;
+    SetFileTime(file, NULL, NULL, &time);
+    CloseHandle(file);
+    return true;
+}
+
+/* Delete the least recently used entries when the cache is over the size limit.
+ * "path" is the path of any entry. */
+static void shader_cache_trim(const WCHAR *path)
+{
+    static const WCHAR stamp_name[] = L"last_trim";
+    uint64_t total = 0, max_size = (uint64_t)wined3d_settings.shader_cache_size << 20;
+    struct shader_cache_file *files = NULL;
+    SIZE_T files_size = 0, count = 0, i;
+    WCHAR pattern[MAX_PATH], *name;
+    WIN32_FIND_DATAW data;
+    HANDLE handle;
+
+    if (!max_size)
+        return;
+
+    wcscpy(pattern, path);
+    name = wcsrchr(pattern, '\\') + 1;
+    lstrcpynW(name, stamp_name, ARRAY_SIZE(pattern) - (name - pattern));
+    if (!shader_cache_trim_due(pattern))
+        return;
+
+    wcscpy(name, L"*");
+    if ((handle = FindFirstFileW(pattern, &data)) == INVALID_HANDLE_VALUE)
+        return;
+    do
+    {
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !wcscmp(data.cFileName, stamp_name))
+            continue;
+        if (!wined3d_array_reserve((void **)&files, &files_size, count + 1, sizeof(*files)))
+            break;
+        files[count].time = data.ftLastWriteTime;
+        files[count].size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        wcscpy(files[count].name, data.cFileName);
+        total += files[count].size;
+        ++count;
+    } while (FindNextFileW(handle, &data));
+    FindClose(handle);
+
+    if (total > max_size)
+    {
+        TRACE("Shader cache size %s exceeds the limit, deleting old entries.\n", wine_dbgstr_longlong(total));
+        qsort(files, count, sizeof(*files), shader_cache_file_compare);
+        /* Leave some room, so that the cache doesn't need to be trimmed again right away. */
+        for (i = 0; i < count && total > max_size - max_size / 4; ++i)
+        {
+            lstrcpynW(name, files[i].name, ARRAY_SIZE(pattern) - (name - pattern));
+            if (DeleteFileW(pattern))
+                total -= files[i].size;
+        }
+    }
+    free(files);
+}
+
+static void shader_cache_store(const struct shader_cache_key *key, uint64_t hash, const struct vkd3d_shader_code *code)
+{
+    struct shader_cache_header header;
+    WCHAR path[MAX_PATH], tmp[MAX_PATH];
+    bool ret;
+    DWORD size;
+    HANDLE file;
+
+    if (!shader_cache_get_path(path, ARRAY_SIZE(path), hash))
+        return;
+    shader_cache_create_directories(path);
+
+    /* Write to a temporary file first, so that other processes never see partial entries. */
+    if (swprintf(tmp, ARRAY_SIZE(tmp), L"%s.%x.%x", path, GetCurrentProcessId(), GetCurrentThreadId()) < 0)
+        return;
+    if ((file = CreateFileW(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL)) == INVALID_HANDLE_VALUE)
+        return;
+
+    header.magic = SHADER_CACHE_MAGIC;
+    header.key_size = key->count;
+    header.code_size = code->size;
+    ret = WriteFile(file, &header, sizeof(header), &size, NULL) && size == sizeof(header)
+            && WriteFile(file, key->data, key->count, &size, NULL) && size == key->count
+            && WriteFile(file, code->code, code->size, &size, NULL) && size == code->size;
+    CloseHandle(file);
+
+    if (!ret || !MoveFileExW(tmp, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        WARN("Failed to write shader cache entry %s.\n", debugstr_w(path));
+        DeleteFileW(tmp);
+        return;
+    }
+
+    if (InterlockedIncrement(&shader_cache_stores) % SHADER_CACHE_TRIM_INTERVAL == 1)
+        shader_cache_trim(path);
+}
+
+static int shader_compile_vkd3d(const struct vkd3d_shader_compile_info *info,
+        struct vkd3d_shader_code *out, char **messages)
+{
+    struct vkd3d_shader_code code;
+    int ret;
+
+    if ((ret = vkd3d_shader_compile(info, &code, messages)) < 0)
+        return ret;
+
+    if (!(out->code = malloc(code.size)))
+    {
+        vkd3d_shader_free_shader_code(&code);
+        return VKD3D_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy((void *)out->code, code.code, code.size);
+    out->size = code.size;
+    vkd3d_shader_free_shader_code(&code);
+    return ret;
+}
+
+/* Same as vkd3d_shader_compile(), but looks up the output in the shader cache
+ * first. "messages" is only set when the shader is actually compiled. The
+ * output should be freed with free(). */
+int wined3d_shader_compile_vkd3d(const struct vkd3d_shader_compile_info *info,
+        struct vkd3d_shader_code *out, char **messages)
+{
+    struct shader_cache_key key;
+    uint64_t hash;
+    int ret;
+
+    if (!wined3d_settings.shader_cache || !shader_cache_key_init(&key, info))
+        return shader_compile_vkd3d(info, out, messages);
+
+    hash = shader_cache_key_hash(&key);
+    if (shader_cache_load(&key, hash, out))
+    {
+        TRACE("Found shader %s in the cache, %lu hits, %lu misses.\n", wine_dbgstr_longlong(hash),
+                InterlockedIncrement(&shader_cache_hits), shader_cache_misses);
+        free(key.data);
+        *messages = NULL;
+        return VKD3D_OK;
+    }
+
+    TRACE("Compiling shader %s, %lu hits, %lu misses.\n", wine_dbgstr_longlong(hash),
+            shader_cache_hits, InterlockedIncrement(&shader_cache_misses));
+    if ((ret = shader_compile_vkd3d(info, out, messages)) >= 0)
+        shader_cache_store(&key, hash, out);
+    free(key.data);
+    return ret;
+}
+
+static bool shader_cache_data_key_init(struct shader_cache_key *key, const void *key_data, SIZE_T key_size)
+{
+    shader_cache_key_init_common(key, SHADER_CACHE_ENTRY_DATA);
+    shader_cache_key_add(key, key_data, key_size);
+    if (key->failed)
+    {
+        free(key->data);
+        return false;
+    }
+    return true;
+}
+
+/* Look up data stored by a backend in the shader cache. The data should be
+ * freed with free(). */
+bool wined3d_shader_cache_load_data(const void *key_data, SIZE_T key_size, struct vkd3d_shader_code *data)
+{
+    struct shader_cache_key key;
+    uint64_t hash;
+    bool ret;
+
+    if (!wined3d_settings.shader_cache || !shader_cache_data_key_init(&key, key_data, key_size))
+        return false;
+
+    hash = shader_cache_key_hash(&key);
+    if ((ret = shader_cache_load(&key, hash, data)))
+        TRACE("Found entry %s in the cache, %lu hits, %lu misses.\n", wine_dbgstr_longlong(hash),
+                InterlockedIncrement(&shader_cache_hits), shader_cache_misses);
+    else
+        TRACE("Entry %s is not in the cache, %lu hits, %lu misses.\n", wine_dbgstr_longlong(hash),
+                shader_cache_hits, InterlockedIncrement(&shader_cache_misses));
+    free(key.data);
+    return ret;
+}
+
+void wined3d_shader_cache_store_data(const void *key_data, SIZE_T key_size, const struct vkd3d_shader_code *data)
+{
+    struct shader_cache_key key;
+
+    if (!wined3d_settings.shader_cache || !shader_cache_data_key_init(&key, key_data, key_size))
+        return;
+
+    shader_cache_store(&key, shader_cache_key_hash(&key), data);
+    free(key.data);
+}
+
 static HRESULT shader_init(struct wined3d_shader *shader, struct wined3d_device *device,
         const struct wined3d_shader_desc *desc, void *parent, const struct wined3d_parent_ops *parent_ops)
 {
@@ -284,7 +284,7 @@ static VkShaderModule shader_spirv_compile_shader(struct wined3d_context_vk *con
     info.log_level = VKD3D_SHADER_LOG_WARNING;
     info.source_name = NULL;
 
-    ret = vkd3d_shader_compile(&info, &spirv, &messages);
+    ret = wined3d_shader_compile_vkd3d(&info, &spirv, &messages);
     if (messages && *messages && FIXME_ON(d3d_shader))
     {
         const char *ptr, *end, *line;
@@ -313,12 +313,12 @@ static VkShaderModule shader_spirv_compile_shader(struct wined3d_context_vk *con
     shader_create_info.pCode = spirv.code;
     if ((vr = VK_CALL(vkCreateShaderModule(device_vk->vk_device, &shader_create_info, NULL, &module))) < 0)
     {
-        vkd3d_shader_free_shader_code(&spirv);
+        free((void *)spirv.code);
         WARN("Failed to create Vulkan shader module, vr %s.\n", wined3d_debug_vkresult(vr));
         return VK_NULL_HANDLE;
     }
 
-    vkd3d_shader_free_shader_code(&spirv);
+    free((void *)spirv.code);
 
     return module;
 }
@@ -129,6 +129,8 @@ struct wined3d_settings wined3d_settings =
     .max_sm_cs = UINT_MAX,
     .renderer = WINED3D_RENDERER_AUTO,
     .shader_backend = WINED3D_SHADER_BACKEND_AUTO,
+    .shader_cache = TRUE,
+    .shader_cache_size = 256,
 };
 
 enum wined3d_renderer CDECL wined3d_get_renderer(void)
@@ -463,6 +465,10 @@ static BOOL wined3d_dll_init(HINSTANCE hInstDLL)
             TRACE("Forcing all constant buffers to be write-mappable.\n");
             wined3d_settings.cb_access_map_w = TRUE;
         }
+        if (!get_config_key_dword(hkey, appkey, env, "shader_cache", &wined3d_settings.shader_cache))
+            TRACE("Setting shader cache to %#x.\n", wined3d_settings.shader_cache);
+        if (!get_config_key_dword(hkey, appkey, env, "shader_cache_size", &wined3d_settings.shader_cache_size))
+            TRACE("Limiting the shader cache to %u MiB.\n", wined3d_settings.shader_cache_size);
     }
 
     if (appkey) RegCloseKey( appkey );
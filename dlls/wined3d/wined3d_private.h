@@ -492,6 +492,8 @@ struct wined3d_settings
     enum wined3d_renderer renderer;
     enum wined3d_shader_backend shader_backend;
     BOOL cb_access_map_w;
+    unsigned int shader_cache;
+    unsigned int shader_cache_size;
 };
 
 extern struct wined3d_settings wined3d_settings;
@@ -4277,6 +4279,10 @@ HRESULT shader_generate_code(const struct wined3d_shader *shader, struct wined3d
 BOOL shader_match_semantic(const char *semantic_name, enum wined3d_decl_usage usage);
 
 enum vkd3d_shader_visibility vkd3d_shader_visibility_from_wined3d(enum wined3d_shader_type shader_type);
+int wined3d_shader_compile_vkd3d(const struct vkd3d_shader_compile_info *info,
+        struct vkd3d_shader_code *out, char **messages);
+bool wined3d_shader_cache_load_data(const void *key_data, SIZE_T key_size, struct vkd3d_shader_code *data);
+void wined3d_shader_cache_store_data(const void *key_data, SIZE_T key_size, const struct vkd3d_shader_code *data);
 
 static inline BOOL shader_is_scalar(const struct wined3d_shader_register *reg)
 {
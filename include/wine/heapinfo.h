@@ -0,0 +1,75 @@
+/*
+ * Wine-specific heap information classes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WINE_WINE_HEAPINFO_H
+#define __WINE_WINE_HEAPINFO_H
+
+#include <winternl.h>
+
+/* HEAP_INFORMATION_CLASS values, for RtlQueryHeapInformation and RtlSetHeapInformation */
+#define HeapWineStatistics          ((HEAP_INFORMATION_CLASS)1000)
+#define HeapWineAllocationSampling  ((HEAP_INFORMATION_CLASS)1001)
+
+/* HeapWineStatistics information class */
+typedef struct _HEAP_WINE_BIN_STATISTICS
+{
+    SIZE_T BlockSize;          /* size of the bin blocks, including their header */
+    ULONG  AllocCount;         /* blocks allocated by the backend, for LFH activation */
+    ULONG  FreeCount;          /* blocks freed by the backend */
+    ULONG  LfhEnabled;         /* whether the LFH frontend allocates the bin blocks */
+    ULONG  LfhGroups;          /* number of LFH block groups */
+    ULONG  LfhUsedCount;       /* used blocks in the LFH groups */
+    ULONG  LfhFreeCount;       /* free blocks in the LFH groups */
+} HEAP_WINE_BIN_STATISTICS, *PHEAP_WINE_BIN_STATISTICS;
+
+typedef struct _HEAP_WINE_STATISTICS
+{
+    ULONG  CompatibilityInfo;  /* HeapCompatibilityInformation value */
+    ULONG  BinCount;           /* number of entries in Bins */
+    SIZE_T ReservedSize;       /* reserved virtual memory, including committed memory */
+    SIZE_T CommittedSize;      /* committed virtual memory */
+    SIZE_T PeakCommittedSize;  /* highest committed size since the heap creation */
+    SIZE_T UsedSize;           /* user size of the allocated blocks */
+    SIZE_T UsedCount;          /* number of allocated blocks */
+    SIZE_T LargeSize;          /* user size of the allocated large blocks, included in UsedSize */
+    SIZE_T LargeCount;         /* number of allocated large blocks, included in UsedCount */
+    SIZE_T FreeSize;           /* size of the free blocks of the backend */
+    SIZE_T FreeCount;          /* number of free blocks of the backend */
+    SIZE_T LargestFreeSize;    /* size of the largest free block of the backend */
+    HEAP_WINE_BIN_STATISTICS Bins[1];
+} HEAP_WINE_STATISTICS, *PHEAP_WINE_STATISTICS;
+
+/* HeapWineAllocationSampling information class */
+#define HEAP_WINE_SAMPLE_FRAMES 8
+
+typedef struct _HEAP_WINE_ALLOCATION_SAMPLE
+{
+    PVOID  Address;            /* allocated block */
+    SIZE_T Size;               /* requested size */
+    ULONG  FrameCount;         /* number of valid entries in Frames */
+    PVOID  Frames[HEAP_WINE_SAMPLE_FRAMES];  /* allocation backtrace */
+} HEAP_WINE_ALLOCATION_SAMPLE, *PHEAP_WINE_ALLOCATION_SAMPLE;
+
+typedef struct _HEAP_WINE_ALLOCATION_SAMPLES
+{
+    ULONG  Rate;               /* one allocation out of Rate is sampled, 0 if sampling is disabled */
+    ULONG  Count;              /* number of entries in Samples, oldest first */
+    HEAP_WINE_ALLOCATION_SAMPLE Samples[1];
+} HEAP_WINE_ALLOCATION_SAMPLES, *PHEAP_WINE_ALLOCATION_SAMPLES;
+
+#endif  /* __WINE_WINE_HEAPINFO_H */
@@ -29,6 +29,7 @@ typedef unsigned __int64 mem_size_t;
 typedef unsigned __int64 file_pos_t;
 typedef unsigned __int64 client_ptr_t;
 typedef unsigned __int64 affinity_t;
+typedef unsigned __int64 object_id_t;
 typedef client_ptr_t mod_handle_t;
 
 struct request_header
@@ -874,6 +875,71 @@ typedef struct
 
 
 
+typedef struct
+{
+    unsigned int         wake_bits;
+    unsigned int         wake_mask;
+    unsigned int         changed_bits;
+    unsigned int         changed_mask;
+} queue_shm_t;
+
+typedef struct
+{
+    int                  cursor_x;
+    int                  cursor_y;
+    unsigned int         cursor_last_change;
+    unsigned char        keystate[256];
+} desktop_shm_t;
+
+typedef union
+{
+    queue_shm_t          queue;
+    desktop_shm_t        desktop;
+} object_shm_t;
+
+typedef volatile struct
+{
+    unsigned int         seq;
+    unsigned int         __pad;
+    object_id_t          id;
+    object_shm_t         shm;
+} shared_object_t;
+
+#define SESSION_SHM_OBJECTS 8192
+
+struct obj_locator
+{
+    object_id_t          id;
+    mem_size_t           offset;
+};
+
+
+
+
+enum fast_sync_type
+{
+    FAST_SYNC_EVENT = 1,
+    FAST_SYNC_MANUAL_EVENT,
+    FAST_SYNC_MUTEX,
+    FAST_SYNC_SEMAPHORE
+};
+
+typedef volatile struct
+{
+    int                  state;
+    unsigned int         count;
+    unsigned int         type;
+    unsigned int         max;
+    unsigned int         id;
+    unsigned int         __pad;
+} fast_sync_t;
+
+#define FAST_SYNC_SERVER  (-1)
+#define FAST_SYNC_OBJECTS 65536
+
+
+
+
 
 struct new_process_request
 {
@@ -1410,7 +1476,9 @@ struct create_event_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int fast_sync;
+    unsigned int fast_sync_id;
+    char __pad_20[4];
 };
 
 
@@ -1502,7 +1570,9 @@ struct create_mutex_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int fast_sync;
+    unsigned int fast_sync_id;
+    char __pad_20[4];
 };
 
 
@@ -1566,7 +1636,9 @@ struct create_semaphore_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int fast_sync;
+    unsigned int fast_sync_id;
+    char __pad_20[4];
 };
 
 
@@ -2750,8 +2822,9 @@ struct get_msg_queue_request
 struct get_msg_queue_reply
 {
     struct reply_header __header;
-    obj_handle_t handle;
+    obj_handle_t       handle;
     char __pad_12[4];
+    struct obj_locator locator;
 };
 
 
@@ -3048,7 +3121,7 @@ struct register_async_request
     int          type;
     async_data_t async;
     int          count;
-    char __pad_60[4];
+    int          ring;
 };
 struct register_async_reply
 {
@@ -3069,6 +3142,19 @@ struct cancel_async_request
     char __pad_28[4];
 };
 struct cancel_async_reply
+{
+    struct reply_header __header;
+    /* VARARG(rings,uints64); */
+};
+
+
+
+struct set_io_ring_request
+{
+    struct request_header __header;
+    int          fd;
+};
+struct set_io_ring_reply
 {
     struct reply_header __header;
 };
@@ -3884,6 +3970,7 @@ struct get_thread_desktop_reply
     struct reply_header __header;
     obj_handle_t handle;
     char __pad_12[4];
+    struct obj_locator locator;
 };
 
 
@@ -5651,6 +5738,35 @@ struct get_next_thread_reply
 };
 
 
+#define REQUEST_STAT_BUCKETS 16
+
+struct request_stat
+{
+    unsigned int  req;
+    unsigned int  count;
+    timeout_t     total_time;
+    timeout_t     max_time;
+    mem_size_t    request_bytes;
+    mem_size_t    reply_bytes;
+    unsigned int  histogram[REQUEST_STAT_BUCKETS];
+};
+
+
+struct get_request_stats_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_request_stats_reply
+{
+    struct reply_header __header;
+    timeout_t    start_time;
+    unsigned int count;
+    /* VARARG(stats,request_stats); */
+    char __pad_20[4];
+};
+
+
 enum request
 {
     REQ_new_process,
@@ -5784,6 +5900,7 @@ enum request
     REQ_cancel_sync,
     REQ_register_async,
     REQ_cancel_async,
+    REQ_set_io_ring,
     REQ_get_async_result,
     REQ_set_async_direct_result,
     REQ_read,
@@ -5938,6 +6055,7 @@ enum request
     REQ_suspend_process,
     REQ_resume_process,
     REQ_get_next_thread,
+    REQ_get_request_stats,
     REQ_NB_REQUESTS
 };
 
@@ -6076,6 +6194,7 @@ union generic_request
     struct cancel_sync_request cancel_sync_request;
     struct register_async_request register_async_request;
     struct cancel_async_request cancel_async_request;
+    struct set_io_ring_request set_io_ring_request;
     struct get_async_result_request get_async_result_request;
     struct set_async_direct_result_request set_async_direct_result_request;
     struct read_request read_request;
@@ -6230,6 +6349,7 @@ union generic_request
     struct suspend_process_request suspend_process_request;
     struct resume_process_request resume_process_request;
     struct get_next_thread_request get_next_thread_request;
+    struct get_request_stats_request get_request_stats_request;
 };
 union generic_reply
 {
@@ -6366,6 +6486,7 @@ union generic_reply
     struct cancel_sync_reply cancel_sync_reply;
     struct register_async_reply register_async_reply;
     struct cancel_async_reply cancel_async_reply;
+    struct set_io_ring_reply set_io_ring_reply;
     struct get_async_result_reply get_async_result_reply;
     struct set_async_direct_result_reply set_async_direct_result_reply;
     struct read_reply read_reply;
@@ -6520,11 +6641,12 @@ union generic_reply
     struct suspend_process_reply suspend_process_reply;
     struct resume_process_reply resume_process_reply;
     struct get_next_thread_reply get_next_thread_reply;
+    struct get_request_stats_reply get_request_stats_reply;
 };
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 801
+#define SERVER_PROTOCOL_VERSION 809
 
 /* ### protocol_version end ### */
 
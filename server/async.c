@@ -18,10 +18,15 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include "config.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -57,6 +62,9 @@ struct async
     unsigned int         canceled :1;     /* have we already queued cancellation for this async? */
     unsigned int         unknown_status :1; /* initial status is not known yet */
     unsigned int         blocking :1;     /* async is blocking */
+    unsigned int         ring :1;         /* I/O submitted to the client io_uring, not done yet */
+    unsigned int         ring_canceled :1; /* the client has been asked to cancel the io_uring I/O */
+    struct wine_rb_entry ring_entry;      /* entry in the process io_uring asyncs */
     struct completion   *completion;      /* completion associated with fd */
     apc_param_t          comp_key;        /* completion key associated with fd */
     unsigned int         comp_flags;      /* completion flags */
@@ -68,6 +76,7 @@ static void async_dump( struct object *obj, int verbose );
 static int async_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void async_satisfied( struct object * obj, struct wait_queue_entry *entry );
 static void async_destroy( struct object *obj );
+static void free_io_ring( struct process *process );
 
 static const struct object_ops async_ops =
 {
@@ -277,6 +286,8 @@ struct async *create_async( struct fd *fd, struct thread *thread, const async_da
     async->canceled      = 0;
     async->unknown_status = 0;
     async->blocking      = !is_fd_overlapped( fd );
+    async->ring          = 0;
+    async->ring_canceled = 0;
     async->completion    = fd_get_completion( fd, &async->comp_key );
     async->comp_flags    = 0;
     async->completion_callback = NULL;
@@ -572,6 +583,14 @@ int async_waiting( struct async_queue *queue )
     return !async->terminated;
 }
 
+/* I/O submitted to the client io_uring is canceled by the client, see get_ring_cancels(),
+ * the async completes once the I/O is done */
+static void cancel_async_io( struct async *async )
+{
+    async->canceled = 1;
+    if (!async->ring) fd_cancel_async( async->fd, async );
+}
+
 static int cancel_async( struct process *process, struct object *obj, struct thread *thread, client_ptr_t iosb )
 {
     struct async *async;
@@ -589,8 +608,7 @@ restart:
             (!thread || async->thread == thread) &&
             (!iosb || async->data.iosb == iosb))
         {
-            async->canceled = 1;
-            fd_cancel_async( async->fd, async );
+            cancel_async_io( async );
             woken++;
             goto restart;
         }
@@ -622,6 +640,7 @@ restart:
 void cancel_process_asyncs( struct process *process )
 {
     cancel_async( process, NULL, NULL, 0 );
+    free_io_ring( process );
 }
 
 int async_close_obj_handle( struct object *obj, struct process *process, obj_handle_t handle )
@@ -639,8 +658,7 @@ restart:
         if (async->terminated || async->canceled || get_fd_user( async->fd ) != obj) continue;
         if (!async->completion || !async->data.apc_context || async->event) continue;
 
-        async->canceled = 1;
-        fd_cancel_async( async->fd, async );
+        cancel_async_io( async );
         goto restart;
     }
     return 1;
@@ -656,8 +674,7 @@ restart:
         if (async->thread != thread || async->terminated || async->canceled) continue;
         if (async->completion && async->data.apc_context && !async->event) continue;
 
-        async->canceled = 1;
-        fd_cancel_async( async->fd, async );
+        cancel_async_io( async );
         goto restart;
     }
 }
@@ -784,6 +801,109 @@ struct async *find_pending_async( struct async_queue *queue )
     return NULL;
 }
 
+/* Regular file I/O submitted by the client to its io_uring is linked to a write of the async
+ * user pointer to a pipe that we are polling, so that we can wake up the async when the I/O
+ * is done. The client callback then reaps the actual result from the completion ring. */
+
+static void io_ring_poll_event( struct fd *fd, int event );
+
+static const struct fd_ops io_ring_fd_ops =
+{
+    NULL,                        /* get_poll_events */
+    io_ring_poll_event,          /* poll_event */
+    NULL,                        /* flush */
+    NULL,                        /* get_fd_type */
+    NULL,                        /* ioctl */
+    NULL,                        /* queue_async */
+    NULL,                        /* reselect_async */
+    NULL                         /* cancel async */
+};
+
+static int compare_ring_async( const void *key, const struct wine_rb_entry *entry )
+{
+    const struct async *async = WINE_RB_ENTRY_VALUE( entry, const struct async, ring_entry );
+    client_ptr_t user = *(const client_ptr_t *)key;
+
+    if (user < async->data.user) return -1;
+    return user > async->data.user;
+}
+
+/* create an async for an I/O that the client submitted to its io_uring */
+void queue_ring_async( struct fd *fd, const async_data_t *data )
+{
+    struct async *async;
+
+    if (!current->process->io_ring)
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        return;
+    }
+    if (wine_rb_get( &current->process->ring_asyncs, &data->user ))
+    {
+        /* the user pointer of an I/O still in flight can't be reused */
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if (!(async = create_async( fd, current, data, NULL ))) return;
+
+    /* the reference is kept until the I/O is done */
+    async->ring = 1;
+    wine_rb_put( &current->process->ring_asyncs, &async->data.user, &async->ring_entry );
+    set_fd_signaled( fd, 0 );
+    set_error( STATUS_PENDING );
+}
+
+/* wake up the async of a completed I/O, the client callback will report the result */
+static void complete_ring_async( struct process *process, client_ptr_t user )
+{
+    struct wine_rb_entry *entry;
+    struct async *async;
+
+    if (!(entry = wine_rb_get( &process->ring_asyncs, &user ))) return;
+    async = WINE_RB_ENTRY_VALUE( entry, struct async, ring_entry );
+    wine_rb_remove( &process->ring_asyncs, &async->ring_entry );
+    async->ring = 0;
+    async_terminate( async, STATUS_ALERTED );
+    release_object( async );
+}
+
+static void io_ring_poll_event( struct fd *fd, int event )
+{
+    struct process *process = get_fd_user( fd );
+    client_ptr_t user[64];
+    int i, ret;
+
+    if (event & POLLIN)
+    {
+        /* the writes are atomic, so we always get complete pointers */
+        if ((ret = read( get_unix_fd( fd ), user, sizeof(user) )) > 0)
+        {
+            for (i = 0; i < ret / sizeof(user[0]); i++) complete_ring_async( process, user[i] );
+            return;
+        }
+        if (ret == -1 && (errno == EAGAIN || errno == EINTR)) return;
+    }
+    set_fd_events( fd, -1 );  /* the client is gone */
+}
+
+/* release the io_uring pipe of a terminated process, along with the asyncs that are still in flight */
+static void free_io_ring( struct process *process )
+{
+    struct async *async;
+
+    if (!process->io_ring) return;
+    release_object( process->io_ring );
+    process->io_ring = NULL;
+
+    while (process->ring_asyncs.root)
+    {
+        async = WINE_RB_ENTRY_VALUE( process->ring_asyncs.root, struct async, ring_entry );
+        wine_rb_remove( &process->ring_asyncs, &async->ring_entry );
+        async->ring = 0;
+        release_object( async );
+    }
+}
+
 /* cancels sync I/O on a thread */
 DECL_HANDLER(cancel_sync)
 {
@@ -797,6 +917,30 @@ DECL_HANDLER(cancel_sync)
     }
 }
 
+/* return the user pointers of the canceled asyncs whose I/O the client io_uring still has to cancel */
+static void get_ring_cancels( struct process *process )
+{
+    struct async *async;
+    client_ptr_t *user;
+    data_size_t count = 0, max = get_reply_max_size() / sizeof(*user);
+
+    if (!process->io_ring) return;
+
+    WINE_RB_FOR_EACH_ENTRY( async, &process->ring_asyncs, struct async, ring_entry )
+        if (async->canceled && !async->ring_canceled && count < max) count++;
+    if (!count || !(user = set_reply_data_size( count * sizeof(*user) ))) return;
+
+    /* the remaining ones will be returned by the next request */
+    WINE_RB_FOR_EACH_ENTRY( async, &process->ring_asyncs, struct async, ring_entry )
+    {
+        if (!count) break;
+        if (!async->canceled || async->ring_canceled) continue;
+        async->ring_canceled = 1;
+        *user++ = async->data.user;
+        count--;
+    }
+}
+
 /* cancels all async I/O */
 DECL_HANDLER(cancel_async)
 {
@@ -809,6 +953,7 @@ DECL_HANDLER(cancel_async)
         if (!count && req->iosb) set_error( STATUS_NOT_FOUND );
         release_object( obj );
     }
+    get_ring_cancels( current->process );
 }
 
 /* get async result from associated iosb */
@@ -891,3 +1036,26 @@ DECL_HANDLER(set_async_direct_result)
 
     release_object( &async->obj );
 }
+
+/* register the pipe that the client io_uring writes the completed asyncs to */
+DECL_HANDLER(set_io_ring)
+{
+    int unix_fd = thread_get_inflight_fd( current, req->fd );
+
+    if (unix_fd == -1)
+    {
+        set_error( STATUS_INVALID_HANDLE );
+        return;
+    }
+    if (current->process->io_ring)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        close( unix_fd );
+        return;
+    }
+    fcntl( unix_fd, F_SETFL, O_NONBLOCK );
+    wine_rb_init( &current->process->ring_asyncs, compare_ring_async );
+    if (!(current->process->io_ring = create_anonymous_fd( &io_ring_fd_ops, unix_fd, &current->process->obj, 0 )))
+        return;
+    set_fd_events( current->process->io_ring, POLLIN );
+}
@@ -31,6 +31,7 @@
 #include "windef.h"
 #include "winternl.h"
 
+#include "file.h"
 #include "handle.h"
 #include "thread.h"
 #include "request.h"
@@ -38,6 +39,9 @@
 
 static const WCHAR event_name[] = {'E','v','e','n','t'};
 
+/* access rights needed to use the in-process state */
+#define FAST_EVENT_ACCESS (SYNCHRONIZE | EVENT_QUERY_STATE | EVENT_MODIFY_STATE)
+
 struct type_descr event_type =
 {
     { event_name, sizeof(event_name) },   /* name */
@@ -56,6 +60,7 @@ struct event
     struct list    kernel_object;   /* list of kernel object pointers */
     int            manual_reset;    /* is it a manual reset event? */
     int            signaled;        /* event has been signaled */
+    fast_sync_t   *fast_sync;       /* in-process state, used until the server needs the event */
 };
 
 static void event_dump( struct object *obj, int verbose );
@@ -63,6 +68,8 @@ static int event_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static int event_signal( struct object *obj, unsigned int access);
 static struct list *event_get_kernel_obj_list( struct object *obj );
+static int event_close_handle( struct object *obj, struct process *process, obj_handle_t handle );
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
@@ -84,8 +91,8 @@ static const struct object_ops event_ops =
     default_unlink_name,       /* unlink_name */
     no_open_file,              /* open_file */
     event_get_kernel_obj_list, /* get_kernel_obj_list */
-    no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_close_handle,        /* close_handle */
+    event_destroy              /* destroy */
 };
 
 
@@ -150,6 +157,7 @@ struct event *create_event( struct object *root, const struct unicode_str *name,
             list_init( &event->kernel_object );
             event->manual_reset = manual_reset;
             event->signaled     = initial_state;
+            event->fast_sync    = NULL;
         }
     }
     return event;
@@ -160,8 +168,18 @@ struct event *get_event_obj( struct process *process, obj_handle_t handle, unsig
     return (struct event *)get_handle_obj( process, handle, access, &event_ops );
 }
 
+/* retrieve the event state from the client before the server uses it */
+static void demote_event( struct event *event )
+{
+    unsigned int count;
+    int state;
+
+    if (demote_fast_sync( event->fast_sync, &state, &count )) event->signaled = state;
+}
+
 static void pulse_event( struct event *event )
 {
+    demote_event( event );
     event->signaled = 1;
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
@@ -170,6 +188,7 @@ static void pulse_event( struct event *event )
 
 void set_event( struct event *event )
 {
+    demote_event( event );
     event->signaled = 1;
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
@@ -177,6 +196,7 @@ void set_event( struct event *event )
 
 void reset_event( struct event *event )
 {
+    demote_event( event );
     event->signaled = 0;
 }
 
@@ -184,6 +204,7 @@ static void event_dump( struct object *obj, int verbose )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
+    demote_event( event );
     fprintf( stderr, "Event manual=%d signaled=%d\n",
              event->manual_reset, event->signaled );
 }
@@ -192,6 +213,7 @@ static int event_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
+    demote_event( event );
     return event->signaled;
 }
 
@@ -223,6 +245,22 @@ static struct list *event_get_kernel_obj_list( struct object *obj )
     return &event->kernel_object;
 }
 
+static int event_close_handle( struct object *obj, struct process *process, obj_handle_t handle )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    /* the client may not know that the handle is closed, make it go through the server */
+    demote_event( event );
+    return 1;
+}
+
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    free_fast_sync( event->fast_sync );
+}
+
 struct keyed_event *create_keyed_event( struct object *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -293,8 +331,19 @@ DECL_HANDLER(create_event)
         if (get_error() == STATUS_OBJECT_NAME_EXISTS)
             reply->handle = alloc_handle( current->process, event, req->access, objattr->attributes );
         else
+        {
             reply->handle = alloc_handle_no_access_check( current->process, event,
                                                           req->access, objattr->attributes );
+            /* unnamed events are only known to this process until it shares the handle */
+            if (reply->handle && !name.len && !(objattr->attributes & OBJ_INHERIT) &&
+                (get_handle_access( current->process, reply->handle ) & FAST_EVENT_ACCESS) == FAST_EVENT_ACCESS)
+            {
+                event->fast_sync = alloc_fast_sync( event->manual_reset ? FAST_SYNC_MANUAL_EVENT : FAST_SYNC_EVENT,
+                                                    event->signaled, 0, 0 );
+                reply->fast_sync = get_fast_sync_index( event->fast_sync );
+                reply->fast_sync_id = get_fast_sync_id( event->fast_sync );
+            }
+        }
         release_object( event );
     }
 
@@ -316,6 +365,7 @@ DECL_HANDLER(event_op)
     struct event *event;
 
     if (!(event = get_event_obj( current->process, req->handle, EVENT_MODIFY_STATE ))) return;
+    demote_event( event );
     reply->state = event->signaled;
     switch(req->op)
     {
@@ -342,6 +392,7 @@ DECL_HANDLER(query_event)
 
     if (!(event = get_event_obj( current->process, req->handle, EVENT_QUERY_STATE ))) return;
 
+    demote_event( event );
     reply->manual_reset = event->manual_reset;
     reply->state = event->signaled;
 
@@ -106,6 +106,14 @@
 # define USE_EPOLL
 #endif /* HAVE_SYS_EPOLL_H && HAVE_EPOLL_CREATE */
 
+#if defined(USE_EPOLL) && defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+# include <sys/mman.h>
+# include <linux/io_uring.h>
+# ifdef IORING_FEAT_EXT_ARG
+#  define USE_IO_URING
+# endif
+#endif
+
 #if defined(HAVE_PORT_H) && defined(HAVE_PORT_CREATE)
 # include <port.h>
 # define USE_EVENT_PORTS
@@ -509,8 +517,262 @@ static inline void fd_poll_event( struct fd *fd, int event )
 
 static int epoll_fd = -1;
 
+#ifdef USE_IO_URING
+
+/* io_uring support: fds are watched with one-shot poll requests that get re-armed after each event,
+ * like with event ports, so that we keep the level-triggered semantics of poll. All the
+ * requests are queued in the submission ring and sent to the kernel in a single syscall
+ * together with the wait for completions. */
+
+#define URING_ENTRIES     128
+#define URING_IGNORE_CQE  (~(__u64)0)  /* user data for requests whose completion is ignored */
+
+static int uring_fd = -1;
+static unsigned int *uring_sq_head;         /* submission ring head (updated by the kernel) */
+static unsigned int *uring_sq_tail;         /* submission ring tail */
+static unsigned int *uring_sq_array;        /* submission ring index array */
+static unsigned int uring_sq_mask;          /* submission ring mask */
+static unsigned int uring_sq_entries;       /* submission ring size */
+static unsigned int *uring_cq_head;         /* completion ring head */
+static unsigned int *uring_cq_tail;         /* completion ring tail (updated by the kernel) */
+static unsigned int uring_cq_mask;          /* completion ring mask */
+static struct io_uring_sqe *uring_sqes;     /* submission queue entries */
+static struct io_uring_cqe *uring_cqes;     /* completion queue entries */
+static void *uring_ring;                    /* mapped rings */
+static size_t uring_ring_size;              /* size of the mapped rings */
+static unsigned int uring_serial;           /* serial number of the last poll request */
+static unsigned int *uring_poll_serial;     /* serial of the pending poll request for each user, 0 if none */
+static int uring_poll_size;                 /* count of allocated entries in uring_poll_serial */
+
+static int init_io_uring(void)
+{
+    static const unsigned int features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    struct io_uring_params params;
+    size_t cq_size;
+    int fd;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params )) == -1) return 0;
+    if ((params.features & features) != features) goto failed;
+
+    uring_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > uring_ring_size) uring_ring_size = cq_size;
+
+    uring_ring = mmap( NULL, uring_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_SQ_RING );
+    if (uring_ring == MAP_FAILED) goto failed;
+    uring_sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (uring_sqes == MAP_FAILED)
+    {
+        munmap( uring_ring, uring_ring_size );
+        goto failed;
+    }
+
+    uring_sq_head    = (unsigned int *)((char *)uring_ring + params.sq_off.head);
+    uring_sq_tail    = (unsigned int *)((char *)uring_ring + params.sq_off.tail);
+    uring_sq_array   = (unsigned int *)((char *)uring_ring + params.sq_off.array);
+    uring_sq_mask    = *(unsigned int *)((char *)uring_ring + params.sq_off.ring_mask);
+    uring_sq_entries = params.sq_entries;
+    uring_cq_head    = (unsigned int *)((char *)uring_ring + params.cq_off.head);
+    uring_cq_tail    = (unsigned int *)((char *)uring_ring + params.cq_off.tail);
+    uring_cq_mask    = *(unsigned int *)((char *)uring_ring + params.cq_off.ring_mask);
+    uring_cqes       = (struct io_uring_cqe *)((char *)uring_ring + params.cq_off.cqes);
+    uring_fd = fd;
+    return 1;
+
+failed:
+    close( fd );
+    return 0;
+}
+
+/* stop using io_uring, we will fall back to the poll() loop */
+static void close_io_uring(void)
+{
+    close( uring_fd );
+    munmap( uring_sqes, uring_sq_entries * sizeof(struct io_uring_sqe) );
+    munmap( uring_ring, uring_ring_size );
+    free( uring_poll_serial );
+    uring_poll_serial = NULL;
+    uring_poll_size = 0;
+    uring_fd = -1;
+}
+
+/* send the queued requests to the kernel, optionally waiting for a completion */
+static int submit_uring_requests( int wait, int timeout )
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int flags = 0, pending;
+
+    pending = *uring_sq_tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE );
+    if (!pending && !wait) return 0;
+
+    memset( &arg, 0, sizeof(arg) );
+    if (wait)
+    {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout != -1)
+        {
+            ts.tv_sec  = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000;
+            arg.ts = (ULONG_PTR)&ts;
+        }
+    }
+    return syscall( __NR_io_uring_enter, uring_fd, pending, wait ? 1 : 0, flags, &arg, sizeof(arg) );
+}
+
+/* queue a request in the submission ring */
+static int queue_uring_request( __u8 opcode, int unix_fd, unsigned int events, __u64 addr, __u64 user_data )
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail = *uring_sq_tail, index;
+
+    if (tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE ) == uring_sq_entries)
+    {
+        /* ring is full, flush it */
+        if (submit_uring_requests( 0, 0 ) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return 0;
+        if (tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE ) == uring_sq_entries)
+        {
+            errno = EBUSY;
+            return 0;
+        }
+    }
+
+    index = tail & uring_sq_mask;
+    sqe = &uring_sqes[index];
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode = opcode;
+    sqe->fd = unix_fd;
+    sqe->poll32_events = events;
+    sqe->addr = addr;
+    sqe->user_data = user_data;
+    uring_sq_array[index] = index;
+    __atomic_store_n( uring_sq_tail, tail + 1, __ATOMIC_RELEASE );
+    return 1;
+}
+
+/* cancel the pending poll request of a user, if any */
+static void cancel_uring_poll( int user )
+{
+    __u64 user_data;
+
+    if (user >= uring_poll_size || !uring_poll_serial[user]) return;
+    user_data = ((__u64)uring_poll_serial[user] << 32) | user;
+    uring_poll_serial[user] = 0;  /* any completion of the old request will now be ignored */
+    if (!queue_uring_request( IORING_OP_POLL_REMOVE, -1, 0, user_data, URING_IGNORE_CQE ))
+    {
+        perror( "io_uring" );  /* should not happen */
+        close_io_uring();
+    }
+}
+
+/* queue a poll request for a user */
+static void arm_uring_poll( int user, int unix_fd, int events )
+{
+    if (user >= uring_poll_size)
+    {
+        unsigned int *new_serial;
+        int new_size = max( user + 1, uring_poll_size ? uring_poll_size * 2 : 64 );
+
+        if (!(new_serial = realloc( uring_poll_serial, new_size * sizeof(*uring_poll_serial) )))
+        {
+            close_io_uring();
+            return;
+        }
+        memset( new_serial + uring_poll_size, 0, (new_size - uring_poll_size) * sizeof(*uring_poll_serial) );
+        uring_poll_serial = new_serial;
+        uring_poll_size = new_size;
+    }
+
+    if (!++uring_serial) uring_serial = 1;
+    if (!queue_uring_request( IORING_OP_POLL_ADD, unix_fd, events | POLLERR | POLLHUP, 0,
+                              ((__u64)uring_serial << 32) | user ))
+    {
+        perror( "io_uring" );  /* should not happen */
+        close_io_uring();
+        return;
+    }
+    uring_poll_serial[user] = uring_serial;
+}
+
+/* set the events that io_uring waits for on this fd; helper for set_fd_events */
+static void set_fd_uring_events( struct fd *fd, int user, int events )
+{
+    if (events == -1)  /* stop waiting on this fd completely */
+    {
+        cancel_uring_poll( user );
+        return;
+    }
+    if (user < uring_poll_size && uring_poll_serial[user] &&
+        pollfd[user].fd == fd->unix_fd && pollfd[user].events == events)
+        return;  /* nothing to do */
+
+    cancel_uring_poll( user );
+    if (uring_fd != -1) arm_uring_poll( user, fd->unix_fd, events );
+}
+
+static void main_loop_uring(void)
+{
+    int i, ret, count, timeout, users[URING_ENTRIES];
+    unsigned int head, tail;
+
+    while (active_users)
+    {
+        timeout = get_next_timeout();
+
+        if (!active_users) break;  /* last user removed by a timeout */
+        if (uring_fd == -1) break;  /* an error occurred with io_uring */
+
+        ret = submit_uring_requests( 1, timeout );
+        set_current_time();
+        if (ret == -1 && errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY)
+        {
+            perror( "io_uring_enter" );
+            close_io_uring();
+            break;
+        }
+
+        /* put the events into the pollfd array first, like poll does */
+        count = 0;
+        head = *uring_cq_head;
+        tail = __atomic_load_n( uring_cq_tail, __ATOMIC_ACQUIRE );
+        while (head != tail && count < ARRAY_SIZE( users ))
+        {
+            struct io_uring_cqe *cqe = &uring_cqes[head++ & uring_cq_mask];
+            int user = (unsigned int)cqe->user_data;
+
+            if (cqe->user_data == URING_IGNORE_CQE) continue;
+            if (user >= uring_poll_size || uring_poll_serial[user] != cqe->user_data >> 32)
+                continue;  /* stale completion of a cancelled request */
+            uring_poll_serial[user] = 0;
+            pollfd[user].revents = cqe->res < 0 ? POLLERR : cqe->res;
+            users[count++] = user;
+        }
+        __atomic_store_n( uring_cq_head, head, __ATOMIC_RELEASE );
+
+        /* read events from the pollfd array, as set_fd_events may modify them */
+        for (i = 0; i < count; i++)
+        {
+            int user = users[i];
+            if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
+            if (uring_fd == -1) break;
+            /* if we are still interested, re-arm the one-shot request */
+            if (pollfd[user].fd != -1 && !uring_poll_serial[user])
+                arm_uring_poll( user, pollfd[user].fd, pollfd[user].events );
+        }
+    }
+}
+
+#endif  /* USE_IO_URING */
+
 static inline void init_epoll(void)
 {
+#ifdef USE_IO_URING
+    if (init_io_uring()) return;
+#endif
     epoll_fd = epoll_create( 128 );
 }
 
@@ -520,6 +782,13 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
     struct epoll_event ev;
     int ctl;
 
+#ifdef USE_IO_URING
+    if (uring_fd != -1)
+    {
+        set_fd_uring_events( fd, user, events );
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     if (events == -1)  /* stop waiting on this fd completely */
@@ -554,6 +823,13 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
 
 static inline void remove_epoll_user( struct fd *fd, int user )
 {
+#ifdef USE_IO_URING
+    if (uring_fd != -1)
+    {
+        cancel_uring_poll( user );
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     if (pollfd[user].fd != -1)
@@ -573,6 +849,13 @@ static inline void main_loop_epoll(void)
     assert( POLLERR == EPOLLERR );
     assert( POLLHUP == EPOLLHUP );
 
+#ifdef USE_IO_URING
+    if (uring_fd != -1)
+    {
+        main_loop_uring();
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     while (active_users)
@@ -2900,7 +3183,13 @@ DECL_HANDLER(register_async)
 
     if ((fd = get_handle_fd_obj( current->process, req->async.handle, access )))
     {
-        if (get_unix_fd( fd ) != -1 && (async = create_async( fd, current, &req->async, NULL )))
+        if (req->ring)
+        {
+            /* the client submitted the I/O to its io_uring, the async is woken up once it's done */
+            if (fd->inode) queue_ring_async( fd, &req->async );
+            else set_error( STATUS_INVALID_PARAMETER );
+        }
+        else if (get_unix_fd( fd ) != -1 && (async = create_async( fd, current, &req->async, NULL )))
         {
             fd->fd_ops->queue_async( fd, async, req->type, req->count );
             release_object( async );
@@ -188,6 +188,33 @@ extern struct mapping *create_fd_mapping( struct object *root, const struct unic
                                           unsigned int attr, const struct security_descriptor *sd );
 extern struct object *create_user_data_mapping( struct object *root, const struct unicode_str *name,
                                                 unsigned int attr, const struct security_descriptor *sd );
+extern struct object *create_session_mapping( struct object *root, const struct unicode_str *name,
+                                             unsigned int attr, const struct security_descriptor *sd );
+extern shared_object_t *alloc_shared_object(void);
+extern void free_shared_object( shared_object_t *object );
+extern void get_shared_object_locator( const shared_object_t *object, struct obj_locator *locator );
+extern struct object *create_fast_sync_mapping( struct object *root, const struct unicode_str *name,
+                                                unsigned int attr, const struct security_descriptor *sd );
+extern fast_sync_t *alloc_fast_sync( enum fast_sync_type type, int state, unsigned int count, unsigned int max );
+extern void free_fast_sync( fast_sync_t *sync );
+extern unsigned int get_fast_sync_index( const fast_sync_t *sync );
+extern unsigned int get_fast_sync_id( const fast_sync_t *sync );
+extern int demote_fast_sync( fast_sync_t *sync, int *state, unsigned int *count );
+
+/* update an object in the session shared memory; the writes have to be enclosed in */
+/* SHARED_WRITE_BEGIN / SHARED_WRITE_END, with 'shared' pointing to the object data */
+#define SHARED_WRITE_BEGIN( object, type ) \
+    do { \
+        shared_object_t *__obj = (object); \
+        type *shared = (type *)&__obj->shm; \
+        __atomic_store_n( &__obj->seq, __obj->seq + 1, __ATOMIC_RELAXED ); \
+        __atomic_thread_fence( __ATOMIC_RELEASE ); \
+        do
+
+#define SHARED_WRITE_END \
+        while (0); \
+        __atomic_store_n( &__obj->seq, __obj->seq + 1, __ATOMIC_RELEASE ); \
+    } while (0)
 
 /* device functions */
 
@@ -249,6 +276,7 @@ extern void fd_copy_completion( struct fd *src, struct fd *dst );
 extern struct iosb *async_get_iosb( struct async *async );
 extern struct thread *async_get_thread( struct async *async );
 extern struct async *find_pending_async( struct async_queue *queue );
+extern void queue_ring_async( struct fd *fd, const async_data_t *data );
 extern void cancel_process_asyncs( struct process *process );
 extern void cancel_terminating_thread_asyncs( struct thread *thread );
 extern int async_close_obj_handle( struct object *obj, struct process *process, obj_handle_t handle );
@@ -22,12 +22,19 @@
 
 #include <assert.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -121,6 +128,22 @@ static const struct object_ops shared_map_ops =
 
 static struct list shared_map_list = LIST_INIT( shared_map_list );
 
+/* image information cached across mappings of the same file */
+struct image_cache_entry
+{
+    struct list     entry;           /* entry in the image cache, most recently used first */
+    dev_t           dev;             /* device of the image file */
+    ino_t           ino;             /* inode of the image file */
+    file_pos_t      size;            /* size of the image file */
+    timeout_t       mtime;           /* modification time of the image file */
+    pe_image_info_t image;           /* image info */
+};
+
+#define IMAGE_CACHE_MAX_ENTRIES 256
+
+static struct list image_cache = LIST_INIT( image_cache );
+static unsigned int image_cache_count;
+
 /* memory view mapped in client address space */
 struct memory_view
 {
@@ -706,8 +729,65 @@ static int load_cfg_header( IMAGE_LOAD_CONFIG_DIRECTORY64 *cfg, size_t va, size_
     return 1;
 }
 
+/* get the modification time of a file, with the best available precision */
+static timeout_t get_stat_mtime( const struct stat *st )
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    return (timeout_t)st->st_mtim.tv_sec * TICKS_PER_SEC + st->st_mtim.tv_nsec / 100;
+#else
+    return (timeout_t)st->st_mtime * TICKS_PER_SEC;
+#endif
+}
+
+/* find the cached image info of a file, if it hasn't changed since it was cached */
+static struct image_cache_entry *find_cached_image( const struct stat *st )
+{
+    struct image_cache_entry *cache;
+
+    LIST_FOR_EACH_ENTRY( cache, &image_cache, struct image_cache_entry, entry )
+    {
+        if (cache->dev != st->st_dev || cache->ino != st->st_ino) continue;
+        if (cache->size != st->st_size || cache->mtime != get_stat_mtime( st )) return NULL;
+        list_remove( &cache->entry );
+        list_add_head( &image_cache, &cache->entry );
+        return cache;
+    }
+    return NULL;
+}
+
+/* add the image info of a file to the cache, replacing any older entry */
+static void add_cached_image( const struct stat *st, const pe_image_info_t *image )
+{
+    struct image_cache_entry *cache, *found = NULL;
+
+    LIST_FOR_EACH_ENTRY( cache, &image_cache, struct image_cache_entry, entry )
+    {
+        if (cache->dev != st->st_dev || cache->ino != st->st_ino) continue;
+        found = cache;
+        break;
+    }
+
+    if ((cache = found)) list_remove( &cache->entry );
+    else if (image_cache_count < IMAGE_CACHE_MAX_ENTRIES)
+    {
+        if (!(cache = malloc( sizeof(*cache) ))) return;
+        image_cache_count++;
+    }
+    else  /* reuse the least recently used entry */
+    {
+        cache = LIST_ENTRY( list_tail( &image_cache ), struct image_cache_entry, entry );
+        list_remove( &cache->entry );
+    }
+    list_add_head( &image_cache, &cache->entry );
+    cache->dev   = st->st_dev;
+    cache->ino   = st->st_ino;
+    cache->size  = st->st_size;
+    cache->mtime = get_stat_mtime( st );
+    cache->image = *image;
+}
+
 /* retrieve the mapping parameters for an executable (PE) image */
-static unsigned int get_image_params( struct mapping *mapping, file_pos_t file_size, int unix_fd )
+static unsigned int get_image_params( struct mapping *mapping, const struct stat *st, int unix_fd )
 {
     static const char builtin_signature[] = "Wine builtin DLL";
     static const char fakedll_signature[] = "Wine placeholder DLL";
@@ -737,8 +817,19 @@ static unsigned int get_image_params( struct mapping *mapping, file_pos_t file_s
     off_t pos;
     int size, has_relocs;
     size_t mz_size, clr_va = 0, clr_size = 0, cfg_va, cfg_size;
+    file_pos_t file_size = st->st_size;
+    struct image_cache_entry *cache;
     unsigned int i;
 
+    if ((cache = find_cached_image( st )))
+    {
+        mapping->image = cache->image;
+        mapping->image.map_addr = get_fd_map_address( mapping->fd );
+        if (!mapping->size) mapping->size = mapping->image.map_size;
+        else if (mapping->size > mapping->image.map_size) return STATUS_SECTION_TOO_BIG;
+        return STATUS_SUCCESS;
+    }
+
     /* load the headers */
 
     if (!file_size) return STATUS_INVALID_FILE_FOR_SECTION;
@@ -920,6 +1011,8 @@ static unsigned int get_image_params( struct mapping *mapping, file_pos_t file_s
     if (!build_shared_mapping( mapping, unix_fd, sec, nt.FileHeader.NumberOfSections ))
         return STATUS_INVALID_FILE_FOR_SECTION;
 
+    /* images with shared sections need the section headers, don't cache them */
+    if (!mapping->shared) add_cached_image( st, &mapping->image );
     return STATUS_SUCCESS;
 }
 
@@ -1012,7 +1105,7 @@ static struct mapping *create_mapping( struct object *root, const struct unicode
         }
         if (flags & SEC_IMAGE)
         {
-            unsigned int err = get_image_params( mapping, st.st_size, unix_fd );
+            unsigned int err = get_image_params( mapping, &st, unix_fd );
             if (!err) return mapping;
             set_error( err );
             goto error;
@@ -1273,6 +1366,146 @@ struct object *create_user_data_mapping( struct object *root, const struct unico
     return &mapping->obj;
 }
 
+static shared_object_t *session_objects;                 /* objects in the session shared memory */
+static unsigned int session_used;                         /* number of entries used so far */
+static unsigned int session_free[SESSION_SHM_OBJECTS];    /* indices of the freed entries */
+static unsigned int session_free_count;                   /* number of freed entries */
+static object_id_t session_last_id;                       /* id of the last allocated object */
+
+struct object *create_session_mapping( struct object *root, const struct unicode_str *name,
+                                       unsigned int attr, const struct security_descriptor *sd )
+{
+    void *ptr;
+    struct mapping *mapping;
+
+    if (!(mapping = create_mapping( root, name, attr, SESSION_SHM_OBJECTS * sizeof(shared_object_t),
+                                    SEC_COMMIT, 0, FILE_READ_DATA | FILE_WRITE_DATA, sd ))) return NULL;
+    ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, get_unix_fd( mapping->fd ), 0 );
+    if (ptr != MAP_FAILED) session_objects = ptr;
+    return &mapping->obj;
+}
+
+/* allocate an entry in the session shared memory, returns NULL if none is available */
+shared_object_t *alloc_shared_object(void)
+{
+    shared_object_t *object;
+
+    if (!session_objects) return NULL;
+    if (session_free_count) object = &session_objects[session_free[--session_free_count]];
+    else if (session_used < SESSION_SHM_OBJECTS) object = &session_objects[session_used++];
+    else return NULL;
+
+    SHARED_WRITE_BEGIN( object, object_shm_t )
+    {
+        memset( shared, 0, sizeof(*shared) );
+        __obj->id = ++session_last_id;
+    }
+    SHARED_WRITE_END;
+    return object;
+}
+
+/* free an entry of the session shared memory */
+void free_shared_object( shared_object_t *object )
+{
+    if (!object) return;
+
+    __atomic_store_n( &object->id, 0, __ATOMIC_RELEASE );
+    session_free[session_free_count++] = object - session_objects;
+}
+
+/* get the locator that clients use to find an object in the session shared memory */
+void get_shared_object_locator( const shared_object_t *object, struct obj_locator *locator )
+{
+    if (!object)
+    {
+        locator->id = 0;
+        locator->offset = 0;
+        return;
+    }
+    locator->id = object->id;
+    locator->offset = (const char *)object - (const char *)session_objects;
+}
+
+static fast_sync_t *fast_sync_objects;                    /* objects in the fast sync shared memory */
+static unsigned int fast_sync_used;                       /* number of entries used so far */
+static unsigned int fast_sync_free[FAST_SYNC_OBJECTS];    /* indices of the freed entries */
+static unsigned int fast_sync_free_count;                 /* number of freed entries */
+static unsigned int fast_sync_last_id;                    /* last id given to an entry */
+
+struct object *create_fast_sync_mapping( struct object *root, const struct unicode_str *name,
+                                         unsigned int attr, const struct security_descriptor *sd )
+{
+    void *ptr;
+    struct mapping *mapping;
+
+    if (!(mapping = create_mapping( root, name, attr, FAST_SYNC_OBJECTS * sizeof(fast_sync_t),
+                                    SEC_COMMIT, 0, FILE_READ_DATA | FILE_WRITE_DATA, sd ))) return NULL;
+#if defined(__linux__) && defined(__NR_futex)
+    ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, get_unix_fd( mapping->fd ), 0 );
+    if (ptr != MAP_FAILED) fast_sync_objects = ptr;
+#endif
+    return &mapping->obj;
+}
+
+/* allocate an in-process synchronization object, returns NULL if none is available */
+fast_sync_t *alloc_fast_sync( enum fast_sync_type type, int state, unsigned int count, unsigned int max )
+{
+    fast_sync_t *sync;
+
+    if (!fast_sync_objects) return NULL;
+    if (fast_sync_free_count) sync = &fast_sync_objects[fast_sync_free[--fast_sync_free_count]];
+    else if (fast_sync_used < FAST_SYNC_OBJECTS) sync = &fast_sync_objects[fast_sync_used++];
+    else return NULL;
+
+    if (!++fast_sync_last_id) ++fast_sync_last_id;
+    sync->type  = type;
+    sync->max   = max;
+    sync->count = count;
+    sync->id    = fast_sync_last_id;
+    __atomic_store_n( &sync->state, state, __ATOMIC_RELEASE );
+    return sync;
+}
+
+/* free an in-process synchronization object, once its object is destroyed */
+void free_fast_sync( fast_sync_t *sync )
+{
+    if (!sync) return;
+    sync->state = FAST_SYNC_SERVER;
+    sync->id = 0;
+    fast_sync_free[fast_sync_free_count++] = sync - fast_sync_objects;
+}
+
+/* get the index that the client uses to find the object, 0 if none */
+unsigned int get_fast_sync_index( const fast_sync_t *sync )
+{
+    return sync ? sync - fast_sync_objects + 1 : 0;
+}
+
+/* get the id that the client uses to check that an entry still belongs to the object */
+unsigned int get_fast_sync_id( const fast_sync_t *sync )
+{
+    return sync ? sync->id : 0;
+}
+
+/* take back the state of an in-process synchronization object; returns FALSE if it was done already */
+int demote_fast_sync( fast_sync_t *sync, int *state, unsigned int *count )
+{
+    unsigned __int64 value, server = (unsigned int)FAST_SYNC_SERVER;
+
+    if (!sync || sync->state == FAST_SYNC_SERVER) return 0;
+
+    value = __atomic_exchange_n( (unsigned __int64 *)sync, server, __ATOMIC_SEQ_CST );
+    *state = (int)value;
+    *count = value >> 32;
+    if (*state == FAST_SYNC_SERVER) return 0;
+
+#if defined(__linux__) && defined(__NR_futex)
+    /* the waiters have to retry through the server */
+    syscall( __NR_futex, &sync->state, FUTEX_WAKE, INT_MAX, NULL, 0, 0 );
+#endif
+    return 1;
+}
+
 /* create a file mapping */
 DECL_HANDLER(create_mapping)
 {
@@ -31,7 +31,9 @@
 #include "windef.h"
 #include "winternl.h"
 
+#include "file.h"
 #include "handle.h"
+#include "process.h"
 #include "thread.h"
 #include "request.h"
 #include "security.h"
@@ -57,11 +59,17 @@ struct mutex
     unsigned int   count;           /* recursion count */
     int            abandoned;       /* has it been abandoned? */
     struct list    entry;           /* entry in owner thread mutex list */
+    fast_sync_t   *fast_sync;       /* in-process state, used until the server needs the mutex */
+    struct list    fast_entry;      /* entry in the creating process list of fast mutexes */
 };
 
+/* access rights needed to use the in-process state */
+#define FAST_MUTEX_ACCESS (SYNCHRONIZE | MUTANT_QUERY_STATE)
+
 static void mutex_dump( struct object *obj, int verbose );
 static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry );
+static int mutex_close_handle( struct object *obj, struct process *process, obj_handle_t handle );
 static void mutex_destroy( struct object *obj );
 static int mutex_signal( struct object *obj, unsigned int access );
 
@@ -85,7 +93,7 @@ static const struct object_ops mutex_ops =
     default_unlink_name,       /* unlink_name */
     no_open_file,              /* open_file */
     no_kernel_obj_list,        /* get_kernel_obj_list */
-    no_close_handle,           /* close_handle */
+    mutex_close_handle,        /* close_handle */
     mutex_destroy              /* destroy */
 };
 
@@ -103,6 +111,32 @@ static void do_grab( struct mutex *mutex, struct thread *thread )
     }
 }
 
+/* retrieve the mutex owner from the client before the server uses it */
+static void demote_mutex( struct mutex *mutex )
+{
+    struct thread *owner = NULL;
+    unsigned int count, error;
+    int tid;
+
+    if (!demote_fast_sync( mutex->fast_sync, &tid, &count )) return;
+    list_remove( &mutex->fast_entry );
+    if (!tid) return;
+
+    error = get_error();
+    owner = get_thread_from_id( tid );
+    set_error( error );
+
+    if (owner && owner->state != TERMINATED)
+    {
+        mutex->count = count;
+        mutex->owner = owner;
+        list_add_head( &owner->mutex_list, &mutex->entry );
+    }
+    else mutex->abandoned = 1;  /* the owner died without releasing it */
+
+    if (owner) release_object( owner );
+}
+
 /* release a mutex once the recursion count is 0 */
 static void do_release( struct mutex *mutex )
 {
@@ -126,6 +160,7 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
             mutex->count = 0;
             mutex->owner = NULL;
             mutex->abandoned = 0;
+            mutex->fast_sync = NULL;
             if (owned) do_grab( mutex, current );
         }
     }
@@ -134,8 +169,17 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
 
 void abandon_mutexes( struct thread *thread )
 {
+    struct mutex *mutex, *next;
     struct list *ptr;
 
+    /* only threads of the creating process can own a mutex through its in-process state,
+     * and once its last thread is gone nobody can use that state anymore */
+    LIST_FOR_EACH_ENTRY_SAFE( mutex, next, &thread->process->fast_mutexes, struct mutex, fast_entry )
+    {
+        if (mutex->fast_sync->state == thread->id || thread->process->running_threads <= 1)
+            demote_mutex( mutex );
+    }
+
     while ((ptr = list_head( &thread->mutex_list )) != NULL)
     {
         struct mutex *mutex = LIST_ENTRY( ptr, struct mutex, entry );
@@ -150,6 +194,7 @@ static void mutex_dump( struct object *obj, int verbose )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
+    demote_mutex( mutex );
     fprintf( stderr, "Mutex count=%u owner=%p\n", mutex->count, mutex->owner );
 }
 
@@ -157,6 +202,7 @@ static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
+    demote_mutex( mutex );
     return (!mutex->count || (mutex->owner == get_wait_queue_thread( entry )));
 }
 
@@ -180,6 +226,7 @@ static int mutex_signal( struct object *obj, unsigned int access )
         set_error( STATUS_ACCESS_DENIED );
         return 0;
     }
+    demote_mutex( mutex );
     if (!mutex->count || (mutex->owner != current))
     {
         set_error( STATUS_MUTANT_NOT_OWNED );
@@ -189,11 +236,25 @@ static int mutex_signal( struct object *obj, unsigned int access )
     return 1;
 }
 
+static int mutex_close_handle( struct object *obj, struct process *process, obj_handle_t handle )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    /* the client may not know that the handle is closed, make it go through the server */
+    demote_mutex( mutex );
+    return 1;
+}
+
 static void mutex_destroy( struct object *obj )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
+    if (mutex->fast_sync)
+    {
+        demote_mutex( mutex );
+        free_fast_sync( mutex->fast_sync );
+    }
     if (!mutex->count) return;
     mutex->count = 0;
     do_release( mutex );
@@ -215,8 +276,27 @@ DECL_HANDLER(create_mutex)
         if (get_error() == STATUS_OBJECT_NAME_EXISTS)
             reply->handle = alloc_handle( current->process, mutex, req->access, objattr->attributes );
         else
+        {
             reply->handle = alloc_handle_no_access_check( current->process, mutex,
                                                           req->access, objattr->attributes );
+            /* unnamed mutexes are only known to this process until it shares the handle */
+            if (reply->handle && !name.len && !(objattr->attributes & OBJ_INHERIT) &&
+                (get_handle_access( current->process, reply->handle ) & FAST_MUTEX_ACCESS) == FAST_MUTEX_ACCESS &&
+                (mutex->fast_sync = alloc_fast_sync( FAST_SYNC_MUTEX, req->owned ? current->id : 0,
+                                                     mutex->count, 0 )))
+            {
+                /* the in-process state owns it now */
+                if (mutex->count)
+                {
+                    list_remove( &mutex->entry );
+                    mutex->count = 0;
+                    mutex->owner = NULL;
+                }
+                list_add_tail( &current->process->fast_mutexes, &mutex->fast_entry );
+                reply->fast_sync = get_fast_sync_index( mutex->fast_sync );
+                reply->fast_sync_id = get_fast_sync_id( mutex->fast_sync );
+            }
+        }
         release_object( mutex );
     }
 
@@ -240,6 +320,7 @@ DECL_HANDLER(release_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  0, &mutex_ops )))
     {
+        demote_mutex( mutex );
         if (!mutex->count || (mutex->owner != current)) set_error( STATUS_MUTANT_NOT_OWNED );
         else
         {
@@ -258,6 +339,7 @@ DECL_HANDLER(query_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  MUTANT_QUERY_STATE, &mutex_ops )))
     {
+        demote_mutex( mutex );
         reply->count = mutex->count;
         reply->owned = (mutex->owner == current);
         reply->abandoned = mutex->abandoned;
@@ -654,6 +654,7 @@ struct process *create_process( int fd, struct process *parent, unsigned int fla
     process->debug_event     = NULL;
     process->handles         = NULL;
     process->msg_fd          = NULL;
+    process->io_ring         = NULL;
     process->sigkill_timeout = NULL;
     process->sigkill_delay   = TICKS_PER_SEC / 64;
     process->machine         = native_machine;
@@ -688,6 +689,7 @@ struct process *create_process( int fd, struct process *parent, unsigned int fla
     list_init( &process->kernel_object );
     list_init( &process->thread_list );
     list_init( &process->locks );
+    list_init( &process->fast_mutexes );
     list_init( &process->asyncs );
     list_init( &process->classes );
     list_init( &process->views );
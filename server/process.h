@@ -22,6 +22,7 @@
 #define __WINE_SERVER_PROCESS_H
 
 #include "object.h"
+#include "wine/rbtree.h"
 
 struct atom_table;
 struct handle_table;
@@ -65,7 +66,10 @@ struct process
     struct job          *job;             /* job object associated with this process */
     struct list          job_entry;       /* list entry for job object */
     struct list          asyncs;          /* list of async object owned by the process */
+    struct fd           *io_ring;         /* pipe signaling the client io_uring completions */
+    struct wine_rb_tree  ring_asyncs;     /* asyncs submitted to the client io_uring, by user pointer */
     struct list          locks;           /* list of file locks owned by the process */
+    struct list          fast_mutexes;    /* list of mutexes using their in-process state */
     struct list          classes;         /* window classes owned by the process */
     struct console      *console;         /* console input */
     enum startup_state   startup_state;   /* startup state */
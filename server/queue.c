@@ -146,6 +146,7 @@ struct msg_queue
     struct hook_table     *hooks;           /* hook table */
     timeout_t              last_get_msg;    /* time of last get message call */
     int                    keystate_lock;   /* owns an input keystate lock */
+    shared_object_t       *shared;          /* queue data in the session shared memory */
 };
 
 struct hotkey
@@ -314,6 +315,7 @@ static struct msg_queue *create_msg_queue( struct thread *thread, struct thread_
         queue->hooks           = NULL;
         queue->last_get_msg    = current_time;
         queue->keystate_lock   = 0;
+        queue->shared          = alloc_shared_object();
         list_init( &queue->send_result );
         list_init( &queue->callback_result );
         list_init( &queue->pending_timers );
@@ -464,6 +466,18 @@ static int update_desktop_cursor_window( struct desktop *desktop, user_handle_t
     return updated;
 }
 
+/* publish the desktop async key state in the session shared memory */
+static void update_shared_keystate( struct desktop *desktop )
+{
+    if (!desktop->shared) return;
+
+    SHARED_WRITE_BEGIN( desktop->shared, desktop_shm_t )
+    {
+        memcpy( shared->keystate, desktop->keystate, sizeof(shared->keystate) );
+    }
+    SHARED_WRITE_END;
+}
+
 static int update_desktop_cursor_pos( struct desktop *desktop, user_handle_t win, int x, int y )
 {
     int updated;
@@ -475,6 +489,17 @@ static int update_desktop_cursor_pos( struct desktop *desktop, user_handle_t win
     desktop->cursor.y = y;
     desktop->cursor.last_change = get_tick_count();
 
+    if (desktop->shared)
+    {
+        SHARED_WRITE_BEGIN( desktop->shared, desktop_shm_t )
+        {
+            shared->cursor_x = x;
+            shared->cursor_y = y;
+            shared->cursor_last_change = desktop->cursor.last_change;
+        }
+        SHARED_WRITE_END;
+    }
+
     if (!win || !is_window_visible( win ) || is_window_transparent( win ))
         win = shallow_window_from_point( desktop, x, y );
     if (update_desktop_cursor_window( desktop, win )) updated = 1;
@@ -590,6 +615,21 @@ static inline int is_signaled( struct msg_queue *queue )
     return ((queue->wake_bits & queue->wake_mask) || (queue->changed_bits & queue->changed_mask));
 }
 
+/* publish the queue bits and masks in the session shared memory */
+static void update_shared_queue( struct msg_queue *queue )
+{
+    if (!queue->shared) return;
+
+    SHARED_WRITE_BEGIN( queue->shared, queue_shm_t )
+    {
+        shared->wake_bits    = queue->wake_bits;
+        shared->wake_mask    = queue->wake_mask;
+        shared->changed_bits = queue->changed_bits;
+        shared->changed_mask = queue->changed_mask;
+    }
+    SHARED_WRITE_END;
+}
+
 /* set some queue bits */
 static inline void set_queue_bits( struct msg_queue *queue, unsigned int bits )
 {
@@ -600,6 +640,7 @@ static inline void set_queue_bits( struct msg_queue *queue, unsigned int bits )
     }
     queue->wake_bits |= bits;
     queue->changed_bits |= bits;
+    update_shared_queue( queue );
     if (is_signaled( queue )) wake_up( &queue->obj, 0 );
 }
 
@@ -608,6 +649,7 @@ static inline void clear_queue_bits( struct msg_queue *queue, unsigned int bits
 {
     queue->wake_bits &= ~bits;
     queue->changed_bits &= ~bits;
+    update_shared_queue( queue );
     if (!(queue->wake_bits & (QS_KEY | QS_MOUSEBUTTON)))
     {
         if (queue->keystate_lock) unlock_input_keystate( queue->input );
@@ -1152,6 +1194,7 @@ static void msg_queue_satisfied( struct object *obj, struct wait_queue_entry *en
     struct msg_queue *queue = (struct msg_queue *)obj;
     queue->wake_mask = 0;
     queue->changed_mask = 0;
+    update_shared_queue( queue );
 }
 
 static void msg_queue_destroy( struct object *obj )
@@ -1191,6 +1234,7 @@ static void msg_queue_destroy( struct object *obj )
     release_object( queue->input );
     if (queue->hooks) release_object( queue->hooks );
     if (queue->fd) release_object( queue->fd );
+    free_shared_object( queue->shared );
 }
 
 static void msg_queue_poll_event( struct fd *fd, int event )
@@ -1520,6 +1564,8 @@ static void update_input_key_state( struct desktop *desktop, unsigned char *keys
         }
         break;
     }
+
+    if (keystate == desktop->keystate) update_shared_keystate( desktop );
 }
 
 /* update the desktop key state according to a mouse message flags */
@@ -2009,6 +2055,14 @@ static int queue_mouse_message( struct desktop *desktop, user_handle_t win, cons
     };
 
     desktop->cursor.last_change = get_tick_count();
+    if (desktop->shared)
+    {
+        SHARED_WRITE_BEGIN( desktop->shared, desktop_shm_t )
+        {
+            shared->cursor_last_change = desktop->cursor.last_change;
+        }
+        SHARED_WRITE_END;
+    }
     flags = input->mouse.flags;
     time  = input->mouse.time;
     if (!time) time = desktop->cursor.last_change;
@@ -2789,7 +2843,11 @@ DECL_HANDLER(get_msg_queue)
     struct msg_queue *queue = get_current_queue();
 
     reply->handle = 0;
-    if (queue) reply->handle = alloc_handle( current->process, queue, SYNCHRONIZE, 0 );
+    if (queue)
+    {
+        reply->handle = alloc_handle( current->process, queue, SYNCHRONIZE, 0 );
+        get_shared_object_locator( queue->shared, &reply->locator );
+    }
 }
 
 
@@ -2835,6 +2893,7 @@ DECL_HANDLER(set_queue_mask)
             if (req->skip_wait) queue->wake_mask = queue->changed_mask = 0;
             else wake_up( &queue->obj, 0 );
         }
+        update_shared_queue( queue );
     }
 }
 
@@ -2848,6 +2907,7 @@ DECL_HANDLER(get_queue_status)
         reply->wake_bits    = queue->wake_bits;
         reply->changed_bits = queue->changed_bits;
         queue->changed_bits &= ~req->clear_bits;
+        update_shared_queue( queue );
     }
     else reply->wake_bits = reply->changed_bits = 0;
 }
@@ -3036,6 +3096,7 @@ DECL_HANDLER(get_message)
     }
     if (filter & QS_INPUT) queue->changed_bits &= ~QS_INPUT;
     if (filter & QS_PAINT) queue->changed_bits &= ~QS_PAINT;
+    update_shared_queue( queue );
 
     /* then check for posted messages */
     if ((filter & QS_POSTMESSAGE) &&
@@ -3090,6 +3151,7 @@ DECL_HANDLER(get_message)
     if (get_win == -1 && current->process->idle_event) set_event( current->process->idle_event );
     queue->wake_mask = req->wake_mask;
     queue->changed_mask = req->changed_mask;
+    update_shared_queue( queue );
     set_error( STATUS_PENDING );  /* FIXME */
 }
 
@@ -3465,6 +3527,7 @@ DECL_HANDLER(get_key_state)
         {
             reply->state = desktop->keystate[req->key & 0xff];
             desktop->keystate[req->key & 0xff] &= ~0x40;
+            update_shared_keystate( desktop );
         }
         set_reply_data( desktop->keystate, size );
         release_object( desktop );
@@ -3495,6 +3558,7 @@ DECL_HANDLER(set_key_state)
     if (req->async && (desktop = get_thread_desktop( current, 0 )))
     {
         memcpy( desktop->keystate, get_req_data(), size );
+        update_shared_keystate( desktop );
         release_object( desktop );
     }
 }
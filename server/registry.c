@@ -26,15 +26,22 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -74,22 +81,34 @@ struct type_descr key_type =
     },
 };
 
+/* an entry in the index of subkeys or values of a key */
+/* the index is a treap sorted by name, with subtree counts to allow lookups by position */
+struct key_index
+{
+    struct key_index *left;        /* entries sorting before this one */
+    struct key_index *right;       /* entries sorting after this one */
+    unsigned int      count;       /* number of entries in this subtree */
+    unsigned int      priority;    /* heap priority, highest at the root of the subtree */
+};
+
+struct hive;
+struct hive_key;
+
 /* a registry key */
 struct key
 {
     struct object     obj;         /* object header */
+    struct key_index  entry;       /* entry in the parent subkeys index */
     WCHAR            *class;       /* key class */
     data_size_t       classlen;    /* length of class name */
-    int               last_subkey; /* last in use subkey */
-    int               nb_subkeys;  /* count of allocated subkeys */
-    struct key      **subkeys;     /* subkeys array */
+    struct key_index *subkeys;     /* subkeys index */
     struct key       *wow6432node; /* Wow6432Node subkey */
-    int               last_value;  /* last in use value */
-    int               nb_values;   /* count of allocated values in array */
-    struct key_value *values;      /* values array */
+    struct key_index *values;      /* values index */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
+    const struct hive     *hive;     /* hive containing the subkeys and values not loaded yet */
+    const struct hive_key *hive_key; /* hive data of the key, NULL once loaded */
 };
 
 /* key flags */
@@ -105,6 +124,7 @@ struct key
 /* a key value */
 struct key_value
 {
+    struct key_index  entry;   /* entry in the key values index */
     WCHAR            *name;    /* value name */
     unsigned short    namelen; /* length of value name */
     unsigned int      type;    /* value type */
@@ -112,9 +132,6 @@ struct key_value
     void             *data;    /* pointer to value data */
 };
 
-#define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
-#define MIN_VALUES   8   /* min. number of allocated values per key */
-
 #define MAX_NAME_LEN  256    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
 
@@ -131,15 +148,24 @@ static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
 
 static void set_periodic_save_timer(void);
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void make_dirty( struct key *key );
+static void load_hive_key( struct key *key );
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index );
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
     struct key  *key;
     const char  *filename;
+    FILE        *journal;        /* journal of the changes since the file was saved */
+    struct key  *journal_key;    /* key of the last journal record */
+    timeout_t    journal_modif;  /* key modification time of the last journal record */
+    long         journal_pos;    /* journal position at the last sync point */
+    pid_t        compact_pid;    /* process compacting the journal into the file */
 };
 
+#define JOURNAL_COMPACT_SIZE (4 * 1024 * 1024)  /* journal size that triggers a compaction */
+
 #define MAX_SAVE_BRANCH_INFO 3
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
@@ -158,6 +184,7 @@ struct file_load_info
     int         line;     /* current input line */
     WCHAR      *tmp;      /* temp buffer to use while parsing input */
     size_t      tmplen;   /* length of temp buffer */
+    int         journal;  /* replaying a journal file */
 };
 
 
@@ -218,8 +245,87 @@ static inline struct key *get_parent( const struct key *key )
  * - key names use escapes too in order to support Unicode
  * - the modification time optionally follows the key name
  * - REG_EXPAND_SZ and REG_MULTI_SZ are saved as strings instead of hex
+ *
+ * Changes made after a branch has been saved are appended to a journal file
+ * in the same format, replayed on top of the branch file at startup:
+ * - a key section only contains the values that changed
+ * - a "#delete" option deletes the key and all its subkeys
+ * - a value with "-" as data is deleted
+ * - a ";; sync" comment follows each complete set of changes, anything after
+ *   the last one is discarded on replay
+ *
+ * Each branch file is also cached in a binary hive file, mapped at startup
+ * instead of parsing the text. The keys are loaded from the mapping the first
+ * time their subkeys or values are accessed. The hive is only used when it was
+ * written along with the current branch file, so the text file remains the
+ * reference and can still be edited by hand.
  */
 
+#define HIVE_MAGIC   0x45564948  /* "HIVE" */
+#define HIVE_VERSION 1
+
+/* header of a hive file; all offsets are from the start of the file */
+struct hive_header
+{
+    unsigned int       magic;       /* HIVE_MAGIC */
+    unsigned int       version;     /* HIVE_VERSION */
+    unsigned int       prefix_type; /* prefix architecture */
+    unsigned int       root;        /* offset of the branch key */
+    unsigned long long size;        /* size of the hive file */
+    unsigned long long file_ino;    /* inode of the branch file the hive was written with */
+    unsigned long long file_size;   /* size of the branch file */
+    long long          file_time;   /* modification time of the branch file, in nanoseconds */
+};
+
+/* a key in a hive file */
+struct hive_key
+{
+    timeout_t          modif;        /* last modification time */
+    unsigned int       flags;        /* key flags (only KEY_SYMLINK) */
+    unsigned int       namelen;      /* length of the name in bytes */
+    unsigned int       name;         /* offset of the name */
+    unsigned int       classlen;     /* length of the class in bytes */
+    unsigned int       class;        /* offset of the class */
+    unsigned int       subkey_count; /* number of subkeys */
+    unsigned int       subkeys;      /* offset of the sorted array of subkey offsets */
+    unsigned int       value_count;  /* number of values */
+    unsigned int       values;       /* offset of the sorted array of struct hive_value */
+};
+
+/* a value in a hive file */
+struct hive_value
+{
+    unsigned int       type;         /* value type */
+    unsigned int       namelen;      /* length of the name in bytes */
+    unsigned int       name;         /* offset of the name */
+    unsigned int       len;          /* length of the data in bytes */
+    unsigned int       data;         /* offset of the data */
+};
+
+/* a mapped hive file */
+struct hive
+{
+    const char        *base;         /* base address of the mapping */
+    size_t             size;         /* size of the mapping */
+};
+
+/* the path of a key that is still in a hive, for saving it */
+struct hive_path
+{
+    const struct hive_path *parent;  /* path of the parent, NULL for a loaded key */
+    const struct key       *key;     /* the loaded key, if no parent */
+    const WCHAR            *name;    /* name of the hive key */
+    data_size_t             len;     /* length of the name */
+};
+
+/* state of a hive file being written */
+struct hive_writer
+{
+    FILE              *file;         /* output file */
+    unsigned int       pos;          /* current position in the file */
+    int                failed;       /* a write has failed */
+};
+
 /* dump the full path of a key */
 static void dump_path( const struct key *key, const struct key *base, FILE *f )
 {
@@ -285,81 +391,418 @@ static void dump_value( const struct key_value *value, FILE *f )
     fputc( '\n', f );
 }
 
-/* find the named child of a given key and return its index */
-static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+static inline unsigned int index_count( const struct key_index *index )
 {
-    int i, min, max, res;
-    data_size_t len;
+    return index ? index->count : 0;
+}
+
+static inline struct key *index_to_key( const struct key_index *entry )
+{
+    return (struct key *)((char *)entry - offsetof( struct key, entry ));
+}
 
-    min = 0;
-    max = key->last_subkey;
-    while (min <= max)
+static inline struct key_value *index_to_value( const struct key_index *entry )
+{
+    return (struct key_value *)((char *)entry - offsetof( struct key_value, entry ));
+}
+
+/* recompute the subtree count of an index entry */
+static inline void index_update( struct key_index *entry )
+{
+    entry->count = index_count( entry->left ) + index_count( entry->right ) + 1;
+}
+
+/* get the entry at a given position in the index */
+static struct key_index *index_get( const struct key_index *index, unsigned int pos )
+{
+    while (index)
     {
-        i = (min + max) / 2;
-        len = min( key->subkeys[i]->obj.name->len, name->len );
-        res = memicmp_strW( key->subkeys[i]->obj.name->name, name->str, len );
-        if (!res) res = key->subkeys[i]->obj.name->len - name->len;
-        if (!res)
+        unsigned int left = index_count( index->left );
+        if (pos == left) break;
+        if (pos < left) index = index->left;
+        else
         {
-            *index = i;
-            return key->subkeys[i];
+            pos -= left + 1;
+            index = index->right;
         }
-        if (res > 0) max = i - 1;
-        else min = i + 1;
     }
-    *index = min;  /* this is where we should insert it */
-    return NULL;
+    return (struct key_index *)index;
+}
+
+/* get the subkey at a given position */
+static inline struct key *get_subkey( const struct key *key, unsigned int pos )
+{
+    return index_to_key( index_get( key->subkeys, pos ));
+}
+
+/* get the value at a given position */
+static inline struct key_value *get_value_at( const struct key *key, unsigned int pos )
+{
+    return index_to_value( index_get( key->values, pos ));
+}
+
+/* call a function for every entry of the index, in order */
+static void index_walk( const struct key_index *index, void (*func)( struct key_index *, void * ), void *arg )
+{
+    while (index)
+    {
+        index_walk( index->left, func, arg );
+        func( (struct key_index *)index, arg );
+        index = index->right;
+    }
+}
+
+/* split an index in two, the first containing the entries before the specified position */
+static void index_split( struct key_index *index, unsigned int pos,
+                         struct key_index **before, struct key_index **after )
+{
+    if (!index)
+    {
+        *before = *after = NULL;
+        return;
+    }
+    if (index_count( index->left ) < pos)
+    {
+        index_split( index->right, pos - index_count( index->left ) - 1, &index->right, after );
+        *before = index;
+    }
+    else
+    {
+        index_split( index->left, pos, before, &index->left );
+        *after = index;
+    }
+    index_update( index );
 }
 
-/* try to grow the array of subkeys; return 1 if OK, 0 on error */
-static int grow_subkeys( struct key *key )
+/* merge two indexes, all entries of the first one sorting before the second one */
+static struct key_index *index_merge( struct key_index *before, struct key_index *after )
 {
-    struct key **new_subkeys;
-    int nb_subkeys;
+    if (!before) return after;
+    if (!after) return before;
+    if (before->priority > after->priority)
+    {
+        before->right = index_merge( before->right, after );
+        index_update( before );
+        return before;
+    }
+    after->left = index_merge( before, after->left );
+    index_update( after );
+    return after;
+}
+
+/* insert an entry at the given position of the index */
+static void index_insert( struct key_index **index, struct key_index *entry, unsigned int pos )
+{
+    static unsigned int seed = 0x2545f491;
+    struct key_index *before, *after;
+
+    /* xorshift, any well distributed sequence keeps the treap balanced */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    entry->priority = seed;
+    entry->left = entry->right = NULL;
+    entry->count = 1;
+
+    index_split( *index, pos, &before, &after );
+    *index = index_merge( index_merge( before, entry ), after );
+}
 
-    if (key->nb_subkeys)
+/* remove the entry at the given position of the index and return it */
+static struct key_index *index_remove( struct key_index **index, unsigned int pos )
+{
+    struct key_index *before, *entry, *after;
+
+    index_split( *index, pos, &before, &after );
+    index_split( after, 1, &entry, &after );
+    *index = index_merge( before, after );
+    return entry;
+}
+
+/* compare the name of a key with a given name */
+static int compare_key_name( const struct key *key, const struct unicode_str *name )
+{
+    data_size_t len = min( key->obj.name->len, name->len );
+    int res = memicmp_strW( key->obj.name->name, name->str, len );
+
+    if (!res) res = key->obj.name->len - name->len;
+    return res;
+}
+
+/* find the named child of a given key and return its index */
+static struct key *find_subkey( struct key *key, const struct unicode_str *name, int *index )
+{
+    struct key_index *entry;
+    struct key *subkey;
+    int pos = 0, res;
+
+    load_hive_key( key );
+    entry = key->subkeys;
+    while (entry)
     {
-        nb_subkeys = key->nb_subkeys + (key->nb_subkeys / 2);  /* grow by 50% */
-        if (!(new_subkeys = realloc( key->subkeys, nb_subkeys * sizeof(*new_subkeys) )))
+        subkey = index_to_key( entry );
+        if (!(res = compare_key_name( subkey, name )))
         {
-            set_error( STATUS_NO_MEMORY );
-            return 0;
+            *index = pos + index_count( entry->left );
+            return subkey;
+        }
+        if (res > 0) entry = entry->left;
+        else
+        {
+            pos += index_count( entry->left ) + 1;
+            entry = entry->right;
         }
     }
-    else
+    *index = pos;  /* this is where we should insert it */
+    return NULL;
+}
+
+/* get a pointer to an array of items in a hive, checking that it is within bounds */
+static const void *hive_data( const struct hive *hive, unsigned int offset, unsigned int count, size_t size )
+{
+    if (offset > hive->size || count > (hive->size - offset) / size) return NULL;
+    return hive->base + offset;
+}
+
+/* get the number of subkeys of a key, including the ones not loaded yet */
+static inline unsigned int get_subkey_count( const struct key *key )
+{
+    if (key->hive_key) return key->hive_key->subkey_count;
+    return index_count( key->subkeys );
+}
+
+/* get the number of values of a key, including the ones not loaded yet */
+static inline unsigned int get_value_count( const struct key *key )
+{
+    if (key->hive_key) return key->hive_key->value_count;
+    return index_count( key->values );
+}
+
+/* dump the full path of a key that is still in a hive */
+static void dump_hive_path( const struct hive_path *path, const struct key *base, FILE *f )
+{
+    if (!path->parent)
     {
-        nb_subkeys = MIN_SUBKEYS;
-        if (!(new_subkeys = mem_alloc( nb_subkeys * sizeof(*new_subkeys) ))) return 0;
+        dump_path( path->key, base, f );
+        return;
     }
-    key->subkeys    = new_subkeys;
-    key->nb_subkeys = nb_subkeys;
-    return 1;
+    if (path->parent->parent || path->parent->key != base)
+    {
+        dump_hive_path( path->parent, base, f );
+        fprintf( f, "\\\\" );
+    }
+    dump_strW( path->name, path->len, f, "[]" );
+}
+
+/* save the options of a key following its path */
+static void save_key_options( FILE *f, timeout_t modif, const WCHAR *class, data_size_t classlen,
+                              unsigned int flags )
+{
+    fprintf( f, "] %u\n", (unsigned int)((modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+    fprintf( f, "#time=%x%08x\n", (unsigned int)(modif >> 32), (unsigned int)modif );
+    if (class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( class, classlen, f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (flags & KEY_SYMLINK) fputs( "#link\n", f );
+}
+
+/* save the values of a key that are still in a hive */
+static void save_hive_values( const struct hive *hive, const struct hive_key *hkey, FILE *f )
+{
+    const struct hive_value *hvalues;
+    struct key_value value;
+    unsigned int i;
+
+    if (!(hvalues = hive_data( hive, hkey->values, hkey->value_count, sizeof(*hvalues) ))) return;
+    for (i = 0; i < hkey->value_count; i++)
+    {
+        value.type    = hvalues[i].type;
+        value.namelen = hvalues[i].namelen;
+        value.len     = hvalues[i].len;
+        value.name    = (WCHAR *)hive_data( hive, hvalues[i].name, value.namelen, 1 );
+        value.data    = (void *)hive_data( hive, hvalues[i].data, value.len, 1 );
+        if (value.name && value.data) dump_value( &value, f );
+    }
+}
+
+static void save_hive_subkeys( const struct hive *hive, const struct hive_key *hkey,
+                               const struct hive_path *path, const struct key *base, FILE *f );
+
+/* save a key that is still in a hive and all its subkeys */
+static void save_hive_key( const struct hive *hive, const struct hive_key *hkey,
+                           const struct hive_path *path, const struct key *base, FILE *f )
+{
+    if (hkey->value_count || !hkey->subkey_count || hkey->classlen || (hkey->flags & KEY_SYMLINK))
+    {
+        fprintf( f, "\n[" );
+        dump_hive_path( path, base, f );
+        save_key_options( f, hkey->modif, hkey->classlen ? hive_data( hive, hkey->class, hkey->classlen, 1 ) : NULL,
+                          hkey->classlen, hkey->flags );
+        save_hive_values( hive, hkey, f );
+    }
+    save_hive_subkeys( hive, hkey, path, base, f );
+}
+
+/* save the subkeys of a key that are still in a hive */
+static void save_hive_subkeys( const struct hive *hive, const struct hive_key *hkey,
+                               const struct hive_path *path, const struct key *base, FILE *f )
+{
+    const unsigned int *subkeys;
+    const struct hive_key *subkey;
+    struct hive_path subpath;
+    unsigned int i;
+
+    if (!(subkeys = hive_data( hive, hkey->subkeys, hkey->subkey_count, sizeof(*subkeys) ))) return;
+    subpath.parent = path;
+    subpath.key = NULL;
+    for (i = 0; i < hkey->subkey_count; i++)
+    {
+        if (!(subkey = hive_data( hive, subkeys[i], 1, sizeof(*subkey) ))) continue;
+        if (!(subpath.name = hive_data( hive, subkey->name, subkey->namelen, 1 ))) continue;
+        subpath.len = subkey->namelen;
+        save_hive_key( hive, subkey, &subpath, base, f );
+    }
+}
+
+struct save_subkeys_args
+{
+    const struct key *base;
+    FILE             *f;
+};
+
+static void save_subkeys( const struct key *key, const struct key *base, FILE *f );
+
+static void save_value_entry( struct key_index *entry, void *arg )
+{
+    dump_value( index_to_value( entry ), arg );
+}
+
+static void save_subkey_entry( struct key_index *entry, void *arg )
+{
+    struct save_subkeys_args *args = arg;
+    save_subkeys( index_to_key( entry ), args->base, args->f );
 }
 
 /* save a registry and all its subkeys to a text file */
 static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
 {
-    int i;
+    struct save_subkeys_args args = { base, f };
+    struct hive_path path;
 
     if (key->flags & KEY_VOLATILE) return;
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
-    if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
+    if (get_value_count( key ) || !get_subkey_count( key ) || key->class || (key->flags & KEY_SYMLINK))
     {
         fprintf( f, "\n[" );
         if (key != base) dump_path( key, base, f );
-        fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
-        fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
-        if (key->class)
-        {
-            fprintf( f, "#class=\"" );
-            dump_strW( key->class, key->classlen, f, "\"\"" );
-            fprintf( f, "\"\n" );
-        }
-        if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
-        for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+        save_key_options( f, key->modif, key->class, key->classlen, key->flags );
+        if (key->hive_key) save_hive_values( key->hive, key->hive_key, f );
+        index_walk( key->values, save_value_entry, f );
+    }
+    if (key->hive_key)
+    {
+        /* don't load the subkeys only to save them */
+        path.parent = NULL;
+        path.key = key;
+        save_hive_subkeys( key->hive, key->hive_key, &path, base, f );
+    }
+    index_walk( key->subkeys, save_subkey_entry, &args );
+}
+
+/* get the saved branch containing a key, if any */
+static struct save_branch_info *get_save_branch( const struct key *key )
+{
+    int i;
+
+    if (key->flags & (KEY_VOLATILE | KEY_DELETED)) return NULL;
+    for ( ; key; key = get_parent( key ))
+        for (i = 0; i < save_branch_count; i++)
+            if (save_branch_info[i].key == key) return &save_branch_info[i];
+    return NULL;
+}
+
+/* start a journal record for a key; return the branch it belongs to */
+static struct save_branch_info *journal_key_header( struct key *key )
+{
+    struct save_branch_info *branch = get_save_branch( key );
+
+    if (!branch || !branch->journal) return NULL;
+    if (branch->journal_key != key)
+    {
+        fprintf( branch->journal, "\n[" );
+        if (key != branch->key) dump_path( key, branch->key, branch->journal );
+        fprintf( branch->journal, "]\n" );
+        branch->journal_key = key;
+        branch->journal_modif = 0;
+    }
+    if (branch->journal_modif != key->modif)
+    {
+        fprintf( branch->journal, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
+        branch->journal_modif = key->modif;
+    }
+    return branch;
+}
+
+/* record the creation or the options of a key in the journal */
+static void journal_key( struct key *key )
+{
+    struct save_branch_info *branch;
+
+    if (!(branch = journal_key_header( key ))) return;
+    if (key->class)
+    {
+        fprintf( branch->journal, "#class=\"" );
+        dump_strW( key->class, key->classlen, branch->journal, "\"\"" );
+        fprintf( branch->journal, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", branch->journal );
+}
+
+/* record the deletion of a key in the journal */
+static void journal_delete_key( struct key *key )
+{
+    struct save_branch_info *branch;
+
+    if (!(branch = journal_key_header( key ))) return;
+    fputs( "#delete\n", branch->journal );
+    branch->journal_key = NULL;
+}
+
+/* record a key and all its subkeys in the journal */
+static void journal_subkeys( struct key *key )
+{
+    struct save_branch_info *branch = get_save_branch( key );
+
+    if (!branch || !branch->journal) return;
+    save_subkeys( key, branch->key, branch->journal );
+    branch->journal_key = NULL;
+}
+
+/* record a value change in the journal */
+static void journal_set_value( struct key *key, const struct key_value *value )
+{
+    struct save_branch_info *branch;
+
+    if ((branch = journal_key_header( key ))) dump_value( value, branch->journal );
+}
+
+/* record a value deletion in the journal */
+static void journal_delete_value( struct key *key, const struct unicode_str *name )
+{
+    struct save_branch_info *branch;
+
+    if (!(branch = journal_key_header( key ))) return;
+    if (name->len)
+    {
+        fputc( '\"', branch->journal );
+        dump_strW( name->str, name->len, branch->journal, "\"\"" );
+        fprintf( branch->journal, "\"=-\n" );
     }
-    for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
+    else fprintf( branch->journal, "@=-\n" );
 }
 
 static void dump_operation( const struct key *key, const struct key_value *value, const char *op )
@@ -566,6 +1009,7 @@ static struct object *key_lookup_name( struct object *obj, struct unicode_str *n
     {
         name->str += next / sizeof(WCHAR);
         name->len -= next;
+        if (attr & OBJ_KEY_WOW64) load_hive_key( found );
         if ((attr & OBJ_KEY_WOW64) && found->wow6432node && !is_wow6432node( name->str, name->len ))
             found = found->wow6432node;
     }
@@ -582,7 +1026,7 @@ static int key_link_name( struct object *obj, struct object_name *name, struct o
     struct key *key = (struct key *)obj;
     struct key *parent_key = (struct key *)parent;
     struct unicode_str tmp;
-    int i, index;
+    int index;
 
     if (parent->ops != &key_ops)
     {
@@ -592,18 +1036,11 @@ static int key_link_name( struct object *obj, struct object_name *name, struct o
         return 0;
     }
 
-    if (parent_key->last_subkey + 1 == parent_key->nb_subkeys)
-    {
-        /* need to grow the array */
-        if (!grow_subkeys( parent_key )) return 0;
-    }
     tmp.str = name->name;
     tmp.len = name->len;
     find_subkey( parent_key, &tmp, &index );
-
-    for (i = ++parent_key->last_subkey; i > index; i--)
-        parent_key->subkeys[i] = parent_key->subkeys[i - 1];
-    parent_key->subkeys[index] = (struct key *)grab_object( key );
+    index_insert( &parent_key->subkeys, &key->entry, index );
+    grab_object( key );
     if (is_wow6432node( name->name, name->len ) &&
         !is_wow6432node( parent_key->obj.name->name, parent_key->obj.name->len ))
         parent_key->wow6432node = key;
@@ -615,7 +1052,9 @@ static void key_unlink_name( struct object *obj, struct object_name *name )
 {
     struct key *key = (struct key *)obj;
     struct key *parent = (struct key *)name->parent;
-    int i, nb_subkeys;
+    struct key_index *entry;
+    struct unicode_str tmp;
+    unsigned int index = 0;
 
     if (!parent) return;
 
@@ -625,25 +1064,23 @@ static void key_unlink_name( struct object *obj, struct object_name *name )
         return;
     }
 
-    for (i = 0; i <= parent->last_subkey; i++) if (parent->subkeys[i] == key) break;
-    assert( i <= parent->last_subkey );
-    for ( ; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
-    parent->last_subkey--;
+    /* the object name is already cleared, look for the key using the unlinked name */
+    tmp.str = name->name;
+    tmp.len = name->len;
+    for (entry = parent->subkeys; entry != &key->entry; )
+    {
+        assert( entry );
+        if (compare_key_name( index_to_key( entry ), &tmp ) > 0) entry = entry->left;
+        else
+        {
+            index += index_count( entry->left ) + 1;
+            entry = entry->right;
+        }
+    }
+    index_remove( &parent->subkeys, index + index_count( entry->left ));
     name->parent = NULL;
     if (parent->wow6432node == key) parent->wow6432node = NULL;
     release_object( key );
-
-    /* try to shrink the array */
-    nb_subkeys = parent->nb_subkeys;
-    if (nb_subkeys > MIN_SUBKEYS && parent->last_subkey < nb_subkeys / 2)
-    {
-        struct key **new_subkeys;
-        nb_subkeys -= nb_subkeys / 3;  /* shrink by 33% */
-        if (nb_subkeys < MIN_SUBKEYS) nb_subkeys = MIN_SUBKEYS;
-        if (!(new_subkeys = realloc( parent->subkeys, nb_subkeys * sizeof(*new_subkeys) ))) return;
-        parent->subkeys = new_subkeys;
-        parent->nb_subkeys = nb_subkeys;
-    }
 }
 
 /* close the notification associated with a handle */
@@ -655,26 +1092,48 @@ static int key_close_handle( struct object *obj, struct process *process, obj_ha
     return 1;  /* ok to close */
 }
 
+/* free a value removed from its key */
+static void free_value( struct key_value *value )
+{
+    free( value->name );
+    free( value->data );
+    free( value );
+}
+
+/* free all the values of an index */
+static void free_value_index( struct key_index *index )
+{
+    if (!index) return;
+    free_value_index( index->left );
+    free_value_index( index->right );
+    free_value( index_to_value( index ));
+}
+
+/* release all the subkeys of an index */
+static void release_subkey_index( struct key_index *index )
+{
+    struct key *subkey;
+
+    if (!index) return;
+    release_subkey_index( index->left );
+    release_subkey_index( index->right );
+    subkey = index_to_key( index );
+    subkey->obj.name->parent = NULL;
+    release_object( subkey );
+}
+
 static void key_destroy( struct object *obj )
 {
-    int i;
     struct list *ptr;
     struct key *key = (struct key *)obj;
+    int i;
     assert( obj->ops == &key_ops );
 
+    for (i = 0; i < save_branch_count; i++)
+        if (save_branch_info[i].journal_key == key) save_branch_info[i].journal_key = NULL;
     free( key->class );
-    for (i = 0; i <= key->last_value; i++)
-    {
-        free( key->values[i].name );
-        free( key->values[i].data );
-    }
-    free( key->values );
-    for (i = 0; i <= key->last_subkey; i++)
-    {
-        key->subkeys[i]->obj.name->parent = NULL;
-        release_object( key->subkeys[i] );
-    }
-    free( key->subkeys );
+    free_value_index( key->values );
+    release_subkey_index( key->subkeys );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -683,6 +1142,21 @@ static void key_destroy( struct object *obj )
     }
 }
 
+/* initialize a newly created key object */
+static void init_key( struct key *key, timeout_t modif )
+{
+    key->class       = NULL;
+    key->classlen    = 0;
+    key->flags       = 0;
+    key->subkeys     = NULL;
+    key->wow6432node = NULL;
+    key->values      = NULL;
+    key->modif       = modif;
+    key->hive        = NULL;
+    key->hive_key    = NULL;
+    list_init( &key->notify_list );
+}
+
 /* allocate a key object */
 static struct key *create_key_object( struct object *parent, const struct unicode_str *name,
                                       unsigned int attributes, unsigned int options, timeout_t modif,
@@ -697,18 +1171,7 @@ static struct key *create_key_object( struct object *parent, const struct unicod
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            key->class       = NULL;
-            key->classlen    = 0;
-            key->flags       = 0;
-            key->last_subkey = -1;
-            key->nb_subkeys  = 0;
-            key->subkeys     = NULL;
-            key->wow6432node = NULL;
-            key->nb_values   = 0;
-            key->last_value  = -1;
-            key->values      = NULL;
-            key->modif       = modif;
-            list_init( &key->notify_list );
+            init_key( key, modif );
 
             if (options & REG_OPTION_CREATE_LINK) key->flags |= KEY_SYMLINK;
             if (options & REG_OPTION_VOLATILE) key->flags |= KEY_VOLATILE;
@@ -719,7 +1182,7 @@ static struct key *create_key_object( struct object *parent, const struct unicod
                 release_object( key );
                 return NULL;
             }
-            else key->flags |= KEY_DIRTY;
+            else make_dirty( key );
         }
     }
     return key;
@@ -736,15 +1199,20 @@ static void make_dirty( struct key *key )
     }
 }
 
+static void make_clean_entry( struct key_index *entry, void *arg );
+
 /* mark a key and all its subkeys as clean (not modified) */
 static void make_clean( struct key *key )
 {
-    int i;
-
     if (key->flags & KEY_VOLATILE) return;
     if (!(key->flags & KEY_DIRTY)) return;
     key->flags &= ~KEY_DIRTY;
-    for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i] );
+    index_walk( key->subkeys, make_clean_entry, NULL );
+}
+
+static void make_clean_entry( struct key_index *entry, void *arg )
+{
+    make_clean( index_to_key( entry ));
 }
 
 /* go through all the notifications and send them if necessary */
@@ -774,9 +1242,10 @@ static void touch_key( struct key *key, unsigned int change )
 /* get the wow6432node key if any, grabbing it and releasing the original key */
 static struct key *grab_wow6432node( struct key *key )
 {
-    struct key *ret = key->wow6432node;
+    struct key *ret;
 
-    if (!ret) return key;
+    load_hive_key( key );
+    if (!(ret = key->wow6432node)) return key;
     if (ret->flags & KEY_WOWSHARE) return key;
     grab_object( ret );
     release_object( key );
@@ -793,6 +1262,7 @@ static struct key *get_wow6432node( struct key *key )
     if (!key)
         return NULL;
 
+    load_hive_key( key );
     if (key->wow6432node)
         return key->wow6432node;
 
@@ -866,6 +1336,7 @@ static struct key *create_key( struct key *parent, const struct unicode_str *nam
     else
     {
         if (parent) touch_key( get_parent( key ), REG_NOTIFY_CHANGE_NAME );
+        journal_key( key );
         if (debug_level > 1) dump_operation( key, NULL, "Create" );
     }
     return key;
@@ -900,13 +1371,37 @@ static struct key *create_key_recursive( struct key *root, const struct unicode_
     return parent;
 }
 
+struct key_max_lengths
+{
+    data_size_t subkey;
+    data_size_t class;
+    data_size_t value;
+    data_size_t data;
+};
+
+static void get_subkey_max_lengths( struct key_index *entry, void *arg )
+{
+    struct key *subkey = index_to_key( entry );
+    struct key_max_lengths *max = arg;
+
+    if (subkey->obj.name->len > max->subkey) max->subkey = subkey->obj.name->len;
+    if (subkey->classlen > max->class) max->class = subkey->classlen;
+}
+
+static void get_value_max_lengths( struct key_index *entry, void *arg )
+{
+    struct key_value *value = index_to_value( entry );
+    struct key_max_lengths *max = arg;
+
+    if (value->namelen > max->value) max->value = value->namelen;
+    if (value->len > max->data) max->data = value->len;
+}
+
 /* query information about a key or a subkey */
 static void enum_key( struct key *key, int index, int info_class, struct enum_key_reply *reply )
 {
-    int i;
+    struct key_max_lengths max = { 0 };
     data_size_t len, namelen, classlen;
-    data_size_t max_subkey = 0, max_class = 0;
-    data_size_t max_value = 0, max_data = 0;
     WCHAR *fullname = NULL;
     char *data;
 
@@ -918,12 +1413,13 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
 
     if (index != -1)  /* -1 means use the specified key directly */
     {
-        if ((index < 0) || (index > key->last_subkey))
+        load_hive_key( key );
+        if ((index < 0) || (index >= index_count( key->subkeys )))
         {
             set_error( STATUS_NO_MORE_ENTRIES );
             return;
         }
-        key = key->subkeys[index];
+        key = get_subkey( key, index );
     }
 
     namelen = key->obj.name->len;
@@ -945,20 +1441,13 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
         break;
     case KeyFullInformation:
     case KeyCachedInformation:
-        for (i = 0; i <= key->last_subkey; i++)
-        {
-            if (key->subkeys[i]->obj.name->len > max_subkey) max_subkey = key->subkeys[i]->obj.name->len;
-            if (key->subkeys[i]->classlen > max_class) max_class = key->subkeys[i]->classlen;
-        }
-        for (i = 0; i <= key->last_value; i++)
-        {
-            if (key->values[i].namelen > max_value) max_value = key->values[i].namelen;
-            if (key->values[i].len > max_data) max_data = key->values[i].len;
-        }
-        reply->max_subkey = max_subkey;
-        reply->max_class  = max_class;
-        reply->max_value  = max_value;
-        reply->max_data   = max_data;
+        load_hive_key( key );
+        index_walk( key->subkeys, get_subkey_max_lengths, &max );
+        index_walk( key->values, get_value_max_lengths, &max );
+        reply->max_subkey = max.subkey;
+        reply->max_class  = max.class;
+        reply->max_value  = max.value;
+        reply->max_data   = max.data;
         reply->namelen    = namelen;
         if (info_class == KeyCachedInformation)
             classlen = 0; /* don't return any data, only its size */
@@ -968,8 +1457,8 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
         set_error( STATUS_INVALID_PARAMETER );
         return;
     }
-    reply->subkeys = key->last_subkey + 1;
-    reply->values  = key->last_value + 1;
+    reply->subkeys = get_subkey_count( key );
+    reply->values  = get_value_count( key );
     reply->modif   = key->modif;
     reply->total   = namelen + classlen;
 
@@ -1002,8 +1491,9 @@ static void rename_key( struct key *key, const struct unicode_str *new_name )
 {
     struct object_name *new_name_ptr;
     struct key *subkey, *parent = get_parent( key );
+    struct unicode_str old_name;
     data_size_t len;
-    int i, index, cur_index;
+    int index, cur_index;
 
     /* changing to a path is not allowed */
     len = get_path_element( new_name->str, new_name->len );
@@ -1034,25 +1524,20 @@ static void rename_key( struct key *key, const struct unicode_str *new_name )
     new_name_ptr->parent = &parent->obj;
     memcpy( new_name_ptr->name, new_name->str, new_name->len );
 
-    for (cur_index = 0; cur_index <= parent->last_subkey; cur_index++)
-        if (parent->subkeys[cur_index] == key) break;
-
-    if (cur_index < index && (index - cur_index) > 1)
-    {
-        --index;
-        for (i = cur_index; i < index; ++i) parent->subkeys[i] = parent->subkeys[i+1];
-    }
-    else if (cur_index > index)
-    {
-        for (i = cur_index; i > index; --i) parent->subkeys[i] = parent->subkeys[i-1];
-    }
-    parent->subkeys[index] = key;
+    old_name.str = key->obj.name->name;
+    old_name.len = key->obj.name->len;
+    find_subkey( parent, &old_name, &cur_index );
+    index_remove( &parent->subkeys, cur_index );
+    if (cur_index < index) index--;
 
+    journal_delete_key( key );
     free( key->obj.name );
     key->obj.name = new_name_ptr;
+    index_insert( &parent->subkeys, &key->entry, index );
 
     if (debug_level > 1) dump_operation( key, NULL, "Rename" );
     touch_key( key, REG_NOTIFY_CHANGE_NAME );
+    journal_subkeys( key );
 }
 
 /* delete a key and its values */
@@ -1075,70 +1560,55 @@ static int delete_key( struct key *key, int recurse )
 
     if (recurse)
     {
-        while (key->last_subkey >= 0)
-            if (!delete_key( key->subkeys[key->last_subkey], 1 )) return 0;
+        /* the subkeys that are not loaded yet don't need to be loaded to be deleted */
+        key->hive = NULL;
+        key->hive_key = NULL;
+        while (key->subkeys)
+            if (!delete_key( get_subkey( key, index_count( key->subkeys ) - 1 ), 1 )) return 0;
     }
-    else if (key->last_subkey >= 0)  /* we can only delete a key that has no subkeys */
+    else if (get_subkey_count( key ))  /* we can only delete a key that has no subkeys */
     {
         set_error( STATUS_ACCESS_DENIED );
         return 0;
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    journal_delete_key( key );
     key->flags |= KEY_DELETED;
     unlink_named_object( &key->obj );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 1;
 }
 
-/* try to grow the array of values; return 1 if OK, 0 on error */
-static int grow_values( struct key *key )
-{
-    struct key_value *new_val;
-    int nb_values;
-
-    if (key->nb_values)
-    {
-        nb_values = key->nb_values + (key->nb_values / 2);  /* grow by 50% */
-        if (!(new_val = realloc( key->values, nb_values * sizeof(*new_val) )))
-        {
-            set_error( STATUS_NO_MEMORY );
-            return 0;
-        }
-    }
-    else
-    {
-        nb_values = MIN_VALUES;
-        if (!(new_val = mem_alloc( nb_values * sizeof(*new_val) ))) return 0;
-    }
-    key->values = new_val;
-    key->nb_values = nb_values;
-    return 1;
-}
-
-/* find the named value of a given key and return its index in the array */
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
+/* find the named value of a given key and return its index */
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index )
 {
-    int i, min, max, res;
+    struct key_index *entry;
+    struct key_value *value;
+    int pos = 0, res;
     data_size_t len;
 
-    min = 0;
-    max = key->last_value;
-    while (min <= max)
+    load_hive_key( key );
+    entry = key->values;
+    while (entry)
     {
-        i = (min + max) / 2;
-        len = min( key->values[i].namelen, name->len );
-        res = memicmp_strW( key->values[i].name, name->str, len );
-        if (!res) res = key->values[i].namelen - name->len;
+        value = index_to_value( entry );
+        len = min( value->namelen, name->len );
+        res = memicmp_strW( value->name, name->str, len );
+        if (!res) res = value->namelen - name->len;
         if (!res)
         {
-            *index = i;
-            return &key->values[i];
+            *index = pos + index_count( entry->left );
+            return value;
+        }
+        if (res > 0) entry = entry->left;
+        else
+        {
+            pos += index_count( entry->left ) + 1;
+            entry = entry->right;
         }
-        if (res > 0) max = i - 1;
-        else min = i + 1;
     }
-    *index = min;  /* this is where we should insert it */
+    *index = pos;  /* this is where we should insert it */
     return NULL;
 }
 
@@ -1147,20 +1617,19 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
 {
     struct key_value *value;
     WCHAR *new_name = NULL;
-    int i;
 
     if (name->len > MAX_VALUE_LEN * sizeof(WCHAR))
     {
         set_error( STATUS_NAME_TOO_LONG );
         return NULL;
     }
-    if (key->last_value + 1 == key->nb_values)
+    if (!(value = mem_alloc( sizeof(*value) ))) return NULL;
+    if (name->len && !(new_name = memdup( name->str, name->len )))
     {
-        if (!grow_values( key )) return NULL;
+        free( value );
+        return NULL;
     }
-    if (name->len && !(new_name = memdup( name->str, name->len ))) return NULL;
-    for (i = ++key->last_value; i > index; i--) key->values[i] = key->values[i - 1];
-    value = &key->values[index];
+    index_insert( &key->values, &value->entry, index );
     value->name    = new_name;
     value->namelen = name->len;
     value->len     = 0;
@@ -1168,6 +1637,69 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     return value;
 }
 
+/* load a value from a hive */
+static void load_hive_value( struct key *key, const struct hive *hive, const struct hive_value *hvalue )
+{
+    struct key_value *value;
+    struct unicode_str name;
+    const void *data;
+
+    name.len = hvalue->namelen;
+    if (!(name.str = hive_data( hive, hvalue->name, name.len, 1 ))) return;
+    if (!(data = hive_data( hive, hvalue->data, hvalue->len, 1 ))) return;
+    if (!(value = insert_value( key, &name, index_count( key->values )))) return;
+    value->type = hvalue->type;
+    if (hvalue->len && (value->data = memdup( data, hvalue->len ))) value->len = hvalue->len;
+}
+
+/* create a subkey from a hive, leaving its own subkeys and values in the hive */
+static void load_hive_subkey( struct key *parent, const struct hive *hive, unsigned int offset )
+{
+    const struct hive_key *hkey;
+    struct unicode_str name;
+    const WCHAR *class;
+    struct key *key;
+
+    if (!(hkey = hive_data( hive, offset, 1, sizeof(*hkey) ))) return;
+    name.len = hkey->namelen;
+    if (!(name.str = hive_data( hive, hkey->name, name.len, 1 ))) return;
+    if (!name.len || name.len > MAX_NAME_LEN * sizeof(WCHAR)) return;
+    if (get_path_element( name.str, name.len ) != name.len) return;
+    if (!(class = hive_data( hive, hkey->class, hkey->classlen, 1 ))) return;
+
+    if (!(key = create_named_object( &parent->obj, &key_ops, &name, 0, NULL ))) return;
+    init_key( key, hkey->modif );
+    key->flags = hkey->flags & KEY_SYMLINK;
+    if (hkey->classlen && (key->class = memdup( class, hkey->classlen ))) key->classlen = hkey->classlen;
+    if (hkey->subkey_count || hkey->value_count)
+    {
+        key->hive = hive;
+        key->hive_key = hkey;
+    }
+    release_object( key );
+}
+
+/* load the subkeys and values of a key that are still in its hive */
+static void load_hive_key( struct key *key )
+{
+    const struct hive *hive = key->hive;
+    const struct hive_key *hkey = key->hive_key;
+    const struct hive_value *hvalues;
+    const unsigned int *subkeys;
+    unsigned int i, error;
+
+    if (!hkey) return;
+    key->hive = NULL;
+    key->hive_key = NULL;
+
+    error = get_error();
+    if ((hvalues = hive_data( hive, hkey->values, hkey->value_count, sizeof(*hvalues) )))
+        for (i = 0; i < hkey->value_count; i++) load_hive_value( key, hive, &hvalues[i] );
+    if ((subkeys = hive_data( hive, hkey->subkeys, hkey->subkey_count, sizeof(*subkeys) )))
+        for (i = 0; i < hkey->subkey_count; i++) load_hive_subkey( key, hive, subkeys[i] );
+    set_error( error );
+}
+
 /* set a key value */
 static void set_value( struct key *key, const struct unicode_str *name,
                        int type, const void *data, data_size_t len )
@@ -1219,6 +1751,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->len   = len;
     value->data  = ptr;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_set_value( key, value );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
 
@@ -1259,13 +1792,14 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         return;
     }
 
-    if (i < 0 || i > key->last_value) set_error( STATUS_NO_MORE_ENTRIES );
+    load_hive_key( key );
+    if (i < 0 || i >= index_count( key->values )) set_error( STATUS_NO_MORE_ENTRIES );
     else
     {
         void *data;
         data_size_t namelen, maxlen;
 
-        value = &key->values[i];
+        value = get_value_at( key, i );
         reply->type = value->type;
         namelen = value->namelen;
 
@@ -1309,7 +1843,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
 static void delete_value( struct key *key, const struct unicode_str *name )
 {
     struct key_value *value;
-    int i, index, nb_values;
+    int index;
 
     if (key->flags & KEY_PREDEF)
     {
@@ -1323,23 +1857,10 @@ static void delete_value( struct key *key, const struct unicode_str *name )
         return;
     }
     if (debug_level > 1) dump_operation( key, value, "Delete" );
-    free( value->name );
-    free( value->data );
-    for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
-    key->last_value--;
+    index_remove( &key->values, index );
+    free_value( value );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
-
-    /* try to shrink the array */
-    nb_values = key->nb_values;
-    if (nb_values > MIN_VALUES && key->last_value < nb_values / 2)
-    {
-        struct key_value *new_val;
-        nb_values -= nb_values / 3;  /* shrink by 33% */
-        if (nb_values < MIN_VALUES) nb_values = MIN_VALUES;
-        if (!(new_val = realloc( key->values, nb_values * sizeof(*new_val) ))) return;
-        key->values = new_val;
-        key->nb_values = nb_values;
-    }
+    journal_delete_value( key, name );
 }
 
 /* get the registry key corresponding to an hkey handle */
@@ -1542,7 +2063,8 @@ static int load_key_option( struct key *key, const char *buffer, struct file_loa
             else if (*p >= 'a' && *p <= 'f') modif = (modif << 4) | (*p - 'a' + 10);
             else break;
         }
-        update_key_time( key, modif );
+        if (info->journal) key->modif = modif;
+        else update_key_time( key, modif );
     }
     if (!strncmp( buffer, "#class=", 7 ))
     {
@@ -1582,39 +2104,34 @@ static int parse_hex( unsigned char *dest, data_size_t *len, const char *buffer
     return p - buffer;
 }
 
-/* parse a value name and create the corresponding value */
-static struct key_value *parse_value_name( struct key *key, const char *buffer, data_size_t *len,
-                                           struct file_load_info *info )
+/* parse a value name; the name is stored in the temp buffer */
+static int parse_value_name( const char *buffer, struct unicode_str *name, data_size_t *len,
+                             struct file_load_info *info )
 {
-    struct key_value *value;
-    struct unicode_str name;
-    int index;
-
-    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return NULL;
-    name.str = info->tmp;
-    name.len = info->tmplen;
+    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return 0;
+    name->str = info->tmp;
+    name->len = info->tmplen;
     if (buffer[0] == '@')
     {
-        name.len = 0;
+        name->len = 0;
         *len = 1;
     }
     else
     {
-        int r = parse_strW( info->tmp, &name.len, buffer + 1, '\"' );
+        int r = parse_strW( info->tmp, &name->len, buffer + 1, '\"' );
         if (r == -1) goto error;
         *len = r + 1; /* for initial quote */
-        name.len -= sizeof(WCHAR);  /* terminating null */
+        name->len -= sizeof(WCHAR);  /* terminating null */
     }
     while (isspace(buffer[*len])) (*len)++;
     if (buffer[*len] != '=') goto error;
     (*len)++;
     while (isspace(buffer[*len])) (*len)++;
-    if (!(value = find_value( key, &name, &index ))) value = insert_value( key, &name, index );
-    return value;
+    return 1;
 
  error:
     file_read_error( "Malformed value name", info );
-    return NULL;
+    return 0;
 }
 
 /* load a value from the input file */
@@ -1625,8 +2142,21 @@ static int load_value( struct key *key, const char *buffer, struct file_load_inf
     int res, type, parse_type;
     data_size_t maxlen, len;
     struct key_value *value;
+    struct unicode_str name;
+    int index;
 
-    if (!(value = parse_value_name( key, buffer, &len, info ))) return 0;
+    if (!parse_value_name( buffer, &name, &len, info )) return 0;
+    if (info->journal && !strcmp( buffer + len, "-" ))  /* deleted value */
+    {
+        if ((value = find_value( key, &name, &index )))
+        {
+            index_remove( &key->values, index );
+            free_value( value );
+        }
+        return 1;
+    }
+    if (!(value = find_value( key, &name, &index )) && !(value = insert_value( key, &name, index )))
+        return 0;
     if (!(res = get_data_type( buffer + len, &type, &parse_type ))) goto error;
     buffer += len + res;
 
@@ -1714,7 +2244,8 @@ static int get_prefix_len( struct key *key, const char *name, struct file_load_i
 
 /* load all the keys from the input file */
 /* prefix_len is the number of key name prefixes to skip, or -1 for autodetection */
-static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len )
+/* journal is set when replaying a journal file */
+static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len, int journal )
 {
     struct key *subkey = NULL;
     struct file_load_info info;
@@ -1726,6 +2257,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
     info.len    = 4;
     info.tmplen = 4;
     info.line   = 0;
+    info.journal = journal;
     if (!(info.buffer = mem_alloc( info.len ))) return;
     if (!(info.tmp = mem_alloc( info.tmplen )))
     {
@@ -1762,7 +2294,13 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             else file_read_error( "Value without key", &info );
             break;
         case '#':   /* option */
-            if (subkey) load_key_option( subkey, p, &info );
+            if (subkey && journal && !strcmp( p, "#delete" ))
+            {
+                delete_key( subkey, 1 );
+                release_object( subkey );
+                subkey = NULL;
+            }
+            else if (subkey) load_key_option( subkey, p, &info );
             else if (!load_global_option( p, &info )) goto done;
             break;
         case ';':   /* comment */
@@ -1798,35 +2336,167 @@ static void load_registry( struct key *key, obj_handle_t handle )
         FILE *f = fdopen( fd, "r" );
         if (f)
         {
-            load_keys( key, NULL, f, -1 );
+            load_keys( key, NULL, f, -1, 0 );
             fclose( f );
         }
         else file_set_error();
     }
 }
 
+/* get the name of the journal file of a branch */
+static void get_journal_name( const struct save_branch_info *branch, int old, char *name, size_t size )
+{
+    snprintf( name, size, "%s.journal%s", branch->filename, old ? ".old" : "" );
+}
+
+/* replay a journal file on top of a loaded branch */
+static void replay_journal( struct save_branch_info *branch, int old )
+{
+    static const char sync_marker[] = ";; sync\n";
+    char name[64];
+    long pos = 0, end = 0;
+    int c, match = 0;
+    FILE *f;
+
+    get_journal_name( branch, old, name, sizeof(name) );
+    if (!(f = fopen( name, "r+" ))) return;
+
+    /* drop the changes after the last sync point, they may be incomplete */
+    while ((c = fgetc( f )) != EOF)
+    {
+        pos++;
+        if (match >= 0 && c == sync_marker[match])
+        {
+            if (sync_marker[++match]) continue;
+            end = pos;
+            match = 0;
+        }
+        else match = (c == '\n') ? 0 : -1;
+    }
+    if (end < pos && ftruncate( fileno( f ), end ) == -1) end = 0;
+
+    if (end)
+    {
+        rewind( f );
+        load_keys( branch->key, name, f, 0, 1 );
+        make_dirty( branch->key );
+    }
+    fclose( f );
+}
+
+/* open the journal of a branch for appending new changes */
+static void open_journal( struct save_branch_info *branch )
+{
+    char name[64];
+
+    get_journal_name( branch, 0, name, sizeof(name) );
+    if (!(branch->journal = fopen( name, "a" ))) return;
+    fseek( branch->journal, 0, SEEK_END );
+    if (!ftell( branch->journal )) fprintf( branch->journal, "WINE REGISTRY Version 2\n" );
+    branch->journal_key = NULL;
+    branch->journal_pos = ftell( branch->journal );
+}
+
+/* get the name of the hive file of a branch */
+static void get_hive_name( const char *filename, char *name, size_t size )
+{
+    snprintf( name, size, "%s.hive", filename );
+}
+
+/* get the modification time of a file in nanoseconds */
+static long long get_file_time( const struct stat *st )
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#else
+    return st->st_mtime * 1000000000LL;
+#endif
+}
+
+/* map the hive file of a branch, if it is up to date with the branch file */
+static int load_hive( struct key *key, const char *filename )
+{
+    const struct hive_header *header;
+    const struct hive_key *root;
+    struct hive *hive;
+    struct stat st, hive_st;
+    char name[64];
+    void *base;
+    int fd;
+
+    if (stat( filename, &st ) == -1) return 0;
+    get_hive_name( filename, name, sizeof(name) );
+    if ((fd = open( name, O_RDONLY )) == -1) return 0;
+    if (fstat( fd, &hive_st ) == -1 || hive_st.st_size < sizeof(*header) ||
+        (base = mmap( NULL, hive_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return 0;
+    }
+    close( fd );
+
+    header = base;
+    if (header->magic != HIVE_MAGIC || header->version != HIVE_VERSION ||
+        header->size != hive_st.st_size || header->file_ino != st.st_ino ||
+        header->file_size != st.st_size || header->file_time != get_file_time( &st ) ||
+        (prefix_type != PREFIX_UNKNOWN && header->prefix_type != prefix_type) ||
+        !(hive = mem_alloc( sizeof(*hive) )))
+        goto failed;
+
+    hive->base = base;
+    hive->size = hive_st.st_size;
+    if (!(root = hive_data( hive, header->root, 1, sizeof(*root) )))
+    {
+        free( hive );
+        goto failed;
+    }
+    /* the mapping is never released, keys may be loaded from it at any time */
+    if (prefix_type == PREFIX_UNKNOWN) prefix_type = header->prefix_type;
+    key->modif = root->modif;
+    key->hive = hive;
+    key->hive_key = root;
+    return 1;
+
+failed:
+    munmap( base, hive_st.st_size );
+    return 0;
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct save_branch_info *branch;
+    int exists = 1, parsed = 0;
     FILE *f;
 
-    if ((f = fopen( filename, "r" )))
+    if (!load_hive( key, filename ) && (f = fopen( filename, "r" )))
     {
-        load_keys( key, filename, f, 0 );
+        load_keys( key, filename, f, 0, 0 );
         fclose( f );
         if (get_error() == STATUS_NOT_REGISTRY_FILE)
         {
             fprintf( stderr, "%s is not a valid registry file\n", filename );
             return 1;
         }
+        parsed = 1;
     }
+    else if (!key->hive_key) exists = 0;
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].filename = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    branch = &save_branch_info[save_branch_count++];
+    branch->filename = filename;
+    branch->key = (struct key *)grab_object( key );
     make_object_permanent( &key->obj );
-    return (f != NULL);
+
+    /* the file is up to date, only the journals contain unsaved changes */
+    if (exists) make_clean( key );
+    /* save the branch on exit if its hive was out of date */
+    if (parsed) key->flags |= KEY_DIRTY;
+    replay_journal( branch, 1 );
+    replay_journal( branch, 0 );
+    open_journal( branch );
+    return exists;
 }
 
 static WCHAR *format_user_registry_path( const struct sid *sid, struct unicode_str *path )
@@ -2037,6 +2707,190 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* append some data to a hive file and return its offset */
+static unsigned int write_hive_data( struct hive_writer *writer, const void *data, size_t size )
+{
+    static const char padding[8];
+    unsigned int pos, pad = -writer->pos % sizeof(padding);
+
+    if (size > UINT_MAX - pad - writer->pos) writer->failed = 1;
+    if (writer->failed) return 0;
+    if (pad && fwrite( padding, pad, 1, writer->file ) != 1) writer->failed = 1;
+    pos = writer->pos + pad;
+    if (size && fwrite( data, size, 1, writer->file ) != 1) writer->failed = 1;
+    writer->pos = pos + size;
+    return pos;
+}
+
+/* copy the subkeys and values of a key from an existing hive */
+static unsigned int copy_hive_key( struct hive_writer *writer, const struct hive *hive, unsigned int offset );
+
+static void copy_hive_children( struct hive_writer *writer, const struct hive *hive,
+                                const struct hive_key *src, struct hive_key *dst )
+{
+    const struct hive_value *values;
+    const unsigned int *subkeys;
+    struct hive_value *new_values = NULL;
+    unsigned int i, *new_subkeys = NULL;
+
+    if (!(values = hive_data( hive, src->values, src->value_count, sizeof(*values) )) ||
+        !(subkeys = hive_data( hive, src->subkeys, src->subkey_count, sizeof(*subkeys) )) ||
+        (src->value_count && !(new_values = malloc( src->value_count * sizeof(*new_values) ))) ||
+        (src->subkey_count && !(new_subkeys = malloc( src->subkey_count * sizeof(*new_subkeys) ))))
+    {
+        free( new_values );
+        writer->failed = 1;
+        return;
+    }
+    for (i = 0; i < src->value_count; i++)
+    {
+        const void *name = hive_data( hive, values[i].name, values[i].namelen, 1 );
+        const void *data = hive_data( hive, values[i].data, values[i].len, 1 );
+
+        if (!name || !data) writer->failed = 1;
+        if (writer->failed) break;
+        new_values[i] = values[i];
+        new_values[i].name = write_hive_data( writer, name, values[i].namelen );
+        new_values[i].data = write_hive_data( writer, data, values[i].len );
+    }
+    for (i = 0; i < src->subkey_count && !writer->failed; i++)
+        new_subkeys[i] = copy_hive_key( writer, hive, subkeys[i] );
+
+    dst->value_count  = src->value_count;
+    dst->values       = write_hive_data( writer, new_values, src->value_count * sizeof(*new_values) );
+    dst->subkey_count = src->subkey_count;
+    dst->subkeys      = write_hive_data( writer, new_subkeys, src->subkey_count * sizeof(*new_subkeys) );
+    free( new_values );
+    free( new_subkeys );
+}
+
+static unsigned int copy_hive_key( struct hive_writer *writer, const struct hive *hive, unsigned int offset )
+{
+    const struct hive_key *src;
+    const void *name, *class;
+    struct hive_key dst;
+
+    if (!(src = hive_data( hive, offset, 1, sizeof(*src) )) ||
+        !(name = hive_data( hive, src->name, src->namelen, 1 )) ||
+        !(class = hive_data( hive, src->class, src->classlen, 1 )))
+    {
+        writer->failed = 1;
+        return 0;
+    }
+    dst = *src;
+    dst.name  = write_hive_data( writer, name, src->namelen );
+    dst.class = write_hive_data( writer, class, src->classlen );
+    copy_hive_children( writer, hive, src, &dst );
+    return write_hive_data( writer, &dst, sizeof(dst) );
+}
+
+struct write_hive_children_args
+{
+    struct hive_writer *writer;
+    struct hive_value  *values;
+    unsigned int       *subkeys;
+    unsigned int        count;
+};
+
+static unsigned int write_hive_key( struct hive_writer *writer, const struct key *key );
+
+static void write_hive_value_entry( struct key_index *entry, void *arg )
+{
+    struct write_hive_children_args *args = arg;
+    struct key_value *value = index_to_value( entry );
+    struct hive_value *dst = &args->values[args->count++];
+
+    dst->type    = value->type;
+    dst->namelen = value->namelen;
+    dst->name    = write_hive_data( args->writer, value->name, value->namelen );
+    dst->len     = value->len;
+    dst->data    = write_hive_data( args->writer, value->data, value->len );
+}
+
+static void write_hive_subkey_entry( struct key_index *entry, void *arg )
+{
+    struct write_hive_children_args *args = arg;
+    struct key *subkey = index_to_key( entry );
+
+    if (subkey->flags & KEY_VOLATILE) return;
+    args->subkeys[args->count++] = write_hive_key( args->writer, subkey );
+}
+
+/* write a key and all its subkeys to a hive file; subkeys are written before their parent */
+static unsigned int write_hive_key( struct hive_writer *writer, const struct key *key )
+{
+    struct write_hive_children_args args = { writer };
+    struct hive_value *values = NULL;
+    unsigned int *subkeys = NULL;
+    struct hive_key hkey;
+
+    memset( &hkey, 0, sizeof(hkey) );
+    hkey.modif    = key->modif;
+    hkey.flags    = key->flags & KEY_SYMLINK;
+    hkey.namelen  = key->obj.name->len;
+    hkey.name     = write_hive_data( writer, key->obj.name->name, hkey.namelen );
+    hkey.classlen = key->class ? key->classlen : 0;
+    hkey.class    = write_hive_data( writer, key->class, hkey.classlen );
+
+    if (key->hive_key)
+    {
+        copy_hive_children( writer, key->hive, key->hive_key, &hkey );
+        return write_hive_data( writer, &hkey, sizeof(hkey) );
+    }
+
+    if ((index_count( key->values ) && !(values = malloc( index_count( key->values ) * sizeof(*values) ))) ||
+        (index_count( key->subkeys ) && !(subkeys = malloc( index_count( key->subkeys ) * sizeof(*subkeys) ))))
+    {
+        free( values );
+        writer->failed = 1;
+        return 0;
+    }
+    args.values = values;
+    index_walk( key->values, write_hive_value_entry, &args );
+    args.subkeys = subkeys;
+    args.count = 0;
+    index_walk( key->subkeys, write_hive_subkey_entry, &args );
+    hkey.subkey_count = args.count;
+    hkey.value_count = index_count( key->values );
+    hkey.values      = write_hive_data( writer, values, hkey.value_count * sizeof(*values) );
+    hkey.subkeys     = write_hive_data( writer, subkeys, hkey.subkey_count * sizeof(*subkeys) );
+    free( values );
+    free( subkeys );
+    return write_hive_data( writer, &hkey, sizeof(hkey) );
+}
+
+/* write the hive file caching a branch, once the branch file has been saved */
+static void save_hive( struct key *key, const char *filename )
+{
+    struct hive_header header;
+    struct hive_writer writer;
+    struct stat st;
+    char name[64], tmp[80];
+
+    if (stat( filename, &st ) == -1) return;
+    get_hive_name( filename, name, sizeof(name) );
+    snprintf( tmp, sizeof(tmp), "%s.%lx.tmp", name, (long)getpid() );
+    if (!(writer.file = fopen( tmp, "w" ))) return;
+    writer.pos = 0;
+    writer.failed = 0;
+
+    memset( &header, 0, sizeof(header) );
+    write_hive_data( &writer, &header, sizeof(header) );
+    header.magic       = HIVE_MAGIC;
+    header.version     = HIVE_VERSION;
+    header.prefix_type = prefix_type;
+    header.root        = write_hive_key( &writer, key );
+    header.size        = writer.pos;
+    header.file_ino    = st.st_ino;
+    header.file_size   = st.st_size;
+    header.file_time   = get_file_time( &st );
+
+    if (!writer.failed && (fseek( writer.file, 0, SEEK_SET ) ||
+                           fwrite( &header, sizeof(header), 1, writer.file ) != 1))
+        writer.failed = 1;
+    if (fclose( writer.file ) || writer.failed || rename( tmp, name )) unlink( tmp );
+}
+
 /* save a registry branch to a file */
 static int save_branch( struct key *key, const char *filename )
 {
@@ -2093,7 +2947,9 @@ static int save_branch( struct key *key, const char *filename )
     }
 
     save_all_subkeys( key, f );
-    ret = !fclose(f);
+    /* the journals are removed once the branch is saved, so it has to reach the disk first */
+    ret = !fflush( f ) && !fsync( fileno( f ) );
+    if (fclose( f )) ret = 0;
 
     if (tmp[0])
     {
@@ -2102,11 +2958,114 @@ static int save_branch( struct key *key, const char *filename )
         if (!ret) unlink( tmp );
     }
 
+    if (ret) save_hive( key, filename );
+
 done:
     if (ret) make_clean( key );
     return ret;
 }
 
+/* remove the journals of a branch once it has been saved */
+static void remove_journals( struct save_branch_info *branch )
+{
+    char name[64];
+
+    get_journal_name( branch, 1, name, sizeof(name) );
+    unlink( name );
+    get_journal_name( branch, 0, name, sizeof(name) );
+    unlink( name );
+}
+
+/* check if the process compacting a journal is still running */
+static int is_compacting( struct save_branch_info *branch )
+{
+    if (!branch->compact_pid) return 0;
+    /* the process may already have been reaped by the SIGCHLD handler */
+    if (!waitpid( branch->compact_pid, NULL, WNOHANG )) return 1;
+    branch->compact_pid = 0;
+    return 0;
+}
+
+/* close the server file descriptors inherited by a child process, except for stdio */
+static void close_inherited_fds(void)
+{
+    struct dirent *de;
+    DIR *dir;
+    long i, fd, max_fd;
+
+#ifdef __NR_close_range
+    if (!syscall( __NR_close_range, 3, ~0U, 0 )) return;
+#endif
+    /* the file limit can be very large, only close the descriptors that are open */
+    if ((dir = opendir( "/proc/self/fd" )))
+    {
+        while ((de = readdir( dir )))
+        {
+            if ((fd = atol( de->d_name )) < 3 || fd == dirfd( dir )) continue;
+            close( fd );
+        }
+        closedir( dir );
+        return;
+    }
+    if ((max_fd = sysconf( _SC_OPEN_MAX )) <= 0) max_fd = 1024;
+    for (i = 3; i < max_fd; i++) close( i );
+}
+
+/* save the branch file in a child process and start a new journal */
+static void compact_journal( struct save_branch_info *branch )
+{
+    char name[64], old_name[64];
+    pid_t pid;
+
+    if (is_compacting( branch )) return;
+
+    fclose( branch->journal );
+    branch->journal = NULL;
+    get_journal_name( branch, 0, name, sizeof(name) );
+    get_journal_name( branch, 1, old_name, sizeof(old_name) );
+
+    /* the old journal is only left behind if a previous compaction failed */
+    if (access( old_name, F_OK ) && !rename( name, old_name ))
+    {
+        if (!(pid = fork()))
+        {
+            /* the child works on a snapshot of the registry, that the server keeps modifying;
+             * it must not hold on to the client sockets and objects of the server */
+            close_inherited_fds();
+            if (save_branch( branch->key, branch->filename )) unlink( old_name );
+            _exit( 0 );
+        }
+        if (pid != -1)
+        {
+            branch->compact_pid = pid;
+            open_journal( branch );
+            return;
+        }
+    }
+
+    /* fall back to saving synchronously */
+    if (save_branch( branch->key, branch->filename )) remove_journals( branch );
+    open_journal( branch );
+}
+
+/* write out the journal of a branch, and compact it once it gets too large */
+static void sync_journal( struct save_branch_info *branch, int compact )
+{
+    long pos;
+
+    if (!branch->journal)
+    {
+        save_branch( branch->key, branch->filename );
+        return;
+    }
+    if ((pos = ftell( branch->journal )) == branch->journal_pos) return;  /* nothing changed */
+
+    fputs( ";; sync\n", branch->journal );
+    if (!fflush( branch->journal )) fsync( fileno( branch->journal ));
+    branch->journal_pos = ftell( branch->journal );
+    if (compact && pos > JOURNAL_COMPACT_SIZE) compact_journal( branch );
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
@@ -2114,8 +3073,7 @@ static void periodic_save( void *arg )
 
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
-    for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].filename );
+    for (i = 0; i < save_branch_count; i++) sync_journal( &save_branch_info[i], 1 );
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -2135,12 +3093,32 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].filename ))
+        struct save_branch_info *branch = &save_branch_info[i];
+
+        sync_journal( branch, 0 );
+        if (is_compacting( branch ))
+        {
+            char tmp[32];
+
+            /* don't wait for the compaction, the branch is saved directly below */
+            kill( branch->compact_pid, SIGKILL );
+            waitpid( branch->compact_pid, NULL, WNOHANG );
+            snprintf( tmp, sizeof(tmp), "reg%lx%04x.tmp", (long)branch->compact_pid, 0 );
+            unlink( tmp );
+        }
+        branch->compact_pid = 0;
+        if (!save_branch( branch->key, branch->filename ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
-                     save_branch_info[i].filename );
+                     branch->filename );
             perror( " " );
         }
+        else if (branch->journal)
+        {
+            fclose( branch->journal );
+            branch->journal = NULL;
+            remove_journals( branch );
+        }
     }
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
@@ -2177,6 +3155,7 @@ DECL_HANDLER(create_key)
         {
             key->classlen = (key->classlen / sizeof(WCHAR)) * sizeof(WCHAR);
             if (!(key->class = memdup( class, key->classlen ))) key->classlen = 0;
+            journal_key( key );
         }
         reply->hkey = alloc_handle( current->process, key, access, objattr->attributes );
         release_object( key );
@@ -2324,6 +3303,7 @@ DECL_HANDLER(load_registry)
     if ((key = create_key( parent, &name, 0, KEY_WOW64_64KEY, 0, sd )))
     {
         load_registry( key, req->file );
+        journal_subkeys( key );
         release_object( key );
     }
     if (parent) release_object( parent );
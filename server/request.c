@@ -128,6 +128,8 @@ int config_dir_fd = -1;    /* file descriptor for the config dir */
 static struct master_socket *master_socket;  /* the master socket object */
 static struct timeout_user *master_timeout;
 
+static struct request_stat request_stats[REQ_NB_REQUESTS];  /* statistics of each request */
+
 /* complain about a protocol error and terminate the client connection */
 void fatal_protocol_error( struct thread *thread, const char *err, ... )
 {
@@ -288,6 +290,61 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* update the statistics of a request once it has been handled */
+static void add_request_stat( enum request req, timeout_t time, data_size_t request_size, data_size_t reply_size )
+{
+    struct request_stat *stat = &request_stats[req];
+    unsigned int bucket = 0;
+    timeout_t usecs;
+
+    for (usecs = time / 10; usecs && bucket < REQUEST_STAT_BUCKETS - 1; usecs >>= 1) bucket++;
+    stat->count++;
+    stat->total_time += time;
+    if (time > stat->max_time) stat->max_time = time;
+    stat->request_bytes += request_size;
+    stat->reply_bytes += reply_size;
+    stat->histogram[bucket]++;
+}
+
+/* compare request statistics by decreasing total time */
+static int compare_request_stats( const void *p1, const void *p2 )
+{
+    const struct request_stat *stat1 = *(const struct request_stat * const *)p1;
+    const struct request_stat *stat2 = *(const struct request_stat * const *)p2;
+
+    if (stat1->total_time != stat2->total_time) return stat1->total_time < stat2->total_time ? 1 : -1;
+    if (stat1 != stat2) return stat1 < stat2 ? -1 : 1;
+    return 0;
+}
+
+/* dump the request statistics to stderr */
+void dump_request_stats(void)
+{
+    const struct request_stat *sorted[REQ_NB_REQUESTS];
+    unsigned int i, j, count = 0;
+
+    for (i = 0; i < REQ_NB_REQUESTS; i++) if (request_stats[i].count) sorted[count++] = &request_stats[i];
+    qsort( sorted, count, sizeof(sorted[0]), compare_request_stats );
+
+    fprintf( stderr, "Request statistics over %u seconds:\n",
+             (unsigned int)((current_time - server_start_time) / TICKS_PER_SEC) );
+    fprintf( stderr, "%-32s %10s %10s %8s %8s %12s %12s  histogram (us: <1 <2 <4 ...)\n",
+             "request", "count", "total ms", "avg us", "max us", "req bytes", "reply bytes" );
+    for (i = 0; i < count; i++)
+    {
+        const struct request_stat *stat = sorted[i];
+
+        fprintf( stderr, "%-32s %10u %10u %8u %8u %12llu %12llu ",
+                 get_req_name( stat - request_stats ), stat->count,
+                 (unsigned int)(stat->total_time / 10000),
+                 (unsigned int)(stat->total_time / stat->count / 10),
+                 (unsigned int)(stat->max_time / 10),
+                 (unsigned long long)stat->request_bytes, (unsigned long long)stat->reply_bytes );
+        for (j = 0; j < REQUEST_STAT_BUCKETS; j++) fprintf( stderr, " %u", stat->histogram[j] );
+        fputc( '\n', stderr );
+    }
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
@@ -302,7 +359,13 @@ static void call_req_handler( struct thread *thread )
     if (debug_level) trace_request();
 
     if (req < REQ_NB_REQUESTS)
+    {
+        data_size_t size = current->req.request_header.request_size;
+        timeout_t start = monotonic_counter();
+
         req_handlers[req]( &current->req, &reply );
+        add_request_stat( req, monotonic_counter() - start, size, current ? current->reply_size : 0 );
+    }
     else
         set_error( STATUS_NOT_IMPLEMENTED );
 
@@ -324,6 +387,13 @@ static void call_req_handler( struct thread *thread )
     current = NULL;
 }
 
+/* free the variable-size data of the current request */
+static void free_req_data( struct thread *thread )
+{
+    if (thread->req_data != thread->req_buffer) free( thread->req_data );
+    thread->req_data = NULL;
+}
+
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
@@ -331,23 +401,50 @@ void read_request( struct thread *thread )
 
     if (!thread->req_toread)  /* no pending request */
     {
-        if ((ret = read( get_unix_fd( thread->request_fd ), &thread->req,
-                         sizeof(thread->req) )) != sizeof(thread->req)) goto error;
-        if (!(thread->req_toread = thread->req.request_header.request_size))
+        struct iovec vec[2];
+        data_size_t size;
+
+        /* the client sends the request header and data in one go, */
+        /* so try to get the data in the same call if it's small enough */
+        vec[0].iov_base = &thread->req;
+        vec[0].iov_len  = sizeof(thread->req);
+        vec[1].iov_base = thread->req_buffer;
+        vec[1].iov_len  = sizeof(thread->req_buffer);
+
+        if ((ret = readv( get_unix_fd( thread->request_fd ), vec, 2 )) < (int)sizeof(thread->req))
+            goto error;
+        ret -= sizeof(thread->req);
+        size = thread->req.request_header.request_size;
+        if (ret > size)
+        {
+            fatal_protocol_error( thread, "extra data %u after request %d\n",
+                                  ret - size, thread->req.request_header.req );
+            return;
+        }
+        if (!size)
         {
             /* no data, handle request at once */
             call_req_handler( thread );
             return;
         }
-        if (!(thread->req_data = malloc( thread->req_toread )))
+        if (size <= sizeof(thread->req_buffer)) thread->req_data = thread->req_buffer;
+        else if (!(thread->req_data = malloc( size )))
         {
             fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
-                                  thread->req_toread, thread->req.request_header.req );
+                                  size, thread->req.request_header.req );
+            return;
+        }
+        else memcpy( thread->req_data, thread->req_buffer, ret );
+
+        if (!(thread->req_toread = size - ret))
+        {
+            call_req_handler( thread );
+            free_req_data( thread );
             return;
         }
     }
 
-    /* read the variable sized data */
+    /* read the remaining variable sized data */
     for (;;)
     {
         ret = read( get_unix_fd( thread->request_fd ),
@@ -358,8 +455,7 @@ void read_request( struct thread *thread )
         if (!(thread->req_toread -= ret))
         {
             call_req_handler( thread );
-            free( thread->req_data );
-            thread->req_data = NULL;
+            free_req_data( thread );
             return;
         }
     }
@@ -932,3 +1028,28 @@ void close_master_socket( timeout_t timeout )
 
     master_timeout = add_timeout_user( timeout, close_socket_timeout, NULL );
 }
+
+/* retrieve the statistics of the server requests */
+DECL_HANDLER(get_request_stats)
+{
+    struct request_stat *stat;
+    unsigned int i, count = 0;
+
+    for (i = 0; i < REQ_NB_REQUESTS; i++) if (request_stats[i].count) count++;
+    reply->start_time = server_start_time;
+    reply->count = count;
+
+    if (get_reply_max_size() / sizeof(*stat) < count)
+    {
+        set_error( STATUS_BUFFER_TOO_SMALL );
+        return;
+    }
+    if (!(stat = set_reply_data_size( count * sizeof(*stat) ))) return;
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+    {
+        if (!request_stats[i].count) continue;
+        *stat = request_stats[i];
+        stat->req = i;
+        stat++;
+    }
+}
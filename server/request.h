@@ -63,8 +63,11 @@ extern int kill_lock_owner( int sig );
 extern char *server_dir;
 extern int server_dir_fd, config_dir_fd;
 
+extern void dump_request_stats(void);
+
 extern void trace_request(void);
 extern void trace_reply( enum request req, const union generic_reply *reply );
+extern const char *get_req_name( enum request req );
 
 /* get current tick count to return to client */
 static inline unsigned int get_tick_count(void)
@@ -250,6 +253,7 @@ DECL_HANDLER(set_serial_info);
 DECL_HANDLER(cancel_sync);
 DECL_HANDLER(register_async);
 DECL_HANDLER(cancel_async);
+DECL_HANDLER(set_io_ring);
 DECL_HANDLER(get_async_result);
 DECL_HANDLER(set_async_direct_result);
 DECL_HANDLER(read);
@@ -404,6 +408,7 @@ DECL_HANDLER(terminate_job);
 DECL_HANDLER(suspend_process);
 DECL_HANDLER(resume_process);
 DECL_HANDLER(get_next_thread);
+DECL_HANDLER(get_request_stats);
 
 #ifdef WANT_REQUEST_HANDLERS
 
@@ -541,6 +546,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_cancel_sync,
     (req_handler)req_register_async,
     (req_handler)req_cancel_async,
+    (req_handler)req_set_io_ring,
     (req_handler)req_get_async_result,
     (req_handler)req_set_async_direct_result,
     (req_handler)req_read,
@@ -695,6 +701,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_suspend_process,
     (req_handler)req_resume_process,
     (req_handler)req_get_next_thread,
+    (req_handler)req_get_request_stats,
 };
 
 C_ASSERT( sizeof(abstime_t) == 8 );
@@ -721,6 +728,7 @@ C_ASSERT( sizeof(mem_size_t) == 8 );
 C_ASSERT( sizeof(message_data_t) == 48 );
 C_ASSERT( sizeof(mod_handle_t) == 8 );
 C_ASSERT( sizeof(obj_handle_t) == 4 );
+C_ASSERT( sizeof(object_id_t) == 8 );
 C_ASSERT( sizeof(pe_image_info_t) == 88 );
 C_ASSERT( sizeof(process_id_t) == 4 );
 C_ASSERT( sizeof(property_data_t) == 16 );
@@ -732,10 +740,12 @@ C_ASSERT( sizeof(struct filesystem_event) == 12 );
 C_ASSERT( sizeof(struct handle_info) == 20 );
 C_ASSERT( sizeof(struct luid) == 8 );
 C_ASSERT( sizeof(struct luid_attr) == 12 );
+C_ASSERT( sizeof(struct obj_locator) == 16 );
 C_ASSERT( sizeof(struct object_attributes) == 16 );
 C_ASSERT( sizeof(struct object_type_info) == 44 );
 C_ASSERT( sizeof(struct process_info) == 40 );
 C_ASSERT( sizeof(struct rawinput_device) == 12 );
+C_ASSERT( sizeof(struct request_stat) == 104 );
 C_ASSERT( sizeof(struct thread_info) == 40 );
 C_ASSERT( sizeof(thread_id_t) == 4 );
 C_ASSERT( sizeof(timeout_t) == 8 );
@@ -946,7 +956,9 @@ C_ASSERT( FIELD_OFFSET(struct create_event_request, manual_reset) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_event_request, initial_state) == 20 );
 C_ASSERT( sizeof(struct create_event_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_event_reply, handle) == 8 );
-C_ASSERT( sizeof(struct create_event_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_event_reply, fast_sync) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_event_reply, fast_sync_id) == 16 );
+C_ASSERT( sizeof(struct create_event_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct event_op_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct event_op_request, op) == 16 );
 C_ASSERT( sizeof(struct event_op_request) == 24 );
@@ -977,7 +989,9 @@ C_ASSERT( FIELD_OFFSET(struct create_mutex_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct create_mutex_request, owned) == 16 );
 C_ASSERT( sizeof(struct create_mutex_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_mutex_reply, handle) == 8 );
-C_ASSERT( sizeof(struct create_mutex_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_mutex_reply, fast_sync) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_mutex_reply, fast_sync_id) == 16 );
+C_ASSERT( sizeof(struct create_mutex_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct release_mutex_request, handle) == 12 );
 C_ASSERT( sizeof(struct release_mutex_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct release_mutex_reply, prev_count) == 8 );
@@ -999,7 +1013,9 @@ C_ASSERT( FIELD_OFFSET(struct create_semaphore_request, initial) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_semaphore_request, max) == 20 );
 C_ASSERT( sizeof(struct create_semaphore_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_semaphore_reply, handle) == 8 );
-C_ASSERT( sizeof(struct create_semaphore_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_semaphore_reply, fast_sync) == 12 );
+C_ASSERT( FIELD_OFFSET(struct create_semaphore_reply, fast_sync_id) == 16 );
+C_ASSERT( sizeof(struct create_semaphore_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct release_semaphore_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct release_semaphore_request, count) == 16 );
 C_ASSERT( sizeof(struct release_semaphore_request) == 24 );
@@ -1366,7 +1382,8 @@ C_ASSERT( FIELD_OFFSET(struct get_atom_information_reply, total) == 16 );
 C_ASSERT( sizeof(struct get_atom_information_reply) == 24 );
 C_ASSERT( sizeof(struct get_msg_queue_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_msg_queue_reply, handle) == 8 );
-C_ASSERT( sizeof(struct get_msg_queue_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_msg_queue_reply, locator) == 16 );
+C_ASSERT( sizeof(struct get_msg_queue_reply) == 32 );
 C_ASSERT( FIELD_OFFSET(struct set_queue_fd_request, handle) == 12 );
 C_ASSERT( sizeof(struct set_queue_fd_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_queue_mask_request, wake_mask) == 12 );
@@ -1467,11 +1484,15 @@ C_ASSERT( sizeof(struct cancel_sync_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct register_async_request, type) == 12 );
 C_ASSERT( FIELD_OFFSET(struct register_async_request, async) == 16 );
 C_ASSERT( FIELD_OFFSET(struct register_async_request, count) == 56 );
+C_ASSERT( FIELD_OFFSET(struct register_async_request, ring) == 60 );
 C_ASSERT( sizeof(struct register_async_request) == 64 );
 C_ASSERT( FIELD_OFFSET(struct cancel_async_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct cancel_async_request, iosb) == 16 );
 C_ASSERT( FIELD_OFFSET(struct cancel_async_request, only_thread) == 24 );
 C_ASSERT( sizeof(struct cancel_async_request) == 32 );
+C_ASSERT( sizeof(struct cancel_async_reply) == 8 );
+C_ASSERT( FIELD_OFFSET(struct set_io_ring_request, fd) == 12 );
+C_ASSERT( sizeof(struct set_io_ring_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_async_result_request, user_arg) == 16 );
 C_ASSERT( sizeof(struct get_async_result_request) == 24 );
 C_ASSERT( sizeof(struct get_async_result_reply) == 8 );
@@ -1753,7 +1774,8 @@ C_ASSERT( sizeof(struct close_desktop_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_thread_desktop_request, tid) == 12 );
 C_ASSERT( sizeof(struct get_thread_desktop_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_thread_desktop_reply, handle) == 8 );
-C_ASSERT( sizeof(struct get_thread_desktop_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_thread_desktop_reply, locator) == 16 );
+C_ASSERT( sizeof(struct get_thread_desktop_reply) == 32 );
 C_ASSERT( FIELD_OFFSET(struct set_thread_desktop_request, handle) == 12 );
 C_ASSERT( sizeof(struct set_thread_desktop_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct enum_desktop_request, winstation) == 12 );
@@ -2344,6 +2366,10 @@ C_ASSERT( FIELD_OFFSET(struct get_next_thread_request, flags) == 28 );
 C_ASSERT( sizeof(struct get_next_thread_request) == 32 );
 C_ASSERT( FIELD_OFFSET(struct get_next_thread_reply, handle) == 8 );
 C_ASSERT( sizeof(struct get_next_thread_reply) == 16 );
+C_ASSERT( sizeof(struct get_request_stats_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_request_stats_reply, start_time) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_request_stats_reply, count) == 16 );
+C_ASSERT( sizeof(struct get_request_stats_reply) == 24 );
 
 #endif  /* WANT_REQUEST_HANDLERS */
 
@@ -31,6 +31,7 @@
 #include "windef.h"
 #include "winternl.h"
 
+#include "file.h"
 #include "handle.h"
 #include "thread.h"
 #include "request.h"
@@ -38,6 +39,9 @@
 
 static const WCHAR semaphore_name[] = {'S','e','m','a','p','h','o','r','e'};
 
+/* access rights needed to use the in-process state */
+#define FAST_SEMAPHORE_ACCESS (SYNCHRONIZE | SEMAPHORE_QUERY_STATE | SEMAPHORE_MODIFY_STATE)
+
 struct type_descr semaphore_type =
 {
     { semaphore_name, sizeof(semaphore_name) },   /* name */
@@ -55,12 +59,15 @@ struct semaphore
     struct object  obj;    /* object header */
     unsigned int   count;  /* current count */
     unsigned int   max;    /* maximum possible count */
+    fast_sync_t   *fast_sync; /* in-process state, used until the server needs the semaphore */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static int semaphore_close_handle( struct object *obj, struct process *process, obj_handle_t handle );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
@@ -82,8 +89,8 @@ static const struct object_ops semaphore_ops =
     default_unlink_name,           /* unlink_name */
     no_open_file,                  /* open_file */
     no_kernel_obj_list,            /* get_kernel_obj_list */
-    no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_close_handle,        /* close_handle */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -105,14 +112,25 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
             /* initialize it if it didn't already exist */
             sem->count = initial;
             sem->max   = max;
+            sem->fast_sync = NULL;
         }
     }
     return sem;
 }
 
+/* retrieve the semaphore count from the client before the server uses it */
+static void demote_semaphore( struct semaphore *sem )
+{
+    unsigned int count;
+    int state;
+
+    if (demote_fast_sync( sem->fast_sync, &state, &count )) sem->count = state;
+}
+
 static int release_semaphore( struct semaphore *sem, unsigned int count,
                               unsigned int *prev )
 {
+    demote_semaphore( sem );
     if (prev) *prev = sem->count;
     if (sem->count + count < sem->count || sem->count + count > sem->max)
     {
@@ -136,6 +154,7 @@ static void semaphore_dump( struct object *obj, int verbose )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
+    demote_semaphore( sem );
     fprintf( stderr, "Semaphore count=%d max=%d\n", sem->count, sem->max );
 }
 
@@ -143,6 +162,7 @@ static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entr
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
+    demote_semaphore( sem );
     return (sem->count > 0);
 }
 
@@ -167,6 +187,22 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static int semaphore_close_handle( struct object *obj, struct process *process, obj_handle_t handle )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    /* the client may not know that the handle is closed, make it go through the server */
+    demote_semaphore( sem );
+    return 1;
+}
+
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    free_fast_sync( sem->fast_sync );
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -183,8 +219,18 @@ DECL_HANDLER(create_semaphore)
         if (get_error() == STATUS_OBJECT_NAME_EXISTS)
             reply->handle = alloc_handle( current->process, sem, req->access, objattr->attributes );
         else
+        {
             reply->handle = alloc_handle_no_access_check( current->process, sem,
                                                           req->access, objattr->attributes );
+            /* unnamed semaphores are only known to this process until it shares the handle */
+            if (reply->handle && !name.len && !(objattr->attributes & OBJ_INHERIT) &&
+                (get_handle_access( current->process, reply->handle ) & FAST_SEMAPHORE_ACCESS) == FAST_SEMAPHORE_ACCESS)
+            {
+                sem->fast_sync = alloc_fast_sync( FAST_SYNC_SEMAPHORE, sem->count, 0, sem->max );
+                reply->fast_sync = get_fast_sync_index( sem->fast_sync );
+                reply->fast_sync_id = get_fast_sync_id( sem->fast_sync );
+            }
+        }
         release_object( sem );
     }
 
@@ -221,6 +267,7 @@ DECL_HANDLER(query_semaphore)
     if ((sem = (struct semaphore *)get_handle_obj( current->process, req->handle,
                                                    SEMAPHORE_QUERY_STATE, &semaphore_ops )))
     {
+        demote_semaphore( sem );
         reply->current = sem->count;
         reply->max = sem->max;
         release_object( sem );
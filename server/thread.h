@@ -45,6 +45,7 @@ struct inflight_fd
     int server;  /* fd on the server side */
 };
 #define MAX_INFLIGHT_FDS 16  /* max number of fds in flight per thread */
+#define REQ_BUFFER_SIZE  512  /* size of the preallocated buffer for request data */
 
 struct thread
 {
@@ -65,6 +66,7 @@ struct thread
     union generic_request  req;           /* current request */
     void                  *req_data;      /* variable-size data for request */
     unsigned int           req_toread;    /* amount of data still to read in request */
+    unsigned __int64       req_buffer[REQ_BUFFER_SIZE / sizeof(unsigned __int64)]; /* buffer for small request data */
     void                  *reply_data;    /* variable-size data for reply */
     unsigned int           reply_size;    /* size of reply data */
     unsigned int           reply_towrite; /* amount of data still to write in reply */
@@ -478,6 +478,14 @@ static void dump_generic_map( const char *prefix, const generic_map_t *map )
              prefix, map->read, map->write, map->exec, map->all );
 }
 
+static void dump_obj_locator( const char *prefix, const struct obj_locator *locator )
+{
+    fprintf( stderr, "%s{", prefix );
+    dump_uint64( "id=", &locator->id );
+    dump_uint64( ",offset=", &locator->offset );
+    fputc( '}', stderr );
+}
+
 static void dump_varargs_ints( const char *prefix, data_size_t size )
 {
     const int *data = cur_data;
@@ -1372,6 +1380,27 @@ static void dump_varargs_handle_infos( const char *prefix, data_size_t size )
     fputc( '}', stderr );
 }
 
+static void dump_varargs_request_stats( const char *prefix, data_size_t size )
+{
+    const struct request_stat *stat;
+
+    fprintf( stderr, "%s{", prefix );
+    while (size >= sizeof(*stat))
+    {
+        stat = cur_data;
+        fprintf( stderr, "{req=%u,count=%u", stat->req, stat->count );
+        fprintf( stderr, ",total_time=%s", get_timeout_str( -stat->total_time ));
+        fprintf( stderr, ",max_time=%s", get_timeout_str( -stat->max_time ));
+        dump_uint64( ",request_bytes=", &stat->request_bytes );
+        dump_uint64( ",reply_bytes=", &stat->reply_bytes );
+        fputc( '}', stderr );
+        size -= sizeof(*stat);
+        remove_data( sizeof(*stat) );
+        if (size) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+}
+
 typedef void (*dump_func)( const void *req );
 
 /* Everything below this line is generated automatically by tools/make_requests */
@@ -1764,6 +1793,8 @@ static void dump_create_event_request( const struct create_event_request *req )
 static void dump_create_event_reply( const struct create_event_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", fast_sync=%08x", req->fast_sync );
+    fprintf( stderr, ", fast_sync_id=%08x", req->fast_sync_id );
 }
 
 static void dump_event_op_request( const struct event_op_request *req )
@@ -1835,6 +1866,8 @@ static void dump_create_mutex_request( const struct create_mutex_request *req )
 static void dump_create_mutex_reply( const struct create_mutex_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", fast_sync=%08x", req->fast_sync );
+    fprintf( stderr, ", fast_sync_id=%08x", req->fast_sync_id );
 }
 
 static void dump_release_mutex_request( const struct release_mutex_request *req )
@@ -1883,6 +1916,8 @@ static void dump_create_semaphore_request( const struct create_semaphore_request
 static void dump_create_semaphore_reply( const struct create_semaphore_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", fast_sync=%08x", req->fast_sync );
+    fprintf( stderr, ", fast_sync_id=%08x", req->fast_sync_id );
 }
 
 static void dump_release_semaphore_request( const struct release_semaphore_request *req )
@@ -2656,6 +2691,7 @@ static void dump_get_msg_queue_request( const struct get_msg_queue_request *req
 static void dump_get_msg_queue_reply( const struct get_msg_queue_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    dump_obj_locator( ", locator=", &req->locator );
 }
 
 static void dump_set_queue_fd_request( const struct set_queue_fd_request *req )
@@ -2843,6 +2879,7 @@ static void dump_register_async_request( const struct register_async_request *re
     fprintf( stderr, " type=%d", req->type );
     dump_async_data( ", async=", &req->async );
     fprintf( stderr, ", count=%d", req->count );
+    fprintf( stderr, ", ring=%d", req->ring );
 }
 
 static void dump_cancel_async_request( const struct cancel_async_request *req )
@@ -2852,6 +2889,16 @@ static void dump_cancel_async_request( const struct cancel_async_request *req )
     fprintf( stderr, ", only_thread=%d", req->only_thread );
 }
 
+static void dump_cancel_async_reply( const struct cancel_async_reply *req )
+{
+    dump_varargs_uints64( " rings=", cur_size );
+}
+
+static void dump_set_io_ring_request( const struct set_io_ring_request *req )
+{
+    fprintf( stderr, " fd=%d", req->fd );
+}
+
 static void dump_get_async_result_request( const struct get_async_result_request *req )
 {
     dump_uint64( " user_arg=", &req->user_arg );
@@ -3408,6 +3455,7 @@ static void dump_get_thread_desktop_request( const struct get_thread_desktop_req
 static void dump_get_thread_desktop_reply( const struct get_thread_desktop_reply *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    dump_obj_locator( ", locator=", &req->locator );
 }
 
 static void dump_set_thread_desktop_request( const struct set_thread_desktop_request *req )
@@ -4604,6 +4652,17 @@ static void dump_get_next_thread_reply( const struct get_next_thread_reply *req
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_get_request_stats_request( const struct get_request_stats_request *req )
+{
+}
+
+static void dump_get_request_stats_reply( const struct get_request_stats_reply *req )
+{
+    dump_timeout( " start_time=", &req->start_time );
+    fprintf( stderr, ", count=%08x", req->count );
+    dump_varargs_request_stats( ", stats=", cur_size );
+}
+
 static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_new_process_request,
     (dump_func)dump_get_new_process_info_request,
@@ -4736,6 +4795,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_cancel_sync_request,
     (dump_func)dump_register_async_request,
     (dump_func)dump_cancel_async_request,
+    (dump_func)dump_set_io_ring_request,
     (dump_func)dump_get_async_result_request,
     (dump_func)dump_set_async_direct_result_request,
     (dump_func)dump_read_request,
@@ -4890,6 +4950,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_suspend_process_request,
     (dump_func)dump_resume_process_request,
     (dump_func)dump_get_next_thread_request,
+    (dump_func)dump_get_request_stats_request,
 };
 
 static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
@@ -5023,6 +5084,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     NULL,
+    (dump_func)dump_cancel_async_reply,
     NULL,
     (dump_func)dump_get_async_result_reply,
     (dump_func)dump_set_async_direct_result_reply,
@@ -5178,6 +5240,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     (dump_func)dump_get_next_thread_reply,
+    (dump_func)dump_get_request_stats_reply,
 };
 
 static const char * const req_names[REQ_NB_REQUESTS] = {
@@ -5312,6 +5375,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "cancel_sync",
     "register_async",
     "cancel_async",
+    "set_io_ring",
     "get_async_result",
     "set_async_direct_result",
     "read",
@@ -5466,6 +5530,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "suspend_process",
     "resume_process",
     "get_next_thread",
+    "get_request_stats",
 };
 
 static const struct
@@ -5681,6 +5746,11 @@ void trace_request(void)
     else fprintf( stderr, "%04x: %d(?)\n", current->id, req );
 }
 
+const char *get_req_name( enum request req )
+{
+    return req < REQ_NB_REQUESTS ? req_names[req] : "?";
+}
+
 void trace_reply( enum request req, const union generic_reply *reply )
 {
     if (req < REQ_NB_REQUESTS)